@@ -0,0 +1,190 @@
+
+#include <stdio.h>
+#include <string.h>
+
+#include "image.h"
+
+#include "aov.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+constexpr const char*	AOV_NAMES[]			= { "depth", "level", "id", "normal" };
+
+constexpr char			WRITE_FAILED_MSG[]	= "Failed to write %s\n";
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+	/**
+	 * @brief PfmHeader	Returns the header of a one channel little endian
+	 * PFM image, its rows are bottom up.
+	 */
+	std::vector< uint8_t >	PfmHeader( uint32_t width, uint32_t height )
+	{
+		char	header[ 64 ];
+		int		length	= snprintf( header, sizeof( header ), "Pf\n%u %u\n-1.0\n", width, height );
+
+		return	std::vector< uint8_t >( header, header + length );
+	}
+	////////////////////////////////////////////////////////////////////////////
+
+	/**
+	 * @brief PamHeader	Returns the header of a PAM image with 'depth'
+	 * samples per pixel. Samples above 255 take two bytes, big endian, and
+	 * the rows are top down.
+	 */
+	std::vector< uint8_t >	PamHeader( uint32_t width, uint32_t height, uint32_t depth,
+									   uint32_t maxValue, const char* const tupleType )
+	{
+		char	header[ 128 ];
+		int		length	= snprintf( header, sizeof( header ),
+									"P7\nWIDTH %u\nHEIGHT %u\nDEPTH %u\nMAXVAL %u\nTUPLTYPE %s\nENDHDR\n",
+									width, height, depth, maxValue, tupleType );
+
+		return	std::vector< uint8_t >( header, header + length );
+	}
+	////////////////////////////////////////////////////////////////////////////
+
+	void	PushBigEndian( std::vector< uint8_t >& data, uint64_t value, uint32_t bytes )
+	{
+		for( uint32_t i = bytes; i > 0; --i )
+			data.push_back( static_cast< uint8_t >( value >> ( ( i - 1 ) * 8 ) ) );
+	}
+	////////////////////////////////////////////////////////////////////////////
+
+	bool	WriteChannel( const std::string& path, const std::vector< uint8_t >& data )
+	{
+		if( WriteFileAtomic( path.c_str(), data ) )
+			return	true;
+
+		fprintf( stderr, WRITE_FAILED_MSG, path.c_str() );
+		return	false;
+	}
+	////////////////////////////////////////////////////////////////////////////
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief ParseAovChannels	Parses a comma separated list of channel names
+ * (depth, level, id, normal) into a channel mask.
+ * @return	Returns false if a name is unknown.
+ */
+bool	ParseAovChannels( const char* const list, uint32_t& channels )
+{
+	channels	= 0;
+
+	const char*	name	= list;
+	while( '\0' != *name )
+	{
+		const char*		end		= strchr( name, ',' );
+		const size_t	length	= ( nullptr == end ) ? strlen( name ) : size_t( end - name );
+
+		bool	found	= false;
+		for( uint32_t i = 0; i < sizeof( AOV_NAMES ) / sizeof( AOV_NAMES[ 0 ] ); ++i )
+		{
+			if( length == strlen( AOV_NAMES[ i ] ) && 0 == strncmp( name, AOV_NAMES[ i ], length ) )
+			{
+				channels	|= 1u << i;
+				found		= true;
+			}
+		}
+
+		if( ! found )
+			return	false;
+
+		name	+= length + ( ( nullptr == end ) ? 0 : 1 );
+	}
+
+	return	0 != channels;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief AovBuffers::AovBuffers	Allocates the channels of the mask
+ * 'channels', see AovChannel.
+ */
+AovBuffers::AovBuffers( uint32_t channels )
+	: m_channels( channels )
+{
+	const size_t	pixels	= size_t( WIDTH ) * HEIGHT;
+
+	if( Has( AovChannel::DEPTH ) )
+		m_depth.resize( pixels );
+	if( Has( AovChannel::LEVEL ) )
+		m_level.resize( pixels );
+	if( Has( AovChannel::SPHERE_ID ) )
+		m_sphereId.resize( pixels );
+	if( Has( AovChannel::NORMAL ) )
+		m_normal.resize( pixels );
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief AovBuffers::Write	Writes every channel to its own file named
+ * 'basePath' plus the channel name:
+ *	.depth.pfm		Float PFM.
+ *	.level.pam		8 bit gray PAM.
+ *	.id.pam			PAM with four 16 bit samples, the sphere id from the most
+ *					significant word down.
+ *	.normal.pam		PAM with two 16 bit samples, the encoded normal x and y
+ *					plus 32768.
+ * @return	Returns false if a file could not be written.
+ */
+bool	AovBuffers::Write( const std::string& basePath )	const
+{
+	bool	written	= true;
+
+	if( Has( AovChannel::DEPTH ) )
+	{
+		std::vector< uint8_t >	data	= PfmHeader( WIDTH, HEIGHT );
+		const uint8_t* const	bytes	= reinterpret_cast< const uint8_t* >( m_depth.data() );
+		data.insert( data.end(), bytes, bytes + m_depth.size() * sizeof( float ) );
+
+		written	&= WriteChannel( basePath + ".depth.pfm", data );
+	}
+
+	if( Has( AovChannel::LEVEL ) )
+	{
+		std::vector< uint8_t >	data	= PamHeader( WIDTH, HEIGHT, 1, UINT8_MAX, "GRAYSCALE" );
+		for( uint32_t y = HEIGHT; y > 0; --y )
+		{
+			const uint8_t* const	row	= m_level.data() + size_t( y - 1 ) * WIDTH;
+			data.insert( data.end(), row, row + WIDTH );
+		}
+
+		written	&= WriteChannel( basePath + ".level.pam", data );
+	}
+
+	if( Has( AovChannel::SPHERE_ID ) )
+	{
+		std::vector< uint8_t >	data	= PamHeader( WIDTH, HEIGHT, 4, UINT16_MAX, "SPHERE_ID" );
+		for( uint32_t y = HEIGHT; y > 0; --y )
+		{
+			for( uint32_t x = 0; x < WIDTH; ++x )
+				PushBigEndian( data, SphereId( x, y - 1 ), sizeof( uint64_t ) );
+		}
+
+		written	&= WriteChannel( basePath + ".id.pam", data );
+	}
+
+	if( Has( AovChannel::NORMAL ) )
+	{
+		std::vector< uint8_t >	data	= PamHeader( WIDTH, HEIGHT, 2, UINT16_MAX, "NORMAL_OCT16" );
+		for( uint32_t y = HEIGHT; y > 0; --y )
+		{
+			for( uint32_t x = 0; x < WIDTH; ++x )
+			{
+				const uint32_t	packed	= Normal( x, y - 1 );
+				PushBigEndian( data, ( packed & 0xFFFF ) ^ 0x8000, 2 );
+				PushBigEndian( data, ( packed >> 16 ) ^ 0x8000, 2 );
+			}
+		}
+
+		written	&= WriteChannel( basePath + ".normal.pam", data );
+	}
+
+	return	written;
+}
+////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,220 @@
+
+#ifndef AOV_H
+#define AOV_H
+
+////////////////////////////////////////////////////////////////////////////////
+
+#include <string>
+#include <vector>
+
+#include <math.h>
+#include <stdint.h>
+
+#include "config.h"
+#include "hitrecord.h"
+#include "simd.h"
+#include "sphereflake.h"
+#include "vec3.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief The AovChannel enum names the arbitrary output variables a render
+ * can write next to the color. The values are the bits of a channel mask.
+ * DEPTH		Hit distance (HitRecord::result) as a float, infinite on the
+ *				background.
+ * LEVEL		Depth level of the hit sphere as an uint8_t, NO_LEVEL on the
+ *				background.
+ * SPHERE_ID	Path code of the hit sphere as an uint64_t, NO_SPHERE on the
+ *				background (see SurfaceRecord).
+ * NORMAL		World space normal, octahedral in two int16_t (see
+ *				EncodeNormal), 0 on the background.
+ */
+enum class AovChannel : uint32_t
+{
+	DEPTH		= 1 << 0,
+	LEVEL		= 1 << 1,
+	SPHERE_ID	= 1 << 2,
+	NORMAL		= 1 << 3,
+};
+////////////////////////////////////////////////////////////////////////////////
+
+constexpr uint8_t	NO_LEVEL	= UINT8_MAX;
+constexpr uint64_t	NO_SPHERE	= 0;
+constexpr uint64_t	ROOT_SPHERE	= 1;
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool	ParseAovChannels( const char* const list, uint32_t& channels );
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief EncodeNormal	Packs the unit vector 'n' in 32 bits: the octahedral
+ * projection, x in the low and y in the high 16 bits as signed normalized
+ * integers. The error is below 0.01 degrees.
+ */
+inline
+uint32_t	EncodeNormal( const Vec3& n )
+{
+	const float	l1	= fabsf( n.x ) + fabsf( n.y ) + fabsf( n.z );
+	float		x	= n.x / l1;
+	float		y	= n.y / l1;
+	if( n.z < 0.0f )
+	{
+		const float	fx	= ( 1.0f - fabsf( y ) ) * ( ( x >= 0.0f ) ? 1.0f : -1.0f );
+		const float	fy	= ( 1.0f - fabsf( x ) ) * ( ( y >= 0.0f ) ? 1.0f : -1.0f );
+		x	= fx;
+		y	= fy;
+	}
+
+	const int16_t	ix	= static_cast< int16_t >( lrintf( fminf( fmaxf( x, -1.0f ), 1.0f ) * 32767.0f ) );
+	const int16_t	iy	= static_cast< int16_t >( lrintf( fminf( fmaxf( y, -1.0f ), 1.0f ) * 32767.0f ) );
+
+	return	uint32_t( uint16_t( ix ) ) | ( uint32_t( uint16_t( iy ) ) << 16 );
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief DecodeNormal	Unpacks a normal of EncodeNormal.
+ */
+inline
+Vec3	DecodeNormal( uint32_t packed )
+{
+	const float	x	= float( int16_t( packed & 0xFFFF ) ) / 32767.0f;
+	const float	y	= float( int16_t( packed >> 16 ) ) / 32767.0f;
+	const float	z	= 1.0f - fabsf( x ) - fabsf( y );
+	const float	t	= fmaxf( -z, 0.0f );
+
+	return	Vec3( x + ( ( x >= 0.0f ) ? -t : t ),
+				  y + ( ( y >= 0.0f ) ? -t : t ), z ).Normalized();
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief The SurfaceRecord struct records what a packet hit beyond the
+ * distance and level, for the SPHERE_ID and NORMAL channels. Passed to
+ * SphereFlake::Intersect, which calls Record for every hit update.
+ *
+ * The sphere id is the path of child indices from the root: the root is
+ * ROOT_SPHERE and child c of sphere id is id * TOTAL_NUMBER_OF_SPHERES + c + 1.
+ * It does not depend on the camera and is unique down to level 19, deeper ids
+ * wrap around.
+ *
+ * The normal is found in the local frame of the hit sphere, where it is the
+ * hit point, and turned back to the world through the child axes of the path.
+ * Only the channels asked for are computed.
+ */
+struct SurfaceRecord
+{
+	SurfaceRecord( bool recordIds, bool recordNormals )
+		: normal( Vec3() )
+		, ids( recordIds )
+		, normals( recordNormals )
+	{
+		for( uint32_t k = 0; k < SIMD::SIZE; ++k )
+			sphereId[ k ]	= NO_SPHERE;
+	}
+
+	void	Record( const ChildTransform* children, const TraversalFrame* stack, uint32_t level,
+					const SIMD::bool_t& updated, const HitRecord& records )
+	{
+		if( 0 == updated.Mask() )
+			return;
+
+		if( ids )
+		{
+			uint64_t	id	= ROOT_SPHERE;
+			for( uint32_t i = 0; i < level; ++i )
+				id	= id * TOTAL_NUMBER_OF_SPHERES + stack[ i ].nextChild;
+
+			for( uint32_t k = 0; k < SIMD::SIZE; ++k )
+			{
+				if( updated.Extract( k ) )
+					sphereId[ k ]	= id;
+			}
+		}
+
+		if( normals )
+		{
+			const TraversalFrame&	frame	= stack[ level ];
+			const SIMD::float_t		local	= records.result / SIMD::float_t( frame.scale );
+
+			SIMD::Vec	n	= SIMD::Vec( frame.origin ) + frame.direction.MultiplyByFloat( local );
+			for( uint32_t i = level; i > 0; --i )
+			{
+				const Vec3*	axis	= children[ stack[ i - 1 ].nextChild - 1 ].axis;
+				n	= SIMD::Vec( n.dot( SIMD::Vec( Vec3( axis[ 0 ].x, axis[ 1 ].x, axis[ 2 ].x ) ) ),
+								 n.dot( SIMD::Vec( Vec3( axis[ 0 ].y, axis[ 1 ].y, axis[ 2 ].y ) ) ),
+								 n.dot( SIMD::Vec( Vec3( axis[ 0 ].z, axis[ 1 ].z, axis[ 2 ].z ) ) ) );
+			}
+
+			normal	= SIMD::PickBasedOnCondition( updated, n, normal );
+		}
+	}
+
+	SIMD::Vec	normal;
+	uint64_t	sphereId[ SIMD::SIZE ];
+	bool		ids;
+	bool		normals;
+};
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief The AovBuffers class holds the AOV channels of one screen. Only the
+ * channels of the mask are allocated and written. The pixels are in rows, bottom
+ * up like the frame buffer.
+ */
+class AovBuffers
+{
+public:
+	static constexpr uint32_t	WIDTH	= SCREEN_WIDTH;
+	static constexpr uint32_t	HEIGHT	= SCREEN_HEIGHT;
+
+	explicit AovBuffers( uint32_t channels );
+
+	uint32_t	Channels()						const	{ return	m_channels; }
+	bool		Has( AovChannel channel )		const	{ return	0 != ( m_channels & uint32_t( channel ) ); }
+	bool		NeedsSurface()					const	{ return	Has( AovChannel::SPHERE_ID ) || Has( AovChannel::NORMAL ); }
+
+	float		Depth( uint32_t x, uint32_t y )		const	{ return	m_depth[ size_t( y ) * WIDTH + x ]; }
+	uint8_t		Level( uint32_t x, uint32_t y )		const	{ return	m_level[ size_t( y ) * WIDTH + x ]; }
+	uint64_t	SphereId( uint32_t x, uint32_t y )	const	{ return	m_sphereId[ size_t( y ) * WIDTH + x ]; }
+	uint32_t	Normal( uint32_t x, uint32_t y )	const	{ return	m_normal[ size_t( y ) * WIDTH + x ]; }
+
+	/**
+	 * @brief Store	Writes the channels of the packet traced at 'x', 'y'.
+	 * 'surface' is read only when NeedsSurface.
+	 */
+	void	Store( uint32_t x, uint32_t y, const HitRecord& records, const SurfaceRecord& surface )
+	{
+		const size_t	row	= size_t( y ) * WIDTH + x;
+
+		for( uint32_t k = 0; k < SIMD::SIZE; ++k )
+		{
+			const float	result	= records.result.Extract( k );
+			const bool	hit		= result >= HitRecord::DEFAULT_MIN;
+
+			if( Has( AovChannel::DEPTH ) )
+				m_depth[ row + k ]		= hit ? result : INFINITY;
+			if( Has( AovChannel::LEVEL ) )
+				m_level[ row + k ]		= hit ? static_cast< uint8_t >( HitRecord::SphereLevel( records.level.Extract( k ) ) ) : NO_LEVEL;
+			if( Has( AovChannel::SPHERE_ID ) )
+				m_sphereId[ row + k ]	= surface.sphereId[ k ];
+			if( Has( AovChannel::NORMAL ) )
+				m_normal[ row + k ]		= hit ? EncodeNormal( surface.normal.Extract( k ) ) : 0;
+		}
+	}
+
+	bool	Write( const std::string& basePath )	const;
+
+private:
+	uint32_t				m_channels;
+	std::vector< float >	m_depth;
+	std::vector< uint8_t >	m_level;
+	std::vector< uint64_t >	m_sphereId;
+	std::vector< uint32_t >	m_normal;
+};
+////////////////////////////////////////////////////////////////////////////////
+
+#endif // AOV_H
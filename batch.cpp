@@ -0,0 +1,307 @@
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <math.h>
+#include <stdio.h>
+
+#include "aov.h"
+#include "camerapath.h"
+#include "config.h"
+#include "framebuffer.h"
+#include "image.h"
+#include "perfcounters.h"
+#include "qoi.h"
+#include "tracer.h"
+
+#include "batch.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Frames in flight: one traced while the other is encoded.
+constexpr uint32_t	BUFFER_COUNT			= 2;
+
+constexpr char		BAD_PATTERN_MSG[]		= "Invalid sequence pattern: %s\n";
+constexpr char		SCENE_AOV_MSG[]			= "The AOVs are not written for a --scene\n";
+constexpr char		WRITE_FAILED_MSG[]		= "Failed to write %s\n";
+constexpr char		BATCH_START_MSG[]		= "Rendering %u frames (%.2f s at %.2f fps) with %u threads, %u already done\n";
+constexpr char		FRAME_DONE_MSG[]		= "Frame %u/%u traced in %.1f ms (%.2f Mrays/s, lane occupancy %.1f%%)\n";
+constexpr char		STREAM_MSG[]			= "Lane occupancy at depth %u: %.1f%% as traced, %.1f%% regrouped\n";
+constexpr char		PERF_THREAD_MSG[]		= "  thread %2u: %s\n";
+constexpr char		PERF_TOTAL_MSG[]		= "  all:       %s\n";
+constexpr char		PERF_UNAVAILABLE_MSG[]	= "Performance counters unavailable: %s\n";
+constexpr char		TILE_CACHE_MSG[]		= "Tile cache: %.1f%% of %u tiles from memory, %.1f%% from disk\n";
+constexpr char		BATCH_DONE_MSG[]		= "Done in %.1f s: %u frames rendered, %u skipped, %u failed\n";
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+	using	Clock	= std::chrono::steady_clock;
+
+	double	Seconds( Clock::duration d )
+	{
+		return	std::chrono::duration< double >( d ).count();
+	}
+	////////////////////////////////////////////////////////////////////////////
+
+	/**
+	 * @brief AovBasePath	Returns the frame path without its extension, the
+	 * AOV files of the frame add their own.
+	 */
+	std::string	AovBasePath( const std::string& framePath )
+	{
+		const size_t	dot		= framePath.rfind( '.' );
+		const size_t	slash	= framePath.rfind( '/' );
+		if( std::string::npos == dot || ( std::string::npos != slash && dot < slash ) )
+			return	framePath;
+
+		return	framePath.substr( 0, dot );
+	}
+	////////////////////////////////////////////////////////////////////////////
+
+	/**
+	 * @brief The FrameWriter class encodes and writes finished frames on its
+	 * own thread. It holds at most one frame waiting behind the one that is
+	 * being written, Submit blocks when both are taken.
+	 *
+	 * The AOV files of a frame are written before its color file, so a frame
+	 * that exists is complete.
+	 */
+	class FrameWriter
+	{
+	public:
+		FrameWriter()
+			: m_pending( nullptr )
+			, m_pendingAovs( nullptr )
+			, m_active( nullptr )
+			, m_failed( 0 )
+			, m_shouldQuit( false )
+			, m_thread( &FrameWriter::Run, this )
+		{
+		}
+
+		~FrameWriter()
+		{
+			{
+				std::lock_guard< std::mutex >	lock( m_mutex );
+				m_shouldQuit	= true;
+			}
+
+			m_cv.notify_all();
+			m_thread.join();
+		}
+
+		/**
+		 * @brief Submit	Queues 'buffer' and the channels of 'aovs', if not
+		 * null, to be written to 'path'. The buffers must not be changed until
+		 * Release returns for 'buffer'.
+		 */
+		void	Submit( const FrameBuffer& buffer, const AovBuffers* aovs, const std::string& path )
+		{
+			std::unique_lock< std::mutex >	lock( m_mutex );
+			m_cv.wait( lock, [ this ]() { return nullptr == m_pending; } );
+
+			m_pending		= &buffer;
+			m_pendingAovs	= aovs;
+			m_pendingPath	= path;
+			m_cv.notify_all();
+		}
+
+		/**
+		 * @brief Release	Blocks until 'buffer' is neither queued nor being
+		 * written.
+		 */
+		void	Release( const FrameBuffer& buffer )
+		{
+			std::unique_lock< std::mutex >	lock( m_mutex );
+			m_cv.wait( lock, [ & ]() { return &buffer != m_pending && &buffer != m_active; } );
+		}
+
+		/**
+		 * @brief Finish	Blocks until every submitted frame is written.
+		 * @return	Returns the number of frames that could not be written.
+		 */
+		uint32_t	Finish()
+		{
+			std::unique_lock< std::mutex >	lock( m_mutex );
+			m_cv.wait( lock, [ this ]() { return nullptr == m_pending && nullptr == m_active; } );
+
+			return	m_failed;
+		}
+
+	private:
+		void	Run()
+		{
+			std::vector< uint8_t >	rgb( size_t( SCREEN_WIDTH ) * SCREEN_HEIGHT * 3 );
+
+			std::unique_lock< std::mutex >	lock( m_mutex );
+			for(;;)
+			{
+				m_cv.wait( lock, [ this ]() { return m_shouldQuit || nullptr != m_pending; } );
+				if( nullptr == m_pending )
+					return;
+
+				m_active	= m_pending;
+				m_pending	= nullptr;
+				const AovBuffers* const	aovs	= m_pendingAovs;
+				const std::string		path	= m_pendingPath;
+				m_cv.notify_all();
+
+				lock.unlock();
+
+				bool	written	= ( nullptr == aovs ) || aovs->Write( AovBasePath( path ) );
+
+				// The frame buffer is bottom up like the GL texture, images
+				// are top down.
+				ConvertToRgb8( *m_active, true, rgb.data() );
+
+				if( written && ! WriteFileAtomic( path.c_str(), QOI::Encode( rgb.data(), SCREEN_WIDTH, SCREEN_HEIGHT ) ) )
+				{
+					fprintf( stderr, WRITE_FAILED_MSG, path.c_str() );
+					written	= false;
+				}
+
+				lock.lock();
+				m_failed	+= written ? 0 : 1;
+				m_active	= nullptr;
+				m_cv.notify_all();
+			}
+		}
+
+	private:
+		std::mutex				m_mutex;
+		std::condition_variable	m_cv;
+		const FrameBuffer*		m_pending;
+		const AovBuffers*		m_pendingAovs;
+		const FrameBuffer*		m_active;
+		std::string				m_pendingPath;
+		uint32_t				m_failed;
+		bool					m_shouldQuit;
+		std::thread				m_thread;
+	};
+	////////////////////////////////////////////////////////////////////////////
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief RunBatch	Renders every frame of the camera path to disk.
+ * @return	Returns the exit code of the program.
+ */
+int	RunBatch( const Options& options )
+{
+	CameraPath	path;
+	if( ! path.Load( options.cameraPath.c_str() ) )
+		return	1;
+
+	if( FramePath( options.sequence, 0 ).empty() )
+	{
+		fprintf( stderr, BAD_PATTERN_MSG, options.sequence.c_str() );
+		return	1;
+	}
+
+	if( 0 != options.aovChannels && nullptr != options.scene )
+	{
+		fprintf( stderr, SCENE_AOV_MSG );
+		return	1;
+	}
+
+	const uint32_t	frameCount	= static_cast< uint32_t >( floorf( path.Duration() * options.fps + 1e-3f ) ) + 1;
+
+	// Work out what is left before starting any thread.
+	std::vector< uint32_t >	todo;
+	for( uint32_t i = 0; i < frameCount; ++i )
+	{
+		if( ! FileExists( FramePath( options.sequence, i ).c_str() ) )
+			todo.push_back( i );
+	}
+
+	const uint32_t	skipped	= frameCount - static_cast< uint32_t >( todo.size() );
+
+	Tracer			tracer( options, 0 );
+	FrameWriter		writer;
+
+	std::unique_ptr< FrameBuffer >	buffers[ BUFFER_COUNT ];
+	std::unique_ptr< AovBuffers >	aovs[ BUFFER_COUNT ];
+	for( uint32_t i = 0; i < BUFFER_COUNT; ++i )
+	{
+		buffers[ i ].reset( new FrameBuffer( options.hugePages ) );
+		tracer.ClearBuffer( *buffers[ i ] );
+
+		if( 0 != options.aovChannels )
+			aovs[ i ].reset( new AovBuffers( options.aovChannels ) );
+	}
+
+	fprintf( stderr, BATCH_START_MSG, frameCount, path.Duration(), options.fps,
+			 tracer.ThreadCount(), skipped );
+
+	// The threads have opened their counters for the clear.
+	const bool	perfCounters	= options.perfCounters && tracer.PerfError().empty();
+	if( options.perfCounters && ! perfCounters )
+		fprintf( stderr, PERF_UNAVAILABLE_MSG, tracer.PerfError().c_str() );
+
+	const Clock::time_point	start	= Clock::now();
+
+	for( size_t i = 0; i < todo.size(); ++i )
+	{
+		const uint32_t	frame	= todo[ i ];
+		FrameBuffer&	buffer	= *buffers[ i % BUFFER_COUNT ];
+		AovBuffers*		aov		= aovs[ i % BUFFER_COUNT ].get();
+
+		// Wait until the writer is done with the frame that used this buffer.
+		writer.Release( buffer );
+
+		const Clock::time_point	frameStart	= Clock::now();
+		const uint64_t			rays		= tracer.RayCount();
+		const TraversalStats	traversal	= tracer.Traversal();
+
+		if( nullptr != aov )
+			tracer.StartFrame( path.Evaluate( frame / options.fps ), buffer, *aov );
+		else
+			tracer.StartFrame( path.Evaluate( frame / options.fps ), buffer );
+		tracer.WaitFrame();
+
+		const double	seconds	= Seconds( Clock::now() - frameStart );
+		fprintf( stderr, FRAME_DONE_MSG, frame + 1, frameCount, seconds * 1000.0,
+				 ( tracer.RayCount() - rays ) / seconds / 1000000.0,
+				 ( tracer.Traversal() - traversal ).Occupancy() * 100.0 );
+
+		if( perfCounters )
+		{
+			const std::vector< PerfCounts >	counts	= tracer.PerfFrame();
+			for( size_t t = 0; t < counts.size(); ++t )
+				fprintf( stderr, PERF_THREAD_MSG, static_cast< uint32_t >( t ), FormatPerfCounts( counts[ t ] ).c_str() );
+			fprintf( stderr, PERF_TOTAL_MSG, FormatPerfCounts( SumPerfCounts( counts ) ).c_str() );
+		}
+
+		writer.Submit( buffer, aov, FramePath( options.sequence, frame ) );
+	}
+
+	const uint32_t	failed	= writer.Finish();
+
+	if( options.streamRays )
+	{
+		const StreamStats	stream	= tracer.Stream();
+		fprintf( stderr, STREAM_MSG, STREAM_DEPTH, stream.deferred.Occupancy() * 100.0,
+				 stream.compacted.Occupancy() * 100.0 );
+	}
+
+	const TileCacheStats	cache	= tracer.CacheStats();
+	if( 0 != cache.Lookups() )
+	{
+		fprintf( stderr, TILE_CACHE_MSG, double( cache.memoryHits ) / cache.Lookups() * 100.0,
+				 static_cast< uint32_t >( cache.Lookups() ), double( cache.diskHits ) / cache.Lookups() * 100.0 );
+	}
+
+	fprintf( stderr, BATCH_DONE_MSG, Seconds( Clock::now() - start ),
+			 static_cast< uint32_t >( todo.size() ) - failed, skipped, failed );
+
+	return	( 0 == failed ) ? 0 : 1;
+}
+////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,29 @@
+
+#ifndef BATCH_H
+#define BATCH_H
+
+////////////////////////////////////////////////////////////////////////////////
+
+#include "options.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Headless rendering of a camera flythrough.
+ *
+ * The camera path is read from 'options.cameraPath' (see CameraPath) and
+ * sampled at 'options.fps'. Every frame is written as QOI to the file named by
+ * the printf pattern 'options.sequence' and the frame number. The AOV
+ * channels of 'options.aovChannels' go next to it, named like the frame file
+ * without its extension (see AovBuffers::Write).
+ *
+ * All CPUs trace, tracing frame N + 1 overlaps with encoding and writing frame
+ * N. Files are written under a temporary name and renamed when complete, so a
+ * restarted run skips the frames that already exist and resumes where the
+ * previous run stopped.
+ */
+int	RunBatch( const Options& options );
+
+////////////////////////////////////////////////////////////////////////////////
+
+#endif // BATCH_H
@@ -0,0 +1,371 @@
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include <stdio.h>
+
+#if defined( _MSC_VER )
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+
+#include "cputopology.h"
+#include "hitrecord.h"
+#include "ray.h"
+#include "raygen.h"
+#include "simd.h"
+#include "sphereflake.h"
+
+#include "benchmark.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Packets prepared per case. Rays, masks and hit records of the pool take
+// about 100 KB with AVX512, so the kernels run from the cache.
+constexpr uint32_t	POOL_PACKETS		= 256;
+// Passes over the pool per timed sample.
+constexpr uint32_t	SAMPLE_PASSES		= 64;
+// Untimed samples before the timed ones, so the code, the data and the branch
+// predictor are warm.
+constexpr uint32_t	WARMUP_SAMPLES		= 5;
+// The clock is spun this long before the first case, so the CPU is at its
+// working frequency, and the time stamp counter rate is measured meanwhile.
+constexpr double	SPIN_UP_MS			= 200.0;
+// Marks the hit or lane share of a kernel that doesn't depend on it.
+constexpr uint32_t	NOT_APPLICABLE		= UINT32_MAX;
+
+// Scene of the intersection cases: a unit sphere at the origin seen from
+// CAMERA_Z. Hitting lanes aim within HIT_RADIUS of the center, missing ones
+// between MISS_RADIUS and twice that, outside the bounds (twice the radius).
+constexpr float		CAMERA_Z			= 3.0f;
+constexpr float		HIT_RADIUS			= 0.9f;
+constexpr float		MISS_RADIUS			= 2.5f;
+constexpr uint32_t	HIT_DEPTH			= 3;
+
+constexpr char		HEADER_MSG[]		= "Kernel benchmark: %s backend, %u lanes, %s precision, %s, %u samples\n";
+constexpr char		PINNED_MSG[]		= "pinned to CPU %u";
+constexpr char		NOT_PINNED_MSG[]	= "not pinned";
+constexpr char		TSC_MSG[]			= "Time stamp counter %.3f GHz, cycles below are its ticks\n";
+constexpr char		COLUMNS_MSG[]		= "%-22s %5s %6s %14s %11s %8s %12s %10s\n";
+constexpr char		CASE_MSG[]			= "%-22s %5s %6s %14.1f %11.2f %7.1f%% %12.1f %10.2f\n";
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+	using	Clock	= std::chrono::steady_clock;
+
+	// Where the measured kernels' results end up.
+	volatile uint32_t	g_sink	= 0;
+
+	/**
+	 * @brief The Pool struct holds the prepared packets of a case: the rays,
+	 * the active lanes and the hit records.
+	 */
+	struct Pool
+	{
+		std::vector< Ray >			rays;
+		std::vector< SIMD::bool_t >	active;
+		std::vector< HitRecord >	records;
+	};
+
+	/**
+	 * @brief The Result struct is the summary of the samples of a case, in
+	 * cycles per packet.
+	 */
+	struct Result
+	{
+		double	median;
+		double	spread;
+		double	fastest;
+		double	nsPerPacket;
+	};
+
+	/**
+	 * @brief MakePool	Prepares POOL_PACKETS packets whose active lanes hit
+	 * the unit sphere at the origin with probability 'hitPercent' and whose
+	 * lanes are active with probability 'lanePercent'. The lanes are drawn
+	 * independently, so the scalar build sees the same branches as a real
+	 * frame would.
+	 */
+	Pool	MakePool( uint32_t hitPercent, uint32_t lanePercent )
+	{
+		std::mt19937							random( 1234 );
+		std::uniform_real_distribution< float >	unit( 0.0f, 1.0f );
+
+		const Vec3	origin( 0.0f, 0.0f, CAMERA_Z );
+
+		Pool	pool;
+		pool.rays.reserve( POOL_PACKETS );
+		pool.active.reserve( POOL_PACKETS );
+		pool.records.resize( POOL_PACKETS );
+
+		for( uint32_t i = 0; i < POOL_PACKETS; ++i )
+		{
+			float	x[ SIMD::SIZE ];
+			float	y[ SIMD::SIZE ];
+			float	z[ SIMD::SIZE ];
+			float	on[ SIMD::SIZE ];
+			for( uint32_t k = 0; k < SIMD::SIZE; ++k )
+			{
+				const bool	hit		= unit( random ) * 100.0f < float( hitPercent );
+				const float	radius	= hit ? HIT_RADIUS * unit( random ) : MISS_RADIUS * ( 1.0f + unit( random ) );
+				const float	angle	= 6.2831853f * unit( random );
+				const Vec3	dir		= ( Vec3( radius * cosf( angle ), radius * sinf( angle ), 0.0f ) - origin ).Normalized();
+
+				x[ k ]	= dir.x;
+				y[ k ]	= dir.y;
+				z[ k ]	= dir.z;
+				on[ k ]	= ( unit( random ) * 100.0f < float( lanePercent ) ) ? 1.0f : 0.0f;
+			}
+
+			pool.rays.emplace_back( origin, SIMD::Vec( SIMD::float_t::Load( x ), SIMD::float_t::Load( y ),
+													   SIMD::float_t::Load( z ) ) );
+			pool.active.push_back( SIMD::float_t::Load( on ).GreaterOrEqualThan( 0.5f ) );
+		}
+
+		return	pool;
+	}
+	////////////////////////////////////////////////////////////////////////////
+
+	/**
+	 * @brief Measure	Runs 'kernel( i )' for every packet 'i' of the pool,
+	 * SAMPLE_PASSES times per sample, first WARMUP_SAMPLES times untimed and
+	 * then 'samples' times timed. The kernels return a few bits of their
+	 * result, which are summed, so the compiler keeps their work.
+	 */
+	template< typename Kernel >
+	Result	Measure( uint32_t samples, Kernel&& kernel )
+	{
+		constexpr double	PACKETS	= double( POOL_PACKETS ) * SAMPLE_PASSES;
+
+		std::vector< double >	cycles;
+		double					ns		= 0.0;
+		uint32_t				sink	= 0;
+
+		for( uint32_t s = 0; s < WARMUP_SAMPLES + samples; ++s )
+		{
+			const Clock::time_point	start		= Clock::now();
+			const uint64_t			startTicks	= __rdtsc();
+
+			for( uint32_t pass = 0; pass < SAMPLE_PASSES; ++pass )
+			{
+				for( uint32_t i = 0; i < POOL_PACKETS; ++i )
+					sink	+= kernel( i );
+			}
+
+			const uint64_t			endTicks	= __rdtsc();
+			const Clock::time_point	end			= Clock::now();
+			if( s < WARMUP_SAMPLES )
+				continue;
+
+			cycles.push_back( double( endTicks - startTicks ) / PACKETS );
+			ns	+= std::chrono::duration< double, std::nano >( end - start ).count() / PACKETS;
+		}
+
+		g_sink	= sink;
+
+		std::sort( cycles.begin(), cycles.end() );
+
+		Result	result;
+		result.median		= cycles[ cycles.size() / 2 ];
+		result.fastest		= cycles.front();
+		result.nsPerPacket	= ns / samples;
+
+		// The median absolute deviation, in percent of the median.
+		std::vector< double >	deviation;
+		for( const double c : cycles )
+			deviation.push_back( fabs( c - result.median ) );
+		std::sort( deviation.begin(), deviation.end() );
+		result.spread		= 100.0 * deviation[ deviation.size() / 2 ] / result.median;
+
+		return	result;
+	}
+	////////////////////////////////////////////////////////////////////////////
+
+	/**
+	 * @brief Print	Prints the line of a case.
+	 */
+	void	Print( const char* name, uint32_t hitPercent, uint32_t lanePercent, const Result& result )
+	{
+		char	hits[ 16 ];
+		char	lanes[ 16 ];
+		if( NOT_APPLICABLE == hitPercent )
+			snprintf( hits, sizeof( hits ), "-" );
+		else
+			snprintf( hits, sizeof( hits ), "%u%%", hitPercent );
+
+		if( NOT_APPLICABLE == lanePercent )
+			snprintf( lanes, sizeof( lanes ), "-" );
+		else
+			snprintf( lanes, sizeof( lanes ), "%u%%", lanePercent );
+
+		printf( CASE_MSG, name, hits, lanes, result.median, result.median / SIMD::SIZE,
+				result.spread, result.fastest, result.nsPerPacket );
+	}
+	////////////////////////////////////////////////////////////////////////////
+
+	/**
+	 * @brief SpinUp	Busy waits SPIN_UP_MS.
+	 * @return	Returns the time stamp counter ticks per nanosecond.
+	 */
+	double	SpinUp()
+	{
+		const Clock::time_point	start		= Clock::now();
+		const uint64_t			startTicks	= __rdtsc();
+
+		double	ms	= 0.0;
+		while( ms < SPIN_UP_MS )
+			ms	= std::chrono::duration< double, std::milli >( Clock::now() - start ).count();
+
+		return	double( __rdtsc() - startTicks ) / ( ms * 1e6 );
+	}
+	////////////////////////////////////////////////////////////////////////////
+
+	/**
+	 * @brief RunKernels	Measures every case with precision P.
+	 */
+	template< Precision P >
+	void	RunKernels( uint32_t samples )
+	{
+		SphereFlake	flake;
+
+		printf( COLUMNS_MSG, "kernel", "hits", "lanes", "cycles/packet", "cycles/lane",
+				"spread", "fastest", "ns/packet" );
+
+		// The bounds test is branch free, the hit update returns early when no
+		// active lane hits.
+		// The bounds test is measured with the first case only.
+		struct Case
+		{
+			uint32_t	hitPercent;
+			uint32_t	lanePercent;
+			bool		bounds;
+		};
+
+		constexpr Case	INTERSECT_CASES[]	=
+		{
+			{ 50, 100, true }, { 0, 100, false }, { 25, 100, false },
+			{ 100, 100, false }, { 100, 50, false }, { 100, 25, false },
+		};
+
+		for( const Case& c : INTERSECT_CASES )
+		{
+			const uint32_t	hitPercent	= c.hitPercent;
+			const uint32_t	lanePercent	= c.lanePercent;
+			Pool			pool		= MakePool( hitPercent, lanePercent );
+
+			if( c.bounds )
+			{
+				Print( "SphereIntersect/bounds", hitPercent, lanePercent,
+					   Measure( samples, [ & ]( uint32_t i )
+					   {
+						   return	flake.SphereIntersect< P, true >( pool.rays[ i ], Vec3(), 1.0f, 1.0f, HIT_DEPTH,
+																	  pool.active[ i ], pool.records[ i ] ).Mask();
+					   } ) );
+			}
+
+			Print( "SphereIntersect", hitPercent, lanePercent,
+				   Measure( samples, [ & ]( uint32_t i )
+				   {
+					   return	flake.SphereIntersect< P, false >( pool.rays[ i ], Vec3(), 1.0f, 1.0f, HIT_DEPTH,
+																   pool.active[ i ], pool.records[ i ] ).Mask();
+				   } ) );
+		}
+
+		{
+			// Packets spread over the screen, the way the tiles cast them.
+			uint32_t	px[ POOL_PACKETS ];
+			uint32_t	py[ POOL_PACKETS ];
+			for( uint32_t i = 0; i < POOL_PACKETS; ++i )
+			{
+				px[ i ]	= ( i * 37 ) % ( SCREEN_WIDTH / SIMD::SIZE ) * SIMD::SIZE;
+				py[ i ]	= ( i * 53 ) % SCREEN_HEIGHT;
+			}
+
+			// Level views load the directions, turned views also rotate them.
+			CameraView	turned;
+			turned.yaw		= 30.0f;
+			turned.pitch	= 15.0f;
+
+			const Vec3		camera( 0.0f, 0.0f, 5.0f );
+			RayGenerator	rays;
+			for( const CameraView& view : { CameraView(), turned } )
+			{
+				rays.Setup( view, SCREEN_WIDTH, SCREEN_HEIGHT, P );
+				Print( view.IsLevel() ? "Cast" : "Cast (turned)", NOT_APPLICABLE, NOT_APPLICABLE,
+					   Measure( samples, [ & ]( uint32_t i )
+					   {
+						   const Ray	ray	= rays.Cast( camera, px[ i ], py[ i ] );
+						   return	SIMD::GetY( ray.direction() ).GreaterOrEqualThan( 0.0f ).Mask();
+					   } ) );
+			}
+		}
+
+		// The colors need hit records, the pool packets are traced once.
+		constexpr uint32_t	COLOR_HITS[]	= { 50, 0, 100 };
+		for( const uint32_t hitPercent : COLOR_HITS )
+		{
+			Pool	pool	= MakePool( hitPercent, 100 );
+			for( uint32_t i = 0; i < POOL_PACKETS; ++i )
+			{
+				flake.SphereIntersect< P, false >( pool.rays[ i ], Vec3(), 1.0f, 1.0f, HIT_DEPTH,
+												   SIMD::TRUE_VALUE, pool.records[ i ] );
+			}
+
+			Print( "extractColor", hitPercent, NOT_APPLICABLE,
+				   Measure( samples, [ & ]( uint32_t i )
+				   {
+					   uint32_t	bright	= 0;
+					   for( uint32_t k = 0; k < SIMD::SIZE; ++k )
+						   bright	+= ( pool.records[ i ].extractColor( pool.rays[ i ], k ).y > 0.5f ) ? 1 : 0;
+
+					   return	bright;
+				   } ) );
+
+			Print( "Shade", hitPercent, NOT_APPLICABLE,
+				   Measure( samples, [ & ]( uint32_t i )
+				   {
+					   const SIMD::Vec	color	= pool.records[ i ].Shade( pool.rays[ i ] );
+					   return	SIMD::GetY( color ).GreaterOrEqualThan( 0.5f ).Mask();
+				   } ) );
+		}
+	}
+	////////////////////////////////////////////////////////////////////////////
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief RunBenchmark	Measures the kernels on the pinned calling thread.
+ * @return	Returns the exit code of the program.
+ */
+int	RunBenchmark( const Options& options )
+{
+	char	pinned[ 32 ];
+	snprintf( pinned, sizeof( pinned ), "%s", NOT_PINNED_MSG );
+	if( options.pinThreads )
+	{
+		// The last CPU is the one least likely to serve interrupts.
+		const CpuTopology	topology;
+		const uint32_t		cpu	= topology.Cpus().back().id;
+		if( CpuTopology::PinCurrentThread( cpu ) )
+			snprintf( pinned, sizeof( pinned ), PINNED_MSG, cpu );
+	}
+
+	printf( HEADER_MSG, SIMD_NAME, uint32_t( SIMD::SIZE ),
+			( Precision::FAST == options.precision ) ? "fast" : "exact", pinned, options.benchReps );
+	printf( TSC_MSG, SpinUp() );
+
+	if( Precision::FAST == options.precision )
+		RunKernels< Precision::FAST >( options.benchReps );
+	else
+		RunKernels< Precision::EXACT >( options.benchReps );
+
+	return	0;
+}
+////////////////////////////////////////////////////////////////////////////////
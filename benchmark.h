@@ -0,0 +1,28 @@
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+////////////////////////////////////////////////////////////////////////////////
+
+#include "options.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Measures the tracing kernels one by one.
+ *
+ * Runs SphereFlake::SphereIntersect (bounds test and hit update),
+ * RayGenerator::Cast (level and turned view), HitRecord::extractColor and
+ * HitRecord::Shade on a small pool of prepared packets that stays in the L1/L2
+ * cache, with a chosen share of hitting and of active lanes. The calling thread is pinned unless
+ * 'options.pinThreads' is off and every kernel is warmed up before
+ * 'options.benchReps' timed samples. Prints the median time stamp counter
+ * cycles per packet and per lane, the spread of the samples and the fastest
+ * sample, with the precision of 'options.precision' and the SIMD backend of
+ * the build (see SIMD_NAME). Returns the exit code of the program.
+ */
+int	RunBenchmark( const Options& options );
+
+////////////////////////////////////////////////////////////////////////////////
+
+#endif // BENCHMARK_H
@@ -3,8 +3,12 @@
 in vec2				TexCoord;
 out vec4			FragColor;
 uniform sampler2D	texture1;
+// Share of the texture covered by the traced frame.
+uniform vec2		uvScale;
+// Center of the last traced texel, keeps the filter inside the frame.
+uniform vec2		uvMax;
 
 void	main()
 {
-	FragColor	= texture( texture1, TexCoord );
+	FragColor	= texture( texture1, min( TexCoord * uvScale, uvMax ) );
 }
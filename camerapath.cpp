@@ -0,0 +1,128 @@
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include <stdio.h>
+
+#include "camerapath.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+constexpr char	OPEN_FAILED_MSG[]		= "Failed to open the keyframe file %s\n";
+constexpr char	INVALID_KEY_MSG[]		= "%s:%u: expected \"time x y z\" with increasing time\n";
+constexpr char	NO_KEYS_MSG[]			= "No camera keys in %s\n";
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief CameraPath::Load	Reads the keyframes from 'path'.
+ * @return	Returns false if the file can't be read or is invalid.
+ */
+bool	CameraPath::Load( const char* const path )
+{
+	std::ifstream	file( path );
+	if( ! file.is_open() )
+	{
+		fprintf( stderr, OPEN_FAILED_MSG, path );
+		return	false;
+	}
+
+	m_keys.clear();
+
+	std::string	line;
+	uint32_t	lineNumber	= 0;
+	while( std::getline( file, line ) )
+	{
+		++lineNumber;
+
+		size_t	first	= line.find_first_not_of( " \t\r" );
+		if( std::string::npos == first || '#' == line[ first ] )
+			continue;
+
+		std::istringstream	stream( line );
+		CameraKey			key;
+		stream >> key.time >> key.position.x >> key.position.y >> key.position.z;
+
+		if( stream.fail() || ( ! m_keys.empty() && key.time <= m_keys.back().time ) )
+		{
+			fprintf( stderr, INVALID_KEY_MSG, path, lineNumber );
+			return	false;
+		}
+
+		m_keys.push_back( key );
+	}
+
+	if( m_keys.empty() )
+	{
+		fprintf( stderr, NO_KEYS_MSG, path );
+		return	false;
+	}
+
+	return	true;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief CameraPath::Duration	Returns the time of the last key.
+ */
+float	CameraPath::Duration() const
+{
+	return	m_keys.empty() ? 0.0f : m_keys.back().time;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief CameraPath::Tangent	Returns the velocity at key 'index'. Central
+ * difference inside the path, one sided at the ends.
+ */
+Vec3	CameraPath::Tangent( size_t index ) const
+{
+	const size_t	prev	= ( index > 0 ) ? index - 1 : index;
+	const size_t	next	= ( index + 1 < m_keys.size() ) ? index + 1 : index;
+
+	const float		dt		= m_keys[ next ].time - m_keys[ prev ].time;
+	if( dt <= 0.0f )
+		return	Vec3();
+
+	return	( m_keys[ next ].position - m_keys[ prev ].position ) / dt;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief CameraPath::Evaluate	Returns the camera position at 'time'. Times
+ * outside of the keys are clamped to the first and last key.
+ */
+Vec3	CameraPath::Evaluate( float time ) const
+{
+	if( m_keys.empty() )
+		return	Vec3();
+
+	if( time <= m_keys.front().time )
+		return	m_keys.front().position;
+
+	if( time >= m_keys.back().time )
+		return	m_keys.back().position;
+
+	size_t	i	= 0;
+	while( m_keys[ i + 1 ].time < time )
+		++i;
+
+	const CameraKey&	k0	= m_keys[ i ];
+	const CameraKey&	k1	= m_keys[ i + 1 ];
+
+	// Cubic Hermite segment with Catmull-Rom tangents.
+	const float	dt	= k1.time - k0.time;
+	const float	t	= ( time - k0.time ) / dt;
+	const float	t2	= t * t;
+	const float	t3	= t2 * t;
+
+	const float	h00	=  2.0f * t3 - 3.0f * t2 + 1.0f;
+	const float	h10	=         t3 - 2.0f * t2 + t;
+	const float	h01	= -2.0f * t3 + 3.0f * t2;
+	const float	h11	=         t3 -        t2;
+
+	return	k0.position * h00 + Tangent( i ) * ( h10 * dt ) +
+			k1.position * h01 + Tangent( i + 1 ) * ( h11 * dt );
+}
+////////////////////////////////////////////////////////////////////////////////
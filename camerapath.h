@@ -0,0 +1,49 @@
+
+#ifndef CAMERAPATH_H
+#define CAMERAPATH_H
+
+////////////////////////////////////////////////////////////////////////////////
+
+#include <vector>
+
+#include "vec3.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief The CameraKey struct is a camera position at a point in time
+ * (seconds).
+ */
+struct CameraKey
+{
+	float	time;
+	Vec3	position;
+};
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief The CameraPath class is a camera flythrough defined by keyframes.
+ * Positions between the keys are interpolated with a Catmull-Rom spline, so
+ * the camera moves smoothly through the keys.
+ *
+ * The keyframe file has one key per line: "time x y z". Empty lines and lines
+ * starting with '#' are ignored. The times must be increasing.
+ */
+class CameraPath
+{
+public:
+	bool	Load( const char* const path );
+
+	Vec3	Evaluate( float time )	const;
+	float	Duration()				const;
+	bool	Empty()					const	{ return	m_keys.empty(); }
+
+private:
+	Vec3	Tangent( size_t index )	const;
+
+private:
+	std::vector< CameraKey >	m_keys;
+};
+////////////////////////////////////////////////////////////////////////////////
+
+#endif // CAMERAPATH_H
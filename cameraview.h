@@ -0,0 +1,75 @@
+
+#ifndef CAMERAVIEW_H
+#define CAMERAVIEW_H
+
+////////////////////////////////////////////////////////////////////////////////
+
+#include <math.h>
+
+#include "vec3.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Horizontal field of view in degrees the frames had before the camera could
+// turn, the view of the golden images.
+constexpr float	DEFAULT_FOV	= 90.0f;
+constexpr float	MIN_FOV		= 1.0f;
+constexpr float	MAX_FOV		= 179.0f;
+// The camera can look almost straight up or down, not over the top.
+constexpr float	MAX_PITCH	= 89.0f;
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief The CameraView struct is where the camera looks, in degrees. With
+ * yaw and pitch 0 it looks down the negative z axis with y up. Yaw turns it
+ * around the world y axis, positive to the left, pitch tilts it up around its
+ * own x axis. Fov is the horizontal field of view, the vertical one follows
+ * from SCREEN_RATIO.
+ */
+struct CameraView
+{
+	float	yaw		= 0.0f;
+	float	pitch	= 0.0f;
+	float	fov		= DEFAULT_FOV;
+
+	/**
+	 * @brief IsLevel	Returns true when the camera looks down the negative z
+	 * axis, the directions need no rotation.
+	 */
+	bool	IsLevel()			const	{ return	0.0f == yaw && 0.0f == pitch; }
+
+	/**
+	 * @brief TanHalfFov	Returns the tangent of half the horizontal field of
+	 * view, the x of the rightmost ray before it is normalized. Computed in
+	 * double so DEFAULT_FOV gives exactly 1.
+	 */
+	float	TanHalfFov()		const
+	{
+		return	float( tan( double( fov ) * M_PI / 360.0 ) );
+	}
+
+	/**
+	 * @brief Axes	Returns the world directions of the camera's x (right),
+	 * y (up) and z (back) axes.
+	 */
+	void	Axes( Vec3& right, Vec3& up, Vec3& back ) const
+	{
+		const double	y	= double( yaw ) * M_PI / 180.0;
+		const double	p	= double( pitch ) * M_PI / 180.0;
+
+		right	= Vec3( float( cos( y ) ), 0.0f, float( -sin( y ) ) );
+		up		= Vec3( float( sin( p ) * sin( y ) ), float( cos( p ) ), float( sin( p ) * cos( y ) ) );
+		back	= Vec3( float( cos( p ) * sin( y ) ), float( -sin( p ) ), float( cos( p ) * cos( y ) ) );
+	}
+
+	bool	operator==( const CameraView& other )	const
+	{
+		return	yaw == other.yaw && pitch == other.pitch && fov == other.fov;
+	}
+
+	bool	operator!=( const CameraView& other )	const	{ return	! ( *this == other ); }
+};
+////////////////////////////////////////////////////////////////////////////////
+
+#endif // CAMERAVIEW_H
@@ -0,0 +1,190 @@
+
+#include <algorithm>
+
+#include <stdio.h>
+
+#include "image.h"
+#include "qoi.h"
+
+#include "capture.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Free frames per encoder thread: the one it encodes and one waiting for it.
+constexpr uint32_t	FRAMES_PER_THREAD	= 2;
+
+constexpr char		WRITE_FAILED_MSG[]	= "Failed to write %s\n";
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Capture::Capture	Starts 'threadCount' encoder threads for frames of
+ * 'width' x 'height' pixels.
+ */
+Capture::Capture( uint32_t threadCount, uint32_t width, uint32_t height )
+	: m_width( width )
+	, m_height( height )
+	, m_active( 0 )
+	, m_written( 0 )
+	, m_dropped( 0 )
+	, m_failed( 0 )
+	, m_shouldQuit( false )
+{
+	threadCount	= std::max( 1u, threadCount );
+
+	m_free.resize( threadCount * FRAMES_PER_THREAD );
+	for( auto& frame : m_free )
+		frame.resize( size_t( width ) * height );
+
+	for( uint32_t i = 0; i < threadCount; ++i )
+		m_threads.emplace_back( &Capture::Run, this );
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Capture::~Capture	Writes the frames that are queued and stops the
+ * threads.
+ */
+Capture::~Capture()
+{
+	Finish();
+
+	{
+		std::lock_guard< std::mutex >	lock( m_mutex );
+		m_shouldQuit	= true;
+	}
+
+	m_workCv.notify_all();
+	for( auto& thread : m_threads )
+		thread.join();
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Capture::Submit	Queues the frame in 'pixels' to be written to
+ * 'path'. 'pixels' holds rows of the capture width, bottom up, of which the
+ * frame covers the bottom left 'frameWidth' x 'frameHeight'. On success it is
+ * swapped with a free vector of the same size, whose contents are undefined.
+ * @return	Returns false, and leaves 'pixels' alone, if no vector is free.
+ */
+bool	Capture::Submit( std::vector< Vec3 >& pixels, uint32_t frameWidth, uint32_t frameHeight,
+						 const std::string& path )
+{
+	{
+		std::lock_guard< std::mutex >	lock( m_mutex );
+		if( m_free.empty() )
+		{
+			++m_dropped;
+			return	false;
+		}
+
+		Job	job;
+		job.pixels		= std::move( m_free.back() );
+		job.frameWidth	= frameWidth;
+		job.frameHeight	= frameHeight;
+		job.path		= path;
+		m_free.pop_back();
+
+		job.pixels.swap( pixels );
+		m_jobs.push_back( std::move( job ) );
+	}
+
+	m_workCv.notify_one();
+	return	true;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Capture::Finish	Blocks until every queued frame is written.
+ */
+void	Capture::Finish()
+{
+	std::unique_lock< std::mutex >	lock( m_mutex );
+	m_doneCv.wait( lock, [ this ]() { return m_jobs.empty() && 0 == m_active; } );
+}
+////////////////////////////////////////////////////////////////////////////////
+
+uint32_t	Capture::Written()	const
+{
+	std::lock_guard< std::mutex >	lock( m_mutex );
+	return	m_written;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+uint32_t	Capture::Dropped()	const
+{
+	std::lock_guard< std::mutex >	lock( m_mutex );
+	return	m_dropped;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+uint32_t	Capture::Failed()	const
+{
+	std::lock_guard< std::mutex >	lock( m_mutex );
+	return	m_failed;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Capture::Run	The encoder thread. Frames are taken in the order they
+ * were submitted, each thread writes its own.
+ */
+void	Capture::Run()
+{
+	std::vector< uint8_t >	rgb( size_t( m_width ) * m_height * 3 );
+
+	std::unique_lock< std::mutex >	lock( m_mutex );
+	for(;;)
+	{
+		m_workCv.wait( lock, [ this ]() { return m_shouldQuit || ! m_jobs.empty(); } );
+		if( m_jobs.empty() )
+			return;
+
+		Job	job	= std::move( m_jobs.front() );
+		m_jobs.pop_front();
+		++m_active;
+
+		lock.unlock();
+
+		Convert( job, rgb );
+		const bool	written	= WriteFileAtomic( job.path.c_str(), QOI::Encode( rgb.data(), m_width, m_height ) );
+		if( ! written )
+			fprintf( stderr, WRITE_FAILED_MSG, job.path.c_str() );
+
+		lock.lock();
+		m_free.push_back( std::move( job.pixels ) );
+		m_written	+= written ? 1 : 0;
+		m_failed	+= written ? 0 : 1;
+		--m_active;
+		m_doneCv.notify_all();
+	}
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Capture::Convert	Converts the frame of 'job' to RGB8 in 'rgb', top
+ * down. A frame smaller than the capture size is scaled up to it, nearest
+ * pixel.
+ */
+void	Capture::Convert( const Job& job, std::vector< uint8_t >& rgb )	const
+{
+	const Vec3* const	last	= job.pixels.data() + size_t( m_height - 1 ) * m_width;
+
+	if( job.frameWidth == m_width && job.frameHeight == m_height )
+	{
+		ConvertToRgb8( last, m_width, m_height, -ptrdiff_t( m_width ), rgb.data() );
+		return;
+	}
+
+	std::vector< Vec3 >	row( m_width );
+	for( uint32_t y = 0; y < m_height; ++y )
+	{
+		const uint32_t		srcY	= ( m_height - 1 - y ) * job.frameHeight / m_height;
+		const Vec3* const	src		= job.pixels.data() + size_t( srcY ) * m_width;
+		for( uint32_t x = 0; x < m_width; ++x )
+			row[ x ]	= src[ x * job.frameWidth / m_width ];
+
+		ConvertToRgb8( row.data(), m_width, 1, 0, rgb.data() + size_t( y ) * m_width * 3 );
+	}
+}
+////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,83 @@
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+////////////////////////////////////////////////////////////////////////////////
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stdint.h>
+
+#include "vec3.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief The Capture class writes frames to QOI files on a pool of encoder
+ * threads, so capturing does not hold up the caller.
+ *
+ * A frame is handed over by swapping the caller's pixel vector with a free
+ * vector of the pool, no pixels are copied on the calling thread. The encoder
+ * threads convert the frame to RGB8, top down and scaled to the capture size
+ * if it was traced at a lower resolution, and write it with WriteFileAtomic.
+ * When every vector of the pool is taken the frame is dropped instead of
+ * waiting for an encoder.
+ */
+class Capture
+{
+public:
+	Capture( uint32_t threadCount, uint32_t width, uint32_t height );
+	~Capture();
+
+	Capture( const Capture& )				= delete;
+	Capture&	operator=( const Capture& )	= delete;
+
+	bool		Submit( std::vector< Vec3 >& pixels, uint32_t frameWidth, uint32_t frameHeight,
+						const std::string& path );
+	void		Finish();
+
+	uint32_t	Written()	const;
+	uint32_t	Dropped()	const;
+	uint32_t	Failed()	const;
+
+private:
+	/**
+	 * @brief The Job struct is one frame waiting for an encoder. 'pixels' is
+	 * a vector of the pool, in rows of the capture width, bottom up.
+	 */
+	struct Job
+	{
+		std::vector< Vec3 >	pixels;
+		uint32_t			frameWidth;
+		uint32_t			frameHeight;
+		std::string			path;
+	};
+
+	void	Run();
+	void	Convert( const Job& job, std::vector< uint8_t >& rgb )	const;
+
+private:
+	uint32_t							m_width;
+	uint32_t							m_height;
+
+	mutable std::mutex					m_mutex;
+	std::condition_variable				m_workCv;
+	std::condition_variable				m_doneCv;
+	std::vector< std::vector< Vec3 > >	m_free;
+	std::deque< Job >					m_jobs;
+	uint32_t							m_active;
+	uint32_t							m_written;
+	uint32_t							m_dropped;
+	uint32_t							m_failed;
+	bool								m_shouldQuit;
+
+	std::vector< std::thread >			m_threads;
+};
+////////////////////////////////////////////////////////////////////////////////
+
+#endif // CAPTURE_H
@@ -8,6 +8,13 @@ CONFIG -= app_bundle
 CONFIG -= qt
 TARGET = cg-sphereflake
 
+# SIMD backend: avx512, avx, sse or none (qmake SIMD=sse)
+isEmpty(SIMD): SIMD = avx
+equals(SIMD, avx512): DEFINES += USE_AVX512
+equals(SIMD, avx): DEFINES += USE_AVX
+equals(SIMD, sse): DEFINES += USE_SSE
+equals(SIMD, none): DEFINES += USE_NO_SIMD
+
 # Compiling on Windows
 windows: {
 	# libraries and includepath
@@ -16,13 +23,16 @@ windows: {
 
 	# MSVC compiler
 	contains($$QMAKE_CXX, msvc): {
-		QMAKE_CXXFLAGS	+= /arch:AVX
+		equals(SIMD, avx512): QMAKE_CXXFLAGS	+= /arch:AVX512
+		equals(SIMD, avx): QMAKE_CXXFLAGS	+= /arch:AVX
 		QMAKE_CXXFLAGS_RELEASE += /Ox
 	}
 
 	# MinGW compiler
 	contains($$QMAKE_CXX, g++): {
-		QMAKE_CXXFLAGS  += -mavx
+		equals(SIMD, avx512): QMAKE_CXXFLAGS  += -mavx512f
+		equals(SIMD, avx): QMAKE_CXXFLAGS  += -mavx
+		equals(SIMD, sse): QMAKE_CXXFLAGS  += -msse4.1
 		QMAKE_CXXFLAGS_RELEASE += -O3
 	}
 }
@@ -31,34 +41,109 @@ windows: {
 linux {
 	LIBS += -lGL -lSDL2 -lGLEW -lpthread
 
-	QMAKE_CXXFLAGS	+= -mavx
+	HEADERS +=  \
+			distributed.h \
+			server.h \
+			socket.h
+
+	SOURCES +=  \
+			distributed.cpp \
+			server.cpp \
+			socket.cpp
+
+	equals(SIMD, avx512): QMAKE_CXXFLAGS	+= -mavx512f
+	equals(SIMD, avx): QMAKE_CXXFLAGS	+= -mavx
+	equals(SIMD, sse): QMAKE_CXXFLAGS	+= -msse4.1
 	QMAKE_CXXFLAGS_RELEASE += -O3
 	QMAKE_CXXFLAGS_RELEASE -= -O2
 }
 
 # Input
 HEADERS +=  \
+			aov.h \
+			batch.h \
+			benchmark.h \
+			camerapath.h \
+			cameraview.h \
+			capture.h \
 			config.h \
+			cputopology.h \
+			framebuffer.h \
 			GLError.h \
 			glprogram.h \
+			golden.h \
 			hitrecord.h \
+			image.h \
+			impostor.h \
+			options.h \
+			pagealloc.h \
+			perfcounters.h \
+			precisioncheck.h \
+			qoi.h \
 			ray.h \
+			raygen.h \
+			raystream.h \
+			resolution.h \
+			scene.h \
 			screenrenderer.h \
 			simd.h \
 			simd_avx.h \
 			simd_avx512.h \
 			simd_base.h \
+			simd_interleave.h \
+			simd_precision.h \
 			simd_sse.h \
 			sphereflake.h \
+			splatcheck.h \
+			splatter.h \
+			tile.h \
+			tilecache.h \
+			tilepriority.h \
+			tracer.h \
 			vec3.h \
 			window.h
 
 SOURCES +=  \
 			main.cpp \
+			aov.cpp \
+			batch.cpp \
+			benchmark.cpp \
+			camerapath.cpp \
+			capture.cpp \
+			cputopology.cpp \
+			framebuffer.cpp \
 			glprogram.cpp \
+			golden.cpp \
+			image.cpp \
+			impostor.cpp \
+			options.cpp \
+			pagealloc.cpp \
+			perfcounters.cpp \
+			precisioncheck.cpp \
+			qoi.cpp \
+			raygen.cpp \
+			raystream.cpp \
+			resolution.cpp \
+			scene.cpp \
 			screenrenderer.cpp \
+			splatcheck.cpp \
+			splatter.cpp \
+			tilecache.cpp \
+			tilepriority.cpp \
+			tracer.cpp \
 			window.cpp
 
+# make golden: trace the golden views with this build and compare, the timing
+# baseline of the machine stays in the build directory
+golden.commands = $$OUT_PWD/$$TARGET --golden $$PWD/golden --timings $$OUT_PWD/timings.txt
+golden.depends = $$TARGET
+QMAKE_EXTRA_TARGETS += golden
+
+# make bench: measure the kernels with this build
+bench.commands = $$OUT_PWD/$$TARGET --bench
+bench.depends = $$TARGET
+QMAKE_EXTRA_TARGETS += bench
+
 OTHER_FILES +=  \
 			bin/shaders/fragment.glsl \
 			bin/shaders/vertex.glsl \
@@ -17,7 +17,7 @@
 #define	TYPE2_SPHERES_COUNT		3
 
 // Total number of spheres.
-#define TOTAL_NUMBER_OF_SPHERES	TYPE1_SPHERES_COUNT + TYPE2_SPHERES_COUNT
+#define TOTAL_NUMBER_OF_SPHERES	( TYPE1_SPHERES_COUNT + TYPE2_SPHERES_COUNT )
 
 // Sphere Y axis position. Only between 0 and 90 degrees.
 #define	TYPE1_SPHERES_DEGREE	90.0
@@ -35,6 +35,10 @@ constexpr uint32_t	SCREEN_HEIGHT				= 600;
 
 constexpr uint32_t	FPS							= 60;
 
+// Size of the square screen tiles the render threads work on. Must be a
+// multiple of the SIMD width.
+constexpr uint32_t	TILE_SIZE					= 32;
+
 constexpr float		SCREEN_RATIO				= float( SCREEN_HEIGHT ) / float( SCREEN_WIDTH );
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,210 @@
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <string>
+#include <thread>
+
+#if defined( __linux__ )
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "cputopology.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+constexpr char		CPU_ONLINE_PATH[]	= "/sys/devices/system/cpu/online";
+constexpr char		CPU_PATH[]			= "/sys/devices/system/cpu/cpu";
+constexpr char		NODE_PATH[]			= "/sys/devices/system/node/node";
+
+// Upper bound for the NUMA node ids that are probed.
+constexpr uint32_t	MAX_NODES			= 64;
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief ParseCpuList	Parses a sysfs cpu list like "0-3,8,10-11".
+ */
+static
+std::vector< uint32_t >	ParseCpuList( const std::string& list )
+{
+	std::vector< uint32_t >	result;
+
+	size_t	pos	= 0;
+	while( pos < list.size() )
+	{
+		size_t		end		= list.find( ',', pos );
+		if( std::string::npos == end )
+			end	= list.size();
+
+		std::string	range	= list.substr( pos, end - pos );
+		size_t		dash	= range.find( '-' );
+
+		if( ! range.empty() && isdigit( range[ 0 ] ) )
+		{
+			uint32_t	first	= static_cast< uint32_t >( std::stoul( range ) );
+			uint32_t	last	= first;
+			if( std::string::npos != dash )
+				last	= static_cast< uint32_t >( std::stoul( range.substr( dash + 1 ) ) );
+
+			for( uint32_t cpu = first; cpu <= last; ++cpu )
+				result.push_back( cpu );
+		}
+
+		pos	= end + 1;
+	}
+
+	return	result;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief ReadLine	Reads the first line of a (sysfs) file. Returns an empty
+ * string if the file does not exist.
+ */
+static
+std::string	ReadLine( const std::string& path )
+{
+	std::ifstream	file( path );
+	std::string		line;
+	std::getline( file, line );
+
+	return	line;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief CpuTopology::CpuTopology	Constructor for the class. Reads the
+ * topology from sysfs, falls back to a flat layout if that is not possible.
+ */
+CpuTopology::CpuTopology()
+	: m_nodeCount( 1 )
+{
+	if( ReadSysfs() )
+		return;
+
+	m_cpus.clear();
+	m_nodeCount	= 1;
+
+	uint32_t	count	= std::max( 1u, std::thread::hardware_concurrency() );
+	for( uint32_t i = 0; i < count; ++i )
+		m_cpus.push_back( { i, i, 0, 0, true } );
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief CpuTopology::ReadSysfs	Reads the cpu layout from
+ * /sys/devices/system. Returns false if the information is not available.
+ */
+bool	CpuTopology::ReadSysfs()
+{
+#if defined( __linux__ )
+	std::vector< uint32_t >	online	= ParseCpuList( ReadLine( CPU_ONLINE_PATH ) );
+	if( online.empty() )
+		return	false;
+
+	for( uint32_t cpu : online )
+	{
+		const std::string	topology	= CPU_PATH + std::to_string( cpu ) + "/topology/";
+		const std::string	coreId		= ReadLine( topology + "core_id" );
+		const std::string	packageId	= ReadLine( topology + "physical_package_id" );
+		auto				siblings	= ParseCpuList( ReadLine( topology + "thread_siblings_list" ) );
+
+		CpuInfo	info;
+		info.id			= cpu;
+		info.core		= coreId.empty()	? cpu : static_cast< uint32_t >( std::stoul( coreId ) );
+		info.package	= packageId.empty()	? 0   : static_cast< uint32_t >( std::stoul( packageId ) );
+		info.node		= 0;
+		info.primary	= siblings.empty() || cpu == *std::min_element( siblings.begin(), siblings.end() );
+
+		m_cpus.push_back( info );
+	}
+
+	for( uint32_t node = 0; node < MAX_NODES; ++node )
+	{
+		const std::string	cpuList	= ReadLine( NODE_PATH + std::to_string( node ) + "/cpulist" );
+		for( uint32_t cpu : ParseCpuList( cpuList ) )
+		{
+			for( auto& info : m_cpus )
+			{
+				if( info.id == cpu )
+					info.node	= node;
+			}
+		}
+
+		if( ! cpuList.empty() )
+			m_nodeCount	= std::max( m_nodeCount, node + 1 );
+	}
+
+	return	true;
+#else
+	return	false;
+#endif
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief CpuTopology::SelectCpus	Picks 'count' CPUs for the render threads.
+ * One thread per physical core is placed first, alternating between the NUMA
+ * nodes. The SMT siblings are used only after every core is busy and only if
+ * 'useSmt' is set. If there are more threads than CPUs the list wraps around.
+ */
+std::vector< CpuInfo >	CpuTopology::SelectCpus( uint32_t count, bool useSmt ) const
+{
+	std::vector< CpuInfo >	order;
+
+	for( int pass = 0; pass < ( useSmt ? 2 : 1 ); ++pass )
+	{
+		const bool	primary	= 0 == pass;
+
+		std::vector< std::vector< CpuInfo > >	perNode( m_nodeCount );
+		for( const auto& info : m_cpus )
+		{
+			if( info.primary == primary )
+				perNode[ info.node ].push_back( info );
+		}
+
+		for( size_t i = 0; ; ++i )
+		{
+			bool	added	= false;
+			for( const auto& node : perNode )
+			{
+				if( i < node.size() )
+				{
+					order.push_back( node[ i ] );
+					added	= true;
+				}
+			}
+
+			if( ! added )
+				break;
+		}
+	}
+
+	std::vector< CpuInfo >	result;
+	for( uint32_t i = 0; i < count && ! order.empty(); ++i )
+		result.push_back( order[ i % order.size() ] );
+
+	return	result;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief CpuTopology::PinCurrentThread	Pins the calling thread to 'cpu'.
+ * @return	Returns false if pinning is not supported or failed.
+ */
+bool	CpuTopology::PinCurrentThread( uint32_t cpu )
+{
+#if defined( __linux__ )
+	cpu_set_t	set;
+	CPU_ZERO( &set );
+	CPU_SET( cpu, &set );
+
+	return	0 == pthread_setaffinity_np( pthread_self(), sizeof( set ), &set );
+#else
+	( void )( cpu );
+	return	false;
+#endif
+}
+////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,56 @@
+
+#ifndef CPUTOPOLOGY_H
+#define CPUTOPOLOGY_H
+
+////////////////////////////////////////////////////////////////////////////////
+
+#include <vector>
+
+#include <stdint.h>
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief The CpuInfo struct describes a single logical CPU.
+ * Primary is true for the first hardware thread of a physical core. The other
+ * hardware threads of the same core are its SMT siblings.
+ */
+struct CpuInfo
+{
+	uint32_t	id;
+	uint32_t	core;
+	uint32_t	package;
+	uint32_t	node;
+	bool		primary;
+};
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief The CpuTopology class reads the CPU layout of the machine (cores, SMT
+ * siblings and NUMA nodes) and pins threads to CPUs.
+ *
+ * @note On systems other than Linux every CPU is reported as a separate core
+ * on node 0 and pinning is not supported.
+ */
+class CpuTopology
+{
+public:
+	CpuTopology();
+
+	const std::vector< CpuInfo >&	Cpus()			const { return	m_cpus;      }
+	uint32_t						NodeCount()		const { return	m_nodeCount; }
+
+	std::vector< CpuInfo >	SelectCpus( uint32_t count, bool useSmt )	const;
+
+	static bool		PinCurrentThread( uint32_t cpu );
+
+private:
+	bool	ReadSysfs();
+
+private:
+	std::vector< CpuInfo >	m_cpus;
+	uint32_t				m_nodeCount;
+};
+////////////////////////////////////////////////////////////////////////////////
+
+#endif // CPUTOPOLOGY_H
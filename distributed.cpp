@@ -0,0 +1,472 @@
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <vector>
+
+#include <math.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "config.h"
+#include "image.h"
+#include "qoi.h"
+#include "socket.h"
+#include "sphereflake.h"
+#include "tile.h"
+
+#include "distributed.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Tiles in flight per worker. More than one hides the round trip.
+constexpr uint32_t	JOBS_PER_WORKER			= 2;
+constexpr int		POLL_INTERVAL_MS		= 50;
+// Receive timeout for a message that has started to arrive.
+constexpr uint32_t	MESSAGE_TIMEOUT_MS		= 2000;
+// The coordinator gives up when it has no workers for this long.
+constexpr uint32_t	NO_WORKERS_TIMEOUT_MS	= 30000;
+constexpr uint32_t	CONNECT_RETRIES			= 100;
+constexpr uint32_t	CONNECT_RETRY_DELAY_US	= 100000;
+
+constexpr char		SELF_EXE_PATH[]			= "/proc/self/exe";
+
+constexpr char		LISTEN_FAILED_MSG[]		= "Failed to listen on %s\n";
+constexpr char		CONNECT_FAILED_MSG[]	= "Failed to connect to %s\n";
+constexpr char		SPAWN_FAILED_MSG[]		= "Failed to start a worker process\n";
+constexpr char		NO_WORKERS_MSG[]		= "No workers left, giving up with %u of %u tiles done\n";
+constexpr char		WORKER_LOST_MSG[]		= "Worker %d lost, %u tiles put back in the queue\n";
+constexpr char		WRITE_FAILED_MSG[]		= "Failed to write %s\n";
+constexpr char		FRAME_DONE_MSG[]		= "Frame done in %.1f ms: %u tiles, %u reassigned, %u workers used, written to %s\n";
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+	using	Clock	= std::chrono::steady_clock;
+
+	enum	MessageType : uint32_t
+	{
+		MSG_JOB		= 1,
+		MSG_RESULT	= 2,
+		MSG_QUIT	= 3,
+	};
+
+	/**
+	 * @brief The JobMessage struct is sent to the worker for every tile. The
+	 * settings that change the image come with it, the worker's own options
+	 * are its defaults.
+	 */
+	struct	JobMessage
+	{
+		uint32_t	tile;
+		uint32_t	x;
+		uint32_t	y;
+		uint32_t	width;
+		uint32_t	height;
+		float		camera[ 3 ];
+		float		view[ 3 ];
+		float		impostorPixels;
+		uint32_t	occlusionCull;
+		uint32_t	precision;
+	};
+
+	/**
+	 * @brief The ResultMessage struct is the header of the worker's answer.
+	 * The QOI encoded tile follows it.
+	 */
+	struct	ResultMessage
+	{
+		uint32_t	tile;
+	};
+
+	struct	Assignment
+	{
+		uint32_t			tile;
+		Clock::time_point	started;
+		bool				reassigned;
+	};
+
+	struct	Worker
+	{
+		int							fd;
+		std::vector< Assignment >	jobs;
+		uint32_t					completed;
+		bool						dead;
+	};
+	////////////////////////////////////////////////////////////////////////////
+
+	double	Milliseconds( Clock::duration d )
+	{
+		return	std::chrono::duration< double, std::milli >( d ).count();
+	}
+	////////////////////////////////////////////////////////////////////////////
+
+	/**
+	 * @brief SpawnWorkers	Starts 'count' copies of this executable in worker
+	 * mode, connecting to 'address'.
+	 */
+	std::vector< pid_t >	SpawnWorkers( uint32_t count, const char* const address, int listenFd )
+	{
+		std::vector< pid_t >	pids;
+		for( uint32_t i = 0; i < count; ++i )
+		{
+			pid_t	pid	= fork();
+			if( 0 == pid )
+			{
+				close( listenFd );
+				execl( SELF_EXE_PATH, SELF_EXE_PATH, "--worker", address,
+					   static_cast< char* >( nullptr ) );
+				_exit( 1 );
+			}
+
+			if( pid < 0 )
+			{
+				fprintf( stderr, SPAWN_FAILED_MSG );
+				continue;
+			}
+
+			pids.push_back( pid );
+		}
+
+		return	pids;
+	}
+	////////////////////////////////////////////////////////////////////////////
+
+	/**
+	 * @brief ReapWorkers	Removes the processes that have exited from 'pids'.
+	 */
+	void	ReapWorkers( std::vector< pid_t >& pids )
+	{
+		pids.erase( std::remove_if( pids.begin(), pids.end(),
+									[]( pid_t pid ) { return waitpid( pid, nullptr, WNOHANG ) == pid; } ),
+					pids.end() );
+	}
+	////////////////////////////////////////////////////////////////////////////
+
+	/**
+	 * @brief StoreTile	Decodes a result and copies it into 'image'. The rows are
+	 * flipped, the image file has the top row first while row 0 of the screen
+	 * is at the bottom.
+	 * @return	Returns false if the tile is not one of the 'tileCount' tiles
+	 * of the frame or the data does not match it.
+	 */
+	bool	StoreTile( const std::vector< uint8_t >& payload, uint32_t tilesX, uint32_t tileCount,
+					   std::vector< uint8_t >& image, uint32_t& tileIndex )
+	{
+		if( payload.size() < sizeof( ResultMessage ) )
+			return	false;
+
+		ResultMessage	result;
+		memcpy( &result, payload.data(), sizeof( result ) );
+
+		// The index comes from the peer, a tile outside the frame would be
+		// copied outside the image.
+		if( result.tile >= tileCount )
+			return	false;
+
+		std::vector< uint8_t >	rgb;
+		uint32_t				width;
+		uint32_t				height;
+		if( ! QOI::Decode( payload.data() + sizeof( result ), payload.size() - sizeof( result ),
+						   rgb, width, height ) )
+			return	false;
+
+		const Tile	tile	= GetTile( result.tile, tilesX );
+		if( tile.width != width || tile.height != height )
+			return	false;
+
+		for( uint32_t y = 0; y < height; ++y )
+		{
+			const size_t	row	= SCREEN_HEIGHT - 1 - ( tile.y + y );
+			memcpy( image.data() + ( row * SCREEN_WIDTH + tile.x ) * 3,
+					rgb.data() + size_t( y ) * width * 3, width * 3 );
+		}
+
+		tileIndex	= result.tile;
+		return	true;
+	}
+	////////////////////////////////////////////////////////////////////////////
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief RunCoordinator	Renders one frame with worker processes and writes
+ * it to 'options.output'.
+ * @return	Returns the process exit code.
+ */
+int	RunCoordinator( const Options& options )
+{
+	int	listenFd	= Net::Listen( options.address.c_str() );
+	if( listenFd < 0 )
+	{
+		fprintf( stderr, LISTEN_FAILED_MSG, options.address.c_str() );
+		return	1;
+	}
+
+	std::vector< pid_t >	children	= SpawnWorkers( options.spawnWorkers,
+													options.address.c_str(), listenFd );
+
+	const uint32_t	tilesX		= ( SCREEN_WIDTH  + TILE_SIZE - 1 ) / TILE_SIZE;
+	const uint32_t	tilesY		= ( SCREEN_HEIGHT + TILE_SIZE - 1 ) / TILE_SIZE;
+	const uint32_t	tileCount	= tilesX * tilesY;
+
+	std::vector< uint8_t >	image( size_t( SCREEN_WIDTH ) * SCREEN_HEIGHT * 3 );
+	std::vector< bool >		done( tileCount, false );
+	std::deque< uint32_t >	pending;
+	std::vector< Worker >	workers;
+
+	for( uint32_t i = 0; i < tileCount; ++i )
+		pending.push_back( i );
+
+	uint32_t	doneCount		= 0;
+	uint32_t	reassigned		= 0;
+	uint32_t	workersUsed		= 0;
+	const auto	start			= Clock::now();
+	auto		lastWorker		= start;
+
+	while( doneCount < tileCount )
+	{
+		// Hand out tiles to every worker that has a free slot.
+		for( auto& worker : workers )
+		{
+			while( ! worker.dead && worker.jobs.size() < JOBS_PER_WORKER && ! pending.empty() )
+			{
+				uint32_t	index	= pending.front();
+				pending.pop_front();
+				if( done[ index ] )
+					continue;
+
+				const Tile	tile	= GetTile( index, tilesX );
+				JobMessage	job		= { index, tile.x, tile.y, tile.width, tile.height,
+										{ options.camera.x, options.camera.y, options.camera.z },
+										{ options.view.yaw, options.view.pitch, options.view.fov },
+										options.impostorPixels, options.occlusionCull ? 1u : 0u,
+										static_cast< uint32_t >( options.precision ) };
+
+				if( ! Net::SendMessage( worker.fd, MSG_JOB, &job, sizeof( job ) ) )
+				{
+					pending.push_front( index );
+					worker.dead	= true;
+					break;
+				}
+
+				worker.jobs.push_back( { index, Clock::now(), false } );
+			}
+		}
+
+		std::vector< pollfd >	fds( 1 + workers.size() );
+		fds[ 0 ]	= { listenFd, POLLIN, 0 };
+		for( size_t i = 0; i < workers.size(); ++i )
+			fds[ i + 1 ]	= { workers[ i ].fd, POLLIN, 0 };
+
+		poll( fds.data(), fds.size(), POLL_INTERVAL_MS );
+
+		if( fds[ 0 ].revents & POLLIN )
+		{
+			int	fd	= Net::Accept( listenFd );
+			if( fd >= 0 )
+			{
+				Net::SetReceiveTimeout( fd, MESSAGE_TIMEOUT_MS );
+				workers.push_back( { fd, {}, 0, false } );
+			}
+		}
+
+		// Collect the results.
+		for( size_t i = 0; i + 1 < fds.size(); ++i )
+		{
+			Worker&	worker	= workers[ i ];
+			if( 0 == fds[ i + 1 ].revents || worker.dead )
+				continue;
+
+			uint32_t				type;
+			std::vector< uint8_t >	payload;
+			uint32_t				index;
+			if( ! Net::ReceiveMessage( worker.fd, type, payload ) ||
+				MSG_RESULT != type || ! StoreTile( payload, tilesX, tileCount, image, index ) ||
+				index >= tileCount )
+			{
+				worker.dead	= true;
+				continue;
+			}
+
+			worker.jobs.erase( std::remove_if( worker.jobs.begin(), worker.jobs.end(),
+											   [ index ]( const Assignment& a ) { return a.tile == index; } ),
+							   worker.jobs.end() );
+
+			if( 0 == worker.completed++ )
+				++workersUsed;
+
+			if( ! done[ index ] )
+			{
+				done[ index ]	= true;
+				++doneCount;
+			}
+		}
+
+		// Put the tiles of the lost workers back in the queue.
+		for( auto& worker : workers )
+		{
+			if( ! worker.dead )
+				continue;
+
+			uint32_t	requeued	= 0;
+			for( const auto& job : worker.jobs )
+			{
+				if( ! done[ job.tile ] && ! job.reassigned )
+				{
+					pending.push_front( job.tile );
+					++requeued;
+				}
+			}
+
+			fprintf( stderr, WORKER_LOST_MSG, worker.fd, requeued );
+			Net::Close( worker.fd );
+		}
+
+		workers.erase( std::remove_if( workers.begin(), workers.end(),
+									   []( const Worker& w ) { return w.dead; } ),
+					   workers.end() );
+
+		// Give the tiles of slow workers to someone else as well.
+		const auto	now	= Clock::now();
+		for( auto& worker : workers )
+		{
+			for( auto& job : worker.jobs )
+			{
+				if( ! job.reassigned && ! done[ job.tile ] &&
+					Milliseconds( now - job.started ) > options.tileTimeout )
+				{
+					job.reassigned	= true;
+					pending.push_front( job.tile );
+					++reassigned;
+				}
+			}
+		}
+
+		ReapWorkers( children );
+		if( ! workers.empty() || ! children.empty() )
+			lastWorker	= now;
+		else if( Milliseconds( now - lastWorker ) > NO_WORKERS_TIMEOUT_MS )
+		{
+			fprintf( stderr, NO_WORKERS_MSG, doneCount, tileCount );
+			break;
+		}
+	}
+
+	for( auto& worker : workers )
+	{
+		Net::SendMessage( worker.fd, MSG_QUIT, nullptr, 0 );
+		Net::Close( worker.fd );
+	}
+
+	Net::StopListening( listenFd, options.address.c_str() );
+	for( pid_t pid : children )
+		waitpid( pid, nullptr, 0 );
+
+	if( doneCount < tileCount )
+		return	1;
+
+	if( ! WriteFileAtomic( options.output.c_str(), QOI::Encode( image.data(), SCREEN_WIDTH, SCREEN_HEIGHT ) ) )
+	{
+		fprintf( stderr, WRITE_FAILED_MSG, options.output.c_str() );
+		return	1;
+	}
+
+	fprintf( stderr, FRAME_DONE_MSG, Milliseconds( Clock::now() - start ), tileCount,
+			 reassigned, workersUsed, options.output.c_str() );
+
+	return	0;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief RunWorker	Connects to the coordinator and traces the tiles it sends
+ * until it is told to quit or the connection is lost.
+ * @return	Returns the process exit code.
+ */
+int	RunWorker( const Options& options )
+{
+	int	fd	= -1;
+	for( uint32_t i = 0; i < CONNECT_RETRIES && fd < 0; ++i )
+	{
+		fd	= Net::Connect( options.address.c_str() );
+		if( fd < 0 )
+			usleep( CONNECT_RETRY_DELAY_US );
+	}
+
+	if( fd < 0 )
+	{
+		fprintf( stderr, CONNECT_FAILED_MSG, options.address.c_str() );
+		return	1;
+	}
+
+	SphereFlake				sphereFlake;
+	RayGenerator			rays;
+	std::vector< Vec3 >		pixels( TILE_SIZE * TILE_SIZE );
+	std::vector< uint8_t >	rgb( TILE_SIZE * TILE_SIZE * 3 );
+	std::vector< uint8_t >	payload;
+	uint32_t				type;
+
+	// The jobs are tiles of a full screen frame. The directions are set up
+	// again when the view or the precision of the jobs changes.
+	CameraView	view		= options.view;
+	Precision	precision	= options.precision;
+	rays.Setup( view, SCREEN_WIDTH, SCREEN_HEIGHT, precision );
+	sphereFlake.SetFieldOfView( view.TanHalfFov() );
+
+	while( Net::ReceiveMessage( fd, type, payload ) && MSG_JOB == type )
+	{
+		if( payload.size() != sizeof( JobMessage ) )
+			break;
+
+		JobMessage	job;
+		memcpy( &job, payload.data(), sizeof( job ) );
+
+		const Tile	tile	= { job.x, job.y, job.width, job.height };
+		if( tile.width > TILE_SIZE || tile.height > TILE_SIZE || 0 != tile.width % SIMD::SIZE ||
+			job.precision > static_cast< uint32_t >( Precision::FAST ) || !( job.impostorPixels >= 0.0f ) ||
+			! isfinite( job.view[ 0 ] ) || !( fabsf( job.view[ 1 ] ) <= MAX_PITCH ) ||
+			!( job.view[ 2 ] >= MIN_FOV && job.view[ 2 ] <= MAX_FOV ) )
+			break;
+
+		CameraView	jobView;
+		jobView.yaw		= job.view[ 0 ];
+		jobView.pitch	= job.view[ 1 ];
+		jobView.fov		= job.view[ 2 ];
+
+		const Precision	jobPrecision	= static_cast< Precision >( job.precision );
+		if( jobView != view || jobPrecision != precision )
+		{
+			view		= jobView;
+			precision	= jobPrecision;
+			rays.Setup( view, SCREEN_WIDTH, SCREEN_HEIGHT, precision );
+			sphereFlake.SetFieldOfView( view.TanHalfFov() );
+		}
+
+		sphereFlake.SetImpostorPixels( job.impostorPixels );
+		sphereFlake.SetOcclusionCull( 0 != job.occlusionCull );
+
+		const Vec3		camera( job.camera[ 0 ], job.camera[ 1 ], job.camera[ 2 ] );
+		TraversalStats	stats;
+		if( Precision::FAST == precision )
+			TraceTile< Precision::FAST >( sphereFlake, rays, camera, tile, pixels.data(), tile.width, stats );
+		else
+			TraceTile< Precision::EXACT >( sphereFlake, rays, camera, tile, pixels.data(), tile.width, stats );
+		ConvertToRgb8( pixels.data(), tile.width, tile.height, tile.width, rgb.data() );
+
+		const auto		encoded	= QOI::Encode( rgb.data(), tile.width, tile.height );
+		ResultMessage	result	= { job.tile };
+
+		if( ! Net::SendMessage( fd, MSG_RESULT, &result, sizeof( result ),
+								encoded.data(), static_cast< uint32_t >( encoded.size() ) ) )
+			break;
+	}
+
+	Net::Close( fd );
+	return	0;
+}
+////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,31 @@
+
+#ifndef DISTRIBUTED_H
+#define DISTRIBUTED_H
+
+////////////////////////////////////////////////////////////////////////////////
+
+#include "options.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Multi-process tile rendering.
+ *
+ * The coordinator listens on 'options.address', splits the frame in tiles and
+ * hands them out to the worker processes that connect (optionally it starts
+ * 'options.spawnWorkers' of them itself). Each job is the camera, its view, the
+ * tile rectangle and the settings that change the image (impostor size,
+ * occlusion cull and precision), workers answer with the tile compressed as QOI.
+ *
+ * A tile that is not returned within 'options.tileTimeout' is given to another
+ * worker as well, the first result wins. The tiles of a worker that
+ * disconnects or dies are put back in the queue.
+ *
+ * @note Linux only.
+ */
+int	RunCoordinator( const Options& options );
+int	RunWorker( const Options& options );
+
+////////////////////////////////////////////////////////////////////////////////
+
+#endif // DISTRIBUTED_H
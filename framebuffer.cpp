@@ -0,0 +1,46 @@
+
+#include <algorithm>
+
+#include <string.h>
+
+#include "framebuffer.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief FrameBuffer::FrameBuffer	Constructor for the class.
+ * @param hugePages	Back the buffer with huge pages when possible.
+ */
+FrameBuffer::FrameBuffer( bool hugePages )
+	: m_pages( AllocatePages( PIXELS * sizeof( Vec3 ), hugePages ) )
+{
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief FrameBuffer::~FrameBuffer	Destructor for the class.
+ */
+FrameBuffer::~FrameBuffer()
+{
+	FreePages( m_pages );
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief FrameBuffer::Deswizzle	Copies the top left 'width' x 'height' pixels
+ * of the screen to 'dst' in row order, row y starts at dst + y * stride.
+ * Writes 'dst' front to back in one pass.
+ */
+void	FrameBuffer::Deswizzle( Vec3* dst, ptrdiff_t stride, uint32_t width, uint32_t height ) const
+{
+	for( uint32_t y = 0; y < height; ++y )
+	{
+		Vec3* const	row	= dst + ptrdiff_t( y ) * stride;
+		for( uint32_t x = 0; x < width; x += TILE_SIZE )
+		{
+			const uint32_t	count	= std::min( TILE_SIZE, width - x );
+			memcpy( row + x, Pixel( x, y ), count * sizeof( Vec3 ) );
+		}
+	}
+}
+////////////////////////////////////////////////////////////////////////////////
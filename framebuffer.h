@@ -0,0 +1,73 @@
+
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+////////////////////////////////////////////////////////////////////////////////
+
+#include <stddef.h>
+
+#include "config.h"
+#include "pagealloc.h"
+#include "vec3.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief The FrameBuffer class holds the traced colors of one screen.
+ *
+ * The pixels are stored tile by tile in the order of the tile indices of
+ * GetTile, each tile row by row with TILE_SIZE pixels per row. A tile is
+ * whole pages, so a render thread writes only its own cache lines and pages,
+ * and the tiles on the right and bottom edge are padded to the full size.
+ * Deswizzle and Pixel give the screen in row order.
+ *
+ * The memory is page aligned (huge pages if requested) and is not touched on
+ * allocation, see Tracer::ClearBuffer.
+ */
+class FrameBuffer
+{
+public:
+	static constexpr uint32_t	WIDTH		= SCREEN_WIDTH;
+	static constexpr uint32_t	HEIGHT		= SCREEN_HEIGHT;
+	static constexpr uint32_t	TILES_X		= ( WIDTH  + TILE_SIZE - 1 ) / TILE_SIZE;
+	static constexpr uint32_t	TILES_Y		= ( HEIGHT + TILE_SIZE - 1 ) / TILE_SIZE;
+	static constexpr uint32_t	TILE_PIXELS	= TILE_SIZE * TILE_SIZE;
+	// Number of stored pixels, including the padding of the edge tiles.
+	static constexpr size_t		PIXELS		= size_t( TILES_X ) * TILES_Y * TILE_PIXELS;
+
+	explicit FrameBuffer( bool hugePages );
+	~FrameBuffer();
+
+	FrameBuffer( const FrameBuffer& )				= delete;
+	FrameBuffer&	operator=( const FrameBuffer& )	= delete;
+
+	Vec3*			Tile( uint32_t index )						{ return	Data() + size_t( index ) * TILE_PIXELS; }
+	const Vec3*		Pixel( uint32_t x, uint32_t y )		const	{ return	Data() + Offset( x, y ); }
+	PageKind		Kind()								const	{ return	m_pages.kind; }
+
+	void			Deswizzle( Vec3* dst, ptrdiff_t stride,
+							   uint32_t width = WIDTH, uint32_t height = HEIGHT )	const;
+
+private:
+	Vec3*			Data()				{ return	static_cast< Vec3* >( m_pages.data ); }
+	const Vec3*		Data()		const	{ return	static_cast< const Vec3* >( m_pages.data ); }
+
+	/**
+	 * @brief Offset	Returns the index of the screen pixel x, y. The pixels
+	 * up to the right edge of its tile follow it.
+	 */
+	static size_t	Offset( uint32_t x, uint32_t y )
+	{
+		return	( size_t( y / TILE_SIZE ) * TILES_X + x / TILE_SIZE ) * TILE_PIXELS +
+				( y % TILE_SIZE ) * TILE_SIZE + x % TILE_SIZE;
+	}
+
+	PageAllocation	m_pages;
+};
+////////////////////////////////////////////////////////////////////////////////
+
+static_assert( 0 == FrameBuffer::TILE_PIXELS * sizeof( Vec3 ) % 4096, "A tile must be whole pages." );
+
+////////////////////////////////////////////////////////////////////////////////
+
+#endif // FRAMEBUFFER_H
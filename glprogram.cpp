@@ -51,6 +51,16 @@ void	GLProgram::Use()
 }
 ////////////////////////////////////////////////////////////////////////////////
 
+/**
+ * @brief GLProgram::SetUniform	Sets the vec2 uniform 'name' of the program.
+ * The program must be bound.
+ */
+void	GLProgram::SetUniform( const char* const name, float x, float y )
+{
+	glUniform2f( glGetUniformLocation( m_programId, name ), x, y );
+}
+////////////////////////////////////////////////////////////////////////////////
+
 /**
  * @brief GLProgram::CompileShaders This function compiles shaders and links
  * them in a program.
@@ -19,6 +19,7 @@ public:
 	~GLProgram();
 
 	void	Use();
+	void	SetUniform( const char* const name, float x, float y );
 
 private:
 	void		CompileShaders();
@@ -0,0 +1,301 @@
+
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+#include <string.h>
+
+#include "framebuffer.h"
+#include "image.h"
+#include "qoi.h"
+#include "simd.h"
+#include "tracer.h"
+
+#include "golden.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Largest channel difference that is not counted as an error, and the share of
+// pixels allowed over it. The backends round differently only where a ray
+// grazes a sphere, the same budget as the precision check.
+constexpr uint32_t	MAX_CHANNEL_ERROR		= 2;
+constexpr double	MAX_OUTLIER_FRACTION	= 0.001;
+// A view fails when its best time is this much slower than the baseline, and
+// by at least MIN_SLOWDOWN_MS so the small views don't fail on timer noise.
+constexpr double	MAX_SLOWDOWN			= 1.25;
+constexpr double	MIN_SLOWDOWN_MS			= 1.0;
+// Every view is traced this often, the fastest run is its time.
+constexpr uint32_t	REPETITIONS				= 5;
+
+constexpr char		HEADER_MSG[]			= "Golden check of the %s backend, %u threads, baseline %s\n";
+constexpr char		VIEW_MSG[]				= "%-8s %8.2f ms  baseline %8.2f ms  max error %3u, %6zu pixels over %u  %s\n";
+constexpr char		NO_BASELINE_MSG[]		= "%-8s %8.2f ms  baseline     none    max error %3u, %6zu pixels over %u  %s\n";
+constexpr char		WRITTEN_MSG[]			= "%-8s %8.2f ms  written %s\n";
+constexpr char		READ_FAILED_MSG[]		= "%-8s can't read the golden image %s\n";
+constexpr char		WRITE_FAILED_MSG[]		= "Can't write %s\n";
+constexpr char		SIZE_MSG[]				= "%-8s golden image %s is %ux%u, the view is %ux%u\n";
+constexpr char		RECORDED_MSG[]			= "Recorded the timings in %s\n";
+constexpr char		PASSED_MSG[]			= "Golden check passed\n";
+constexpr char		NO_TIMING_MSG[]			= "Golden check passed the images, no timing check of %u of %u views\n";
+constexpr char		FAILED_MSG[]			= "Golden check failed: %u of %u views\n";
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+	/**
+	 * @brief The View struct is one of the checked images: the camera and
+	 * where it looks, the precision it's traced at and the frame size.
+	 */
+	struct View
+	{
+		const char*	name;
+		float		camera[ 3 ];
+		CameraView	look;
+		Precision	precision;
+		uint32_t	width;
+		uint32_t	height;
+	};
+
+	constexpr CameraView	LEVEL	= { 0.0f, 0.0f, DEFAULT_FOV };
+
+	// Most views look down the negative z axis from their position. The views
+	// cover the whole fractal, the deep levels up close, a view from the side,
+	// the fast math path, a frame smaller than the screen and a turned camera
+	// with a narrower field of view.
+	constexpr View	VIEWS[]	=
+	{
+		{ "default",	{ 0.0f, 0.0f, 5.0f },	LEVEL,	Precision::EXACT,	SCREEN_WIDTH,		SCREEN_HEIGHT },
+		{ "close",		{ 0.0f, 0.5f, 2.2f },	LEVEL,	Precision::EXACT,	SCREEN_WIDTH,		SCREEN_HEIGHT },
+		{ "side",		{ 1.5f, 1.0f, 3.0f },	LEVEL,	Precision::EXACT,	SCREEN_WIDTH,		SCREEN_HEIGHT },
+		{ "fast",		{ 0.0f, 0.0f, 5.0f },	LEVEL,	Precision::FAST,	SCREEN_WIDTH,		SCREEN_HEIGHT },
+		{ "small",		{ -0.5f, 0.8f, 3.5f },	LEVEL,	Precision::EXACT,	SCREEN_WIDTH / 2,	SCREEN_HEIGHT / 2 },
+		{ "turned",		{ 3.0f, 1.5f, 2.5f },	{ 45.0f, -15.0f, 60.0f },
+												Precision::EXACT,	SCREEN_WIDTH,		SCREEN_HEIGHT },
+	};
+
+	constexpr uint32_t	VIEW_COUNT	= sizeof( VIEWS ) / sizeof( VIEWS[ 0 ] );
+
+	/**
+	 * @brief ReadFile	Reads the whole file at 'path' into 'data'.
+	 */
+	bool	ReadFile( const std::string& path, std::vector< uint8_t >& data )
+	{
+		FILE*	file	= fopen( path.c_str(), "rb" );
+		if( nullptr == file )
+			return	false;
+
+		data.clear();
+		uint8_t	chunk[ 65536 ];
+		size_t	read;
+		while( ( read = fread( chunk, 1, sizeof( chunk ), file ) ) > 0 )
+			data.insert( data.end(), chunk, chunk + read );
+
+		const bool	ok	= ( 0 == ferror( file ) );
+		fclose( file );
+		return	ok;
+	}
+	////////////////////////////////////////////////////////////////////////////
+
+	/**
+	 * @brief ReadTimings	Reads the 'name milliseconds' lines of the baseline
+	 * at 'path' into 'timings', in the order of VIEWS. Views without a line
+	 * get a negative time.
+	 * @return	Returns false if the file doesn't exist.
+	 */
+	bool	ReadTimings( const std::string& path, double* timings )
+	{
+		for( uint32_t i = 0; i < VIEW_COUNT; ++i )
+			timings[ i ]	= -1.0;
+
+		FILE*	file	= fopen( path.c_str(), "r" );
+		if( nullptr == file )
+			return	false;
+
+		char	name[ 64 ];
+		double	ms;
+		while( 2 == fscanf( file, "%63s %lf", name, &ms ) )
+		{
+			for( uint32_t i = 0; i < VIEW_COUNT; ++i )
+			{
+				if( 0 == strcmp( name, VIEWS[ i ].name ) )
+					timings[ i ]	= ms;
+			}
+		}
+
+		fclose( file );
+		return	true;
+	}
+	////////////////////////////////////////////////////////////////////////////
+
+	/**
+	 * @brief WriteTimings	Writes the times of the views as the baseline at
+	 * 'path'.
+	 */
+	bool	WriteTimings( const std::string& path, const double* timings )
+	{
+		std::string	text;
+		char		line[ 96 ];
+		for( uint32_t i = 0; i < VIEW_COUNT; ++i )
+		{
+			snprintf( line, sizeof( line ), "%s %.3f\n", VIEWS[ i ].name, timings[ i ] );
+			text	+= line;
+		}
+
+		return	WriteFileAtomic( path.c_str(), std::vector< uint8_t >( text.begin(), text.end() ) );
+	}
+	////////////////////////////////////////////////////////////////////////////
+
+	/**
+	 * @brief TraceView	Traces 'view' REPETITIONS times and converts the last
+	 * frame to top down RGB8 in 'rgb'.
+	 * @return	Returns the fastest time in milliseconds.
+	 */
+	double	TraceView( Tracer& tracer, FrameBuffer& buffer, const View& view,
+					   std::vector< Vec3 >& rows, std::vector< uint8_t >& rgb )
+	{
+		const Vec3	camera( view.camera[ 0 ], view.camera[ 1 ], view.camera[ 2 ] );
+
+		tracer.SetPrecision( view.precision );
+	tracer.SetView( view.look );
+
+		double	best	= 0.0;
+		for( uint32_t i = 0; i < REPETITIONS; ++i )
+		{
+			tracer.StartFrame( camera, buffer, view.width, view.height );
+			tracer.WaitFrame();
+
+			const double	ms	= tracer.FrameTime() * 1000.0;
+			best	= ( 0 == i || ms < best ) ? ms : best;
+		}
+
+		// The frame is bottom up, images are top down.
+		const size_t	pixels	= size_t( view.width ) * view.height;
+		rows.resize( pixels );
+		rgb.resize( pixels * 3 );
+		buffer.Deswizzle( rows.data(), view.width, view.width, view.height );
+		ConvertToRgb8( rows.data() + pixels - view.width, view.width, view.height,
+					   -ptrdiff_t( view.width ), rgb.data() );
+
+		return	best;
+	}
+	////////////////////////////////////////////////////////////////////////////
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief RunGoldenCheck	Traces the views and compares them with the golden
+ * images and the timing baseline.
+ * @return	Returns the exit code of the program.
+ */
+int	RunGoldenCheck( const Options& options )
+{
+	Options	traceOptions	= options;
+	// The check is about the tracing, cached tiles would skip it.
+	traceOptions.tileCacheMb	= 0;
+	traceOptions.tileCacheDir.clear();
+
+	Tracer		tracer( traceOptions, 0 );
+	FrameBuffer	buffer( traceOptions.hugePages );
+	tracer.ClearBuffer( buffer );
+
+	const std::string	timingsPath	= options.timingsPath.empty()
+									? std::string( "timings-" ) + SIMD_NAME + ".txt" : options.timingsPath;
+	double				baseline[ VIEW_COUNT ];
+	double				timings[ VIEW_COUNT ];
+	const bool			hasBaseline	= ReadTimings( timingsPath, baseline ) && ! options.updateGolden;
+
+	fprintf( stderr, HEADER_MSG, SIMD_NAME, tracer.ThreadCount(), timingsPath.c_str() );
+
+	std::vector< Vec3 >		rows;
+	std::vector< uint8_t >	rgb;
+	std::vector< uint8_t >	file;
+	std::vector< uint8_t >	golden;
+	uint32_t				failed	= 0;
+	uint32_t				untimed	= 0;
+
+	for( uint32_t i = 0; i < VIEW_COUNT; ++i )
+	{
+		const View&			view	= VIEWS[ i ];
+		const std::string	path	= options.goldenDir + "/" + view.name + ".qoi";
+
+		timings[ i ]	= TraceView( tracer, buffer, view, rows, rgb );
+
+		if( options.updateGolden )
+		{
+			if( ! WriteFileAtomic( path.c_str(), QOI::Encode( rgb.data(), view.width, view.height ) ) )
+			{
+				fprintf( stderr, WRITE_FAILED_MSG, path.c_str() );
+				return	1;
+			}
+
+			fprintf( stderr, WRITTEN_MSG, view.name, timings[ i ], path.c_str() );
+			continue;
+		}
+
+		uint32_t	width	= 0;
+		uint32_t	height	= 0;
+		if( ! ReadFile( path, file ) || ! QOI::Decode( file.data(), file.size(), golden, width, height ) )
+		{
+			fprintf( stderr, READ_FAILED_MSG, view.name, path.c_str() );
+			++failed;
+			continue;
+		}
+
+		if( width != view.width || height != view.height )
+		{
+			fprintf( stderr, SIZE_MSG, view.name, path.c_str(), width, height, view.width, view.height );
+			++failed;
+			continue;
+		}
+
+		const size_t	pixels		= size_t( width ) * height;
+		const ImageDiff	diff		= CompareRgb8( golden.data(), rgb.data(), pixels, MAX_CHANNEL_ERROR );
+		bool			passed		= double( diff.outliers ) / pixels <= MAX_OUTLIER_FRACTION;
+
+		if( hasBaseline && baseline[ i ] > 0.0 )
+		{
+			const double	slowdown	= timings[ i ] - baseline[ i ];
+			passed	= passed && ( timings[ i ] <= baseline[ i ] * MAX_SLOWDOWN || slowdown < MIN_SLOWDOWN_MS );
+
+			fprintf( stderr, VIEW_MSG, view.name, timings[ i ], baseline[ i ], diff.maxError, diff.outliers,
+					 MAX_CHANNEL_ERROR, passed ? "ok" : "FAILED" );
+		}
+		else
+		{
+			fprintf( stderr, NO_BASELINE_MSG, view.name, timings[ i ], diff.maxError, diff.outliers,
+					 MAX_CHANNEL_ERROR, passed ? "ok" : "FAILED" );
+			++untimed;
+		}
+
+		failed	+= passed ? 0 : 1;
+	}
+
+	// A missing baseline is recorded by the first run, it belongs to the
+	// machine and its views are not timed.
+	if( ! hasBaseline && 0 == failed )
+	{
+		if( ! WriteTimings( timingsPath, timings ) )
+		{
+			fprintf( stderr, WRITE_FAILED_MSG, timingsPath.c_str() );
+			return	1;
+		}
+
+		fprintf( stderr, RECORDED_MSG, timingsPath.c_str() );
+	}
+
+	if( 0 != failed )
+	{
+		fprintf( stderr, FAILED_MSG, failed, VIEW_COUNT );
+		return	1;
+	}
+
+	if( 0 != untimed )
+		fprintf( stderr, NO_TIMING_MSG, untimed, VIEW_COUNT );
+	else
+		fprintf( stderr, PASSED_MSG );
+
+	return	0;
+}
+////////////////////////////////////////////////////////////////////////////////
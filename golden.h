@@ -0,0 +1,34 @@
+
+#ifndef GOLDEN_H
+#define GOLDEN_H
+
+////////////////////////////////////////////////////////////////////////////////
+
+#include "options.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Regression check of the traced images and their trace times.
+ *
+ * Traces a fixed set of views (camera, precision and frame size) and compares
+ * each with its golden image '<name>.qoi' in 'options.goldenDir'. A view
+ * fails when more pixels than the budget differ by more than the per channel
+ * tolerance. The golden images do not depend on the SIMD backend, so every
+ * build (see SIMD_NAME) is checked against the same files.
+ *
+ * The best trace time of every view is compared with the baseline of the
+ * backend in 'options.timingsPath', 'timings-<backend>.txt' in the working
+ * directory by default, and a view that got slower than the allowed factor
+ * fails as well. The baselines depend on the machine and stay out of the
+ * source tree. A missing one is recorded by the first run, which reports that
+ * the views were not timed.
+ *
+ * With 'options.updateGolden' the images and the baseline are written instead.
+ * Returns 0 if every view passed and 1 otherwise.
+ */
+int	RunGoldenCheck( const Options& options );
+
+////////////////////////////////////////////////////////////////////////////////
+
+#endif // GOLDEN_H
@@ -4,14 +4,25 @@
 
 ////////////////////////////////////////////////////////////////////////////////
 
+#include <algorithm>
+#include <array>
 #include <limits>
 
+#include "impostor.h"
 #include "ray.h"
 #include "simd.h"
 
 ////////////////////////////////////////////////////////////////////////////////
 
-const Vec3	HASH_CONST	= Vec3( 3.5353123f, 4.1459123f, 1.3490423f );
+const Vec3	HASH_CONST			= Vec3( 3.5353123f, 4.1459123f, 1.3490423f );
+const Vec3	BACKGROUND_COLOR	= Vec3( 0.178f, 0.461f, 0.853f );
+
+// Number of entries of the level color table, deeper hits use the last one.
+constexpr uint32_t	COLOR_LEVELS	= 128;
+// Hits on the impostor of a subtree have this plus the subtree's level, the
+// color table has an entry for each after the level colors.
+constexpr uint32_t	IMPOSTOR_LEVEL	= COLOR_LEVELS;
+constexpr uint32_t	COLOR_ENTRIES	= IMPOSTOR_LEVEL + COLOR_LEVELS;
 
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -20,8 +31,8 @@ const Vec3	HASH_CONST	= Vec3( 3.5353123f, 4.1459123f, 1.3490423f );
  * ray tracing.
  * Min and Max are used to filter hits that are too far or too close.
  * Result stores the resulting hit. Default value -1.0f, means no hit detected.
- * SphereCenter is used to store the center of the sphere that was hit.
- * Radius is used to store the radius of the hit sphere.
+ * Level is the depth of the hit sphere, plus IMPOSTOR_LEVEL when an impostor
+ * was hit (see SphereLevel).
  */
 struct HitRecord
 {
@@ -32,7 +43,6 @@ struct HitRecord
 		: result( -1.f )
 		, min( min )
 		, max( max )
-		, radius( 0.f )
 		, level( -1.0f )
 	{}
 
@@ -42,31 +52,88 @@ struct HitRecord
 	 */
 	Vec3	extractColor( const Ray& ray, uint32_t index )
 	{
-		const float&	recordResult	= result.Extract( index );
-		const float&	levelResult		= level.Extract( index );
-		const Vec3&		dir				= ray.direction().Extract( index );
-		const Vec3&		origin			= ray.origin().Extract( index );
+		return	Color( result.Extract( index ), level.Extract( index ),
+					   ray.origin().Extract( index ), ray.direction().Extract( index ) );
+	}
+
+	/**
+	 * @brief Shade	Calculate the colors of all the lanes at once, the SIMD
+	 * version of Color.
+	 */
+	SIMD::Vec	Shade( const Ray& ray )	const
+	{
+		const SIMD::bool_t	hit		= result.GreaterOrEqualThan( DEFAULT_MIN );
+		const SIMD::Vec		col		= SIMD::Gather( LevelColors(), level, COLOR_ENTRIES );
+		const SIMD::float_t	y		= SIMD::GetY( ray.origin() ) + SIMD::GetY( ray.direction() ) * result;
+		const SIMD::float_t	scale	= SIMD::float_t( 1.0f ) / ( SIMD::float_t( STARTING_RADIUS ) + y );
+
+		return	SIMD::PickBasedOnCondition( hit, col.MultiplyByFloat( scale ), SIMD::Vec( BACKGROUND_COLOR ) );
+	}
 
+	/**
+	 * @brief Color	Calculate color of a single hit. 'recordResult' and
+	 * 'levelResult' are one lane of result and level.
+	 */
+	static Vec3	Color( float recordResult, float levelResult,
+					   const Vec3& origin, const Vec3& dir )
+	{
 		if( HitRecord::DEFAULT_MIN > recordResult )
-			return	Vec3( 0.178f, 0.461f, 0.853f );
+			return	BACKGROUND_COLOR;
 
-		Vec3	col( sinf( levelResult + 0 ),
-					 sinf( levelResult + 1 ),
-					 sinf( levelResult + 2 ) );
+		const uint32_t	index	= ( levelResult < COLOR_ENTRIES - 1 ) ? static_cast< uint32_t >( levelResult ) : COLOR_ENTRIES - 1;
+		Vec3			point	= origin + dir * recordResult;
+		float			div		= STARTING_RADIUS + point.y;
 
-		col	*= HASH_CONST;
+		return	LevelColors()[ index ] * ( 1.0f / div );
+	}
 
-		Vec3	point	= origin + dir * recordResult;
-		float	div		= STARTING_RADIUS + point.y;
+	/**
+	 * @brief SphereLevel	Returns the depth of the sphere or subtree hit with
+	 * 'levelResult', without the impostor offset.
+	 */
+	static uint32_t	SphereLevel( float levelResult )
+	{
+		const uint32_t	level	= static_cast< uint32_t >( levelResult );
+		return	( level >= IMPOSTOR_LEVEL ) ? level - IMPOSTOR_LEVEL : level;
+	}
 
-		return	col / div;
+	/**
+	 * @brief LevelColors	Returns the colors of the levels before the division
+	 * by the hit height, COLOR_LEVELS entries, followed by the colors of the
+	 * impostors of the subtrees at each level, the level colors below them
+	 * mixed by the weights of the ImpostorModel. COLOR_ENTRIES in total.
+	 * Computed on first use.
+	 */
+	static const Vec3*	LevelColors()
+	{
+		static const std::array< Vec3, COLOR_ENTRIES >	colors	= []()
+		{
+			std::array< Vec3, COLOR_ENTRIES >	table;
+			for( uint32_t i = 0; i < COLOR_LEVELS; ++i )
+			{
+				const float	level	= float( i );
+				table[ i ]	= Vec3( sinf( level + 0 ), sinf( level + 1 ), sinf( level + 2 ) ) * HASH_CONST;
+			}
+
+			const ImpostorModel&	model	= GetImpostorModel();
+			for( uint32_t i = 0; i < COLOR_LEVELS; ++i )
+			{
+				Vec3	mixed;
+				for( uint32_t k = 0; k < IMPOSTOR_LEVELS; ++k )
+					mixed	+= table[ std::min( i + k, COLOR_LEVELS - 1 ) ] * model.weights[ k ];
+
+				table[ IMPOSTOR_LEVEL + i ]	= mixed;
+			}
+
+			return	table;
+		}();
+
+		return	colors.data();
 	}
 
-	SIMD::Vec		sphereCenter;
 	SIMD::float_t	result;
 	SIMD::float_t	min;
 	SIMD::float_t	max;
-	SIMD::float_t	radius;
 	SIMD::float_t	level;
 };
 ////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,147 @@
+
+#include <algorithm>
+#include <string>
+
+#include <stdio.h>
+
+#include "image.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+constexpr char	TEMP_SUFFIX[]		= ".tmp";
+constexpr size_t	MAX_PATH_LENGTH		= 4096;
+
+////////////////////////////////////////////////////////////////////////////////
+
+static inline
+uint8_t	ToByte( float v )
+{
+	if( !( v > 0.0f ) )
+		return	0;
+	if( v >= 1.0f )
+		return	255;
+
+	return	static_cast< uint8_t >( v * 255.0f + 0.5f );
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief ConvertToRgb8	Converts float colors to tightly packed RGB8, clamping
+ * to [0, 1] the same way the texture upload does.
+ * @param stride	Number of pixels between two rows in 'src'. A negative stride
+ *					with 'src' pointing to the last row flips the image.
+ */
+void	ConvertToRgb8( const Vec3* src, uint32_t width, uint32_t height,
+					   ptrdiff_t stride, uint8_t* dst )
+{
+	for( uint32_t y = 0; y < height; ++y )
+	{
+		const Vec3*	row	= src + ptrdiff_t( y ) * stride;
+		for( uint32_t x = 0; x < width; ++x )
+		{
+			*dst++	= ToByte( row[ x ].x );
+			*dst++	= ToByte( row[ x ].y );
+			*dst++	= ToByte( row[ x ].z );
+		}
+	}
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief ConvertToRgb8	Converts the screen in 'buffer' to tightly packed RGB8
+ * in row order. With 'flip' the last row comes first.
+ */
+void	ConvertToRgb8( const FrameBuffer& buffer, bool flip, uint8_t* dst )
+{
+	for( uint32_t y = 0; y < FrameBuffer::HEIGHT; ++y )
+	{
+		const uint32_t	row	= flip ? FrameBuffer::HEIGHT - 1 - y : y;
+		for( uint32_t x = 0; x < FrameBuffer::WIDTH; x += TILE_SIZE )
+		{
+			const uint32_t	width	= std::min( TILE_SIZE, FrameBuffer::WIDTH - x );
+			ConvertToRgb8( buffer.Pixel( x, row ), width, 1, 0, dst );
+			dst	+= width * 3;
+		}
+	}
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief CompareRgb8	Compares two RGB8 images of 'pixels' pixels channel by
+ * channel. Pixels with a channel that differs by more than 'tolerance' are
+ * counted as outliers.
+ */
+ImageDiff	CompareRgb8( const uint8_t* a, const uint8_t* b, size_t pixels, uint32_t tolerance )
+{
+	ImageDiff	diff;
+	for( size_t i = 0; i < pixels; ++i )
+	{
+		uint32_t	pixelError	= 0;
+		for( uint32_t c = 0; c < 3; ++c, ++a, ++b )
+		{
+			const uint32_t	error	= ( *a > *b ) ? *a - *b : *b - *a;
+			pixelError	= ( error > pixelError ) ? error : pixelError;
+		}
+
+		diff.maxError	= ( pixelError > diff.maxError ) ? pixelError : diff.maxError;
+		if( pixelError > tolerance )
+			++diff.outliers;
+	}
+
+	return	diff;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief FileExists	Returns true if 'path' can be opened for reading.
+ */
+bool	FileExists( const char* const path )
+{
+	FILE*	file	= fopen( path, "rb" );
+	if( nullptr == file )
+		return	false;
+
+	fclose( file );
+	return	true;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief FramePath	Formats the file name of frame 'index' with the printf
+ * pattern 'pattern'.
+ * @return	Returns an empty string if the pattern is invalid.
+ */
+std::string	FramePath( const std::string& pattern, uint32_t index )
+{
+	char	path[ MAX_PATH_LENGTH ];
+	int		length	= snprintf( path, sizeof( path ), pattern.c_str(), index );
+	if( length <= 0 || size_t( length ) >= sizeof( path ) )
+		return	std::string();
+
+	return	path;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief WriteFileAtomic	Writes 'data' to a temporary file and renames it to
+ * 'path', so a partially written file never has the final name.
+ */
+bool	WriteFileAtomic( const char* const path, const std::vector< uint8_t >& data )
+{
+	const std::string	temp	= std::string( path ) + TEMP_SUFFIX;
+
+	FILE*	file	= fopen( temp.c_str(), "wb" );
+	if( nullptr == file )
+		return	false;
+
+	const bool	written	= data.size() == fwrite( data.data(), 1, data.size(), file );
+	if( 0 != fclose( file ) || ! written )
+	{
+		remove( temp.c_str() );
+		return	false;
+	}
+
+	return	0 == rename( temp.c_str(), path );
+}
+////////////////////////////////////////////////////////////////////////////////
+
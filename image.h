@@ -0,0 +1,41 @@
+
+#ifndef IMAGE_H
+#define IMAGE_H
+
+////////////////////////////////////////////////////////////////////////////////
+
+#include <string>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "framebuffer.h"
+#include "vec3.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief The ImageDiff struct is the result of CompareRgb8.
+ * maxError		Largest difference of a single channel.
+ * outliers		Number of pixels with a channel that differs by more than the
+ *				tolerance.
+ */
+struct ImageDiff
+{
+	uint32_t	maxError	= 0;
+	size_t		outliers	= 0;
+};
+////////////////////////////////////////////////////////////////////////////////
+
+void		ConvertToRgb8( const Vec3* src, uint32_t width, uint32_t height,
+						   ptrdiff_t stride, uint8_t* dst );
+void		ConvertToRgb8( const FrameBuffer& buffer, bool flip, uint8_t* dst );
+ImageDiff	CompareRgb8( const uint8_t* a, const uint8_t* b, size_t pixels, uint32_t tolerance );
+bool		FileExists( const char* const path );
+std::string	FramePath( const std::string& pattern, uint32_t index );
+bool		WriteFileAtomic( const char* const path, const std::vector< uint8_t >& data );
+
+////////////////////////////////////////////////////////////////////////////////
+
+#endif // IMAGE_H
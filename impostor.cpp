@@ -0,0 +1,130 @@
+
+#include <math.h>
+
+#include "hitrecord.h"
+#include "ray.h"
+#include "simd.h"
+#include "sphereflake.h"
+
+#include "impostor.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+// The subtree is looked at from this many directions spread evenly over the
+// sphere, from this many root radii away, through a grid of this many rays
+// per side over its bounds. The rays are almost parallel, and the narrow
+// field of view keeps the spheres down to level 5 over the pixel cull, the
+// deepest level stands for the spheres below it.
+constexpr uint32_t	MODEL_DIRECTIONS	= 64;
+constexpr float		MODEL_DISTANCE		= 16.0f;
+constexpr float		MODEL_TAN_HALF_FOV	= 1.0f / 16.0f;
+constexpr uint32_t	MODEL_GRID			= 32;
+
+static_assert( 0 == MODEL_GRID % SIMD::SIZE, "The grid rows are traced in whole packets" );
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+	/**
+	 * @brief MeasureModel	Traces the whole fractal as a stand in for every
+	 * subtree and counts the hits per level.
+	 */
+	ImpostorModel	MeasureModel()
+	{
+		// Impostors are off until SetImpostorPixels, so this traces the spheres.
+		SphereFlake	sphereFlake;
+		sphereFlake.SetFieldOfView( MODEL_TAN_HALF_FOV );
+
+		// Twice the root radius, the bounds of the traversal.
+		constexpr float	BOUNDS	= 2.0f;
+		constexpr float	GOLDEN	= 2.39996323f;
+
+		uint64_t	inBounds	= 0;
+		uint64_t	hits		= 0;
+		uint64_t	levels[ IMPOSTOR_LEVELS ]	= {};
+
+		for( uint32_t d = 0; d < MODEL_DIRECTIONS; ++d )
+		{
+			// Fibonacci sphere.
+			const float	z		= 1.0f - 2.0f * ( float( d ) + 0.5f ) / MODEL_DIRECTIONS;
+			const float	r		= sqrtf( 1.0f - z * z );
+			const float	phi		= GOLDEN * float( d );
+			const Vec3	toward( r * cosf( phi ), r * sinf( phi ), z );
+
+			const Vec3	helper	= ( fabsf( toward.y ) < 0.9f ) ? Vec3( 0.0f, 1.0f, 0.0f ) : Vec3( 1.0f, 0.0f, 0.0f );
+			const Vec3	u		= helper.cross( toward ).Normalized();
+			const Vec3	v		= toward.cross( u );
+			const Vec3	camera	= toward * ( MODEL_DISTANCE * STARTING_RADIUS );
+
+			for( uint32_t y = 0; y < MODEL_GRID; ++y )
+			{
+				for( uint32_t x = 0; x < MODEL_GRID; x += SIMD::SIZE )
+				{
+					float	dx[ SIMD::SIZE ];
+					float	dy[ SIMD::SIZE ];
+					float	dz[ SIMD::SIZE ];
+					bool	bounded[ SIMD::SIZE ];
+
+					for( uint32_t k = 0; k < SIMD::SIZE; ++k )
+					{
+						const float	a		= ( ( float( x + k ) + 0.5f ) / MODEL_GRID * 2.0f - 1.0f ) * BOUNDS;
+						const float	b		= ( ( float( y ) + 0.5f ) / MODEL_GRID * 2.0f - 1.0f ) * BOUNDS;
+						const Vec3	target	= ( u * a + v * b ) * STARTING_RADIUS;
+						const Vec3	dir		= ( target - camera ).Normalized();
+
+						// Distance of the ray from the center of the fractal.
+						const Vec3	closest	= camera.cross( dir );
+						bounded[ k ]	= closest.dot( closest ) < BOUNDS * BOUNDS * STARTING_RADIUS * STARTING_RADIUS;
+
+						dx[ k ]	= dir.x;
+						dy[ k ]	= dir.y;
+						dz[ k ]	= dir.z;
+					}
+
+					const Ray	ray( camera, SIMD::Vec( SIMD::float_t::Load( dx ), SIMD::float_t::Load( dy ),
+														SIMD::float_t::Load( dz ) ) );
+					HitRecord	records;
+					sphereFlake.Intersect( ray, records );
+
+					for( uint32_t k = 0; k < SIMD::SIZE; ++k )
+					{
+						if( ! bounded[ k ] )
+							continue;
+
+						++inBounds;
+						if( records.result.Extract( k ) < HitRecord::DEFAULT_MIN )
+							continue;
+
+						const uint32_t	level	= static_cast< uint32_t >( records.level.Extract( k ) );
+						++hits;
+						++levels[ ( level < IMPOSTOR_LEVELS ) ? level : IMPOSTOR_LEVELS - 1 ];
+					}
+				}
+			}
+		}
+
+		ImpostorModel	model;
+		model.coverage	= float( double( hits ) / double( inBounds ) );
+		model.radius	= BOUNDS * sqrtf( model.coverage );
+		for( uint32_t i = 0; i < IMPOSTOR_LEVELS; ++i )
+			model.weights[ i ]	= float( double( levels[ i ] ) / double( hits ) );
+
+		return	model;
+	}
+	////////////////////////////////////////////////////////////////////////////
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief GetImpostorModel	Returns the impostor model of the fractal, measured
+ * on first use. It depends only on the fractal parameters, the same model is
+ * measured by every run.
+ */
+const ImpostorModel&	GetImpostorModel()
+{
+	static const ImpostorModel	model	= MeasureModel();
+	return	model;
+}
+////////////////////////////////////////////////////////////////////////////////
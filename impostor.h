@@ -0,0 +1,43 @@
+
+#ifndef IMPOSTOR_H
+#define IMPOSTOR_H
+
+////////////////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Levels below the root of a subtree that the model tells apart, deeper hits
+// count for the last one.
+constexpr uint32_t	IMPOSTOR_LEVELS	= 6;
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief The ImpostorModel struct describes how a subtree of the fractal
+ * looks from afar, averaged over all directions. Every subtree is the same as
+ * the whole fractal scaled down, so one model holds for all of them.
+ *
+ * coverage	Share of the rays into the bounds of the subtree (twice the radius
+ *			of its root sphere) that hit one of its spheres.
+ * radius	Radius of the impostor sphere in root radii, it covers the same
+ *			share of the bounds.
+ * weights	Share of the hits on each level below the root, they add up to 1.
+ *
+ * A subtree drawn as an impostor is a single sphere of 'radius' with the
+ * level colors mixed by 'weights' (see HitRecord::LevelColors).
+ */
+struct ImpostorModel
+{
+	float	coverage;
+	float	radius;
+	float	weights[ IMPOSTOR_LEVELS ];
+};
+////////////////////////////////////////////////////////////////////////////////
+
+const ImpostorModel&	GetImpostorModel();
+
+////////////////////////////////////////////////////////////////////////////////
+
+#endif // IMPOSTOR_H
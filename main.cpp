@@ -1,17 +1,75 @@
 
 #include <iostream>
 
+#include "batch.h"
+#include "benchmark.h"
+#include "golden.h"
+#include "options.h"
+#include "precisioncheck.h"
+#include "scene.h"
+#include "splatcheck.h"
 #include "window.h"
 
+#if defined( __linux__ )
+#include "distributed.h"
+#include "server.h"
+#endif
+
 ////////////////////////////////////////////////////////////////////////////////
 
 #define APP_NAME "SphereFlake"
 
 ////////////////////////////////////////////////////////////////////////////////
 
-int	main( int, char** )
+int	main( int argc, char** argv )
 {
-	Window	win( APP_NAME );
+	Options	options;
+	if( ! ParseOptions( argc, argv, options ) )
+	{
+		PrintUsage( argv[ 0 ] );
+		return	1;
+	}
+
+	// Loaded once, the tracers of every mode share it.
+	if( ! options.scenePath.empty() )
+	{
+		std::shared_ptr< Scene >	scene( new Scene() );
+		if( ! scene->Load( options.scenePath.c_str() ) )
+			return	1;
+
+		options.scene	= scene;
+	}
+
+	if( Mode::BATCH == options.mode )
+		return	RunBatch( options );
+
+	if( Mode::PRECISION == options.mode )
+		return	RunPrecisionCheck( options );
+
+	if( Mode::GOLDEN == options.mode )
+		return	RunGoldenCheck( options );
+
+	if( Mode::BENCHMARK == options.mode )
+		return	RunBenchmark( options );
+
+	if( Mode::SPLAT_CHECK == options.mode )
+		return	RunSplatCheck( options );
+
+#if defined( __linux__ )
+	if( Mode::COORDINATOR == options.mode )
+		return	RunCoordinator( options );
+
+	if( Mode::WORKER == options.mode )
+		return	RunWorker( options );
+
+	if( Mode::SERVER == options.mode )
+		return	RunServer( options );
+
+	if( Mode::QUERY == options.mode )
+		return	RunQuery( options );
+#endif
+
+	Window	win( APP_NAME, options );
 	win.run();
 
 	return	0;
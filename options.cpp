@@ -0,0 +1,461 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "aov.h"
+#include "options.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+constexpr char	UNKNOWN_OPTION_MSG[]	= "Unknown option: %s\n";
+constexpr char	MISSING_VALUE_MSG[]		= "Missing value for option: %s\n";
+constexpr char	INVALID_VALUE_MSG[]		= "Invalid value for option: %s\n";
+
+constexpr char	USAGE_MSG[]				=
+	"Usage: %s [options]\n"
+	"  --threads <n>      Number of render threads (default: CPUs - 1).\n"
+	"  --no-pin           Do not pin the render threads to CPUs.\n"
+	"  --no-smt           Use at most one render thread per physical core.\n"
+	"  --no-hugepages     Do not use huge pages for the frame buffer.\n"
+	"  --stream           Regroup diverging rays into full SIMD packets.\n"
+	"  --no-vsync         Pace the window with a timer instead of vsync.\n"
+	"  --tile-order <o>   Order of the tiles: rows, center, focus (mouse\n"
+	"                     cursor), error (most changed) or age (default: center).\n"
+	"  --target-ms <ms>   Lower the resolution while moving to trace a frame\n"
+	"                     in <ms> (default: off).\n"
+	"  --min-scale <s>    Lowest resolution scale for --target-ms (default: 0.25).\n"
+	"  --fast-math        Use the approximate reciprocal square root.\n"
+	"  --tile-cache <mb>  Keep up to <mb> megabytes of traced tiles and copy\n"
+	"                     them when a view comes back (default: off).\n"
+	"  --tile-cache-dir <dir>\n"
+	"                     Also keep the tiles in <dir> across runs (256 MB in\n"
+	"                     memory unless --tile-cache is given).\n"
+	"  --deep-zoom        Keep deep close-ups exact by tracing the spheres\n"
+	"                     around the camera from a path computed in double.\n"
+	"  --zoom-path <c,c,...>\n"
+	"                     Deep zoom with the camera (and --camera) in the\n"
+	"                     frame of the sphere reached by these child indices\n"
+	"                     (0-8) from the root.\n"
+	"  --look <yaw,pitch> Direction of the camera in degrees, yaw turns left\n"
+	"                     and pitch looks up (default: 0,0, down -z).\n"
+	"  --fov <degrees>    Horizontal field of view (default: 90).\n"
+	"  --impostor-pixels <p>\n"
+	"                     Draw the subtrees of spheres with a radius under <p>\n"
+	"                     pixels as one averaged sphere, 0 drops the spheres\n"
+	"                     under a pixel instead (default: 2).\n"
+	"  --no-occlusion-cull\n"
+	"                     Trace the subtrees hidden behind their parent too,\n"
+	"                     to measure the cull.\n"
+	"  --splat            Splat the spheres onto the screen instead of tracing\n"
+	"                     the rays down the hierarchy.\n"
+	"  --perf-counters    Count IPC, cache and branch misses and vector\n"
+	"                     instructions of every render thread per frame.\n"
+	"  --scene <file>     Trace the flakes placed by the lines \"x y z scale\n"
+	"                     [yaw pitch roll]\" of <file> instead of one flake\n"
+	"                     at the origin.\n"
+	"  --check-precision  Compare a --fast-math frame at --camera against the\n"
+	"                     exact one and exit.\n"
+	"  --check-splat      Compare --splat frames at --camera against traced\n"
+	"                     ones at 1x, 2x and 4x the screen size and exit.\n"
+	"  --help             Print this message.\n"
+	"\n"
+	"Capturing (window):\n"
+	"  --capture <pattern>      printf pattern of the frames recorded with F9\n"
+	"                           (default: capture_%%05u.qoi).\n"
+	"  --screenshot <pattern>   printf pattern of the F12 screenshots\n"
+	"                           (default: screenshot_%%03u.qoi).\n"
+	"  --capture-threads <n>    Threads encoding captured frames (default: 2).\n"
+	"\n"
+	"Distributed rendering (Linux only):\n"
+	"  --coordinator <address>  Render one frame by handing out tiles to\n"
+	"                           workers connecting to <address>\n"
+	"                           (unix:<path> or <host>:<port>).\n"
+	"  --worker <address>       Trace tiles for the coordinator at <address>.\n"
+	"  --spawn-workers <n>      Start <n> local worker processes.\n"
+	"  --tile-timeout <ms>      Give a tile to another worker after <ms>\n"
+	"                           (default: 5000).\n"
+	"  --output <path>          Image written by the coordinator (QOI).\n"
+	"  --camera <x,y,z>         Camera position (default: 0,0,5).\n"
+	"\n"
+	"Render server (Linux only):\n"
+	"  --server <address>       Answer image requests on <address> until\n"
+	"                           interrupted.\n"
+	"  --query <address>        Request the image at --camera from the server\n"
+	"                           at <address>, write it to --output and print\n"
+	"                           the server statistics.\n"
+	"  --size <w>x<h>           Size of the queried image (default: 800x600).\n"
+	"  --quality <q>            full, fast or preview (half resolution)\n"
+	"                           (default: full).\n"
+	"\n"
+	"Batch rendering:\n"
+	"  --batch <keyframes>      Render the camera path in <keyframes> (lines\n"
+	"                           of \"time x y z\") without a window.\n"
+	"  --sequence <pattern>     printf pattern of the frame files\n"
+	"                           (default: frame_%%05u.qoi).\n"
+	"  --fps <n>                Frames per second (default: 30).\n"
+	"  --aov <channels>         Also write the comma separated channels depth,\n"
+	"                           level, id and normal of every frame.\n"
+	"\n"
+	"Regression check:\n"
+	"  --golden <dir>           Trace fixed views, compare them with the golden\n"
+	"                           images in <dir> and their times with the\n"
+	"                           baseline of this build's SIMD backend.\n"
+	"  --timings <path>         Timing baseline of the golden check (default:\n"
+	"                           timings-<backend>.txt in the working directory).\n"
+	"  --update-golden          Write the golden images and the baseline\n"
+	"                           instead.\n"
+	"\n"
+	"Kernel benchmark:\n"
+	"  --bench                  Measure SphereIntersect, the ray generation,\n"
+	"                           extractColor and Shade in isolation with this\n"
+	"                           build's SIMD backend and --fast-math, and exit.\n"
+	"  --bench-reps <n>         Timed samples per case (default: 21).\n";
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief ParseVec3	Parses a vector written as "x,y,z".
+ */
+static
+bool	ParseVec3( const char* const str, Vec3& v )
+{
+	return	3 == sscanf( str, "%f,%f,%f", &v.x, &v.y, &v.z );
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief ParseLook	Parses the yaw and pitch of 'view' written as
+ * "yaw,pitch" in degrees, the pitch at most MAX_PITCH up or down.
+ */
+static
+bool	ParseLook( const char* const str, CameraView& view )
+{
+	if( 2 != sscanf( str, "%f,%f", &view.yaw, &view.pitch ) )
+		return	false;
+
+	return	view.pitch >= -MAX_PITCH && view.pitch <= MAX_PITCH;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief ParseSize	Parses a size written as "<w>x<h>", both at most the
+ * screen size.
+ */
+static
+bool	ParseSize( const char* const str, uint32_t& width, uint32_t& height )
+{
+	if( 2 != sscanf( str, "%ux%u", &width, &height ) )
+		return	false;
+
+	return	width > 0 && width <= SCREEN_WIDTH && height > 0 && height <= SCREEN_HEIGHT;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief ParseZoomPath	Parses child indices written as "c,c,...", shorter than
+ * the deepest level.
+ */
+static
+bool	ParseZoomPath( const char* str, std::vector< uint8_t >& path )
+{
+	path.clear();
+	for(;;)
+	{
+		char*				end;
+		const unsigned long	child	= strtoul( str, &end, 10 );
+		if( end == str || child >= TOTAL_NUMBER_OF_SPHERES || path.size() + 1 >= GetMaxDepth() )
+			return	false;
+
+		path.push_back( static_cast< uint8_t >( child ) );
+		if( '\0' == *end )
+			return	true;
+		if( ',' != *end )
+			return	false;
+
+		str	= end + 1;
+	}
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief ParseQuality	Parses the name of a Quality.
+ */
+static
+bool	ParseQuality( const char* const str, Quality& quality )
+{
+	if( 0 == strcmp( str, "full" ) )
+		quality	= Quality::FULL;
+	else if( 0 == strcmp( str, "fast" ) )
+		quality	= Quality::FAST;
+	else if( 0 == strcmp( str, "preview" ) )
+		quality	= Quality::PREVIEW;
+	else
+		return	false;
+
+	return	true;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief ParseOptions	Parses the command line arguments into 'options'.
+ * @return	Returns false if the arguments are invalid or help was requested.
+ */
+bool	ParseOptions( int argc, char** argv, Options& options )
+{
+	for( int i = 1; i < argc; ++i )
+	{
+		const char* const	arg		= argv[ i ];
+		const bool			hasNext	= i + 1 < argc;
+
+		auto	next	= [ & ]() { return	argv[ ++i ]; };
+
+		// Options that need a value.
+		const char* const	VALUE_OPTIONS[]	=
+		{
+			"--threads", "--coordinator", "--worker", "--spawn-workers",
+			"--tile-timeout", "--output", "--camera", "--batch", "--sequence",
+			"--fps", "--target-ms", "--min-scale", "--tile-order", "--aov",
+			"--capture", "--screenshot", "--capture-threads", "--server",
+			"--query", "--size", "--quality", "--tile-cache", "--tile-cache-dir",
+			"--golden", "--timings", "--bench-reps", "--zoom-path", "--look", "--fov",
+			"--impostor-pixels", "--scene",
+		};
+
+		for( const char* const option : VALUE_OPTIONS )
+		{
+			if( 0 == strcmp( arg, option ) && ! hasNext )
+			{
+				fprintf( stderr, MISSING_VALUE_MSG, arg );
+				return	false;
+			}
+		}
+
+		if( 0 == strcmp( arg, "--threads" ) )
+			options.threadCount		= static_cast< uint32_t >( strtoul( next(), nullptr, 10 ) );
+		else if( 0 == strcmp( arg, "--coordinator" ) )
+		{
+			options.mode			= Mode::COORDINATOR;
+			options.address			= next();
+		}
+		else if( 0 == strcmp( arg, "--worker" ) )
+		{
+			options.mode			= Mode::WORKER;
+			options.address			= next();
+		}
+		else if( 0 == strcmp( arg, "--spawn-workers" ) )
+			options.spawnWorkers	= static_cast< uint32_t >( strtoul( next(), nullptr, 10 ) );
+		else if( 0 == strcmp( arg, "--tile-timeout" ) )
+			options.tileTimeout		= static_cast< uint32_t >( strtoul( next(), nullptr, 10 ) );
+		else if( 0 == strcmp( arg, "--output" ) )
+			options.output			= next();
+		else if( 0 == strcmp( arg, "--camera" ) )
+		{
+			if( ! ParseVec3( next(), options.camera ) )
+			{
+				fprintf( stderr, INVALID_VALUE_MSG, arg );
+				return	false;
+			}
+		}
+		else if( 0 == strcmp( arg, "--server" ) )
+		{
+			options.mode			= Mode::SERVER;
+			options.address			= next();
+		}
+		else if( 0 == strcmp( arg, "--query" ) )
+		{
+			options.mode			= Mode::QUERY;
+			options.address			= next();
+		}
+		else if( 0 == strcmp( arg, "--size" ) )
+		{
+			if( ! ParseSize( next(), options.imageWidth, options.imageHeight ) )
+			{
+				fprintf( stderr, INVALID_VALUE_MSG, arg );
+				return	false;
+			}
+		}
+		else if( 0 == strcmp( arg, "--quality" ) )
+		{
+			if( ! ParseQuality( next(), options.quality ) )
+			{
+				fprintf( stderr, INVALID_VALUE_MSG, arg );
+				return	false;
+			}
+		}
+		else if( 0 == strcmp( arg, "--batch" ) )
+		{
+			options.mode			= Mode::BATCH;
+			options.cameraPath		= next();
+		}
+		else if( 0 == strcmp( arg, "--sequence" ) )
+			options.sequence		= next();
+		else if( 0 == strcmp( arg, "--fps" ) )
+		{
+			options.fps				= strtof( next(), nullptr );
+			if( !( options.fps > 0.0f ) )
+			{
+				fprintf( stderr, INVALID_VALUE_MSG, arg );
+				return	false;
+			}
+		}
+		else if( 0 == strcmp( arg, "--aov" ) )
+		{
+			if( ! ParseAovChannels( next(), options.aovChannels ) )
+			{
+				fprintf( stderr, INVALID_VALUE_MSG, arg );
+				return	false;
+			}
+		}
+		else if( 0 == strcmp( arg, "--no-pin" ) )
+			options.pinThreads	= false;
+		else if( 0 == strcmp( arg, "--no-smt" ) )
+			options.useSmt		= false;
+		else if( 0 == strcmp( arg, "--no-hugepages" ) )
+			options.hugePages	= false;
+		else if( 0 == strcmp( arg, "--stream" ) )
+			options.streamRays	= true;
+		else if( 0 == strcmp( arg, "--no-vsync" ) )
+			options.vsync		= false;
+		else if( 0 == strcmp( arg, "--tile-order" ) )
+		{
+			if( ! ParseTileOrder( next(), options.tileOrder ) )
+			{
+				fprintf( stderr, INVALID_VALUE_MSG, arg );
+				return	false;
+			}
+		}
+		else if( 0 == strcmp( arg, "--target-ms" ) )
+		{
+			options.targetFrameMs	= strtof( next(), nullptr );
+			if( !( options.targetFrameMs > 0.0f ) )
+			{
+				fprintf( stderr, INVALID_VALUE_MSG, arg );
+				return	false;
+			}
+		}
+		else if( 0 == strcmp( arg, "--min-scale" ) )
+		{
+			options.minScale		= strtof( next(), nullptr );
+			if( !( options.minScale > 0.0f && options.minScale <= 1.0f ) )
+			{
+				fprintf( stderr, INVALID_VALUE_MSG, arg );
+				return	false;
+			}
+		}
+		else if( 0 == strcmp( arg, "--capture" ) )
+			options.capture			= next();
+		else if( 0 == strcmp( arg, "--screenshot" ) )
+			options.screenshot		= next();
+		else if( 0 == strcmp( arg, "--capture-threads" ) )
+		{
+			options.captureThreads	= static_cast< uint32_t >( strtoul( next(), nullptr, 10 ) );
+			if( 0 == options.captureThreads )
+			{
+				fprintf( stderr, INVALID_VALUE_MSG, arg );
+				return	false;
+			}
+		}
+		else if( 0 == strcmp( arg, "--tile-cache" ) )
+		{
+			options.tileCacheMb		= static_cast< uint32_t >( strtoul( next(), nullptr, 10 ) );
+			if( 0 == options.tileCacheMb )
+			{
+				fprintf( stderr, INVALID_VALUE_MSG, arg );
+				return	false;
+			}
+		}
+		else if( 0 == strcmp( arg, "--tile-cache-dir" ) )
+			options.tileCacheDir	= next();
+		else if( 0 == strcmp( arg, "--deep-zoom" ) )
+			options.deepZoom	= true;
+		else if( 0 == strcmp( arg, "--zoom-path" ) )
+		{
+			options.deepZoom	= true;
+			if( ! ParseZoomPath( next(), options.zoomPath ) )
+			{
+				fprintf( stderr, INVALID_VALUE_MSG, arg );
+				return	false;
+			}
+		}
+		else if( 0 == strcmp( arg, "--look" ) )
+		{
+			if( ! ParseLook( next(), options.view ) )
+			{
+				fprintf( stderr, INVALID_VALUE_MSG, arg );
+				return	false;
+			}
+		}
+		else if( 0 == strcmp( arg, "--fov" ) )
+		{
+			options.view.fov	= strtof( next(), nullptr );
+			if( !( options.view.fov >= MIN_FOV && options.view.fov <= MAX_FOV ) )
+			{
+				fprintf( stderr, INVALID_VALUE_MSG, arg );
+				return	false;
+			}
+		}
+		else if( 0 == strcmp( arg, "--impostor-pixels" ) )
+		{
+			options.impostorPixels	= strtof( next(), nullptr );
+			if( !( options.impostorPixels >= 0.0f ) )
+			{
+				fprintf( stderr, INVALID_VALUE_MSG, arg );
+				return	false;
+			}
+		}
+		else if( 0 == strcmp( arg, "--no-occlusion-cull" ) )
+			options.occlusionCull	= false;
+		else if( 0 == strcmp( arg, "--splat" ) )
+			options.splatSpheres	= true;
+		else if( 0 == strcmp( arg, "--perf-counters" ) )
+			options.perfCounters	= true;
+		else if( 0 == strcmp( arg, "--scene" ) )
+			options.scenePath		= next();
+		else if( 0 == strcmp( arg, "--fast-math" ) )
+			options.precision	= Precision::FAST;
+		else if( 0 == strcmp( arg, "--check-precision" ) )
+			options.mode		= Mode::PRECISION;
+		else if( 0 == strcmp( arg, "--check-splat" ) )
+			options.mode		= Mode::SPLAT_CHECK;
+		else if( 0 == strcmp( arg, "--golden" ) )
+		{
+			options.mode		= Mode::GOLDEN;
+			options.goldenDir	= next();
+		}
+		else if( 0 == strcmp( arg, "--timings" ) )
+			options.timingsPath	= next();
+		else if( 0 == strcmp( arg, "--update-golden" ) )
+			options.updateGolden	= true;
+		else if( 0 == strcmp( arg, "--bench" ) )
+			options.mode		= Mode::BENCHMARK;
+		else if( 0 == strcmp( arg, "--bench-reps" ) )
+		{
+			options.benchReps	= static_cast< uint32_t >( strtoul( next(), nullptr, 10 ) );
+			if( 0 == options.benchReps )
+			{
+				fprintf( stderr, INVALID_VALUE_MSG, arg );
+				return	false;
+			}
+		}
+		else if( 0 == strcmp( arg, "--help" ) )
+			return	false;
+		else
+		{
+			fprintf( stderr, UNKNOWN_OPTION_MSG, arg );
+			return	false;
+		}
+	}
+
+	return	true;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief PrintUsage	Prints the supported command line options.
+ */
+void	PrintUsage( const char* const appName )
+{
+	fprintf( stderr, USAGE_MSG, appName );
+}
+////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,190 @@
+
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+////////////////////////////////////////////////////////////////////////////////
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include "cameraview.h"
+#include "config.h"
+#include "simd_precision.h"
+#include "tilepriority.h"
+#include "vec3.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+class Scene;
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief The Mode enum selects what the program does.
+ * INTERACTIVE	Opens a window (default).
+ * COORDINATOR	Hands out tiles of one frame to worker processes.
+ * WORKER		Traces tiles for a coordinator.
+ * BATCH		Renders a camera path to numbered images.
+ * PRECISION	Compares the fast math frame against the exact one.
+ * SERVER		Answers image requests from other processes.
+ * QUERY		Requests one image from a server.
+ * GOLDEN		Compares fixed views against the golden images.
+ * BENCHMARK	Measures the tracing kernels one by one.
+ * SPLAT_CHECK	Compares the splatted frames against the traced ones.
+ */
+enum class Mode
+{
+	INTERACTIVE,
+	COORDINATOR,
+	WORKER,
+	BATCH,
+	PRECISION,
+	SERVER,
+	QUERY,
+	GOLDEN,
+	BENCHMARK,
+	SPLAT_CHECK,
+};
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief The Quality enum is the quality a server image is traced at.
+ * FULL		Exact square roots at the requested resolution.
+ * FAST		Approximate reciprocal square roots (see Precision).
+ * PREVIEW	FAST at half the resolution in both directions, scaled up.
+ */
+enum class Quality : uint32_t
+{
+	FULL,
+	FAST,
+	PREVIEW,
+};
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief The Options struct holds the settings that can be changed from the
+ * command line.
+ *
+ * threadCount	Number of render threads. 0 means one per CPU minus the one
+ *				left for the gl calls.
+ * pinThreads	Pin every render thread to its own CPU.
+ * useSmt		Allow more than one render thread per physical core.
+ * hugePages	Back the large buffers with huge pages when possible.
+ * streamRays	Regroup the rays of a tile into full packets (see RayStream).
+ * vsync		Pace the window by vsync, falls back to a timer when the driver
+ *				has no swap interval.
+ * tileOrder	Order the tiles of a frame are traced in.
+ * targetFrameMs	Trace time per frame the window aims for by lowering the
+ *				resolution, 0 keeps the native resolution.
+ * minScale		Lowest resolution scale used to meet targetFrameMs.
+ * precision	Square root policy of the tracing, FAST uses the approximate
+ *				reciprocal square root (see Precision).
+ * capture		printf pattern of the frames recorded by the window.
+ * screenshot	printf pattern of the window's screenshots.
+ * captureThreads	Number of threads encoding the captured frames.
+ * tileCacheMb	Memory of the tile cache in megabytes, 0 for none (see
+ *				TileCache).
+ * tileCacheDir	Directory of the tile cache's disk tier, empty for none.
+ * deepZoom		Take the origins of the spheres around the camera from a chain
+ *				computed in double (see CameraChain). The camera is in the
+ *				local frame of the last sphere of zoomPath.
+ * zoomPath		Child indices from the root to the sphere the camera is given
+ *				in, empty for world units.
+ * view			Direction and field of view of the camera (see CameraView).
+ * impostorPixels	Radius in pixels under which a subtree is drawn as one
+ *				impostor sphere, 0 drops the spheres under a pixel instead
+ *				(see SphereFlake::SetImpostorPixels).
+ * occlusionCull	Skip the subtrees hidden behind their parent, off only to
+ *				measure the cull (see SphereFlake::IsHiddenByParent).
+ * splatSpheres	Find the primary hits by splatting the spheres instead of
+ *				tracing the packets down the hierarchy (see SphereSplatter).
+ * perfCounters	Count the hardware events of every render thread per frame
+ *				(see PerfCounters), printed by the window and the batch mode.
+ * scenePath	File of the flake instances to trace instead of the single
+ *				flake at the origin, empty for none.
+ * scene		The instances of scenePath, loaded by main and shared by the
+ *				tracers (see Scene).
+ *
+ * address		Socket address of the coordinator or the server ("unix:<path>"
+ *				or "<host>:<port>").
+ * spawnWorkers	Number of local worker processes the coordinator starts.
+ * tileTimeout	Milliseconds after which a tile is given to another worker.
+ * output		Path of the image written by the coordinator.
+ * camera		Camera position used by the offline modes.
+ * imageWidth	Width of the image a query asks for.
+ * imageHeight	Height of the image a query asks for.
+ * quality		Quality a query asks for.
+ *
+ * cameraPath	Keyframe file of the batch mode.
+ * sequence		printf pattern of the batch frame files, gets the frame number.
+ * fps			Frames per second of camera path time.
+ * aovChannels	Mask of the AOV channels written next to every batch frame (see
+ *				AovChannel), 0 for none.
+ *
+ * goldenDir	Directory of the golden images (see RunGoldenCheck).
+ * timingsPath	Timing baseline of the golden check, empty for
+ *				timings-<backend>.txt in the working directory.
+ * updateGolden	Write the golden images and timings instead of comparing.
+ *
+ * benchReps	Timed samples of every kernel benchmark case.
+ */
+struct Options
+{
+	Mode		mode			= Mode::INTERACTIVE;
+
+	uint32_t	threadCount		= 0;
+	bool		pinThreads		= true;
+	bool		useSmt			= true;
+	bool		hugePages		= true;
+	bool		streamRays		= false;
+	Precision	precision		= Precision::EXACT;
+	bool		vsync			= true;
+	TileOrder	tileOrder		= TileOrder::CENTER;
+	float		targetFrameMs	= 0.0f;
+	float		minScale		= 0.25f;
+	std::string	capture			= "capture_%05u.qoi";
+	std::string	screenshot		= "screenshot_%03u.qoi";
+	uint32_t	captureThreads	= 2;
+	uint32_t	tileCacheMb		= 0;
+	std::string	tileCacheDir;
+	bool		deepZoom		= false;
+	std::vector< uint8_t >	zoomPath;
+	CameraView	view;
+	float		impostorPixels	= 2.0f;
+	bool		occlusionCull	= true;
+	bool		splatSpheres	= false;
+	bool		perfCounters	= false;
+	std::string	scenePath;
+	std::shared_ptr< const Scene >	scene;
+
+	std::string	address			= "unix:/tmp/sphereflake.sock";
+	uint32_t	spawnWorkers	= 0;
+	uint32_t	tileTimeout		= 5000;
+	std::string	output			= "sphereflake.qoi";
+	Vec3		camera			= Vec3( 0.0f, 0.0f, 5.0f );
+	uint32_t	imageWidth		= SCREEN_WIDTH;
+	uint32_t	imageHeight		= SCREEN_HEIGHT;
+	Quality		quality			= Quality::FULL;
+
+	std::string	cameraPath;
+	std::string	sequence		= "frame_%05u.qoi";
+	float		fps				= 30.0f;
+	uint32_t	aovChannels		= 0;
+
+	std::string	goldenDir;
+	std::string	timingsPath;
+	bool		updateGolden	= false;
+
+	uint32_t	benchReps		= 21;
+};
+////////////////////////////////////////////////////////////////////////////////
+
+bool	ParseOptions( int argc, char** argv, Options& options );
+void	PrintUsage( const char* const appName );
+
+////////////////////////////////////////////////////////////////////////////////
+
+#endif // OPTIONS_H
@@ -0,0 +1,138 @@
+
+#include <new>
+
+#include <stdint.h>
+
+#if defined( __linux__ )
+#include <sys/mman.h>
+#endif
+
+#include "pagealloc.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+constexpr size_t	PAGE_SIZE_BYTES		= 4096;
+constexpr size_t	HUGE_PAGE_SIZE		= 2 * 1024 * 1024;
+
+////////////////////////////////////////////////////////////////////////////////
+
+static
+size_t	RoundUp( size_t value, size_t alignment )
+{
+	return	( value + alignment - 1 ) / alignment * alignment;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief AllocatePages	Allocates 'bytes' of page aligned memory. If
+ * 'hugePages' is set and the buffer is at least one huge page large, explicit
+ * huge pages are tried first, then a huge page aligned mapping advised for
+ * transparent huge pages. Small buffers use normal pages. When no mapping
+ * can be made, and on other systems, the memory comes from operator new.
+ * @throws std::bad_alloc	If no memory is left at all.
+ */
+PageAllocation	AllocatePages( size_t bytes, bool hugePages )
+{
+	PageAllocation	allocation;
+
+#if defined( __linux__ )
+	if( hugePages && bytes >= HUGE_PAGE_SIZE )
+	{
+		const size_t	size	= RoundUp( bytes, HUGE_PAGE_SIZE );
+		void*			data	= mmap( nullptr, size, PROT_READ | PROT_WRITE,
+										MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+										-1, 0 );
+		if( MAP_FAILED != data )
+		{
+			allocation.data	= data;
+			allocation.size	= size;
+			allocation.kind	= PageKind::HUGETLB;
+
+			return	allocation;
+		}
+
+		// Map one extra huge page and trim the ends, so the buffer starts on a
+		// huge page boundary and can be fully backed by transparent huge pages.
+		const size_t	mapped	= size + HUGE_PAGE_SIZE;
+		uint8_t*		raw		= static_cast< uint8_t* >( mmap( nullptr, mapped,
+																 PROT_READ | PROT_WRITE,
+																 MAP_PRIVATE | MAP_ANONYMOUS,
+																 -1, 0 ) );
+		if( MAP_FAILED != static_cast< void* >( raw ) )
+		{
+			uint8_t*	aligned	= reinterpret_cast< uint8_t* >( RoundUp( reinterpret_cast< uintptr_t >( raw ), HUGE_PAGE_SIZE ) );
+			size_t		head	= static_cast< size_t >( aligned - raw );
+			size_t		tail	= mapped - head - size;
+
+			if( head )
+				munmap( raw, head );
+			if( tail )
+				munmap( aligned + size, tail );
+
+			allocation.data	= aligned;
+			allocation.size	= size;
+			allocation.kind	= ( 0 == madvise( aligned, size, MADV_HUGEPAGE ) )
+							? PageKind::TRANSPARENT_HUGE
+							: PageKind::NORMAL;
+
+			return	allocation;
+		}
+	}
+
+	const size_t	size	= RoundUp( bytes, PAGE_SIZE_BYTES );
+	void*			data	= mmap( nullptr, size, PROT_READ | PROT_WRITE,
+									MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+	if( MAP_FAILED != data )
+	{
+		allocation.data	= data;
+		allocation.size	= size;
+
+		return	allocation;
+	}
+#else
+	( void )( hugePages );
+#endif
+
+	allocation.size	= RoundUp( bytes, PAGE_SIZE_BYTES );
+	allocation.data	= ::operator new( allocation.size, std::align_val_t( PAGE_SIZE_BYTES ) );
+	allocation.kind	= PageKind::HEAP;
+
+	return	allocation;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief FreePages	Releases memory obtained with AllocatePages.
+ */
+void	FreePages( PageAllocation& allocation )
+{
+	if( nullptr == allocation.data )
+		return;
+
+	if( PageKind::HEAP == allocation.kind )
+		::operator delete( allocation.data, std::align_val_t( PAGE_SIZE_BYTES ) );
+#if defined( __linux__ )
+	else
+		munmap( allocation.data, allocation.size );
+#endif
+
+	allocation	= PageAllocation();
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief PageKindName	Returns a printable name for 'kind'.
+ */
+const char*	PageKindName( PageKind kind )
+{
+	switch( kind )
+	{
+		case	PageKind::HUGETLB:				return	"hugetlb";
+		case	PageKind::TRANSPARENT_HUGE:		return	"thp";
+		case	PageKind::NORMAL:				return	"normal";
+		case	PageKind::HEAP:					return	"heap";
+	}
+
+	return	"normal";
+}
+////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,49 @@
+
+#ifndef PAGEALLOC_H
+#define PAGEALLOC_H
+
+////////////////////////////////////////////////////////////////////////////////
+
+#include <stddef.h>
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief The PageKind enum tells what kind of pages back an allocation.
+ * HUGETLB			Explicit huge pages (MAP_HUGETLB).
+ * TRANSPARENT_HUGE	Regular mapping advised for transparent huge pages.
+ * NORMAL			Regular pages.
+ * HEAP				Page aligned operator new, where the mappings failed or
+ *					are not available.
+ */
+enum class PageKind
+{
+	NORMAL,
+	TRANSPARENT_HUGE,
+	HUGETLB,
+	HEAP,
+};
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief The PageAllocation struct describes memory obtained with
+ * AllocatePages. The memory is page aligned and is not touched by the
+ * allocator, so the physical pages are placed on the NUMA node of the thread
+ * that writes them first. The data is never null, an allocation that fails
+ * throws std::bad_alloc.
+ */
+struct PageAllocation
+{
+	void*		data		= nullptr;
+	size_t		size		= 0;
+	PageKind	kind		= PageKind::NORMAL;
+};
+////////////////////////////////////////////////////////////////////////////////
+
+PageAllocation	AllocatePages( size_t bytes, bool hugePages );
+void			FreePages( PageAllocation& allocation );
+const char*		PageKindName( PageKind kind );
+
+////////////////////////////////////////////////////////////////////////////////
+
+#endif // PAGEALLOC_H
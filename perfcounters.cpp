@@ -0,0 +1,314 @@
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined( __linux__ )
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <cpuid.h>
+#endif
+
+#include "perfcounters.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+constexpr char	NOT_SUPPORTED_MSG[]		= "not supported on this system";
+constexpr char	NO_PMU_MSG[]			= "no hardware counters (a virtual machine?)";
+constexpr char	PARANOID_MSG[]			= " (see /proc/sys/kernel/perf_event_paranoid)";
+constexpr char	NOT_AVAILABLE[]			= "n/a";
+
+// The events of each group, the first one leads it and COUNT fills the rest.
+// Four events fit the general purpose counters of a core with SMT on.
+constexpr PerfEvent	GROUP_EVENTS[][ 4 ]	=
+{
+	{ PerfEvent::CYCLES, PerfEvent::INSTRUCTIONS, PerfEvent::BRANCH_MISSES, PerfEvent::L1D_MISSES },
+	{ PerfEvent::L2_MISSES, PerfEvent::LLC_MISSES, PerfEvent::VECTOR_OPS, PerfEvent::COUNT },
+};
+
+#if defined( __linux__ )
+// FP_ARITH_INST_RETIRED (event 0xC7) with the umasks of the 128, 256 and 512
+// bit packed single precision instructions, since Broadwell.
+constexpr uint64_t	INTEL_PACKED_SINGLE	= 0xA8C7;
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+#if defined( __linux__ )
+	/**
+	 * @brief IsIntel	Returns true if the CPU is an Intel one, the raw events
+	 * are model specific.
+	 */
+	bool	IsIntel()
+	{
+#if defined( __x86_64__ ) || defined( __i386__ )
+		unsigned int	eax		= 0;
+		unsigned int	ebx		= 0;
+		unsigned int	ecx		= 0;
+		unsigned int	edx		= 0;
+		if( ! __get_cpuid( 0, &eax, &ebx, &ecx, &edx ) )
+			return	false;
+
+		// "GenuineIntel" in ebx, edx, ecx.
+		return	0x756E6547 == ebx && 0x49656E69 == edx && 0x6C65746E == ecx;
+#else
+		return	false;
+#endif
+	}
+	////////////////////////////////////////////////////////////////////////////
+
+	/**
+	 * @brief EventAttr	Fills the type and config of 'event' in 'attr'.
+	 * @return	Returns false if the event is not known on this CPU.
+	 */
+	bool	EventAttr( PerfEvent event, perf_event_attr& attr )
+	{
+		constexpr uint64_t	L1D_READ_MISS	= PERF_COUNT_HW_CACHE_L1D
+											| ( PERF_COUNT_HW_CACHE_OP_READ << 8 )
+											| ( PERF_COUNT_HW_CACHE_RESULT_MISS << 16 );
+
+		attr.type	= PERF_TYPE_HARDWARE;
+		switch( event )
+		{
+		case PerfEvent::CYCLES:			attr.config	= PERF_COUNT_HW_CPU_CYCLES;			return	true;
+		case PerfEvent::INSTRUCTIONS:	attr.config	= PERF_COUNT_HW_INSTRUCTIONS;		return	true;
+		case PerfEvent::L2_MISSES:		attr.config	= PERF_COUNT_HW_CACHE_REFERENCES;	return	true;
+		case PerfEvent::LLC_MISSES:		attr.config	= PERF_COUNT_HW_CACHE_MISSES;		return	true;
+		case PerfEvent::BRANCH_MISSES:	attr.config	= PERF_COUNT_HW_BRANCH_MISSES;		return	true;
+		case PerfEvent::L1D_MISSES:
+			attr.type	= PERF_TYPE_HW_CACHE;
+			attr.config	= L1D_READ_MISS;
+			return	true;
+		case PerfEvent::VECTOR_OPS:
+			attr.type	= PERF_TYPE_RAW;
+			attr.config	= INTEL_PACKED_SINGLE;
+			return	IsIntel();
+		default:
+			return	false;
+		}
+	}
+	////////////////////////////////////////////////////////////////////////////
+#endif
+
+	/**
+	 * @brief AppendValue	Appends "'name' 'value'" to 'text', formatted with
+	 * 'format', or "'name' n/a" when it was not counted.
+	 */
+	void	AppendValue( std::string& text, const char* name, bool valid, double value, const char* format )
+	{
+		char	buffer[ 64 ];
+		if( valid )
+			snprintf( buffer, sizeof( buffer ), format, value );
+		else
+			snprintf( buffer, sizeof( buffer ), "%s", NOT_AVAILABLE );
+
+		if( ! text.empty() )
+			text	+= "  ";
+		text	+= name;
+		text	+= ' ';
+		text	+= buffer;
+	}
+	////////////////////////////////////////////////////////////////////////////
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief PerfCounters::PerfCounters	Constructor for the class. Nothing is
+ * counted before Open.
+ */
+PerfCounters::PerfCounters()
+{
+	for( Group& group : m_groups )
+		group.count	= 0;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief PerfCounters::~PerfCounters	Destructor for the class. Closes the
+ * events.
+ */
+PerfCounters::~PerfCounters()
+{
+	Close();
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief PerfCounters::Open	Starts counting the events on the calling thread
+ * on whatever CPU it runs.
+ * @return	Returns false if no event could be opened, see Error.
+ */
+bool	PerfCounters::Open()
+{
+	Close();
+
+#if defined( __linux__ )
+	int			firstError	= 0;
+	uint32_t	opened		= 0;
+
+	for( uint32_t g = 0; g < GROUP_COUNT; ++g )
+	{
+		Group&	group	= m_groups[ g ];
+		for( const PerfEvent event : GROUP_EVENTS[ g ] )
+		{
+			perf_event_attr	attr;
+			memset( &attr, 0, sizeof( attr ) );
+			attr.size			= sizeof( attr );
+			attr.read_format	= PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+			attr.exclude_kernel	= 1;
+			attr.exclude_hv		= 1;
+
+			if( ! EventAttr( event, attr ) )
+				continue;
+
+			// The first event that opens leads the group.
+			const int	leader	= ( 0 == group.count ) ? -1 : group.fds[ 0 ];
+			const int	fd		= static_cast< int >( syscall( __NR_perf_event_open, &attr, 0, -1, leader,
+																  PERF_FLAG_FD_CLOEXEC ) );
+			if( fd < 0 )
+			{
+				firstError	= ( 0 == firstError ) ? errno : firstError;
+				continue;
+			}
+
+			group.fds[ group.count ]	= fd;
+			group.events[ group.count ]	= event;
+			++group.count;
+			++opened;
+		}
+	}
+
+	if( 0 != opened )
+		return	true;
+
+	if( ENOENT == firstError || ENODEV == firstError || EOPNOTSUPP == firstError )
+		m_error	= NO_PMU_MSG;
+	else
+		m_error	= strerror( firstError );
+
+	if( EACCES == firstError || EPERM == firstError )
+		m_error	+= PARANOID_MSG;
+#else
+	m_error	= NOT_SUPPORTED_MSG;
+#endif
+
+	return	false;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief PerfCounters::Read	Returns the events counted since Open. A group
+ * that never got a counter is left out of the mask.
+ */
+PerfCounts	PerfCounters::Read() const
+{
+	PerfCounts	counts;
+
+#if defined( __linux__ )
+	for( const Group& group : m_groups )
+	{
+		if( 0 == group.count )
+			continue;
+
+		// Count, time enabled, time running and the value of each event.
+		uint64_t		data[ 3 + GROUP_SIZE ];
+		const ssize_t	size	= read( group.fds[ 0 ], data, sizeof( data ) );
+		if( size < static_cast< ssize_t >( ( 3 + group.count ) * sizeof( uint64_t ) ) || 0 == data[ 2 ] )
+			continue;
+
+		const double	scale	= double( data[ 1 ] ) / double( data[ 2 ] );
+		for( uint32_t i = 0; i < group.count && i < data[ 0 ]; ++i )
+		{
+			const uint32_t	event	= static_cast< uint32_t >( group.events[ i ] );
+			counts.values[ event ]	= static_cast< uint64_t >( double( data[ 3 + i ] ) * scale );
+			counts.valid			|= 1u << event;
+		}
+	}
+#endif
+
+	return	counts;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief PerfCounters::Close	Closes the events, members before the leader.
+ */
+void	PerfCounters::Close()
+{
+	for( Group& group : m_groups )
+	{
+#if defined( __linux__ )
+		for( uint32_t i = group.count; i-- > 0; )
+			close( group.fds[ i ] );
+#endif
+		group.count	= 0;
+	}
+
+	m_error.clear();
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief SumPerfCounts	Returns the sum of 'counts', with the events counted in
+ * all of them.
+ */
+PerfCounts	SumPerfCounts( const std::vector< PerfCounts >& counts )
+{
+	PerfCounts	total;
+	if( counts.empty() )
+		return	total;
+
+	total.valid	= ~0u;
+	for( const PerfCounts& c : counts )
+	{
+		total.valid	&= c.valid;
+		for( uint32_t i = 0; i < PERF_EVENT_COUNT; ++i )
+			total.values[ i ]	+= c.values[ i ];
+	}
+
+	return	total;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief FormatPerfCounts	Returns 'counts' as one line: the instructions per
+ * cycle, the misses per thousand instructions, the share of the instructions
+ * that are packed arithmetic and the instruction count. Events that were not
+ * counted are n/a.
+ */
+std::string	FormatPerfCounts( const PerfCounts& counts )
+{
+	const double	cycles			= double( counts.Get( PerfEvent::CYCLES ) );
+	const double	instructions	= double( counts.Get( PerfEvent::INSTRUCTIONS ) );
+	const bool		perInstruction	= counts.Has( PerfEvent::INSTRUCTIONS ) && instructions > 0.0;
+
+	const auto	perKilo	= [ & ]( PerfEvent event )
+	{
+		return	double( counts.Get( event ) ) * 1000.0 / instructions;
+	};
+
+	std::string	text;
+	AppendValue( text, "IPC", perInstruction && counts.Has( PerfEvent::CYCLES ) && cycles > 0.0,
+				 instructions / cycles, "%.2f" );
+	AppendValue( text, "MPKI L1D", perInstruction && counts.Has( PerfEvent::L1D_MISSES ),
+				 perKilo( PerfEvent::L1D_MISSES ), "%.2f" );
+	AppendValue( text, "L2", perInstruction && counts.Has( PerfEvent::L2_MISSES ),
+				 perKilo( PerfEvent::L2_MISSES ), "%.2f" );
+	AppendValue( text, "LLC", perInstruction && counts.Has( PerfEvent::LLC_MISSES ),
+				 perKilo( PerfEvent::LLC_MISSES ), "%.3f" );
+	AppendValue( text, "branch", perInstruction && counts.Has( PerfEvent::BRANCH_MISSES ),
+				 perKilo( PerfEvent::BRANCH_MISSES ), "%.2f" );
+	AppendValue( text, "vector", perInstruction && counts.Has( PerfEvent::VECTOR_OPS ),
+				 double( counts.Get( PerfEvent::VECTOR_OPS ) ) * 100.0 / instructions, "%.1f%%" );
+	AppendValue( text, "instructions", counts.Has( PerfEvent::INSTRUCTIONS ), instructions * 1e-6, "%.1fM" );
+
+	return	text;
+}
+////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,124 @@
+
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+////////////////////////////////////////////////////////////////////////////////
+
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief The PerfEvent enum lists the hardware events counted per thread.
+ *
+ * CYCLES			Core cycles.
+ * INSTRUCTIONS		Instructions retired.
+ * L1D_MISSES		Loads that missed the L1 data cache.
+ * L2_MISSES		Requests that reached the last level cache, the misses of
+ *					the L2 on the CPUs with three levels.
+ * LLC_MISSES		Requests that missed the last level cache.
+ * BRANCH_MISSES	Mispredicted branches retired.
+ * VECTOR_OPS		Packed single precision arithmetic instructions retired,
+ *					counted on Intel only.
+ */
+enum class PerfEvent : uint32_t
+{
+	CYCLES,
+	INSTRUCTIONS,
+	L1D_MISSES,
+	L2_MISSES,
+	LLC_MISSES,
+	BRANCH_MISSES,
+	VECTOR_OPS,
+	COUNT,
+};
+
+constexpr uint32_t	PERF_EVENT_COUNT	= static_cast< uint32_t >( PerfEvent::COUNT );
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief The PerfCounts struct holds a value of every event and a mask of the
+ * events that were counted, one bit per PerfEvent. The difference of two reads
+ * is the count in between.
+ */
+struct PerfCounts
+{
+	uint64_t	values[ PERF_EVENT_COUNT ]	= {};
+	uint32_t	valid						= 0;
+
+	bool		Has( PerfEvent event )	const	{ return	0 != ( valid & ( 1u << static_cast< uint32_t >( event ) ) ); }
+	uint64_t	Get( PerfEvent event )	const	{ return	values[ static_cast< uint32_t >( event ) ]; }
+
+	PerfCounts	operator-( const PerfCounts& rhs )	const
+	{
+		PerfCounts	result;
+		result.valid	= valid & rhs.valid;
+		for( uint32_t i = 0; i < PERF_EVENT_COUNT; ++i )
+			result.values[ i ]	= values[ i ] - rhs.values[ i ];
+
+		return	result;
+	}
+};
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief The PerfCounters class counts the hardware events of the thread that
+ * opened it, with perf_event_open on Linux.
+ *
+ * The events are opened in two groups that fit the counters of one core, the
+ * events of a group are always scheduled together so their ratios hold. When
+ * the kernel multiplexes the groups the values are scaled up by the share of
+ * time a group was counting. User space only, the kernel and the hypervisor
+ * are left out.
+ *
+ * An event the CPU or the kernel doesn't support is left out of its mask. When
+ * none can be opened (no PMU in a virtual machine, perf_event_paranoid, other
+ * systems than Linux) Open fails with the reason in Error and every read is
+ * empty.
+ */
+class PerfCounters
+{
+public:
+	PerfCounters();
+	~PerfCounters();
+
+	PerfCounters( const PerfCounters& )				= delete;
+	PerfCounters&	operator=( const PerfCounters& )	= delete;
+
+	bool				Open();
+	PerfCounts			Read()		const;
+	const std::string&	Error()		const	{ return	m_error; }
+
+private:
+	static constexpr uint32_t	GROUP_COUNT		= 2;
+	static constexpr uint32_t	GROUP_SIZE		= 4;
+
+	/**
+	 * @brief The Group struct is the descriptors of the events of one group,
+	 * the first one is the leader.
+	 */
+	struct Group
+	{
+		int			fds[ GROUP_SIZE ];
+		PerfEvent	events[ GROUP_SIZE ];
+		uint32_t	count;
+	};
+
+	void	Close();
+
+private:
+	Group		m_groups[ GROUP_COUNT ];
+	std::string	m_error;
+};
+////////////////////////////////////////////////////////////////////////////////
+
+PerfCounts	SumPerfCounts( const std::vector< PerfCounts >& counts );
+std::string	FormatPerfCounts( const PerfCounts& counts );
+
+////////////////////////////////////////////////////////////////////////////////
+
+#endif // PERFCOUNTERS_H
@@ -0,0 +1,87 @@
+
+#include <chrono>
+#include <vector>
+
+#include <stdio.h>
+
+#include "framebuffer.h"
+#include "image.h"
+#include "tracer.h"
+
+#include "precisioncheck.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Largest channel difference that is not counted as an error. The approximate
+// square root moves the hit distance by a few ulps, which can round a color to
+// the neighbouring 8 bit value.
+constexpr uint32_t	MAX_CHANNEL_ERROR		= 2;
+// Share of pixels allowed over MAX_CHANNEL_ERROR. These are silhouette pixels
+// where a grazing ray flips between hit and miss.
+constexpr double	MAX_OUTLIER_FRACTION	= 0.001;
+
+constexpr size_t	SCREEN_PIXELS			= size_t( SCREEN_WIDTH ) * SCREEN_HEIGHT;
+
+constexpr char		FRAME_MSG[]				= "%-5s %8.1f ms\n";
+constexpr char		RESULT_MSG[]			= "Max channel error %u, %zu pixels (%.4f%%) over %u\n";
+constexpr char		PASSED_MSG[]			= "Precision check passed\n";
+constexpr char		FAILED_MSG[]			= "Precision check failed, allowed %.4f%% of pixels over %u\n";
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+	using	Clock	= std::chrono::steady_clock;
+
+	/**
+	 * @brief TraceFrame	Traces the frame at 'camera' with precision 'precision'
+	 * and returns it as RGB8.
+	 */
+	std::vector< uint8_t >	TraceFrame( Options options, Precision precision, const char* name )
+	{
+		options.precision	= precision;
+
+		Tracer		tracer( options, 0 );
+		FrameBuffer	buffer( options.hugePages );
+		tracer.ClearBuffer( buffer );
+
+		const Clock::time_point	start	= Clock::now();
+		tracer.StartFrame( options.camera, buffer );
+		tracer.WaitFrame();
+		fprintf( stderr, FRAME_MSG, name,
+				 std::chrono::duration< double, std::milli >( Clock::now() - start ).count() );
+
+		std::vector< uint8_t >	rgb( SCREEN_PIXELS * 3 );
+		ConvertToRgb8( buffer, false, rgb.data() );
+
+		return	rgb;
+	}
+	////////////////////////////////////////////////////////////////////////////
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief RunPrecisionCheck	Compares the fast and exact frames at the camera.
+ * @return	Returns the exit code of the program.
+ */
+int	RunPrecisionCheck( const Options& options )
+{
+	const std::vector< uint8_t >	exact	= TraceFrame( options, Precision::EXACT, "exact" );
+	const std::vector< uint8_t >	fast	= TraceFrame( options, Precision::FAST, "fast" );
+
+	const ImageDiff	diff		= CompareRgb8( exact.data(), fast.data(), SCREEN_PIXELS, MAX_CHANNEL_ERROR );
+	const double	fraction	= double( diff.outliers ) / SCREEN_PIXELS;
+
+	fprintf( stderr, RESULT_MSG, diff.maxError, diff.outliers, fraction * 100.0, MAX_CHANNEL_ERROR );
+
+	if( fraction > MAX_OUTLIER_FRACTION )
+	{
+		fprintf( stderr, FAILED_MSG, MAX_OUTLIER_FRACTION * 100.0, MAX_CHANNEL_ERROR );
+		return	1;
+	}
+
+	fprintf( stderr, PASSED_MSG );
+	return	0;
+}
+////////////////////////////////////////////////////////////////////////////////
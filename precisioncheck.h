@@ -0,0 +1,23 @@
+
+#ifndef PRECISIONCHECK_H
+#define PRECISIONCHECK_H
+
+////////////////////////////////////////////////////////////////////////////////
+
+#include "options.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Checks that the fast math path stays within the image error budget.
+ *
+ * Traces the frame at 'options.camera' once with Precision::EXACT and once
+ * with Precision::FAST, compares the 8 bit images and prints the largest
+ * channel error, the number of pixels over the tolerance and the time of both
+ * frames. Returns 0 if the error is within the budget and 1 otherwise.
+ */
+int	RunPrecisionCheck( const Options& options );
+
+////////////////////////////////////////////////////////////////////////////////
+
+#endif // PRECISIONCHECK_H
@@ -0,0 +1,251 @@
+
+#include <string.h>
+
+#include "qoi.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+constexpr uint8_t	OP_INDEX		= 0x00;
+constexpr uint8_t	OP_DIFF			= 0x40;
+constexpr uint8_t	OP_LUMA			= 0x80;
+constexpr uint8_t	OP_RUN			= 0xc0;
+constexpr uint8_t	OP_RGB			= 0xfe;
+constexpr uint8_t	OP_RGBA			= 0xff;
+constexpr uint8_t	OP_MASK			= 0xc0;
+
+constexpr uint32_t	HEADER_SIZE		= 14;
+constexpr uint8_t	PADDING[]		= { 0, 0, 0, 0, 0, 0, 0, 1 };
+constexpr uint32_t	MAX_RUN			= 62;
+constexpr uint32_t	MAX_PIXELS		= 400000000;
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+	struct	Pixel
+	{
+		uint8_t	r;
+		uint8_t	g;
+		uint8_t	b;
+		uint8_t	a;
+
+		bool	operator==( const Pixel& rhs ) const
+		{
+			return	r == rhs.r && g == rhs.g && b == rhs.b && a == rhs.a;
+		}
+	};
+	////////////////////////////////////////////////////////////////////////////
+
+	inline
+	uint32_t	Hash( const Pixel& p )
+	{
+		return	( p.r * 3 + p.g * 5 + p.b * 7 + p.a * 11 ) % 64;
+	}
+	////////////////////////////////////////////////////////////////////////////
+
+	inline
+	void	Write32( std::vector< uint8_t >& out, uint32_t v )
+	{
+		out.push_back( static_cast< uint8_t >( v >> 24 ) );
+		out.push_back( static_cast< uint8_t >( v >> 16 ) );
+		out.push_back( static_cast< uint8_t >( v >>  8 ) );
+		out.push_back( static_cast< uint8_t >( v       ) );
+	}
+	////////////////////////////////////////////////////////////////////////////
+
+	inline
+	uint32_t	Read32( const uint8_t* p )
+	{
+		return	uint32_t( p[ 0 ] ) << 24 | uint32_t( p[ 1 ] ) << 16 |
+				uint32_t( p[ 2 ] ) <<  8 | uint32_t( p[ 3 ] );
+	}
+	////////////////////////////////////////////////////////////////////////////
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief QOI::Encode	Compresses a tightly packed RGB8 image.
+ * @return	Returns the encoded file contents (header, data and end marker).
+ */
+std::vector< uint8_t >	QOI::Encode( const uint8_t* rgb, uint32_t width, uint32_t height )
+{
+	std::vector< uint8_t >	out;
+	const size_t			pixelCount	= size_t( width ) * height;
+
+	// Worst case is one OP_RGB (4 bytes) per pixel.
+	out.reserve( HEADER_SIZE + pixelCount * 4 + sizeof( PADDING ) );
+
+	out.insert( out.end(), { 'q', 'o', 'i', 'f' } );
+	Write32( out, width );
+	Write32( out, height );
+	out.push_back( 3 );
+	out.push_back( 0 );
+
+	Pixel		index[ 64 ];
+	memset( index, 0, sizeof( index ) );
+
+	Pixel		prev	= { 0, 0, 0, 255 };
+	uint32_t	run		= 0;
+
+	for( size_t i = 0; i < pixelCount; ++i )
+	{
+		const Pixel	px	= { rgb[ i * 3 + 0 ], rgb[ i * 3 + 1 ], rgb[ i * 3 + 2 ], 255 };
+
+		if( px == prev )
+		{
+			++run;
+			if( MAX_RUN == run || pixelCount - 1 == i )
+			{
+				out.push_back( static_cast< uint8_t >( OP_RUN | ( run - 1 ) ) );
+				run	= 0;
+			}
+
+			continue;
+		}
+
+		if( run )
+		{
+			out.push_back( static_cast< uint8_t >( OP_RUN | ( run - 1 ) ) );
+			run	= 0;
+		}
+
+		const uint32_t	hash	= Hash( px );
+		if( index[ hash ] == px )
+		{
+			out.push_back( static_cast< uint8_t >( OP_INDEX | hash ) );
+		}
+		else
+		{
+			index[ hash ]	= px;
+
+			const int8_t	dr	= static_cast< int8_t >( px.r - prev.r );
+			const int8_t	dg	= static_cast< int8_t >( px.g - prev.g );
+			const int8_t	db	= static_cast< int8_t >( px.b - prev.b );
+			const int8_t	drg	= static_cast< int8_t >( dr - dg );
+			const int8_t	dbg	= static_cast< int8_t >( db - dg );
+
+			if( dr > -3 && dr < 2 && dg > -3 && dg < 2 && db > -3 && db < 2 )
+			{
+				out.push_back( static_cast< uint8_t >( OP_DIFF | ( dr + 2 ) << 4 | ( dg + 2 ) << 2 | ( db + 2 ) ) );
+			}
+			else if( drg > -9 && drg < 8 && dg > -33 && dg < 32 && dbg > -9 && dbg < 8 )
+			{
+				out.push_back( static_cast< uint8_t >( OP_LUMA | ( dg + 32 ) ) );
+				out.push_back( static_cast< uint8_t >( ( drg + 8 ) << 4 | ( dbg + 8 ) ) );
+			}
+			else
+			{
+				out.push_back( OP_RGB );
+				out.push_back( px.r );
+				out.push_back( px.g );
+				out.push_back( px.b );
+			}
+		}
+
+		prev	= px;
+	}
+
+	out.insert( out.end(), PADDING, PADDING + sizeof( PADDING ) );
+
+	return	out;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief QOI::Decode	Decompresses a QOI file into tightly packed RGB8.
+ * @return	Returns false if the data is not a valid QOI image.
+ */
+bool	QOI::Decode( const uint8_t* data, size_t size, std::vector< uint8_t >& rgb,
+					 uint32_t& width, uint32_t& height )
+{
+	if( size < HEADER_SIZE + sizeof( PADDING ) || 0 != memcmp( data, "qoif", 4 ) )
+		return	false;
+
+	width	= Read32( data + 4 );
+	height	= Read32( data + 8 );
+
+	const size_t	pixelCount	= size_t( width ) * height;
+	if( 0 == width || 0 == height || pixelCount > MAX_PIXELS )
+		return	false;
+
+	rgb.resize( pixelCount * 3 );
+
+	Pixel		index[ 64 ];
+	memset( index, 0, sizeof( index ) );
+
+	Pixel		px		= { 0, 0, 0, 255 };
+	uint32_t	run		= 0;
+	size_t		pos		= HEADER_SIZE;
+	const size_t	end	= size - sizeof( PADDING );
+
+	for( size_t i = 0; i < pixelCount; ++i )
+	{
+		if( run )
+		{
+			--run;
+		}
+		else if( pos < end )
+		{
+			const uint8_t	op	= data[ pos++ ];
+
+			if( OP_RGB == op )
+			{
+				if( pos + 3 > end )
+					return	false;
+
+				px.r	= data[ pos++ ];
+				px.g	= data[ pos++ ];
+				px.b	= data[ pos++ ];
+			}
+			else if( OP_RGBA == op )
+			{
+				if( pos + 4 > end )
+					return	false;
+
+				px.r	= data[ pos++ ];
+				px.g	= data[ pos++ ];
+				px.b	= data[ pos++ ];
+				px.a	= data[ pos++ ];
+			}
+			else if( OP_INDEX == ( op & OP_MASK ) )
+			{
+				px		= index[ op ];
+			}
+			else if( OP_DIFF == ( op & OP_MASK ) )
+			{
+				px.r	+= ( ( op >> 4 ) & 0x03 ) - 2;
+				px.g	+= ( ( op >> 2 ) & 0x03 ) - 2;
+				px.b	+= ( ( op      ) & 0x03 ) - 2;
+			}
+			else if( OP_LUMA == ( op & OP_MASK ) )
+			{
+				if( pos + 1 > end )
+					return	false;
+
+				const uint8_t	next	= data[ pos++ ];
+				const int		dg		= ( op & 0x3f ) - 32;
+
+				px.r	+= dg - 8 + ( ( next >> 4 ) & 0x0f );
+				px.g	+= dg;
+				px.b	+= dg - 8 + ( next & 0x0f );
+			}
+			else
+			{
+				run		= op & 0x3f;
+			}
+
+			index[ Hash( px ) ]	= px;
+		}
+		else
+		{
+			return	false;
+		}
+
+		rgb[ i * 3 + 0 ]	= px.r;
+		rgb[ i * 3 + 1 ]	= px.g;
+		rgb[ i * 3 + 2 ]	= px.b;
+	}
+
+	return	true;
+}
+////////////////////////////////////////////////////////////////////////////////
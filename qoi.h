@@ -0,0 +1,30 @@
+
+#ifndef QOI_H
+#define QOI_H
+
+////////////////////////////////////////////////////////////////////////////////
+
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Encoder and decoder for the "Quite OK Image" format
+ * (https://qoiformat.org). It is lossless, needs no external library and is
+ * fast enough to compress tiles and whole frames on the fly.
+ *
+ * Only 3 channel (RGB) images are produced, decoding accepts RGB and RGBA.
+ */
+namespace QOI
+{
+	std::vector< uint8_t >	Encode( const uint8_t* rgb, uint32_t width, uint32_t height );
+	bool					Decode( const uint8_t* data, size_t size,
+									std::vector< uint8_t >& rgb,
+									uint32_t& width, uint32_t& height );
+} // namespace QOI
+////////////////////////////////////////////////////////////////////////////////
+
+#endif // QOI_H
@@ -0,0 +1,92 @@
+
+#include "raygen.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief RayGenerator::RayGenerator	Constructor for the class. The table is
+ * built by the first Setup.
+ */
+RayGenerator::RayGenerator()
+	: m_width( 0 )
+	, m_height( 0 )
+	, m_packetsPerRow( 0 )
+	, m_fov( 0.0f )
+	, m_precision( Precision::EXACT )
+	, m_rotate( false )
+{
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief RayGenerator::Setup	Prepares the packets of a 'width' x 'height'
+ * frame seen through 'view', normalized with 'precision'. Rebuilds the table
+ * only if the frame size, the field of view or the precision changed.
+ */
+void	RayGenerator::Setup( const CameraView& view, uint32_t width, uint32_t height, Precision precision )
+{
+	if( width != m_width || height != m_height || view.fov != m_fov || precision != m_precision )
+	{
+		m_width			= width;
+		m_height		= height;
+		m_packetsPerRow	= ( width + SIMD::SIZE - 1 ) / SIMD::SIZE;
+		m_fov			= view.fov;
+		m_precision		= precision;
+
+		if( Precision::FAST == precision )
+			BuildTable< Precision::FAST >();
+		else
+			BuildTable< Precision::EXACT >();
+	}
+
+	// Level views keep the table's directions bit for bit.
+	m_rotate	= ! view.IsLevel();
+	if( ! m_rotate )
+		return;
+
+	Vec3	right;
+	Vec3	up;
+	Vec3	back;
+	view.Axes( right, up, back );
+
+	m_rows[ 0 ]	= SIMD::Vec( Vec3( right.x, up.x, back.x ) );
+	m_rows[ 1 ]	= SIMD::Vec( Vec3( right.y, up.y, back.y ) );
+	m_rows[ 2 ]	= SIMD::Vec( Vec3( right.z, up.z, back.z ) );
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief RayGenerator::BuildTable	Computes the camera space direction of
+ * every packet. A smaller frame covers the same view with fewer rays. The
+ * rows span SCREEN_RATIO of the width from the bottom of the view, the
+ * framing of the original frames.
+ */
+template< Precision P >
+void	RayGenerator::BuildTable()
+{
+	const float	tanHalfFov	= CameraView{ 0.0f, 0.0f, m_fov }.TanHalfFov();
+
+	m_directions.resize( size_t( m_packetsPerRow ) * m_height );
+
+	for( uint32_t y = 0; y < m_height; ++y )
+	{
+		float	v	= float( y ) / float( m_height );
+		v		*= SCREEN_RATIO;
+		v		= ( v - 0.5f ) * 2.0f * tanHalfFov;
+
+		for( uint32_t p = 0; p < m_packetsPerRow; ++p )
+		{
+			float	u[ SIMD::SIZE ];
+			for( uint32_t k = 0; k < SIMD::SIZE; ++k )
+			{
+				u[ k ]	= float( p * SIMD::SIZE + k ) / float( m_width );
+				u[ k ]	= ( u[ k ] - 0.5f ) * 2.0f * tanHalfFov;
+			}
+
+			SIMD::Vec	dir( SIMD::float_t::Load( u ), SIMD::float_t( v ), SIMD::float_t( -1.0f ) );
+
+			m_directions[ size_t( y ) * m_packetsPerRow + p ]	= dir.MultiplyByFloat( SIMD::RSqrt< P >( dir.dot( dir ) ) );
+		}
+	}
+}
+////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,74 @@
+
+#ifndef RAYGEN_H
+#define RAYGEN_H
+
+////////////////////////////////////////////////////////////////////////////////
+
+#include <vector>
+
+#include <stdint.h>
+
+#include "cameraview.h"
+#include "config.h"
+#include "ray.h"
+#include "simd.h"
+#include "simd_precision.h"
+#include "vec3.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief The RayGenerator class casts the primary ray packets of a frame.
+ *
+ * The normalized camera space directions of every packet of the frame are
+ * kept in a table of SIMD::Vec, one entry per SIMD::SIZE pixels of a row, so a
+ * packet is three aligned loads. The table depends only on the frame size, the
+ * field of view and the precision and is rebuilt by Setup when one of them
+ * changes. The orientation of the camera is applied per packet, a broadcast
+ * matrix times the loaded directions, and skipped when the camera is level.
+ *
+ * Setup is called while no thread casts rays, Cast is called by all of them.
+ */
+class RayGenerator
+{
+public:
+	RayGenerator();
+
+	void	Setup( const CameraView& view, uint32_t width, uint32_t height, Precision precision );
+
+	/**
+	 * @brief Cast	Returns the packet of the pixels 'x' to 'x + SIMD::SIZE - 1'
+	 * of row 'y' with the origin 'origin'. 'x' is a multiple of SIMD::SIZE
+	 * and the pixels are in the frame of the last Setup.
+	 */
+	Ray		Cast( const Vec3& origin, uint32_t x, uint32_t y ) const
+	{
+		const SIMD::Vec&	dir	= m_directions[ y * m_packetsPerRow + x / SIMD::SIZE ];
+		if( ! m_rotate )
+			return	Ray( origin, dir );
+
+		return	Ray( origin, SIMD::Vec( dir.dot( m_rows[ 0 ] ), dir.dot( m_rows[ 1 ] ), dir.dot( m_rows[ 2 ] ) ) );
+	}
+
+	uint32_t	Width()			const	{ return	m_width; }
+	uint32_t	Height()		const	{ return	m_height; }
+
+private:
+	template< Precision P >
+	void	BuildTable();
+
+private:
+	std::vector< SIMD::Vec >	m_directions;
+	uint32_t					m_width;
+	uint32_t					m_height;
+	uint32_t					m_packetsPerRow;
+	float						m_fov;
+	Precision					m_precision;
+
+	// Rows of the camera to world rotation, each component broadcast.
+	SIMD::Vec					m_rows[ 3 ];
+	bool						m_rotate;
+};
+////////////////////////////////////////////////////////////////////////////////
+
+#endif // RAYGEN_H
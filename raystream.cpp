@@ -0,0 +1,179 @@
+
+#include "hitrecord.h"
+#include "ray.h"
+
+#include "raystream.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+constexpr uint32_t	TILE_PIXELS	= TILE_SIZE * TILE_SIZE;
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief RayStream::RayStream	Constructor for the class.
+ */
+RayStream::RayStream()
+	: m_buckets( SphereFlake::NodeCount( STREAM_DEPTH ) )
+	, m_max( TILE_PIXELS )
+	, m_result( TILE_PIXELS )
+	, m_level( TILE_PIXELS )
+	, m_directions( TILE_PIXELS )
+{
+	m_used.reserve( m_buckets.size() );
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief RayStream::TraceTile	Traces the pixels of 'tile' as seen from
+ * 'origin', see TraceTile in tile.h for the parameters.
+ */
+template< Precision P >
+void	RayStream::TraceTile( SphereFlake& sphereFlake, const RayGenerator& rays, const Vec3& origin,
+							  const Tile& tile, Vec3* out, uint32_t stride,
+							  TraversalStats& traversal, StreamStats& stream )
+{
+	// Packets from the root down to STREAM_DEPTH.
+	for( uint32_t y = 0; y < tile.height; ++y )
+	{
+		for( uint32_t x = 0; x < tile.width; x += SIMD::SIZE )
+		{
+			const uint32_t	first	= y * TILE_SIZE + x;
+
+			HitRecord	records;
+			Ray			ray		= rays.Cast( origin, tile.x + x, tile.y + y );
+
+			sphereFlake.Intersect< P >( ray, records, traversal, STREAM_DEPTH,
+								   [ & ]( uint32_t node, const TraversalFrame& frame )
+								   {
+									   stream.deferred.Add( frame.active );
+									   Defer( node, frame, first );
+								   } );
+
+			for( uint32_t k = 0; k < SIMD::SIZE; ++k )
+			{
+				m_max[ first + k ]			= records.max.Extract( k );
+				m_result[ first + k ]		= records.result.Extract( k );
+				m_level[ first + k ]		= records.level.Extract( k );
+				m_directions[ first + k ]	= ray.direction().Extract( k );
+			}
+		}
+	}
+
+	// Dense packets through the subtrees.
+	for( uint32_t node : m_used )
+		TraceBucket< P >( sphereFlake, m_buckets[ node ], traversal, stream );
+
+	m_used.clear();
+
+	for( uint32_t y = 0; y < tile.height; ++y )
+	{
+		for( uint32_t x = 0; x < tile.width; ++x )
+		{
+			const uint32_t	i	= y * TILE_SIZE + x;
+			out[ y * stride + x ]	= HitRecord::Color( m_result[ i ], m_level[ i ],
+														origin, m_directions[ i ] );
+		}
+	}
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief RayStream::Defer	Adds the live lanes of a packet that reached
+ * sphere 'node' to its bucket. 'firstPixel' is the pixel of lane 0.
+ */
+void	RayStream::Defer( uint32_t node, const TraversalFrame& frame, uint32_t firstPixel )
+{
+	Bucket&	bucket	= m_buckets[ node ];
+	if( bucket.pixels.empty() )
+	{
+		bucket.node	= frame;
+		m_used.push_back( node );
+	}
+
+	for( uint32_t k = 0; k < SIMD::SIZE; ++k )
+	{
+		if( ! frame.active.Extract( k ) )
+			continue;
+
+		bucket.pixels.push_back( firstPixel + k );
+		bucket.directions.push_back( frame.direction.Extract( k ) );
+	}
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief RayStream::TraceBucket	Traces the rays of 'bucket' in full packets
+ * and keeps the hits that are closer than the ones of their pixels. Empties
+ * the bucket.
+ */
+template< Precision P >
+void	RayStream::TraceBucket( SphereFlake& sphereFlake, Bucket& bucket,
+								TraversalStats& traversal, StreamStats& stream )
+{
+	// Lane i is active when i < count.
+	float	laneIndex[ SIMD::SIZE ];
+	for( uint32_t k = 0; k < SIMD::SIZE; ++k )
+		laneIndex[ k ]	= float( k );
+
+	const SIMD::float_t	lanes	= SIMD::float_t::Load( laneIndex );
+	const uint32_t		size	= static_cast< uint32_t >( bucket.pixels.size() );
+
+	for( uint32_t first = 0; first < size; first += SIMD::SIZE )
+	{
+		const uint32_t	count	= ( size - first < SIMD::SIZE ) ? size - first : SIMD::SIZE;
+
+		Vec3	directions[ SIMD::SIZE ];
+		float	max[ SIMD::SIZE ];
+		float	result[ SIMD::SIZE ];
+		float	level[ SIMD::SIZE ];
+		for( uint32_t k = 0; k < SIMD::SIZE; ++k )
+		{
+			// Unused lanes repeat the last ray and are masked out.
+			const uint32_t	ray		= first + ( ( k < count ) ? k : count - 1 );
+			const uint32_t	pixel	= bucket.pixels[ ray ];
+
+			directions[ k ]	= bucket.directions[ ray ];
+			max[ k ]		= m_max[ pixel ];
+			result[ k ]		= m_result[ pixel ];
+			level[ k ]		= m_level[ pixel ];
+		}
+
+		TraversalFrame	node	= bucket.node;
+		node.direction	= SIMD::Vec( directions );
+		node.active		= lanes.LessThan( float( count ) );
+
+		HitRecord	records;
+		records.max		= SIMD::float_t::Load( max );
+		records.result	= SIMD::float_t::Load( result );
+		records.level	= SIMD::float_t::Load( level );
+
+		stream.compacted.Add( node.active );
+		sphereFlake.IntersectSubtree< P >( node, STREAM_DEPTH, records, traversal );
+
+		for( uint32_t k = 0; k < count; ++k )
+		{
+			const uint32_t	pixel	= bucket.pixels[ first + k ];
+			const float		hit		= records.max.Extract( k );
+			if( hit < m_max[ pixel ] )
+			{
+				m_max[ pixel ]		= hit;
+				m_result[ pixel ]	= records.result.Extract( k );
+				m_level[ pixel ]	= records.level.Extract( k );
+			}
+		}
+	}
+
+	bucket.pixels.clear();
+	bucket.directions.clear();
+}
+////////////////////////////////////////////////////////////////////////////////
+
+template void	RayStream::TraceTile< Precision::EXACT >( SphereFlake&, const RayGenerator&, const Vec3&,
+														  const Tile&, Vec3*, uint32_t,
+														  TraversalStats&, StreamStats& );
+template void	RayStream::TraceTile< Precision::FAST >( SphereFlake&, const RayGenerator&, const Vec3&,
+														 const Tile&, Vec3*, uint32_t,
+														 TraversalStats&, StreamStats& );
+
+////////////////////////////////////////////////////////////////////////////////
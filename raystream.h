@@ -0,0 +1,90 @@
+
+#ifndef RAYSTREAM_H
+#define RAYSTREAM_H
+
+////////////////////////////////////////////////////////////////////////////////
+
+#include <vector>
+
+#include <stdint.h>
+
+#include "raygen.h"
+#include "sphereflake.h"
+#include "tile.h"
+#include "vec3.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Depth at which the packets of a tile are split up and regrouped by sphere.
+constexpr uint32_t	STREAM_DEPTH	= 3;
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief The StreamStats struct reports the lane occupancy at the stream depth.
+ * Deferred counts the packets as they arrived at the spheres of that depth,
+ * compacted counts the full packets the same rays were repacked into.
+ */
+struct StreamStats
+{
+	TraversalStats	deferred;
+	TraversalStats	compacted;
+};
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief The RayStream class traces a tile in stream mode.
+ *
+ * The packets of the tile are traced from the root as usual, but stop at the
+ * spheres of STREAM_DEPTH. The live rays of all the packets that reach the
+ * same sphere are gathered, and as all the rays share the camera their origin
+ * in the local frame of that sphere is the same. They are repacked into full
+ * SIMD packets and traced through the subtree, and the hits are scattered
+ * back to their pixels, keeping the closest one.
+ *
+ * Deep in the flake a packet from RayGenerator::Cast has only a few live lanes, the
+ * regrouped packets are dense. One RayStream is used per thread, the buffers
+ * are reused between tiles.
+ */
+class RayStream
+{
+public:
+	RayStream();
+
+	template< Precision P >
+	void	TraceTile( SphereFlake& sphereFlake, const RayGenerator& rays, const Vec3& origin,
+					   const Tile& tile, Vec3* out, uint32_t stride,
+					   TraversalStats& traversal, StreamStats& stream );
+
+private:
+	/**
+	 * @brief The Bucket struct holds the rays that reached one sphere of
+	 * STREAM_DEPTH: the sphere's frame and per ray its pixel and direction in
+	 * that frame.
+	 */
+	struct Bucket
+	{
+		TraversalFrame			node;
+		std::vector< uint32_t >	pixels;
+		std::vector< Vec3 >		directions;
+	};
+
+	void	Defer( uint32_t node, const TraversalFrame& frame, uint32_t firstPixel );
+
+	template< Precision P >
+	void	TraceBucket( SphereFlake& sphereFlake, Bucket& bucket,
+						 TraversalStats& traversal, StreamStats& stream );
+
+private:
+	std::vector< Bucket >	m_buckets;
+	std::vector< uint32_t >	m_used;
+
+	// Closest hit and world direction per pixel of the tile.
+	std::vector< float >	m_max;
+	std::vector< float >	m_result;
+	std::vector< float >	m_level;
+	std::vector< Vec3 >		m_directions;
+};
+////////////////////////////////////////////////////////////////////////////////
+
+#endif // RAYSTREAM_H
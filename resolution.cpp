@@ -0,0 +1,72 @@
+
+#include <algorithm>
+
+#include <math.h>
+
+#include "config.h"
+#include "simd.h"
+
+#include "resolution.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Share of the distance to the scale that meets the target covered per frame.
+constexpr float	DAMPING			= 0.5f;
+// Growth of the scale per frame while the camera stands still.
+constexpr float	SETTLE_STEP		= 1.25f;
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief DynamicResolution::DynamicResolution	Constructor for the class.
+ * @param targetSeconds	Trace time to aim for.
+ * @param minScale		Lowest scale of the screen size, in ( 0, 1 ].
+ */
+DynamicResolution::DynamicResolution( double targetSeconds, float minScale )
+	: m_target( targetSeconds )
+	, m_minScale( minScale )
+	, m_scale( 1.0f )
+{
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief DynamicResolution::Update	Picks the scale of the next frame from the
+ * trace time of the last one.
+ */
+void	DynamicResolution::Update( double traceSeconds, bool cameraMoved )
+{
+	if( ! cameraMoved )
+	{
+		m_scale	= std::min( 1.0f, m_scale * SETTLE_STEP );
+		return;
+	}
+
+	if( !( traceSeconds > 0.0 ) )
+		return;
+
+	const float	ideal	= m_scale * static_cast< float >( sqrt( m_target / traceSeconds ) );
+	m_scale	+= ( ideal - m_scale ) * DAMPING;
+	m_scale	= std::max( m_minScale, std::min( 1.0f, m_scale ) );
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief DynamicResolution::Width	Returns the width of the next frame, rounded
+ * down to the SIMD width.
+ */
+uint32_t	DynamicResolution::Width() const
+{
+	const uint32_t	width	= static_cast< uint32_t >( SCREEN_WIDTH * m_scale );
+	return	std::max< uint32_t >( SIMD::SIZE, width - width % SIMD::SIZE );
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief DynamicResolution::Height	Returns the height of the next frame.
+ */
+uint32_t	DynamicResolution::Height() const
+{
+	return	std::max( 1u, static_cast< uint32_t >( SCREEN_HEIGHT * m_scale ) );
+}
+////////////////////////////////////////////////////////////////////////////////
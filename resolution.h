@@ -0,0 +1,39 @@
+
+#ifndef RESOLUTION_H
+#define RESOLUTION_H
+
+////////////////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief The DynamicResolution class picks the resolution of the next frame
+ * so the trace time stays close to a target.
+ *
+ * The resolution is a scale of the screen size between 'minScale' and 1. The
+ * trace time is taken as proportional to the number of pixels, so the scale
+ * that meets the target is the current one times sqrt( target / time ), and
+ * the controller moves half way there every frame. While the camera stands
+ * still the scale grows back to the native resolution, a step per frame.
+ */
+class DynamicResolution
+{
+public:
+	DynamicResolution( double targetSeconds, float minScale );
+
+	void		Update( double traceSeconds, bool cameraMoved );
+
+	float		Scale()		const	{ return	m_scale; }
+	uint32_t	Width()		const;
+	uint32_t	Height()	const;
+
+private:
+	double		m_target;
+	float		m_minScale;
+	float		m_scale;
+};
+////////////////////////////////////////////////////////////////////////////////
+
+#endif // RESOLUTION_H
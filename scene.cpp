@@ -0,0 +1,296 @@
+
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <string>
+
+#include <stdio.h>
+
+#include "scene.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+constexpr char		OPEN_FAILED_MSG[]		= "Failed to open the scene file %s\n";
+constexpr char		INVALID_INSTANCE_MSG[]	= "%s:%u: expected \"x y z scale [yaw pitch roll]\" with a positive scale\n";
+constexpr char		NO_INSTANCES_MSG[]		= "No instances in %s\n";
+
+// Radius of the bounds of a flake in root radii, the root and its children.
+constexpr float		FLAKE_BOUNDS			= 2.0f;
+
+// Bins of the centroids along each axis the splits are taken from.
+constexpr uint32_t	SAH_BINS				= 16;
+// Cost of a box test and of tracing an instance whose bounds are hit, relative
+// to each other. Entering an instance costs at least its root sphere tests.
+constexpr float		NODE_COST				= 1.0f;
+constexpr float		INSTANCE_COST			= 4.0f;
+// Leaves are split further when they have more instances than this, even if
+// the heuristic would keep them.
+constexpr uint32_t	MAX_LEAF_SIZE			= 4;
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+	/**
+	 * @brief Component	Returns the component 'axis' (0 to 2) of 'v'.
+	 */
+	float	Component( const Vec3& v, uint32_t axis )
+	{
+		return	( 0 == axis ) ? v.x : ( 1 == axis ) ? v.y : v.z;
+	}
+	////////////////////////////////////////////////////////////////////////////
+
+	/**
+	 * @brief The Bounds struct is an axis aligned box that grows to hold the
+	 * boxes added to it. Empty until the first one.
+	 */
+	struct Bounds
+	{
+		Vec3	min	= Vec3( std::numeric_limits< float >::max() );
+		Vec3	max	= Vec3( -std::numeric_limits< float >::max() );
+
+		void	Add( const Vec3& boxMin, const Vec3& boxMax )
+		{
+			min	= Vec3( std::min( min.x, boxMin.x ), std::min( min.y, boxMin.y ), std::min( min.z, boxMin.z ) );
+			max	= Vec3( std::max( max.x, boxMax.x ), std::max( max.y, boxMax.y ), std::max( max.z, boxMax.z ) );
+		}
+
+		/**
+		 * @brief HalfArea	Returns half of the surface area, 0 when empty.
+		 */
+		float	HalfArea()	const
+		{
+			if( min.x > max.x )
+				return	0.0f;
+
+			const Vec3	size	= max - min;
+			return	size.x * size.y + size.y * size.z + size.z * size.x;
+		}
+	};
+	////////////////////////////////////////////////////////////////////////////
+
+	/**
+	 * @brief AddInstance	Adds the box around the bounds of 'instance' to
+	 * 'bounds'. The bounds are a ball, the box doesn't depend on the turn.
+	 */
+	void	AddInstance( Bounds& bounds, const FlakeInstance& instance )
+	{
+		const Vec3	extent( FLAKE_BOUNDS * STARTING_RADIUS * instance.scale );
+		bounds.Add( instance.position - extent, instance.position + extent );
+	}
+	////////////////////////////////////////////////////////////////////////////
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Scene::Load	Reads the instances from 'path' and builds the
+ * hierarchy.
+ * @return	Returns false if the file can't be read or is invalid.
+ */
+bool	Scene::Load( const char* const path )
+{
+	std::ifstream	file( path );
+	if( ! file.is_open() )
+	{
+		fprintf( stderr, OPEN_FAILED_MSG, path );
+		return	false;
+	}
+
+	m_instances.clear();
+
+	std::string	line;
+	uint32_t	lineNumber	= 0;
+	while( std::getline( file, line ) )
+	{
+		++lineNumber;
+
+		size_t	first	= line.find_first_not_of( " \t\r" );
+		if( std::string::npos == first || '#' == line[ first ] )
+			continue;
+
+		std::istringstream	stream( line );
+		Vec3				position;
+		float				scale	= 0.0f;
+		stream >> position.x >> position.y >> position.z >> scale;
+
+		// The angles are optional, but all three or none.
+		float	angles[ 3 ]	= { 0.0f, 0.0f, 0.0f };
+		bool	valid		= ! stream.fail() && scale > 0.0f;
+		if( valid && stream >> angles[ 0 ] )
+			valid	= ! ( stream >> angles[ 1 ] >> angles[ 2 ] ).fail();
+
+		if( ! valid )
+		{
+			fprintf( stderr, INVALID_INSTANCE_MSG, path, lineNumber );
+			return	false;
+		}
+
+		Add( position, scale, angles[ 0 ], angles[ 1 ], angles[ 2 ] );
+	}
+
+	if( m_instances.empty() )
+	{
+		fprintf( stderr, NO_INSTANCES_MSG, path );
+		return	false;
+	}
+
+	Build();
+	return	true;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Scene::Add	Places a flake with its root sphere at 'position' and
+ * 'scale' times its radius, turned by 'yaw' around y, then by 'pitch' around
+ * x and by 'roll' around z, in degrees. Build has to be called before the
+ * next Intersect.
+ */
+void	Scene::Add( const Vec3& position, float scale, float yaw, float pitch, float roll )
+{
+	const float	cy	= cosf( angleToRads( yaw ) );
+	const float	sy	= sinf( angleToRads( yaw ) );
+	const float	cp	= cosf( angleToRads( pitch ) );
+	const float	sp	= sinf( angleToRads( pitch ) );
+	const float	cr	= cosf( angleToRads( roll ) );
+	const float	sr	= sinf( angleToRads( roll ) );
+
+	// The columns of the turn Ry * Rx * Rz are the local axes in the world,
+	// the rows of its inverse.
+	FlakeInstance	instance;
+	instance.position	= position;
+	instance.scale		= scale;
+	instance.rows[ 0 ]	= Vec3( cy * cr + sy * sp * sr, cp * sr, -sy * cr + cy * sp * sr );
+	instance.rows[ 1 ]	= Vec3( -cy * sr + sy * sp * cr, cp * cr, sy * sr + cy * sp * cr );
+	instance.rows[ 2 ]	= Vec3( sy * cp, -sp, cy * cp );
+
+	m_instances.push_back( instance );
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Scene::Build	Builds the hierarchy over the instances, which are
+ * reordered so that the instances of each leaf are next to each other.
+ */
+void	Scene::Build()
+{
+	m_nodes.clear();
+	if( m_instances.empty() )
+		return;
+
+	m_nodes.reserve( 2 * m_instances.size() );
+	BuildNode( 0, static_cast< uint32_t >( m_instances.size() ), 0 );
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Scene::BuildNode	Adds the node of the 'count' instances from
+ * 'first' on at level 'depth' and its subtree.
+ * @return	Returns the index of the node.
+ *
+ * The split is the border between two bins of the centroids, on the axis and
+ * at the border with the lowest cost NODE_COST + ( area( left ) *
+ * count( left ) + area( right ) * count( right ) ) / area( node ) *
+ * INSTANCE_COST. The node stays a leaf when that is no less than the cost of
+ * the leaf, count * INSTANCE_COST, unless it has more than MAX_LEAF_SIZE
+ * instances. Instances whose centroids can't be told apart are split in half.
+ */
+uint32_t	Scene::BuildNode( uint32_t first, uint32_t count, uint32_t depth )
+{
+	Bounds	bounds;
+	Bounds	centroids;
+	for( uint32_t i = first; i < first + count; ++i )
+	{
+		AddInstance( bounds, m_instances[ i ] );
+		centroids.Add( m_instances[ i ].position, m_instances[ i ].position );
+	}
+
+	const uint32_t	index	= static_cast< uint32_t >( m_nodes.size() );
+	m_nodes.push_back( Node{ bounds.min, bounds.max, first, count } );
+
+	if( 1 == count || depth + 1 >= MAX_BVH_DEPTH )
+		return	index;
+
+	float		bestCost	= std::numeric_limits< float >::max();
+	uint32_t	bestAxis	= 0;
+	uint32_t	bestSplit	= 0;
+	for( uint32_t axis = 0; axis < 3; ++axis )
+	{
+		const float	low		= Component( centroids.min, axis );
+		const float	extent	= Component( centroids.max, axis ) - low;
+		if( extent <= 0.0f )
+			continue;
+
+		Bounds		bins[ SAH_BINS ];
+		uint32_t	binCounts[ SAH_BINS ]	= {};
+		for( uint32_t i = first; i < first + count; ++i )
+		{
+			const float		t	= ( Component( m_instances[ i ].position, axis ) - low ) / extent;
+			const uint32_t	bin	= std::min( static_cast< uint32_t >( t * SAH_BINS ), SAH_BINS - 1 );
+			AddInstance( bins[ bin ], m_instances[ i ] );
+			++binCounts[ bin ];
+		}
+
+		// Areas and counts of the bins left of each border, then the sweep
+		// from the right.
+		float		leftArea[ SAH_BINS ];
+		uint32_t	leftCount[ SAH_BINS ];
+		Bounds		left;
+		uint32_t	n	= 0;
+		for( uint32_t b = 0; b + 1 < SAH_BINS; ++b )
+		{
+			left.Add( bins[ b ].min, bins[ b ].max );
+			n				+= binCounts[ b ];
+			leftArea[ b ]	= left.HalfArea();
+			leftCount[ b ]	= n;
+		}
+
+		Bounds	right;
+		n	= 0;
+		for( uint32_t b = SAH_BINS - 1; b > 0; --b )
+		{
+			right.Add( bins[ b ].min, bins[ b ].max );
+			n	+= binCounts[ b ];
+			if( 0 == n || count == n )
+				continue;
+
+			const float	cost	= leftArea[ b - 1 ] * leftCount[ b - 1 ] + right.HalfArea() * n;
+			if( cost < bestCost )
+			{
+				bestCost	= cost;
+				bestAxis	= axis;
+				bestSplit	= b;
+			}
+		}
+	}
+
+	const float	splitCost	= NODE_COST + bestCost / bounds.HalfArea() * INSTANCE_COST;
+	const float	leafCost	= count * INSTANCE_COST;
+	if( leafCost <= splitCost && count <= MAX_LEAF_SIZE )
+		return	index;
+
+	FlakeInstance* const	begin	= m_instances.data() + first;
+	FlakeInstance* const	end		= begin + count;
+	FlakeInstance*			middle	= begin + count / 2;
+	if( std::numeric_limits< float >::max() != bestCost )
+	{
+		const float	low		= Component( centroids.min, bestAxis );
+		const float	extent	= Component( centroids.max, bestAxis ) - low;
+		middle	= std::partition( begin, end, [ & ]( const FlakeInstance& instance )
+		{
+			const float	t	= ( Component( instance.position, bestAxis ) - low ) / extent;
+			return	std::min( static_cast< uint32_t >( t * SAH_BINS ), SAH_BINS - 1 ) < bestSplit;
+		} );
+	}
+
+	const uint32_t	leftCount	= static_cast< uint32_t >( middle - begin );
+	BuildNode( first, leftCount, depth + 1 );
+	const uint32_t	right		= BuildNode( first + leftCount, count - leftCount, depth + 1 );
+
+	m_nodes[ index ].first	= right;
+	m_nodes[ index ].count	= 0;
+
+	return	index;
+}
+////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,221 @@
+
+#ifndef SCENE_H
+#define SCENE_H
+
+////////////////////////////////////////////////////////////////////////////////
+
+#include <vector>
+
+#include <stdint.h>
+
+#include "config.h"
+#include "hitrecord.h"
+#include "ray.h"
+#include "raygen.h"
+#include "simd.h"
+#include "simd_precision.h"
+#include "sphereflake.h"
+#include "tile.h"
+#include "vec3.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Deepest level of the instance hierarchy, the build makes a leaf there.
+constexpr uint32_t	MAX_BVH_DEPTH	= 48;
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief The FlakeInstance struct is a copy of the sphereflake placed in the
+ * world. Its root sphere has the radius STARTING_RADIUS * scale and is
+ * centered at 'position'. A world point p is at
+ * ( rows[ 0 ] . q, rows[ 1 ] . q, rows[ 2 ] . q ) / ( STARTING_RADIUS * scale ),
+ * q = p - position, in the frame of the root sphere.
+ */
+struct FlakeInstance
+{
+	Vec3	position;
+	Vec3	rows[ 3 ];
+	float	scale;
+};
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief The Scene class is a set of sphereflakes at different positions,
+ * scales and orientations, with a bounding volume hierarchy over them.
+ *
+ * The scene file has one instance per line: "x y z scale [yaw pitch roll]",
+ * the angles in degrees turn the flake around the y, x and z axes in that
+ * order. Empty lines and lines starting with '#' are ignored.
+ *
+ * The hierarchy is built over the bounds of the instances, twice the radius of
+ * their root sphere, with the surface area heuristic evaluated in SAH_BINS
+ * bins along each axis. Its nodes are stored depth first, the left child
+ * follows its parent.
+ *
+ * A packet goes down the hierarchy with the lanes that hit the box of a node,
+ * the nearer child first, and skips the boxes that are behind the hits found
+ * so far. At a leaf the packet is moved to the frame of each instance and
+ * traced there by the SphereFlake (see SphereFlake::IntersectInstance), so
+ * the cost grows with the log of the instance count, not with the count.
+ */
+class Scene
+{
+public:
+	bool	Load( const char* const path );
+	void	Add( const Vec3& position, float scale, float yaw, float pitch, float roll );
+	void	Build();
+
+	template< Precision P >
+	void	Intersect( SphereFlake& sphereFlake, const Ray& ray, HitRecord& records,
+					   TraversalStats& stats )	const;
+
+	size_t	InstanceCount()	const	{ return	m_instances.size(); }
+	size_t	NodeCount()		const	{ return	m_nodes.size(); }
+	bool	Empty()			const	{ return	m_instances.empty(); }
+
+private:
+	/**
+	 * @brief The Node struct is a box of the hierarchy. A leaf has the 'count'
+	 * instances from 'first' on, an inner node has a count of 0 and its right
+	 * child at 'first'.
+	 */
+	struct Node
+	{
+		Vec3		min;
+		Vec3		max;
+		uint32_t	first;
+		uint32_t	count;
+	};
+
+	uint32_t	BuildNode( uint32_t first, uint32_t count, uint32_t depth );
+
+	static SIMD::bool_t	HitBox( const Node& node, const Vec3& origin, const SIMD::float_t inverse[ 3 ],
+								const HitRecord& records );
+
+private:
+	std::vector< FlakeInstance >	m_instances;
+	std::vector< Node >				m_nodes;
+};
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Scene::HitBox	Returns the lanes whose rays from 'origin', with the
+ * reciprocal directions 'inverse', pass through the box of 'node' within the
+ * range of 'records'.
+ */
+inline
+SIMD::bool_t	Scene::HitBox( const Node& node, const Vec3& origin, const SIMD::float_t inverse[ 3 ],
+							   const HitRecord& records )
+{
+	const auto	min	= []( const SIMD::float_t& a, const SIMD::float_t& b ) { return SIMD::PickBasedOnCondition( a.LessThan( b ), a, b ); };
+	const auto	max	= []( const SIMD::float_t& a, const SIMD::float_t& b ) { return SIMD::PickBasedOnCondition( a.LessThan( b ), b, a ); };
+
+	const SIMD::float_t	x0	= SIMD::float_t( node.min.x - origin.x ) * inverse[ 0 ];
+	const SIMD::float_t	x1	= SIMD::float_t( node.max.x - origin.x ) * inverse[ 0 ];
+	const SIMD::float_t	y0	= SIMD::float_t( node.min.y - origin.y ) * inverse[ 1 ];
+	const SIMD::float_t	y1	= SIMD::float_t( node.max.y - origin.y ) * inverse[ 1 ];
+	const SIMD::float_t	z0	= SIMD::float_t( node.min.z - origin.z ) * inverse[ 2 ];
+	const SIMD::float_t	z1	= SIMD::float_t( node.max.z - origin.z ) * inverse[ 2 ];
+
+	const SIMD::float_t	near	= max( max( min( x0, x1 ), min( y0, y1 ) ), max( min( z0, z1 ), records.min ) );
+	const SIMD::float_t	far		= min( min( max( x0, x1 ), max( y0, y1 ) ), min( max( z0, z1 ), records.max ) );
+
+	return	far.GreaterOrEqualThan( near );
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Scene::Intersect	Traces 'ray' through the instances of the scene
+ * with 'sphereFlake', the hits go to 'records' in world units. The rays of
+ * the packet have to share the origin. P is the precision policy of the
+ * square roots.
+ */
+template< Precision P >
+inline
+void	Scene::Intersect( SphereFlake& sphereFlake, const Ray& ray, HitRecord& records,
+						  TraversalStats& stats ) const
+{
+	const Vec3				origin		= ray.origin().Extract( 0 );
+	const SIMD::Vec&		direction	= ray.direction();
+	const SIMD::float_t		one( 1.0f );
+	const SIMD::float_t		inverse[ 3 ]	= { one / direction.dot( SIMD::Vec( Vec3( 1.0f, 0.0f, 0.0f ) ) ),
+												one / direction.dot( SIMD::Vec( Vec3( 0.0f, 1.0f, 0.0f ) ) ),
+												one / direction.dot( SIMD::Vec( Vec3( 0.0f, 0.0f, 1.0f ) ) ) };
+
+	uint32_t	stack[ MAX_BVH_DEPTH + 1 ];
+	uint32_t	size	= 0;
+
+	stack[ size++ ]	= 0;
+	while( 0 != size )
+	{
+		const uint32_t	index	= stack[ --size ];
+		const Node&		node	= m_nodes[ index ];
+
+		// The boxes are tested when taken, the hits may have come closer
+		// since they were pushed.
+		const SIMD::bool_t	active	= HitBox( node, origin, inverse, records );
+		if( 0 == active.Mask() )
+			continue;
+
+		if( 0 == node.count )
+		{
+			// The nearer child goes on top, by the distance to the box centers.
+			const Node&		left		= m_nodes[ index + 1 ];
+			const Node&		right		= m_nodes[ node.first ];
+			const Vec3		toLeft		= ( left.min + left.max ) * 0.5f - origin;
+			const Vec3		toRight		= ( right.min + right.max ) * 0.5f - origin;
+			const bool		leftFirst	= toLeft.dot( toLeft ) < toRight.dot( toRight );
+
+			stack[ size++ ]	= leftFirst ? node.first : index + 1;
+			stack[ size++ ]	= leftFirst ? index + 1 : node.first;
+			continue;
+		}
+
+		for( uint32_t i = node.first; i < node.first + node.count; ++i )
+		{
+			const FlakeInstance&	instance	= m_instances[ i ];
+			const float				scale		= STARTING_RADIUS * instance.scale;
+			const Vec3				delta		= origin - instance.position;
+			const Vec3				local		= Vec3( instance.rows[ 0 ].dot( delta ),
+														instance.rows[ 1 ].dot( delta ),
+														instance.rows[ 2 ].dot( delta ) ) / scale;
+
+			sphereFlake.IntersectInstance< P >( local,
+												SIMD::Vec( direction.dot( SIMD::Vec( instance.rows[ 0 ] ) ),
+														   direction.dot( SIMD::Vec( instance.rows[ 1 ] ) ),
+														   direction.dot( SIMD::Vec( instance.rows[ 2 ] ) ) ),
+												scale, active, records, stats );
+		}
+	}
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief TraceTile	Traces the pixels of 'tile' through the instances of
+ * 'scene', see TraceTile in tile.h for the other parameters.
+ */
+template< Precision P = Precision::EXACT >
+inline
+void	TraceTile( const Scene& scene, SphereFlake& sphereFlake, const RayGenerator& rays, const Vec3& origin,
+				   const Tile& tile, Vec3* out, uint32_t stride, TraversalStats& stats )
+{
+	for( uint32_t y = 0; y < tile.height; ++y )
+	{
+		for( uint32_t x = 0; x < tile.width; x += SIMD::SIZE )
+		{
+			HitRecord	records;
+			Ray			ray		= rays.Cast( origin, tile.x + x, tile.y + y );
+			Vec3*		pixels	= out + y * stride + x;
+
+			scene.Intersect< P >( sphereFlake, ray, records, stats );
+
+			SIMD::StorePixels( records.Shade( ray ), pixels );
+		}
+	}
+
+	SIMD::StoreFence();
+}
+////////////////////////////////////////////////////////////////////////////////
+
+#endif // SCENE_H
@@ -1,12 +1,11 @@
 
-#include <random>
-
 #include "SDL2/SDL.h"
 #include <GL/glew.h>
 
+#include "image.h"
+#include "perfcounters.h"
 #include "simd_base.h"
 
-#include "hitrecord.h"
 #include "screenrenderer.h"
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -14,52 +13,203 @@
 constexpr char		FRAG_SHADER_FILE_PATH[]		= "bin/shaders/fragment.glsl";
 constexpr char		VERT_SHADER_FILE_PATH[]		= "bin/shaders/vertex.glsl";
 
-constexpr size_t	BUFFER_SIZE					= SCREEN_WIDTH * SCREEN_HEIGHT;
+constexpr char		RAYS_PER_SECOND_MSG[]		= "%.2f Mrays/s (threads: %u, pinned: %u, nodes: %u, smt: %s, pages: %s)";
+constexpr char		LANE_OCCUPANCY_MSG[]		= "Lane occupancy: %.1f%%";
+constexpr char		RESOLUTION_MSG[]			= "Resolution %ux%u, last frame traced in %.1f ms";
+constexpr char		STREAM_OCCUPANCY_MSG[]		= "Lane occupancy at depth %u: %.1f%% as traced, %.1f%% regrouped";
+constexpr char		BAD_PATTERN_MSG[]			= "Invalid capture pattern: %s";
+constexpr char		RECORDING_MSG[]				= "Recording to %s";
+constexpr char		RECORDING_DONE_MSG[]		= "Recording stopped";
+constexpr char		SCREENSHOT_MSG[]			= "Screenshot %s";
+constexpr char		CAPTURE_MSG[]				= "Captured %u frames, %u dropped, %u failed";
+constexpr char		TILE_CACHE_MSG[]			= "Tile cache: %.1f%% of %u tiles from memory, %.1f%% from disk";
+constexpr char		PERF_THREAD_MSG[]			= "Thread %2u: %s";
+constexpr char		PERF_TOTAL_MSG[]			= "All:       %s";
+constexpr char		PERF_UNAVAILABLE_MSG[]		= "Performance counters unavailable: %s";
 
 ////////////////////////////////////////////////////////////////////////////////
 
 /**
  * @brief ScreenRenderer::ScreenRenderer	Constructor for hte class
+ * @param options	Thread and memory settings.
+ * @param camPos	The camera position the window starts at.
+ * @param view		Where the camera looks at the start.
  */
-ScreenRenderer::ScreenRenderer()
-	: m_shouldQuit( false )
-	, m_origin( 0., 0., 5. )
+ScreenRenderer::ScreenRenderer( const Options& options, const Vec3& camPos, const CameraView& view )
+	: m_options( options )
+	, m_buffer( options.hugePages )
+	, m_upload( size_t( SCREEN_WIDTH ) * SCREEN_HEIGHT )
+	, m_program( new GLProgram( VERT_SHADER_FILE_PATH, FRAG_SHADER_FILE_PATH ) )
+	// leave one thread for the gl calls.
+	, m_tracer( options, 1 )
+	, m_resolution( options.targetFrameMs / 1000.0, options.minScale )
+	, m_frameWidth( SCREEN_WIDTH )
+	, m_frameHeight( SCREEN_HEIGHT )
+	, m_frameCamera( camPos )
+	, m_frameView( view )
+	, m_frameTraced( false )
+	, m_recording( false )
+	, m_screenshot( false )
+	, m_captureIndex( 0 )
+	, m_screenshotIndex( 0 )
+	, m_statsTime( std::chrono::steady_clock::now() )
+	, m_statsRays( 0 )
 {
-	m_buffer	= new Vec3[ BUFFER_SIZE ];
-	m_program	= new GLProgram( VERT_SHADER_FILE_PATH, FRAG_SHADER_FILE_PATH );
-
 	InitTexture();
+	m_tracer.ClearBuffer( m_buffer );
 
-	// leave one thread for the gl calls.
-	auto	threadCount	= std::thread::hardware_concurrency() - 1;
-
-	for( uint32_t i = 0; i < threadCount; ++i )
+	// The threads have opened their counters for the clear.
+	if( m_options.perfCounters && ! m_tracer.PerfError().empty() )
 	{
-		m_threads.push_back( std::make_shared< std::thread >( &ScreenRenderer::RenderBuffer, this ) );
+		SDL_Log( PERF_UNAVAILABLE_MSG, m_tracer.PerfError().c_str() );
+		m_options.perfCounters	= false;
 	}
 }
 ////////////////////////////////////////////////////////////////////////////////
 
 /**
- * @brief ScreenRenderer::~ScreenRenderer	Destructor for the class.
+ * @brief ScreenRenderer::~ScreenRenderer	Destructor for the class. The render
+ * threads are stopped by the tracer, before the buffer is released.
  */
 ScreenRenderer::~ScreenRenderer()
 {
-	m_shouldQuit	= true;
-	for( auto& t : m_threads )
-		t->join();
-
-	delete[]	m_buffer;
+	if( m_capture )
+	{
+		m_capture->Finish();
+		SDL_Log( CAPTURE_MSG, m_capture->Written(), m_capture->Dropped(), m_capture->Failed() );
+	}
 }
 ////////////////////////////////////////////////////////////////////////////////
 
 /**
  * @brief ScreenRenderer::Update	Update method. Called every frame.
- * @param cam	The camera position.
+ * Starts tracing the next frame once the previous one is done, the window
+ * keeps showing the buffer while it is being filled. The resolution of the
+ * next frame follows from the trace time of the last one. With a frame time
+ * target a frame that runs over it is cut short once the camera has moved, the
+ * tiles traced first are the ones that matter most (see TileOrder). A frame
+ * that was finished is captured before the next one starts.
+ * @param cam		The camera position.
+ * @param view		Where the camera looks.
+ * @param cursor	The mouse position in window pixels, top down.
  */
-void	ScreenRenderer::Update( const Vec3& camPos )
+void	ScreenRenderer::Update( const Vec3& camPos, const CameraView& view, int cursorX, int cursorY )
 {
-	m_origin	= camPos;
+	const Vec3	delta	= camPos - m_frameCamera;
+	const bool	moved	= 0.0f != delta.dot( delta ) || view != m_frameView;
+
+	if( ! m_tracer.IsFrameDone() )
+	{
+		if( !( m_options.targetFrameMs > 0.0f ) || ! moved ||
+			m_tracer.Elapsed() * 1000.0 < m_options.targetFrameMs )
+			return;
+
+		m_tracer.CancelFrame();
+	}
+	else if( m_frameTraced )
+	{
+		CaptureFrame();
+	}
+
+	if( m_options.targetFrameMs > 0.0f )
+	{
+		m_resolution.Update( m_tracer.FrameTime(), moved );
+
+		m_frameWidth	= m_resolution.Width();
+		m_frameHeight	= m_resolution.Height();
+	}
+
+	if( view != m_frameView )
+		m_tracer.SetView( view );
+
+	m_frameCamera	= camPos;
+	m_frameView		= view;
+	m_tracer.SetFocus( float( cursorX ) * m_frameWidth / SCREEN_WIDTH,
+					   float( SCREEN_HEIGHT - cursorY ) * m_frameHeight / SCREEN_HEIGHT );
+	m_tracer.StartFrame( camPos, m_buffer, m_frameWidth, m_frameHeight );
+	m_frameTraced	= true;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief ScreenRenderer::ToggleRecording	Starts or stops writing every
+ * finished frame to the files of the capture pattern.
+ */
+void	ScreenRenderer::ToggleRecording()
+{
+	if( m_recording )
+	{
+		m_recording	= false;
+		SDL_Log( RECORDING_DONE_MSG );
+		return;
+	}
+
+	if( FramePath( m_options.capture, 0 ).empty() )
+	{
+		SDL_Log( BAD_PATTERN_MSG, m_options.capture.c_str() );
+		return;
+	}
+
+	m_recording	= true;
+	SDL_Log( RECORDING_MSG, m_options.capture.c_str() );
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief ScreenRenderer::TakeScreenshot	Saves the next finished frame to the
+ * first unused file name of the screenshot pattern.
+ */
+void	ScreenRenderer::TakeScreenshot()
+{
+	if( FramePath( m_options.screenshot, 0 ).empty() )
+	{
+		SDL_Log( BAD_PATTERN_MSG, m_options.screenshot.c_str() );
+		return;
+	}
+
+	m_screenshot	= true;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief ScreenRenderer::CaptureFrame	Hands the finished frame to the
+ * capture threads if it is wanted. The frame is put in row order straight
+ * into a vector of the capture pool, the only work done on this thread.
+ */
+void	ScreenRenderer::CaptureFrame()
+{
+	if( ! m_recording && ! m_screenshot )
+		return;
+
+	if( ! m_capture )
+		m_capture.reset( new Capture( m_options.captureThreads, SCREEN_WIDTH, SCREEN_HEIGHT ) );
+
+	m_buffer.Deswizzle( m_upload.data(), SCREEN_WIDTH, m_frameWidth, m_frameHeight );
+
+	if( m_screenshot )
+	{
+		std::string	path	= FramePath( m_options.screenshot, m_screenshotIndex );
+		while( FileExists( path.c_str() ) )
+			path	= FramePath( m_options.screenshot, ++m_screenshotIndex );
+
+		// A recorded frame needs the pixels as well, the screenshot gets a copy.
+		std::vector< Vec3 >	copy;
+		if( m_recording )
+			copy	= m_upload;
+
+		if( m_capture->Submit( m_recording ? copy : m_upload, m_frameWidth, m_frameHeight, path ) )
+		{
+			SDL_Log( SCREENSHOT_MSG, path.c_str() );
+			m_screenshot	= false;
+			++m_screenshotIndex;
+		}
+	}
+
+	if( m_recording &&
+		m_capture->Submit( m_upload, m_frameWidth, m_frameHeight, FramePath( m_options.capture, m_captureIndex ) ) )
+	{
+		++m_captureIndex;
+	}
 }
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -76,18 +226,89 @@ void	ScreenRenderer::ClearScreen()
 
 /**
  * @brief ScreenRenderer::RenderFrame	Function that renders the frame.
- * Uploads the new screen data from m_buffer to a texture and then displays the
- * said texture.
+ * Puts the tiles of m_buffer in row order, uploads them to a texture and then
+ * displays the said texture, scaled up if the frame has a lower resolution.
  */
 void	ScreenRenderer::RenderFrame()
 {
+	m_buffer.Deswizzle( m_upload.data(), SCREEN_WIDTH, m_frameWidth, m_frameHeight );
+
+	m_program->Use();
+	m_program->SetUniform( "uvScale", float( m_frameWidth ) / SCREEN_WIDTH,
+						   float( m_frameHeight ) / SCREEN_HEIGHT );
+	m_program->SetUniform( "uvMax", ( m_frameWidth - 0.5f ) / SCREEN_WIDTH,
+						   ( m_frameHeight - 0.5f ) / SCREEN_HEIGHT );
+
 	glBindTexture( GL_TEXTURE_2D, m_textureId );
 	glTexImage2D( GL_TEXTURE_2D, 0, GL_RGB, SCREEN_WIDTH, SCREEN_HEIGHT, 0,
-				  GL_RGB, GL_FLOAT, m_buffer );
+				  GL_RGB, GL_FLOAT, m_upload.data() );
 
 	glBindVertexArray( m_VAO );
 	glBindTexture( GL_TEXTURE_2D, m_textureId );
 	glDrawElements( GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr );
+
+	LogRaysPerSecond();
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief ScreenRenderer::LogRaysPerSecond	Logs the ray throughput together
+ * with the thread and memory settings, about once per second. Running with
+ * different options gives a rays/s comparison for each setting.
+ */
+void	ScreenRenderer::LogRaysPerSecond()
+{
+	auto	now		= std::chrono::steady_clock::now();
+	double	elapsed	= std::chrono::duration< double >( now - m_statsTime ).count();
+	if( elapsed < 1.0 )
+		return;
+
+	uint64_t	rays	= m_tracer.RayCount();
+
+	SDL_Log( RAYS_PER_SECOND_MSG, double( rays - m_statsRays ) / elapsed * 1e-6,
+			 m_tracer.ThreadCount(), m_tracer.PinnedCount(), m_tracer.NodeCount(),
+			 m_options.useSmt ? "on" : "off", PageKindName( m_buffer.Kind() ) );
+
+	const TraversalStats	traversal	= m_tracer.Traversal();
+	SDL_Log( LANE_OCCUPANCY_MSG, ( traversal - m_statsTraversal ).Occupancy() * 100.0 );
+
+	if( m_options.targetFrameMs > 0.0f )
+		SDL_Log( RESOLUTION_MSG, m_frameWidth, m_frameHeight, m_tracer.FrameTime() * 1000.0 );
+
+	if( m_capture )
+		SDL_Log( CAPTURE_MSG, m_capture->Written(), m_capture->Dropped(), m_capture->Failed() );
+
+	const StreamStats		stream		= m_tracer.Stream();
+	if( m_options.streamRays )
+	{
+		SDL_Log( STREAM_OCCUPANCY_MSG, STREAM_DEPTH,
+				 ( stream.deferred - m_statsStream.deferred ).Occupancy() * 100.0,
+				 ( stream.compacted - m_statsStream.compacted ).Occupancy() * 100.0 );
+	}
+
+	const TileCacheStats	cache		= m_tracer.CacheStats();
+	const uint64_t			lookups		= cache.Lookups() - m_statsCache.Lookups();
+	if( 0 != lookups )
+	{
+		SDL_Log( TILE_CACHE_MSG, double( cache.memoryHits - m_statsCache.memoryHits ) / lookups * 100.0,
+				 static_cast< uint32_t >( lookups ),
+				 double( cache.diskHits - m_statsCache.diskHits ) / lookups * 100.0 );
+	}
+
+	// The events of the last frame, the frames of a second are alike.
+	if( m_options.perfCounters )
+	{
+		const std::vector< PerfCounts >	counts	= m_tracer.PerfFrame();
+		for( size_t t = 0; t < counts.size(); ++t )
+			SDL_Log( PERF_THREAD_MSG, static_cast< uint32_t >( t ), FormatPerfCounts( counts[ t ] ).c_str() );
+		SDL_Log( PERF_TOTAL_MSG, FormatPerfCounts( SumPerfCounts( counts ) ).c_str() );
+	}
+
+	m_statsTime			= now;
+	m_statsRays			= rays;
+	m_statsTraversal	= traversal;
+	m_statsStream		= stream;
+	m_statsCache		= cache;
 }
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -140,49 +361,12 @@ void	ScreenRenderer::InitTexture()
 
 	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER );
 	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER );
-	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
-	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+	// At native resolution the pixels sample texel centers, linear filtering
+	// only blends when a lower resolution is scaled up.
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
 
 	glActiveTexture( GL_TEXTURE0 );
-
-	for( uint32_t i = 0; i < BUFFER_SIZE; ++i )
-	{
-		m_buffer[ i ]	= Vec3( 0.178f, 0.461f, 0.853f );
-	}
 }
 ////////////////////////////////////////////////////////////////////////////////
 
-/**
- * @brief ScreenRenderer::RenderBuffer	This function does the ray tracing.
- * It is called from multiple threads. And will continue execute, while the
- * program is running.
- */
-using	dist	= std::uniform_int_distribution< uint32_t >;
-void	ScreenRenderer::RenderBuffer()
-{
-	auto			s	= std::chrono::system_clock::now().time_since_epoch();
-
-	std::mt19937	mt;
-	mt.seed( static_cast< uint32_t >( s.count() ) );
-
-	dist	rndWidth( 0, SCREEN_WIDTH / SIMD::SIZE - 1 );
-	dist	rndHeight( 0, SCREEN_HEIGHT - 1 );
-
-	for(;;)
-	{
-		HitRecord	records;
-		uint32_t	x		= rndWidth( mt ) * SIMD::SIZE;
-		uint32_t	y		= rndHeight( mt );
-		uint32_t	index	= y * SCREEN_WIDTH + x;
-		Ray			ray		= Ray::castRays( m_origin, x, y );
-
-		m_sphereFlake.Intersect( ray, records );
-
-		for( uint32_t k = 0; k < SIMD::SIZE; ++k )
-			m_buffer[ index + k ]	= records.extractColor( ray, k );
-
-		if( m_shouldQuit )
-			return;
-	}
-}
-////////////////////////////////////////////////////////////////////////////////
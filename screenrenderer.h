@@ -4,49 +4,84 @@
 
 ////////////////////////////////////////////////////////////////////////////////
 
-#include <thread>
+#include <chrono>
+#include <memory>
 #include <vector>
 
 #include <stdint.h>
 
 #include "vec3.h"
-#include "sphereflake.h"
+#include "capture.h"
+#include "framebuffer.h"
 #include "glprogram.h"
+#include "options.h"
+#include "resolution.h"
+#include "tracer.h"
 
 ////////////////////////////////////////////////////////////////////////////////
 
 /**
  * @brief The ScreenRenderer class is used to render the SphereFlake to the
  * screen.
+ *
+ * With 'options.targetFrameMs' the frames are traced at the resolution picked
+ * by DynamicResolution and the fragment shader scales them up to the window.
+ *
+ * Finished frames can be recorded as a numbered sequence and saved as
+ * screenshots. They are encoded by a Capture on its own threads, created on
+ * first use.
  */
 class ScreenRenderer
 {
 public:
-	ScreenRenderer();
+	ScreenRenderer( const Options& options, const Vec3& camPos, const CameraView& view );
 	~ScreenRenderer();
 
-	void	Update( const Vec3& camPos );
+	void	Update( const Vec3& camPos, const CameraView& view, int cursorX, int cursorY );
 	void	ClearScreen();
 	void	RenderFrame();
 
+	void	ToggleRecording();
+	void	TakeScreenshot();
+
 private:
 	void	InitTexture();
-	void	RenderBuffer();
+	void	LogRaysPerSecond();
+	void	CaptureFrame();
 
 private:
-	bool			m_shouldQuit;
+	uint32_t				m_textureId;
+	uint32_t				m_VAO;
+	uint32_t				m_VBO;
+	uint32_t				m_EBO;
+
+	Options					m_options;
+	FrameBuffer				m_buffer;
+	// The buffer in row order for the texture upload.
+	std::vector< Vec3 >		m_upload;
+	GLProgram*				m_program;
+	Tracer					m_tracer;
 
-	Vec3			m_origin;
-	uint32_t		m_textureId;
-	uint32_t		m_VAO;
-	uint32_t		m_VBO;
-	uint32_t		m_EBO;
+	// Resolution of the frame being traced and the camera it is traced from.
+	DynamicResolution		m_resolution;
+	uint32_t				m_frameWidth;
+	uint32_t				m_frameHeight;
+	Vec3					m_frameCamera;
+	CameraView				m_frameView;
+	bool					m_frameTraced;
 
-	Vec3*			m_buffer;
-	GLProgram*		m_program;
-	SphereFlake		m_sphereFlake;
+	// Frames to capture once they are finished.
+	std::unique_ptr< Capture >	m_capture;
+	bool						m_recording;
+	bool						m_screenshot;
+	uint32_t					m_captureIndex;
+	uint32_t					m_screenshotIndex;
 
-	std::vector< std::shared_ptr< std::thread > >	m_threads;
+	std::chrono::steady_clock::time_point	m_statsTime;
+	uint64_t								m_statsRays;
+	TraversalStats							m_statsTraversal;
+	StreamStats								m_statsStream;
+	TileCacheStats							m_statsCache;
 };
 ////////////////////////////////////////////////////////////////////////////////
 
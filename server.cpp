@@ -0,0 +1,714 @@
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <inttypes.h>
+#include <math.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "config.h"
+#include "framebuffer.h"
+#include "image.h"
+#include "qoi.h"
+#include "simd.h"
+#include "socket.h"
+#include "tracer.h"
+
+#include "server.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Requests waiting for the tracer, more are answered with STATUS_BUSY.
+constexpr size_t	MAX_QUEUED				= 256;
+// Frames in flight: one traced while the other is encoded.
+constexpr uint32_t	BUFFER_COUNT			= 2;
+// Number of recent requests the latency percentiles are taken over.
+constexpr size_t	LATENCY_WINDOW			= 1024;
+constexpr int		POLL_INTERVAL_MS		= 100;
+// Receive timeout for a message that has started to arrive.
+constexpr uint32_t	MESSAGE_TIMEOUT_MS		= 2000;
+constexpr double	STATS_INTERVAL_S		= 10.0;
+
+constexpr char		LISTEN_FAILED_MSG[]		= "Failed to listen on %s\n";
+constexpr char		CONNECT_FAILED_MSG[]	= "Failed to connect to %s\n";
+constexpr char		SERVER_START_MSG[]		= "Serving on %s with %u threads\n";
+constexpr char		SERVER_DONE_MSG[]		= "Server stopped after %.1f s\n";
+constexpr char		STATS_MSG[]				= "%" PRIu64 " requests (%" PRIu64 " shared a frame, %" PRIu64 " rejected), "
+											  "%" PRIu64 " frames, %.1f requests/s, %.2f Mrays/s while tracing\n"
+											  "Latency %.1f ms mean, %.1f p50, %.1f p95, %.1f p99, %.1f max "
+											  "(queue %.1f, trace %.1f, encode %.1f)\n";
+constexpr char		QUERY_FAILED_MSG[]		= "No answer from %s\n";
+constexpr char		QUERY_STATUS_MSG[]		= "The server refused the request (status %u)\n";
+constexpr char		WRITE_FAILED_MSG[]		= "Failed to write %s\n";
+constexpr char		QUERY_DONE_MSG[]		= "%ux%u image written to %s in %.1f ms (queue %.1f, trace %.1f, encode %.1f)\n";
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+	using	Clock	= std::chrono::steady_clock;
+
+	// Set by SIGINT and SIGTERM.
+	volatile sig_atomic_t	g_interrupted	= 0;
+
+	void	OnInterrupt( int )
+	{
+		g_interrupted	= 1;
+	}
+	////////////////////////////////////////////////////////////////////////////
+
+	double	Milliseconds( Clock::duration d )
+	{
+		return	std::chrono::duration< double, std::milli >( d ).count();
+	}
+	////////////////////////////////////////////////////////////////////////////
+
+	void	PrintStats( const Server::StatsReply& stats )
+	{
+		fprintf( stderr, STATS_MSG, stats.requests, stats.shared, stats.rejected, stats.frames,
+				 stats.requestsPerSecond, stats.raysPerSecond / 1000000.0, stats.latencyMean,
+				 stats.latencyP50, stats.latencyP95, stats.latencyP99, stats.latencyMax,
+				 stats.queueMean, stats.traceMean, stats.encodeMean );
+	}
+	////////////////////////////////////////////////////////////////////////////
+
+	/**
+	 * @brief The Client struct is a connection. It is shared by the requests
+	 * in flight, the socket is closed when the last of them is answered, so
+	 * the descriptor is not reused while replies may still be sent to it.
+	 * Replies are sent by both the network and the render thread.
+	 */
+	struct	Client
+	{
+		explicit Client( int fd )
+			: fd( fd )
+			, closed( false )
+		{
+		}
+
+		~Client()
+		{
+			Net::Close( fd );
+		}
+
+		bool	Send( uint32_t type, const void* header, uint32_t headerSize,
+					  const void* payload = nullptr, uint32_t size = 0 )
+		{
+			std::lock_guard< std::mutex >	lock( sendMutex );
+			return	Net::SendMessage( fd, type, header, headerSize, payload, size );
+		}
+
+		const int			fd;
+		std::mutex			sendMutex;
+		std::atomic< bool >	closed;
+	};
+
+	struct	Request
+	{
+		std::shared_ptr< Client >	client;
+		Server::RenderRequest		msg;
+		Clock::time_point			received;
+	};
+
+	/**
+	 * @brief The Frame struct is one traced frame and the requests it answers.
+	 */
+	struct	Frame
+	{
+		Vec3					camera;
+		uint32_t				width;
+		uint32_t				height;
+		Precision				precision;
+		std::vector< Request >	requests;
+		Clock::time_point		started;
+		double					traceMs;
+	};
+	////////////////////////////////////////////////////////////////////////////
+
+	/**
+	 * @brief IsValid	Returns true if the request can be traced.
+	 */
+	bool	IsValid( const Server::RenderRequest& msg )
+	{
+		return	msg.width > 0 && msg.width <= SCREEN_WIDTH &&
+				msg.height > 0 && msg.height <= SCREEN_HEIGHT &&
+				msg.quality <= static_cast< uint32_t >( Quality::PREVIEW ) &&
+				isfinite( msg.camera[ 0 ] ) && isfinite( msg.camera[ 1 ] ) && isfinite( msg.camera[ 2 ] );
+	}
+	////////////////////////////////////////////////////////////////////////////
+
+	/**
+	 * @brief MakeFrame	Returns the frame that answers 'request', without the
+	 * request. The traced width is rounded up to the SIMD width, the image is
+	 * scaled to the requested size.
+	 */
+	Frame	MakeFrame( const Request& request )
+	{
+		const Server::RenderRequest&	msg		= request.msg;
+		const Quality					quality	= static_cast< Quality >( msg.quality );
+
+		Frame	frame;
+		frame.camera	= Vec3( msg.camera[ 0 ], msg.camera[ 1 ], msg.camera[ 2 ] );
+		frame.width		= msg.width;
+		frame.height	= msg.height;
+		frame.precision	= ( Quality::FULL == quality ) ? Precision::EXACT : Precision::FAST;
+		frame.traceMs	= 0.0;
+
+		if( Quality::PREVIEW == quality )
+		{
+			frame.width		= ( frame.width  + 1 ) / 2;
+			frame.height	= ( frame.height + 1 ) / 2;
+		}
+
+		frame.width	= ( frame.width + SIMD::SIZE - 1 ) / SIMD::SIZE * SIMD::SIZE;
+		return	frame;
+	}
+	////////////////////////////////////////////////////////////////////////////
+
+	bool	SameFrame( const Frame& a, const Frame& b )
+	{
+		return	a.camera.x == b.camera.x && a.camera.y == b.camera.y && a.camera.z == b.camera.z &&
+				a.width == b.width && a.height == b.height && a.precision == b.precision;
+	}
+	////////////////////////////////////////////////////////////////////////////
+
+	/**
+	 * @brief The Statistics class collects the timings of the answered
+	 * requests. Written by the render thread, read by the network thread.
+	 */
+	class Statistics
+	{
+	public:
+		Statistics()
+			: m_start( Clock::now() )
+			, m_traceMs( 0.0 )
+			, m_next( 0 )
+		{
+			memset( &m_totals, 0, sizeof( m_totals ) );
+			m_latencies.reserve( LATENCY_WINDOW );
+		}
+
+		void	Answered( double queueMs, double traceMs, double encodeMs, double latencyMs, bool shared )
+		{
+			std::lock_guard< std::mutex >	lock( m_mutex );
+			++m_totals.requests;
+			m_totals.shared			+= shared ? 1 : 0;
+			m_totals.latencyMean	+= latencyMs;
+			m_totals.latencyMax		= std::max( m_totals.latencyMax, latencyMs );
+			m_totals.queueMean		+= queueMs;
+			m_totals.traceMean		+= traceMs;
+			m_totals.encodeMean		+= encodeMs;
+
+			if( m_latencies.size() < LATENCY_WINDOW )
+				m_latencies.push_back( latencyMs );
+			else
+				m_latencies[ m_next ]	= latencyMs;
+
+			m_next	= ( m_next + 1 ) % LATENCY_WINDOW;
+		}
+
+		void	Rejected()
+		{
+			std::lock_guard< std::mutex >	lock( m_mutex );
+			++m_totals.rejected;
+		}
+
+		void	Traced( uint64_t rays, double traceMs )
+		{
+			std::lock_guard< std::mutex >	lock( m_mutex );
+			++m_totals.frames;
+			m_totals.rays	+= rays;
+			m_traceMs		+= traceMs;
+		}
+
+		/**
+		 * @brief Snapshot	Returns the statistics so far, the sums of the
+		 * totals turned into means.
+		 */
+		Server::StatsReply	Snapshot()	const
+		{
+			std::vector< double >	latencies;
+			Server::StatsReply		stats;
+			double					traceMs;
+			{
+				std::lock_guard< std::mutex >	lock( m_mutex );
+				latencies	= m_latencies;
+				stats		= m_totals;
+				traceMs		= m_traceMs;
+			}
+
+			stats.uptime	= std::chrono::duration< double >( Clock::now() - m_start ).count();
+
+			if( 0 != stats.requests )
+			{
+				stats.requestsPerSecond	= stats.requests / stats.uptime;
+				stats.latencyMean		/= stats.requests;
+				stats.queueMean			/= stats.requests;
+				stats.traceMean			/= stats.requests;
+				stats.encodeMean		/= stats.requests;
+			}
+
+			if( traceMs > 0.0 )
+				stats.raysPerSecond	= stats.rays / ( traceMs / 1000.0 );
+
+			if( ! latencies.empty() )
+			{
+				std::sort( latencies.begin(), latencies.end() );
+				auto	percentile	= [ & ]( double p ) { return latencies[ size_t( p * ( latencies.size() - 1 ) ) ]; };
+
+				stats.latencyP50	= percentile( 0.50 );
+				stats.latencyP95	= percentile( 0.95 );
+				stats.latencyP99	= percentile( 0.99 );
+			}
+
+			return	stats;
+		}
+
+	private:
+		mutable std::mutex		m_mutex;
+		Clock::time_point		m_start;
+		// Counters and sums, the rates and percentiles are left at 0.
+		Server::StatsReply		m_totals;
+		double					m_traceMs;
+		std::vector< double >	m_latencies;
+		size_t					m_next;
+	};
+	////////////////////////////////////////////////////////////////////////////
+
+	/**
+	 * @brief The BatchRenderer class traces the queued requests on its own
+	 * thread with a Tracer that uses all CPUs.
+	 *
+	 * The requests that arrive while a batch is traced form the next batch.
+	 * Requests of a batch that want the same frame share it, the frames are
+	 * traced in the order their first request arrived. A frame is encoded and
+	 * sent while the next one is traced.
+	 */
+	class BatchRenderer
+	{
+	public:
+		BatchRenderer( const Options& options, Statistics& stats )
+			: m_tracer( options, 0 )
+			, m_stats( stats )
+			, m_rays( 0 )
+			, m_rows( size_t( SCREEN_WIDTH ) * SCREEN_HEIGHT )
+			, m_row( SCREEN_WIDTH )
+			, m_rgb( size_t( SCREEN_WIDTH ) * SCREEN_HEIGHT * 3 )
+			, m_shouldQuit( false )
+		{
+			for( uint32_t i = 0; i < BUFFER_COUNT; ++i )
+			{
+				m_buffers[ i ].reset( new FrameBuffer( options.hugePages ) );
+				m_tracer.ClearBuffer( *m_buffers[ i ] );
+			}
+
+			m_thread	= std::thread( &BatchRenderer::Run, this );
+		}
+
+		/**
+		 * @brief ~BatchRenderer	Answers the requests that are queued and
+		 * stops the thread.
+		 */
+		~BatchRenderer()
+		{
+			{
+				std::lock_guard< std::mutex >	lock( m_mutex );
+				m_shouldQuit	= true;
+			}
+
+			m_cv.notify_all();
+			m_thread.join();
+		}
+
+		/**
+		 * @brief Push	Queues a request.
+		 * @return	Returns false if the queue is full.
+		 */
+		bool	Push( Request&& request )
+		{
+			{
+				std::lock_guard< std::mutex >	lock( m_mutex );
+				if( m_queue.size() >= MAX_QUEUED )
+					return	false;
+
+				m_queue.push_back( std::move( request ) );
+			}
+
+			m_cv.notify_one();
+			return	true;
+		}
+
+		uint32_t	ThreadCount()	const	{ return	m_tracer.ThreadCount(); }
+
+	private:
+		void	Run()
+		{
+			std::unique_lock< std::mutex >	lock( m_mutex );
+			for(;;)
+			{
+				m_cv.wait( lock, [ this ]() { return m_shouldQuit || ! m_queue.empty(); } );
+				if( m_queue.empty() )
+					return;
+
+				std::deque< Request >	batch;
+				batch.swap( m_queue );
+
+				lock.unlock();
+				TraceBatch( batch );
+				lock.lock();
+			}
+		}
+
+		/**
+		 * @brief TraceBatch	Groups the requests by frame, traces the frames
+		 * and answers the requests.
+		 */
+		void	TraceBatch( std::deque< Request >& batch )
+		{
+			std::vector< Frame >	frames;
+			for( auto& request : batch )
+			{
+				if( request.client->closed )
+					continue;
+
+				Frame	frame	= MakeFrame( request );
+				auto	same	= std::find_if( frames.begin(), frames.end(),
+												[ & ]( const Frame& f ) { return SameFrame( f, frame ); } );
+				if( frames.end() == same )
+				{
+					frames.push_back( frame );
+					same	= frames.end() - 1;
+				}
+
+				same->requests.push_back( std::move( request ) );
+			}
+
+			for( size_t i = 0; i < frames.size(); ++i )
+			{
+				m_tracer.WaitFrame();
+				if( 0 != i )
+					FinishFrame( frames[ i - 1 ] );
+
+				Frame&	frame	= frames[ i ];
+				m_tracer.SetPrecision( frame.precision );
+
+				m_rays			= m_tracer.RayCount();
+				frame.started	= Clock::now();
+				m_tracer.StartFrame( frame.camera, *m_buffers[ i % BUFFER_COUNT ], frame.width, frame.height );
+
+				if( 0 != i )
+					Answer( frames[ i - 1 ], *m_buffers[ ( i - 1 ) % BUFFER_COUNT ] );
+			}
+
+			if( ! frames.empty() )
+			{
+				m_tracer.WaitFrame();
+				FinishFrame( frames.back() );
+				Answer( frames.back(), *m_buffers[ ( frames.size() - 1 ) % BUFFER_COUNT ] );
+			}
+		}
+
+		/**
+		 * @brief FinishFrame	Records the trace time of the frame that just
+		 * finished.
+		 */
+		void	FinishFrame( Frame& frame )
+		{
+			frame.traceMs	= m_tracer.FrameTime() * 1000.0;
+			m_stats.Traced( m_tracer.RayCount() - m_rays, frame.traceMs );
+		}
+
+		/**
+		 * @brief Answer	Scales the frame in 'buffer' to the size of every
+		 * request of 'frame', encodes it and sends it.
+		 */
+		void	Answer( const Frame& frame, const FrameBuffer& buffer )
+		{
+			buffer.Deswizzle( m_rows.data(), frame.width, frame.width, frame.height );
+
+			for( size_t i = 0; i < frame.requests.size(); ++i )
+			{
+				const Request&	request	= frame.requests[ i ];
+				const uint32_t	width	= request.msg.width;
+				const uint32_t	height	= request.msg.height;
+
+				const Clock::time_point	encodeStart	= Clock::now();
+
+				// The frame is bottom up, images are top down.
+				for( uint32_t y = 0; y < height; ++y )
+				{
+					const uint32_t		srcY	= ( height - 1 - y ) * frame.height / height;
+					const Vec3* const	src		= m_rows.data() + size_t( srcY ) * frame.width;
+					for( uint32_t x = 0; x < width; ++x )
+						m_row[ x ]	= src[ x * frame.width / width ];
+
+					ConvertToRgb8( m_row.data(), width, 1, 0, m_rgb.data() + size_t( y ) * width * 3 );
+				}
+
+				const auto	encoded	= QOI::Encode( m_rgb.data(), width, height );
+				const Clock::time_point	encodeEnd	= Clock::now();
+
+				Server::RenderReply	reply;
+				reply.id		= request.msg.id;
+				reply.status	= Server::STATUS_OK;
+				reply.width		= width;
+				reply.height	= height;
+				reply.queueMs	= static_cast< float >( Milliseconds( frame.started - request.received ) );
+				reply.traceMs	= static_cast< float >( frame.traceMs );
+				reply.encodeMs	= static_cast< float >( Milliseconds( encodeEnd - encodeStart ) );
+
+				if( ! request.client->Send( Server::MSG_IMAGE, &reply, sizeof( reply ),
+											encoded.data(), static_cast< uint32_t >( encoded.size() ) ) )
+				{
+					request.client->closed	= true;
+					continue;
+				}
+
+				m_stats.Answered( reply.queueMs, reply.traceMs, reply.encodeMs,
+								  Milliseconds( Clock::now() - request.received ), 0 != i );
+			}
+		}
+
+	private:
+		Tracer							m_tracer;
+		Statistics&						m_stats;
+		std::unique_ptr< FrameBuffer >	m_buffers[ BUFFER_COUNT ];
+		uint64_t						m_rays;
+
+		// Scratch of Answer: the frame in row order, one scaled row and the
+		// image.
+		std::vector< Vec3 >				m_rows;
+		std::vector< Vec3 >				m_row;
+		std::vector< uint8_t >			m_rgb;
+
+		std::mutex						m_mutex;
+		std::condition_variable			m_cv;
+		std::deque< Request >			m_queue;
+		bool							m_shouldQuit;
+		std::thread						m_thread;
+	};
+	////////////////////////////////////////////////////////////////////////////
+
+	/**
+	 * @brief Reject	Answers a request that is not traced.
+	 */
+	void	Reject( Client& client, const Server::RenderRequest& msg, Server::Status status,
+					Statistics& stats )
+	{
+		Server::RenderReply	reply;
+		memset( &reply, 0, sizeof( reply ) );
+		reply.id		= msg.id;
+		reply.status	= status;
+
+		if( ! client.Send( Server::MSG_IMAGE, &reply, sizeof( reply ) ) )
+			client.closed	= true;
+
+		stats.Rejected();
+	}
+	////////////////////////////////////////////////////////////////////////////
+
+	/**
+	 * @brief HandleMessage	Handles one message of 'client'.
+	 * @return	Returns false if the client sent something it should not have.
+	 */
+	bool	HandleMessage( const std::shared_ptr< Client >& client, uint32_t type,
+						   const std::vector< uint8_t >& payload, BatchRenderer& renderer,
+						   Statistics& stats )
+	{
+		if( Server::MSG_STATS == type )
+		{
+			const Server::StatsReply	reply	= stats.Snapshot();
+			return	client->Send( Server::MSG_STATS_REPLY, &reply, sizeof( reply ) );
+		}
+
+		if( Server::MSG_RENDER != type || payload.size() != sizeof( Server::RenderRequest ) )
+			return	false;
+
+		Request	request;
+		request.client		= client;
+		request.received	= Clock::now();
+		memcpy( &request.msg, payload.data(), sizeof( request.msg ) );
+
+		if( ! IsValid( request.msg ) )
+			Reject( *client, request.msg, Server::STATUS_BAD_REQUEST, stats );
+		else
+		{
+			const Server::RenderRequest	msg	= request.msg;
+			if( ! renderer.Push( std::move( request ) ) )
+				Reject( *client, msg, Server::STATUS_BUSY, stats );
+		}
+
+		return	true;
+	}
+	////////////////////////////////////////////////////////////////////////////
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief RunServer	Answers requests on 'options.address' until the process
+ * is interrupted, then answers the queued requests and prints the statistics.
+ * @return	Returns the process exit code.
+ */
+int	RunServer( const Options& options )
+{
+	int	listenFd	= Net::Listen( options.address.c_str() );
+	if( listenFd < 0 )
+	{
+		fprintf( stderr, LISTEN_FAILED_MSG, options.address.c_str() );
+		return	1;
+	}
+
+	// The flag is checked after every poll, which also returns early when
+	// the signal is delivered to this thread.
+	struct sigaction	action;
+	memset( &action, 0, sizeof( action ) );
+	action.sa_handler	= OnInterrupt;
+	sigaction( SIGINT, &action, nullptr );
+	sigaction( SIGTERM, &action, nullptr );
+
+	Statistics								stats;
+	std::vector< std::shared_ptr< Client > >	clients;
+	Clock::time_point						lastLog		= Clock::now();
+	uint64_t								lastCount	= 0;
+	{
+		BatchRenderer	renderer( options, stats );
+		fprintf( stderr, SERVER_START_MSG, options.address.c_str(), renderer.ThreadCount() );
+
+		while( ! g_interrupted )
+		{
+			std::vector< pollfd >	fds( 1 + clients.size() );
+			fds[ 0 ]	= { listenFd, POLLIN, 0 };
+			for( size_t i = 0; i < clients.size(); ++i )
+				fds[ i + 1 ]	= { clients[ i ]->fd, POLLIN, 0 };
+
+			poll( fds.data(), fds.size(), POLL_INTERVAL_MS );
+
+			if( fds[ 0 ].revents & POLLIN )
+			{
+				int	fd	= Net::Accept( listenFd );
+				if( fd >= 0 )
+				{
+					Net::SetReceiveTimeout( fd, MESSAGE_TIMEOUT_MS );
+					clients.push_back( std::make_shared< Client >( fd ) );
+				}
+			}
+
+			for( size_t i = 0; i + 1 < fds.size(); ++i )
+			{
+				const auto&	client	= clients[ i ];
+				if( 0 == fds[ i + 1 ].revents || client->closed )
+					continue;
+
+				uint32_t				type;
+				std::vector< uint8_t >	payload;
+				if( ! Net::ReceiveMessage( client->fd, type, payload ) ||
+					! HandleMessage( client, type, payload, renderer, stats ) )
+					client->closed	= true;
+			}
+
+			// The requests in flight keep their client until they are
+			// answered.
+			clients.erase( std::remove_if( clients.begin(), clients.end(),
+										   []( const std::shared_ptr< Client >& c ) { return c->closed.load(); } ),
+						   clients.end() );
+
+			const Clock::time_point	now	= Clock::now();
+			if( std::chrono::duration< double >( now - lastLog ).count() >= STATS_INTERVAL_S )
+			{
+				const Server::StatsReply	snapshot	= stats.Snapshot();
+				if( snapshot.requests + snapshot.rejected != lastCount )
+					PrintStats( snapshot );
+
+				lastCount	= snapshot.requests + snapshot.rejected;
+				lastLog		= now;
+			}
+		}
+	}
+
+	const Server::StatsReply	snapshot	= stats.Snapshot();
+	PrintStats( snapshot );
+	fprintf( stderr, SERVER_DONE_MSG, snapshot.uptime );
+
+	clients.clear();
+	Net::StopListening( listenFd, options.address.c_str() );
+	return	0;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief RunQuery	Requests the image at 'options.camera' from the server at
+ * 'options.address', writes it to 'options.output' and prints the statistics
+ * of the server.
+ * @return	Returns the process exit code.
+ */
+int	RunQuery( const Options& options )
+{
+	int	fd	= Net::Connect( options.address.c_str() );
+	if( fd < 0 )
+	{
+		fprintf( stderr, CONNECT_FAILED_MSG, options.address.c_str() );
+		return	1;
+	}
+
+	Server::RenderRequest	request	= { 1, options.imageWidth, options.imageHeight,
+										static_cast< uint32_t >( options.quality ),
+										{ options.camera.x, options.camera.y, options.camera.z } };
+
+	const Clock::time_point	start	= Clock::now();
+
+	uint32_t				type;
+	std::vector< uint8_t >	payload;
+	if( ! Net::SendMessage( fd, Server::MSG_RENDER, &request, sizeof( request ) ) ||
+		! Net::ReceiveMessage( fd, type, payload ) ||
+		Server::MSG_IMAGE != type || payload.size() < sizeof( Server::RenderReply ) )
+	{
+		fprintf( stderr, QUERY_FAILED_MSG, options.address.c_str() );
+		Net::Close( fd );
+		return	1;
+	}
+
+	const double	roundTrip	= Milliseconds( Clock::now() - start );
+
+	Server::RenderReply	reply;
+	memcpy( &reply, payload.data(), sizeof( reply ) );
+	if( Server::STATUS_OK != reply.status )
+	{
+		fprintf( stderr, QUERY_STATUS_MSG, reply.status );
+		Net::Close( fd );
+		return	1;
+	}
+
+	const std::vector< uint8_t >	image( payload.begin() + sizeof( reply ), payload.end() );
+	if( ! WriteFileAtomic( options.output.c_str(), image ) )
+	{
+		fprintf( stderr, WRITE_FAILED_MSG, options.output.c_str() );
+		Net::Close( fd );
+		return	1;
+	}
+
+	fprintf( stderr, QUERY_DONE_MSG, reply.width, reply.height, options.output.c_str(), roundTrip,
+			 reply.queueMs, reply.traceMs, reply.encodeMs );
+
+	Server::StatsReply	stats;
+	if( Net::SendMessage( fd, Server::MSG_STATS, nullptr, 0 ) &&
+		Net::ReceiveMessage( fd, type, payload ) &&
+		Server::MSG_STATS_REPLY == type && payload.size() == sizeof( stats ) )
+	{
+		memcpy( &stats, payload.data(), sizeof( stats ) );
+		PrintStats( stats );
+	}
+
+	Net::Close( fd );
+	return	0;
+}
+////////////////////////////////////////////////////////////////////////////////
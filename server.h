@@ -0,0 +1,116 @@
+
+#ifndef SERVER_H
+#define SERVER_H
+
+////////////////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+
+#include "options.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Render server answering image requests of other processes.
+ *
+ * The server listens on 'options.address' and keeps one Tracer for its whole
+ * life. Clients send a RenderRequest with the camera, the image size and the
+ * Quality, and get back a RenderReply followed by the image encoded as QOI,
+ * top row first. The image always shows the field of view of the window, a
+ * size of another aspect ratio stretches it. A StatsRequest is answered with
+ * the StatsReply of the server.
+ *
+ * Requests are collected while the tracer is busy and traced as a batch. The
+ * requests of a batch that want the same frame (camera, traced size and
+ * precision) share it, and a frame is encoded and sent while the next one is
+ * traced. Requests that do not fit in the queue are answered with
+ * STATUS_BUSY.
+ *
+ * The messages use the framing of Net::SendMessage, in host byte order.
+ *
+ * @note Linux only.
+ */
+namespace Server
+{
+	enum	MessageType : uint32_t
+	{
+		MSG_RENDER		= 1,
+		MSG_IMAGE		= 2,
+		MSG_STATS		= 3,
+		MSG_STATS_REPLY	= 4,
+	};
+
+	enum	Status : uint32_t
+	{
+		STATUS_OK			= 0,
+		STATUS_BAD_REQUEST	= 1,
+		STATUS_BUSY			= 2,
+	};
+
+	/**
+	 * @brief The RenderRequest struct is the payload of MSG_RENDER. 'id' is
+	 * chosen by the client and returned in the reply. The size is at most the
+	 * screen size, 'quality' is a Quality.
+	 */
+	struct	RenderRequest
+	{
+		uint32_t	id;
+		uint32_t	width;
+		uint32_t	height;
+		uint32_t	quality;
+		float		camera[ 3 ];
+	};
+
+	/**
+	 * @brief The RenderReply struct is the header of MSG_IMAGE, the QOI image
+	 * follows it when the status is STATUS_OK. The times are in milliseconds:
+	 * waiting in the queue, tracing the frame and encoding the image.
+	 */
+	struct	RenderReply
+	{
+		uint32_t	id;
+		uint32_t	status;
+		uint32_t	width;
+		uint32_t	height;
+		float		queueMs;
+		float		traceMs;
+		float		encodeMs;
+	};
+
+	/**
+	 * @brief The StatsReply struct is the payload of MSG_STATS_REPLY, the
+	 * answer to an empty MSG_STATS.
+	 *
+	 * The latencies are from receiving a request until its reply is sent, in
+	 * milliseconds, over the last requests (see LATENCY_WINDOW in the source).
+	 * The means are over all the requests answered with an image. 'shared'
+	 * counts the requests that got a frame traced for another one.
+	 */
+	struct	StatsReply
+	{
+		uint64_t	requests;
+		uint64_t	rejected;
+		uint64_t	shared;
+		uint64_t	frames;
+		uint64_t	rays;
+		double		uptime;
+		double		requestsPerSecond;
+		double		raysPerSecond;
+		double		latencyMean;
+		double		latencyP50;
+		double		latencyP95;
+		double		latencyP99;
+		double		latencyMax;
+		double		queueMean;
+		double		traceMean;
+		double		encodeMean;
+	};
+} // namespace Server
+////////////////////////////////////////////////////////////////////////////////
+
+int	RunServer( const Options& options );
+int	RunQuery( const Options& options );
+
+////////////////////////////////////////////////////////////////////////////////
+
+#endif // SERVER_H
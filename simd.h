@@ -10,25 +10,30 @@
 
 // This code selects the SIMD implementation that is going to be used.
 // In case that no SIMD is available, a no SIMD implementation is provided
-// as well.
-
-// NOTE!: AVX512 is untested. The PC used for the development does not support
-// AVX512.
+// as well. The build picks one with USE_AVX512, USE_AVX, USE_SSE or
+// USE_NO_SIMD (see the SIMD variable of the .pro file), AVX is the default.
+// The golden image check (--golden) traces the same views with every one.
 
+#if !defined(USE_AVX512) && !defined(USE_AVX) && !defined(USE_SSE) && !defined(USE_NO_SIMD)
 #define USE_AVX
+#endif
 
 #if defined(USE_AVX512)
 #include "simd_avx512.h"
 	namespace	SIMD	= AVX512;
+	constexpr char	SIMD_NAME[]	= "avx512";
 #elif defined(USE_AVX)
 #include "simd_avx.h"
 	namespace	SIMD	= AVX;
+	constexpr char	SIMD_NAME[]	= "avx";
 #elif defined(USE_SSE)
 #include "simd_sse.h"
 	namespace	SIMD	= SSE;
+	constexpr char	SIMD_NAME[]	= "sse";
 #else
 #include "simd_base.h"
 	namespace	SIMD	= NO_SIMD;
+	constexpr char	SIMD_NAME[]	= "none";
 #endif
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -8,6 +8,8 @@
 #include <cassert>
 #include <immintrin.h>
 
+#include "simd_precision.h"
+#include "simd_interleave.h"
 #include "vec3.h"
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -33,7 +35,11 @@ namespace AVX
 			__m256		val;
 			uint32_t	f[ SIZE ];
 		};
+		bool_t() {}
 		constexpr bool_t( __m256 v ) : val( v ) {}
+		constexpr bool_t( const bool_t& rhs ) : val( rhs.val ) {}
+
+		bool_t&		operator=( const bool_t& rhs )				{ val	= rhs.val; return	*this; }
 
 		operator bool()											const
 		{
@@ -42,10 +48,25 @@ namespace AVX
 				return	true;
 			return	false;
 		}
+
+		bool_t		operator&( const bool_t& rhs )				const { return	_mm256_and_ps( val, rhs.val ); }
+
+		/**
+		 * @brief Mask	Returns one bit per lane, set for the true lanes.
+		 */
+		uint32_t	Mask()										const { return	_mm256_movemask_ps( val ); }
+
+		/**
+		 * @brief Extract	Returns the value of lane 'index', in the same lane
+		 * order as float_t::Extract.
+		 */
+		bool		Extract( uint32_t index )					const { return	0 != f[ SIZE - index - 1 ]; }
 	};
 
 	// Const false value
 	const bool_t	FALSE_VALUE	= _mm256_set1_ps( 0.0f );
+	// Const true value, all lanes set
+	const bool_t	TRUE_VALUE	= _mm256_castsi256_ps( _mm256_set1_epi32( -1 ) );
 
 	/**
 	 * @brief The float_t struct is a float type that uses SIMD.
@@ -61,6 +82,9 @@ namespace AVX
 			val	= _mm256_set1_ps( v );
 		}
 		constexpr float_t( __m256 v ) : val( v ) { }
+		constexpr float_t( const float_t& rhs ) : val( rhs.val ) { }
+
+		float_t&	operator=( const float_t& rhs )				{ val	= rhs.val; return	*this; }
 
 		float_t	operator*( const float_t& rhs )						const { return	_mm256_mul_ps( val, rhs.val );   }
 		float_t	operator-( const float_t& rhs )						const { return	_mm256_sub_ps( val, rhs.val );   }
@@ -76,6 +100,14 @@ namespace AVX
 			return	_mm256_and_ps( minMask, maxMask );
 		}
 
+		/**
+		 * @brief Load	Returns the lanes 'v', lane i is returned by Extract( i ).
+		 */
+		static float_t	Load( const float v[ SIZE ] )
+		{
+			return	_mm256_set_ps( v[ 0 ], v[ 1 ], v[ 2 ], v[ 3 ], v[ 4 ], v[ 5 ], v[ 6 ], v[ 7 ] );
+		}
+
 		float	Extract( uint32_t index ) const
 		{
 			switch( index )
@@ -112,6 +144,31 @@ namespace AVX
 
 		AVXVec3(){}
 
+		// Copy the registers, not the float arrays of the unions, so the
+		// compiler keeps the copies in full width registers.
+		AVXVec3( const AVXVec3& rhs )
+		{
+			val[ 0 ].m	= rhs.val[ 0 ].m;
+			val[ 1 ].m	= rhs.val[ 1 ].m;
+			val[ 2 ].m	= rhs.val[ 2 ].m;
+		}
+
+		AVXVec3&	operator=( const AVXVec3& rhs )
+		{
+			val[ 0 ].m	= rhs.val[ 0 ].m;
+			val[ 1 ].m	= rhs.val[ 1 ].m;
+			val[ 2 ].m	= rhs.val[ 2 ].m;
+
+			return	*this;
+		}
+
+		AVXVec3( const float_t& x, const float_t& y, const float_t& z )
+		{
+			val[ 0 ].m	= x.val;
+			val[ 1 ].m	= y.val;
+			val[ 2 ].m	= z.val;
+		}
+
 		AVXVec3( Vec3 v )
 		{
 			val[ 0 ].m	= _mm256_set1_ps( v.x );
@@ -263,6 +320,140 @@ namespace AVX
 		return	_mm256_sqrt_ps( val.val );
 	}
 	////////////////////////////////////////////////////////////////////////////
+
+	/**
+	 * @brief Sqrt	Square root with the precision policy 'P'.
+	 */
+	template< Precision P >
+	float_t	Sqrt( const float_t& val );
+
+	/**
+	 * @brief RSqrt	Reciprocal square root with the precision policy 'P'.
+	 */
+	template< Precision P >
+	float_t	RSqrt( const float_t& val );
+
+	template<>
+	inline
+	float_t	Sqrt< Precision::EXACT >( const float_t& val )
+	{
+		return	_mm256_sqrt_ps( val.val );
+	}
+
+	template<>
+	inline
+	float_t	RSqrt< Precision::EXACT >( const float_t& val )
+	{
+		return	_mm256_div_ps( _mm256_set1_ps( 1.0f ), _mm256_sqrt_ps( val.val ) );
+	}
+
+	template<>
+	inline
+	float_t	RSqrt< Precision::FAST >( const float_t& val )
+	{
+		// y = y * ( 1.5 - 0.5 * x * y * y )
+		__m256	y		= _mm256_rsqrt_ps( val.val );
+		__m256	halfX	= _mm256_mul_ps( val.val, _mm256_set1_ps( 0.5f ) );
+		__m256	yy		= _mm256_mul_ps( y, y );
+
+		return	_mm256_mul_ps( y, _mm256_sub_ps( _mm256_set1_ps( 1.5f ), _mm256_mul_ps( halfX, yy ) ) );
+	}
+
+	template<>
+	inline
+	float_t	Sqrt< Precision::FAST >( const float_t& val )
+	{
+		// rsqrt( 0 ) is infinite, zero those lanes.
+		__m256	positive	= _mm256_cmp_ps( val.val, _mm256_setzero_ps(), _CMP_GT_OQ );
+		return	_mm256_and_ps( _mm256_mul_ps( val.val, RSqrt< Precision::FAST >( val ).val ), positive );
+	}
+	////////////////////////////////////////////////////////////////////////////
+
+	/**
+	 * @brief GetY	Returns the y components of 'v'.
+	 */
+	inline
+	float_t	GetY( const AVXVec3& v )
+	{
+		return	v.val[ 1 ].m;
+	}
+	////////////////////////////////////////////////////////////////////////////
+
+	/**
+	 * @brief Gather	Returns table[ index ] for every lane, 'index' is clamped
+	 * to [ 0, count - 1 ] and truncated. AVX has no gather instruction, the
+	 * entries are loaded one by one.
+	 */
+	inline
+	AVXVec3	Gather( const Vec3* table, const float_t& index, uint32_t count )
+	{
+		const __m256	clamped	= _mm256_min_ps( _mm256_max_ps( index.val, _mm256_setzero_ps() ),
+												 _mm256_set1_ps( float( count - 1 ) ) );
+
+		alignas( 32 ) int32_t	i[ SIZE ];
+		_mm256_store_si256( reinterpret_cast< __m256i* >( i ), _mm256_cvttps_epi32( clamped ) );
+
+		const Vec3* const	e[ SIZE ]	= { table + i[ 0 ], table + i[ 1 ], table + i[ 2 ], table + i[ 3 ],
+											table + i[ 4 ], table + i[ 5 ], table + i[ 6 ], table + i[ 7 ] };
+
+		AVXVec3	result;
+		result.val[ 0 ].m	= _mm256_setr_ps( e[ 0 ]->x, e[ 1 ]->x, e[ 2 ]->x, e[ 3 ]->x, e[ 4 ]->x, e[ 5 ]->x, e[ 6 ]->x, e[ 7 ]->x );
+		result.val[ 1 ].m	= _mm256_setr_ps( e[ 0 ]->y, e[ 1 ]->y, e[ 2 ]->y, e[ 3 ]->y, e[ 4 ]->y, e[ 5 ]->y, e[ 6 ]->y, e[ 7 ]->y );
+		result.val[ 2 ].m	= _mm256_setr_ps( e[ 0 ]->z, e[ 1 ]->z, e[ 2 ]->z, e[ 3 ]->z, e[ 4 ]->z, e[ 5 ]->z, e[ 6 ]->z, e[ 7 ]->z );
+
+		return	result;
+	}
+	////////////////////////////////////////////////////////////////////////////
+
+	/**
+	 * @brief StorePixels	Writes the lanes of 'color' to the SIZE pixels at
+	 * 'out', lane Extract( k ) to out[ k ]. If 'out' is 32 byte aligned the
+	 * pixels are written with non-temporal stores, which bypass the caches,
+	 * see StoreFence.
+	 */
+	inline
+	void	StorePixels( const AVXVec3& color, Vec3* out )
+	{
+		// Pixels 0 to 3 are in the high half, in reverse order.
+		__m128	first[ 3 ];
+		__m128	second[ 3 ];
+		InterleaveRgb( ReverseLanes( _mm256_extractf128_ps( color.val[ 0 ].m, 1 ) ),
+					   ReverseLanes( _mm256_extractf128_ps( color.val[ 1 ].m, 1 ) ),
+					   ReverseLanes( _mm256_extractf128_ps( color.val[ 2 ].m, 1 ) ), first );
+		InterleaveRgb( ReverseLanes( _mm256_castps256_ps128( color.val[ 0 ].m ) ),
+					   ReverseLanes( _mm256_castps256_ps128( color.val[ 1 ].m ) ),
+					   ReverseLanes( _mm256_castps256_ps128( color.val[ 2 ].m ) ), second );
+
+		float* const	dst	= &out->x;
+		if( 0 == reinterpret_cast< uintptr_t >( dst ) % 32 )
+		{
+			_mm256_stream_ps( dst +  0, _mm256_insertf128_ps( _mm256_castps128_ps256( first[ 0 ] ), first[ 1 ], 1 ) );
+			_mm256_stream_ps( dst +  8, _mm256_insertf128_ps( _mm256_castps128_ps256( first[ 2 ] ), second[ 0 ], 1 ) );
+			_mm256_stream_ps( dst + 16, _mm256_insertf128_ps( _mm256_castps128_ps256( second[ 1 ] ), second[ 2 ], 1 ) );
+		}
+		else
+		{
+			_mm_storeu_ps( dst +  0, first[ 0 ] );
+			_mm_storeu_ps( dst +  4, first[ 1 ] );
+			_mm_storeu_ps( dst +  8, first[ 2 ] );
+			_mm_storeu_ps( dst + 12, second[ 0 ] );
+			_mm_storeu_ps( dst + 16, second[ 1 ] );
+			_mm_storeu_ps( dst + 20, second[ 2 ] );
+		}
+	}
+	////////////////////////////////////////////////////////////////////////////
+
+	/**
+	 * @brief StoreFence	Orders the non-temporal stores of StorePixels before
+	 * the stores that follow, so a thread that sees the tile as done also sees
+	 * its pixels.
+	 */
+	inline
+	void	StoreFence()
+	{
+		_mm_sfence();
+	}
+	////////////////////////////////////////////////////////////////////////////
 }; // namespace AVX
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -8,6 +8,8 @@
 #include <cassert>
 #include <immintrin.h>
 
+#include "simd_precision.h"
+#include "simd_interleave.h"
 #include "vec3.h"
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -19,7 +21,7 @@
  */
 namespace AVX512
 {
-#ifdef __AVX512__
+#ifdef __AVX512F__
 
 	static constexpr uint8_t	SIZE	= 16;
 
@@ -36,17 +38,33 @@ namespace AVX512
 		union {
 			__mmask16		val;
 		};
+		bool_t() {}
 		constexpr bool_t( __mmask16 v ) : val( v ) {}
 
 		operator bool()											const
 		{
 			return	val != 0;
 		}
+
+		bool_t		operator&( const bool_t& rhs )				const { return	static_cast< __mmask16 >( val & rhs.val ); }
+
+		/**
+		 * @brief Mask	Returns one bit per lane, set for the true lanes.
+		 */
+		uint32_t	Mask()										const { return	val; }
+
+		/**
+		 * @brief Extract	Returns the value of lane 'index', in the same lane
+		 * order as float_t::Extract.
+		 */
+		bool		Extract( uint32_t index )					const { return	0 != ( ( val >> ( SIZE - index - 1 ) ) & 1 ); }
 	};
 	////////////////////////////////////////////////////////////////////////////
 
 	// Const false value
 	const bool_t	FALSE_VALUE	= 0;
+	// Const true value, all lanes set
+	const bool_t	TRUE_VALUE	= 0xFFFF;
 
 	/**
 	 * @brief The float_t struct is a float type that uses SIMD.
@@ -62,6 +80,9 @@ namespace AVX512
 			val	= _mm512_set1_ps( v );
 		}
 		constexpr float_t( __m512 v ) : val( v ) { }
+		constexpr float_t( const float_t& rhs ) : val( rhs.val ) { }
+
+		float_t&	operator=( const float_t& rhs )				{ val	= rhs.val; return	*this; }
 
 		float_t	operator*( const float_t& rhs )						const { return	_mm512_mul_ps( val, rhs.val );                  }
 		float_t	operator-( const float_t& rhs )						const { return	_mm512_sub_ps( val, rhs.val );                  }
@@ -77,6 +98,14 @@ namespace AVX512
 			return	minMask & maxMask;
 		}
 
+		/**
+		 * @brief Load	Returns the lanes 'v', lane i is returned by Extract( i ).
+		 */
+		static float_t	Load( const float v[ SIZE ] )
+		{
+			return	_mm512_set_ps( v[ 0 ], v[ 1 ], v[ 2 ], v[ 3 ], v[ 4 ], v[ 5 ], v[ 6 ], v[ 7 ], v[ 8 ], v[ 9 ], v[ 10 ], v[ 11 ], v[ 12 ], v[ 13 ], v[ 14 ], v[ 15 ] );
+		}
+
 		float	Extract( uint32_t index ) const
 		{
 			if( index >= 16 )
@@ -103,6 +132,31 @@ namespace AVX512
 
 		AVX512Vec3(){}
 
+		// Copy the registers, not the float arrays of the unions, so the
+		// compiler keeps the copies in full width registers.
+		AVX512Vec3( const AVX512Vec3& rhs )
+		{
+			val[ 0 ].m	= rhs.val[ 0 ].m;
+			val[ 1 ].m	= rhs.val[ 1 ].m;
+			val[ 2 ].m	= rhs.val[ 2 ].m;
+		}
+
+		AVX512Vec3&	operator=( const AVX512Vec3& rhs )
+		{
+			val[ 0 ].m	= rhs.val[ 0 ].m;
+			val[ 1 ].m	= rhs.val[ 1 ].m;
+			val[ 2 ].m	= rhs.val[ 2 ].m;
+
+			return	*this;
+		}
+
+		AVX512Vec3( const float_t& x, const float_t& y, const float_t& z )
+		{
+			val[ 0 ].m	= x.val;
+			val[ 1 ].m	= y.val;
+			val[ 2 ].m	= z.val;
+		}
+
 		AVX512Vec3( Vec3 v )
 		{
 			val[ 0 ].m	= _mm512_set1_ps( v.x );
@@ -167,7 +221,7 @@ namespace AVX512
 	inline
 	float_t	PickBasedOnCondition( bool_t cond, const float_t& f1, const float_t& f2 )
 	{
-		return	_mm512_mask_blend_ps( cond.val, f1.val, f2.val );
+		return	_mm512_mask_blend_ps( cond.val, f2.val, f1.val );
 	}
 	////////////////////////////////////////////////////////////////////////////
 
@@ -180,9 +234,9 @@ namespace AVX512
 	{
 		AVX512Vec3	result;
 
-		result.val[ 0 ].m	= _mm512_mask_blend_ps( cond.val, v1.val[ 0 ].m, v2.val[ 0 ].m );
-		result.val[ 1 ].m	= _mm512_mask_blend_ps( cond.val, v1.val[ 1 ].m, v2.val[ 1 ].m );
-		result.val[ 2 ].m	= _mm512_mask_blend_ps( cond.val, v1.val[ 2 ].m, v2.val[ 2 ].m );
+		result.val[ 0 ].m	= _mm512_mask_blend_ps( cond.val, v2.val[ 0 ].m, v1.val[ 0 ].m );
+		result.val[ 1 ].m	= _mm512_mask_blend_ps( cond.val, v2.val[ 1 ].m, v1.val[ 1 ].m );
+		result.val[ 2 ].m	= _mm512_mask_blend_ps( cond.val, v2.val[ 2 ].m, v1.val[ 2 ].m );
 
 		return	result;
 	}
@@ -242,8 +296,141 @@ namespace AVX512
 		return	_mm512_sqrt_ps( val.val );
 	}
 	////////////////////////////////////////////////////////////////////////////
-#endif // __AVX512__
 
+	/**
+	 * @brief Sqrt	Square root with the precision policy 'P'.
+	 */
+	template< Precision P >
+	float_t	Sqrt( const float_t& val );
+
+	/**
+	 * @brief RSqrt	Reciprocal square root with the precision policy 'P'.
+	 */
+	template< Precision P >
+	float_t	RSqrt( const float_t& val );
+
+	template<>
+	inline
+	float_t	Sqrt< Precision::EXACT >( const float_t& val )
+	{
+		return	_mm512_sqrt_ps( val.val );
+	}
+
+	template<>
+	inline
+	float_t	RSqrt< Precision::EXACT >( const float_t& val )
+	{
+		return	_mm512_div_ps( _mm512_set1_ps( 1.0f ), _mm512_sqrt_ps( val.val ) );
+	}
+
+	template<>
+	inline
+	float_t	RSqrt< Precision::FAST >( const float_t& val )
+	{
+		// y = y * ( 1.5 - 0.5 * x * y * y )
+		__m512	y		= _mm512_rsqrt14_ps( val.val );
+		__m512	halfX	= _mm512_mul_ps( val.val, _mm512_set1_ps( 0.5f ) );
+		__m512	yy		= _mm512_mul_ps( y, y );
+
+		return	_mm512_mul_ps( y, _mm512_sub_ps( _mm512_set1_ps( 1.5f ), _mm512_mul_ps( halfX, yy ) ) );
+	}
+
+	template<>
+	inline
+	float_t	Sqrt< Precision::FAST >( const float_t& val )
+	{
+		// rsqrt( 0 ) is infinite, zero those lanes.
+		__mmask16	positive	= _mm512_cmp_ps_mask( val.val, _mm512_setzero_ps(), _CMP_GT_OQ );
+		return	_mm512_maskz_mul_ps( positive, val.val, RSqrt< Precision::FAST >( val ).val );
+	}
+	////////////////////////////////////////////////////////////////////////////
+#endif // __AVX512F__
+
+
+	/**
+	 * @brief GetY	Returns the y components of 'v'.
+	 */
+	inline
+	float_t	GetY( const AVX512Vec3& v )
+	{
+		return	v.val[ 1 ].m;
+	}
+	////////////////////////////////////////////////////////////////////////////
+
+	/**
+	 * @brief Gather	Returns table[ index ] for every lane, 'index' is clamped
+	 * to [ 0, count - 1 ] and truncated.
+	 */
+	inline
+	AVX512Vec3	Gather( const Vec3* table, const float_t& index, uint32_t count )
+	{
+		static_assert( sizeof( Vec3 ) == 3 * sizeof( float ), "Vec3 must be three packed floats" );
+
+		const __m512	clamped	= _mm512_min_ps( _mm512_max_ps( index.val, _mm512_setzero_ps() ),
+												 _mm512_set1_ps( float( count - 1 ) ) );
+		const __m512i	offset	= _mm512_mullo_epi32( _mm512_cvttps_epi32( clamped ), _mm512_set1_epi32( 3 ) );
+		const float*	base	= &table->x;
+
+		AVX512Vec3	result;
+		result.val[ 0 ].m	= _mm512_i32gather_ps( offset, base + 0, sizeof( float ) );
+		result.val[ 1 ].m	= _mm512_i32gather_ps( offset, base + 1, sizeof( float ) );
+		result.val[ 2 ].m	= _mm512_i32gather_ps( offset, base + 2, sizeof( float ) );
+
+		return	result;
+	}
+	////////////////////////////////////////////////////////////////////////////
+
+	/**
+	 * @brief StorePixels	Writes the lanes of 'color' to the SIZE pixels at
+	 * 'out', lane Extract( k ) to out[ k ]. If 'out' is 64 byte aligned the
+	 * pixels are written with non-temporal stores, which bypass the caches,
+	 * see StoreFence.
+	 */
+	inline
+	void	StorePixels( const AVX512Vec3& color, Vec3* out )
+	{
+		// Quarter q holds pixels 12 - 4q to 15 - 4q in reverse order.
+		alignas( 64 ) __m128	rgb[ 12 ];
+		InterleaveRgb( ReverseLanes( _mm512_extractf32x4_ps( color.val[ 0 ].m, 3 ) ),
+					   ReverseLanes( _mm512_extractf32x4_ps( color.val[ 1 ].m, 3 ) ),
+					   ReverseLanes( _mm512_extractf32x4_ps( color.val[ 2 ].m, 3 ) ), rgb + 0 );
+		InterleaveRgb( ReverseLanes( _mm512_extractf32x4_ps( color.val[ 0 ].m, 2 ) ),
+					   ReverseLanes( _mm512_extractf32x4_ps( color.val[ 1 ].m, 2 ) ),
+					   ReverseLanes( _mm512_extractf32x4_ps( color.val[ 2 ].m, 2 ) ), rgb + 3 );
+		InterleaveRgb( ReverseLanes( _mm512_extractf32x4_ps( color.val[ 0 ].m, 1 ) ),
+					   ReverseLanes( _mm512_extractf32x4_ps( color.val[ 1 ].m, 1 ) ),
+					   ReverseLanes( _mm512_extractf32x4_ps( color.val[ 2 ].m, 1 ) ), rgb + 6 );
+		InterleaveRgb( ReverseLanes( _mm512_extractf32x4_ps( color.val[ 0 ].m, 0 ) ),
+					   ReverseLanes( _mm512_extractf32x4_ps( color.val[ 1 ].m, 0 ) ),
+					   ReverseLanes( _mm512_extractf32x4_ps( color.val[ 2 ].m, 0 ) ), rgb + 9 );
+
+		const float*	src	= reinterpret_cast< const float* >( rgb );
+		float* const	dst	= &out->x;
+		if( 0 == reinterpret_cast< uintptr_t >( dst ) % 64 )
+		{
+			_mm512_stream_ps( dst +  0, _mm512_load_ps( src +  0 ) );
+			_mm512_stream_ps( dst + 16, _mm512_load_ps( src + 16 ) );
+			_mm512_stream_ps( dst + 32, _mm512_load_ps( src + 32 ) );
+		}
+		else
+		{
+			_mm512_storeu_ps( dst +  0, _mm512_load_ps( src +  0 ) );
+			_mm512_storeu_ps( dst + 16, _mm512_load_ps( src + 16 ) );
+			_mm512_storeu_ps( dst + 32, _mm512_load_ps( src + 32 ) );
+		}
+	}
+	////////////////////////////////////////////////////////////////////////////
+
+	/**
+	 * @brief StoreFence	Orders the non-temporal stores of StorePixels before
+	 * the stores that follow.
+	 */
+	inline
+	void	StoreFence()
+	{
+		_mm_sfence();
+	}
+	////////////////////////////////////////////////////////////////////////////
 }; // namespace AVX512
 ////////////////////////////////////////////////////////////////////////////////
 
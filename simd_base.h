@@ -6,6 +6,7 @@
 
 #include <stdint.h>
 
+#include "simd_precision.h"
 #include "vec3.h"
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -20,6 +21,8 @@ namespace NO_SIMD
 	static constexpr uint8_t	SIZE		= 1;
 	// Const false value
 	static constexpr bool		FALSE_VALUE	= false;
+	// Const true value
+	static constexpr bool		TRUE_VALUE	= true;
 	using						Vec			= Vec3;
 	struct						bool_t;
 
@@ -35,6 +38,10 @@ namespace NO_SIMD
 
 		constexpr			operator bool()	const { return	val; }
 
+		constexpr bool_t	operator&( const bool_t& rhs )	const { return	val && rhs.val; }
+		constexpr uint32_t	Mask()							const { return	val ? 1 : 0; }
+		constexpr bool		Extract( uint32_t )				const { return	val; }
+
 		bool	val;
 	};
 	////////////////////////////////////////////////////////////////////////////
@@ -46,14 +53,16 @@ namespace NO_SIMD
 	{
 		constexpr float_t( float v ) : val( v ) {}
 
+		// The arithmetic goes through the conversion to float.
 		constexpr			operator float()									const { return	val;                    }
-		constexpr float_t	operator+( const float_t& rhs )						const { return	val + rhs.val;          }
 		constexpr bool_t	operator<( const float_t& rhs )						const { return	val < rhs.val;          }
 		constexpr bool_t	GreaterOrEqualThan( const float_t& rhs )			const { return	val >= rhs.val;         }
 		constexpr bool_t	LessThan( const float_t& rhs )						const { return	val < rhs.val;          }
 		constexpr bool_t	IsInRange( const float_t& min, const float_t max )	const { return	val > min && val < max; }
 		constexpr float		Extract( uint32_t )									const { return	val;                    }
 
+		static constexpr float_t	Load( const float v[ SIZE ] )						  { return	v[ 0 ];                 }
+
 		float	val;
 	};
 	////////////////////////////////////////////////////////////////////////////
@@ -80,6 +89,70 @@ namespace NO_SIMD
 		return	v2;
 	}
 	////////////////////////////////////////////////////////////////////////////
+
+	/**
+	 * @brief Sqrt	Square root. The scalar code has no approximate path, both
+	 * precision policies are exact.
+	 */
+	template< Precision P >
+	inline
+	float_t	Sqrt( const float_t& val )
+	{
+		return	::sqrtf( val.val );
+	}
+	////////////////////////////////////////////////////////////////////////////
+
+	/**
+	 * @brief RSqrt	Reciprocal square root, exact for both policies.
+	 */
+	template< Precision P >
+	inline
+	float_t	RSqrt( const float_t& val )
+	{
+		return	1.0f / ::sqrtf( val.val );
+	}
+	////////////////////////////////////////////////////////////////////////////
+
+	/**
+	 * @brief GetY	Returns the y component of 'v'.
+	 */
+	inline
+	float_t	GetY( const Vec& v )
+	{
+		return	v.y;
+	}
+	////////////////////////////////////////////////////////////////////////////
+
+	/**
+	 * @brief Gather	Returns table[ index ], 'index' is clamped to
+	 * [ 0, count - 1 ] and truncated.
+	 */
+	inline
+	Vec	Gather( const Vec3* table, const float_t& index, uint32_t count )
+	{
+		const float	clamped	= fminf( fmaxf( index.val, 0.0f ), float( count - 1 ) );
+		return	table[ static_cast< uint32_t >( clamped ) ];
+	}
+	////////////////////////////////////////////////////////////////////////////
+
+	/**
+	 * @brief StorePixels	Writes 'color' to the pixel at 'out'.
+	 */
+	inline
+	void	StorePixels( const Vec& color, Vec3* out )
+	{
+		*out	= color;
+	}
+	////////////////////////////////////////////////////////////////////////////
+
+	/**
+	 * @brief StoreFence	Nothing to order, StorePixels uses plain stores.
+	 */
+	inline
+	void	StoreFence()
+	{
+	}
+	////////////////////////////////////////////////////////////////////////////
 }
 ////////////////////////////////////////////////////////////////////////////////
 
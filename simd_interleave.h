@@ -0,0 +1,42 @@
+
+#ifndef SIMD_INTERLEAVE_H
+#define SIMD_INTERLEAVE_H
+
+////////////////////////////////////////////////////////////////////////////////
+
+#include <xmmintrin.h>
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief ReverseLanes	Returns the four lanes of 'v' in reverse order. The
+ * backends keep pixel k in lane SIZE - k - 1 (see float_t::Extract).
+ */
+inline
+__m128	ReverseLanes( __m128 v )
+{
+	return	_mm_shuffle_ps( v, v, _MM_SHUFFLE( 0, 1, 2, 3 ) );
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief InterleaveRgb	Turns four pixels stored as separate r, g and b lanes
+ * (pixel k in lane k) into the twelve floats of four consecutive Vec3.
+ * out[ 0 ] = r0 g0 b0 r1, out[ 1 ] = g1 b1 r2 g2, out[ 2 ] = b2 r3 g3 b3.
+ */
+inline
+void	InterleaveRgb( __m128 r, __m128 g, __m128 b, __m128 out[ 3 ] )
+{
+	const __m128	rgLow	= _mm_unpacklo_ps( r, g );								// r0 g0 r1 g1
+	const __m128	rgHigh	= _mm_unpackhi_ps( r, g );								// r2 g2 r3 g3
+	const __m128	b0r1	= _mm_shuffle_ps( b, rgLow, _MM_SHUFFLE( 2, 2, 0, 0 ) );	// b0 b0 r1 r1
+	const __m128	g1b1	= _mm_shuffle_ps( rgLow, b, _MM_SHUFFLE( 1, 1, 3, 3 ) );	// g1 g1 b1 b1
+	const __m128	b2g3	= _mm_shuffle_ps( b, rgHigh, _MM_SHUFFLE( 3, 2, 3, 2 ) );	// b2 b3 r3 g3
+
+	out[ 0 ]	= _mm_shuffle_ps( rgLow, b0r1, _MM_SHUFFLE( 2, 0, 1, 0 ) );
+	out[ 1 ]	= _mm_shuffle_ps( g1b1, rgHigh, _MM_SHUFFLE( 1, 0, 2, 0 ) );
+	out[ 2 ]	= _mm_shuffle_ps( b2g3, b2g3, _MM_SHUFFLE( 1, 3, 2, 0 ) );
+}
+////////////////////////////////////////////////////////////////////////////////
+
+#endif // SIMD_INTERLEAVE_H
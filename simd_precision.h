@@ -0,0 +1,21 @@
+
+#ifndef SIMD_PRECISION_H
+#define SIMD_PRECISION_H
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief The Precision enum is the precision policy of the square root
+ * functions of the SIMD backends (Sqrt and RSqrt).
+ * EXACT	Full precision sqrt and divide.
+ * FAST		Approximate reciprocal square root refined with one Newton-Raphson
+ *			step, about 22 correct bits. Enough for primary visibility.
+ */
+enum class Precision
+{
+	EXACT,
+	FAST,
+};
+////////////////////////////////////////////////////////////////////////////////
+
+#endif // SIMD_PRECISION_H
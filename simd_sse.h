@@ -9,6 +9,8 @@
 #include <xmmintrin.h>
 #include <smmintrin.h>
 
+#include "simd_precision.h"
+#include "simd_interleave.h"
 #include "vec3.h"
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -34,17 +36,36 @@ namespace SSE
 			__m128		val;
 			uint32_t	f[ SIZE ];
 		};
+		bool_t() {}
 		constexpr bool_t( __m128 v ) : val( v ) {}
+		constexpr bool_t( const bool_t& rhs ) : val( rhs.val ) {}
+
+		bool_t&		operator=( const bool_t& rhs )				{ val	= rhs.val; return	*this; }
 
 		operator bool()											const
 		{
 			return	_mm_movemask_ps( val );
 		}
+
+		bool_t		operator&( const bool_t& rhs )				const { return	_mm_and_ps( val, rhs.val ); }
+
+		/**
+		 * @brief Mask	Returns one bit per lane, set for the true lanes.
+		 */
+		uint32_t	Mask()										const { return	_mm_movemask_ps( val ); }
+
+		/**
+		 * @brief Extract	Returns the value of lane 'index', in the same lane
+		 * order as float_t::Extract.
+		 */
+		bool		Extract( uint32_t index )					const { return	0 != f[ SIZE - index - 1 ]; }
 	};
 	////////////////////////////////////////////////////////////////////////////
 
 	// Const false value
 	const bool_t	FALSE_VALUE	= _mm_castsi128_ps( _mm_set1_epi32( 0 ) );
+	// Const true value, all lanes set
+	const bool_t	TRUE_VALUE	= _mm_castsi128_ps( _mm_set1_epi32( -1 ) );
 
 	/**
 	 * @brief The float_t struct is a float type that uses SIMD.
@@ -60,6 +81,9 @@ namespace SSE
 			val	= _mm_set1_ps( v );
 		}
 		constexpr float_t( __m128 v ) : val( v ) { }
+		constexpr float_t( const float_t& rhs ) : val( rhs.val ) { }
+
+		float_t&	operator=( const float_t& rhs )				{ val	= rhs.val; return	*this; }
 
 		float_t	operator*( const float_t& rhs )						const { return	_mm_mul_ps( val, rhs.val );   }
 		float_t	operator-( const float_t& rhs )						const { return	_mm_sub_ps( val, rhs.val );   }
@@ -69,14 +93,20 @@ namespace SSE
 		bool_t	LessThan( const float_t& rhs )						const { return	_mm_cmplt_ps( val, rhs.val ); }
 		bool_t	IsInRange( const float_t& min, const float_t& max )	const
 		{
-			_mm_cmp_ps( val, min.val, _CMP_GT_OQ );
-
 			__m128	minMask	= _mm_cmpgt_ps( val, min.val );
 			__m128	maxMask	= _mm_cmplt_ps( val, max.val );
 
 			return	_mm_and_ps( minMask, maxMask );
 		}
 
+		/**
+		 * @brief Load	Returns the lanes 'v', lane i is returned by Extract( i ).
+		 */
+		static float_t	Load( const float v[ SIZE ] )
+		{
+			return	_mm_set_ps( v[ 0 ], v[ 1 ], v[ 2 ], v[ 3 ] );
+		}
+
 		float	Extract( uint32_t index ) const
 		{
 			switch( index )
@@ -109,6 +139,31 @@ namespace SSE
 
 		SSEDVec3(){}
 
+		// Copy the registers, not the float arrays of the unions, so the
+		// compiler keeps the copies in full width registers.
+		SSEDVec3( const SSEDVec3& rhs )
+		{
+			val[ 0 ].m	= rhs.val[ 0 ].m;
+			val[ 1 ].m	= rhs.val[ 1 ].m;
+			val[ 2 ].m	= rhs.val[ 2 ].m;
+		}
+
+		SSEDVec3&	operator=( const SSEDVec3& rhs )
+		{
+			val[ 0 ].m	= rhs.val[ 0 ].m;
+			val[ 1 ].m	= rhs.val[ 1 ].m;
+			val[ 2 ].m	= rhs.val[ 2 ].m;
+
+			return	*this;
+		}
+
+		SSEDVec3( const float_t& x, const float_t& y, const float_t& z )
+		{
+			val[ 0 ].m	= x.val;
+			val[ 1 ].m	= y.val;
+			val[ 2 ].m	= z.val;
+		}
+
 		SSEDVec3( Vec3 v )
 		{
 			val[ 0 ].m	= _mm_set1_ps( v.x );
@@ -264,6 +319,128 @@ namespace SSE
 		return	_mm_sqrt_ps( val.val );
 	}
 	////////////////////////////////////////////////////////////////////////////
+
+	/**
+	 * @brief Sqrt	Square root with the precision policy 'P'.
+	 */
+	template< Precision P >
+	float_t	Sqrt( const float_t& val );
+
+	/**
+	 * @brief RSqrt	Reciprocal square root with the precision policy 'P'.
+	 */
+	template< Precision P >
+	float_t	RSqrt( const float_t& val );
+
+	template<>
+	inline
+	float_t	Sqrt< Precision::EXACT >( const float_t& val )
+	{
+		return	_mm_sqrt_ps( val.val );
+	}
+
+	template<>
+	inline
+	float_t	RSqrt< Precision::EXACT >( const float_t& val )
+	{
+		return	_mm_div_ps( _mm_set1_ps( 1.0f ), _mm_sqrt_ps( val.val ) );
+	}
+
+	template<>
+	inline
+	float_t	RSqrt< Precision::FAST >( const float_t& val )
+	{
+		// y = y * ( 1.5 - 0.5 * x * y * y )
+		__m128	y		= _mm_rsqrt_ps( val.val );
+		__m128	halfX	= _mm_mul_ps( val.val, _mm_set1_ps( 0.5f ) );
+		__m128	yy		= _mm_mul_ps( y, y );
+
+		return	_mm_mul_ps( y, _mm_sub_ps( _mm_set1_ps( 1.5f ), _mm_mul_ps( halfX, yy ) ) );
+	}
+
+	template<>
+	inline
+	float_t	Sqrt< Precision::FAST >( const float_t& val )
+	{
+		// rsqrt( 0 ) is infinite, zero those lanes.
+		__m128	positive	= _mm_cmpgt_ps( val.val, _mm_setzero_ps() );
+		return	_mm_and_ps( _mm_mul_ps( val.val, RSqrt< Precision::FAST >( val ).val ), positive );
+	}
+	////////////////////////////////////////////////////////////////////////////
+
+	/**
+	 * @brief GetY	Returns the y components of 'v'.
+	 */
+	inline
+	float_t	GetY( const SSEDVec3& v )
+	{
+		return	v.val[ 1 ].m;
+	}
+	////////////////////////////////////////////////////////////////////////////
+
+	/**
+	 * @brief Gather	Returns table[ index ] for every lane, 'index' is clamped
+	 * to [ 0, count - 1 ] and truncated.
+	 */
+	inline
+	SSEDVec3	Gather( const Vec3* table, const float_t& index, uint32_t count )
+	{
+		const __m128	clamped	= _mm_min_ps( _mm_max_ps( index.val, _mm_setzero_ps() ),
+											  _mm_set1_ps( float( count - 1 ) ) );
+
+		alignas( 16 ) int32_t	i[ SIZE ];
+		_mm_store_si128( reinterpret_cast< __m128i* >( i ), _mm_cvttps_epi32( clamped ) );
+
+		const Vec3* const	e[ SIZE ]	= { table + i[ 0 ], table + i[ 1 ], table + i[ 2 ], table + i[ 3 ] };
+
+		SSEDVec3	result;
+		result.val[ 0 ].m	= _mm_setr_ps( e[ 0 ]->x, e[ 1 ]->x, e[ 2 ]->x, e[ 3 ]->x );
+		result.val[ 1 ].m	= _mm_setr_ps( e[ 0 ]->y, e[ 1 ]->y, e[ 2 ]->y, e[ 3 ]->y );
+		result.val[ 2 ].m	= _mm_setr_ps( e[ 0 ]->z, e[ 1 ]->z, e[ 2 ]->z, e[ 3 ]->z );
+
+		return	result;
+	}
+	////////////////////////////////////////////////////////////////////////////
+
+	/**
+	 * @brief StorePixels	Writes the lanes of 'color' to the SIZE pixels at
+	 * 'out', lane Extract( k ) to out[ k ]. If 'out' is 16 byte aligned the
+	 * pixels are written with non-temporal stores, which bypass the caches,
+	 * see StoreFence.
+	 */
+	inline
+	void	StorePixels( const SSEDVec3& color, Vec3* out )
+	{
+		__m128	rgb[ 3 ];
+		InterleaveRgb( ReverseLanes( color.val[ 0 ].m ), ReverseLanes( color.val[ 1 ].m ),
+					   ReverseLanes( color.val[ 2 ].m ), rgb );
+
+		float* const	dst	= &out->x;
+		if( 0 == reinterpret_cast< uintptr_t >( dst ) % 16 )
+		{
+			_mm_stream_ps( dst + 0, rgb[ 0 ] );
+			_mm_stream_ps( dst + 4, rgb[ 1 ] );
+			_mm_stream_ps( dst + 8, rgb[ 2 ] );
+		}
+		else
+		{
+			_mm_storeu_ps( dst + 0, rgb[ 0 ] );
+			_mm_storeu_ps( dst + 4, rgb[ 1 ] );
+			_mm_storeu_ps( dst + 8, rgb[ 2 ] );
+		}
+	}
+	////////////////////////////////////////////////////////////////////////////
+
+	/**
+	 * @brief StoreFence	Orders the non-temporal stores of StorePixels before
+	 * the stores that follow.
+	 */
+	inline
+	void	StoreFence()
+	{
+		_mm_sfence();
+	}
+	////////////////////////////////////////////////////////////////////////////
 }; // namespace SSE
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -0,0 +1,342 @@
+
+#include <string>
+
+#include <errno.h>
+#include <netdb.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include "socket.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+constexpr char		UNIX_PREFIX[]		= "unix:";
+constexpr char		TCP_PREFIX[]		= "tcp:";
+
+constexpr int		LISTEN_BACKLOG		= 64;
+constexpr uint32_t	MAX_MESSAGE_SIZE	= 256 * 1024 * 1024;
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+	bool	StartsWith( const std::string& str, const char* const prefix )
+	{
+		return	0 == str.compare( 0, strlen( prefix ), prefix );
+	}
+	////////////////////////////////////////////////////////////////////////////
+
+	/**
+	 * @brief FillUnixAddress	Fills 'addr' from "unix:<path>".
+	 */
+	bool	FillUnixAddress( const std::string& address, sockaddr_un& addr )
+	{
+		const std::string	path	= address.substr( strlen( UNIX_PREFIX ) );
+		if( path.empty() || path.size() >= sizeof( addr.sun_path ) )
+			return	false;
+
+		memset( &addr, 0, sizeof( addr ) );
+		addr.sun_family	= AF_UNIX;
+		memcpy( addr.sun_path, path.c_str(), path.size() );
+
+		return	true;
+	}
+	////////////////////////////////////////////////////////////////////////////
+
+	/**
+	 * @brief RemoveSocketFile	Removes the file at 'path' if it is a socket.
+	 * @return	Returns false if something else is there.
+	 */
+	bool	RemoveSocketFile( const char* const path )
+	{
+		struct stat	info;
+		if( 0 != lstat( path, &info ) )
+			return	ENOENT == errno;
+
+		return	S_ISSOCK( info.st_mode ) && 0 == unlink( path );
+	}
+	////////////////////////////////////////////////////////////////////////////
+
+	/**
+	 * @brief ResolveTcpAddress	Resolves "[tcp:]<host>:<port>".
+	 */
+	addrinfo*	ResolveTcpAddress( std::string address, bool passive )
+	{
+		if( StartsWith( address, TCP_PREFIX ) )
+			address	= address.substr( strlen( TCP_PREFIX ) );
+
+		const size_t	colon	= address.rfind( ':' );
+		if( std::string::npos == colon )
+			return	nullptr;
+
+		const std::string	host	= address.substr( 0, colon );
+		const std::string	port	= address.substr( colon + 1 );
+
+		addrinfo	hints;
+		memset( &hints, 0, sizeof( hints ) );
+		hints.ai_family		= AF_UNSPEC;
+		hints.ai_socktype	= SOCK_STREAM;
+		hints.ai_flags		= passive ? AI_PASSIVE : 0;
+
+		addrinfo*	result	= nullptr;
+		if( 0 != getaddrinfo( host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &result ) )
+			return	nullptr;
+
+		return	result;
+	}
+	////////////////////////////////////////////////////////////////////////////
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Net::Listen	Creates a listening socket on 'address'. An existing
+ * Unix socket file is replaced, any other file at the path is left alone.
+ * @return	Returns the socket or -1 on error.
+ */
+int	Net::Listen( const char* const address )
+{
+	const std::string	str( address );
+
+	if( StartsWith( str, UNIX_PREFIX ) )
+	{
+		sockaddr_un	addr;
+		if( ! FillUnixAddress( str, addr ) )
+			return	-1;
+
+		if( ! RemoveSocketFile( addr.sun_path ) )
+			return	-1;
+
+		int	fd	= socket( AF_UNIX, SOCK_STREAM, 0 );
+		if( fd < 0 )
+			return	-1;
+
+		if( 0 != bind( fd, reinterpret_cast< sockaddr* >( &addr ), sizeof( addr ) ) ||
+			0 != listen( fd, LISTEN_BACKLOG ) )
+		{
+			close( fd );
+			return	-1;
+		}
+
+		return	fd;
+	}
+
+	addrinfo*	info	= ResolveTcpAddress( str, true );
+	if( nullptr == info )
+		return	-1;
+
+	int	fd	= socket( info->ai_family, info->ai_socktype, info->ai_protocol );
+	if( fd >= 0 )
+	{
+		int	enable	= 1;
+		setsockopt( fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof( enable ) );
+
+		if( 0 != bind( fd, info->ai_addr, info->ai_addrlen ) ||
+			0 != listen( fd, LISTEN_BACKLOG ) )
+		{
+			close( fd );
+			fd	= -1;
+		}
+	}
+
+	freeaddrinfo( info );
+	return	fd;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Net::StopListening	Closes the socket 'listenFd' made by Listen on
+ * 'address' and removes its Unix socket file.
+ */
+void	Net::StopListening( int listenFd, const char* const address )
+{
+	Close( listenFd );
+
+	const std::string	str( address );
+	sockaddr_un			addr;
+	if( StartsWith( str, UNIX_PREFIX ) && FillUnixAddress( str, addr ) )
+		RemoveSocketFile( addr.sun_path );
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Net::Accept	Accepts a connection on a listening socket.
+ * @return	Returns the new socket or -1 on error.
+ */
+int	Net::Accept( int listenFd )
+{
+	int	fd	= accept( listenFd, nullptr, nullptr );
+	if( fd < 0 )
+		return	-1;
+
+	int	enable	= 1;
+	setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof( enable ) );
+
+	return	fd;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Net::Connect	Connects to 'address'.
+ * @return	Returns the socket or -1 on error.
+ */
+int	Net::Connect( const char* const address )
+{
+	const std::string	str( address );
+
+	if( StartsWith( str, UNIX_PREFIX ) )
+	{
+		sockaddr_un	addr;
+		if( ! FillUnixAddress( str, addr ) )
+			return	-1;
+
+		int	fd	= socket( AF_UNIX, SOCK_STREAM, 0 );
+		if( fd < 0 )
+			return	-1;
+
+		if( 0 != connect( fd, reinterpret_cast< sockaddr* >( &addr ), sizeof( addr ) ) )
+		{
+			close( fd );
+			return	-1;
+		}
+
+		return	fd;
+	}
+
+	addrinfo*	info	= ResolveTcpAddress( str, false );
+	if( nullptr == info )
+		return	-1;
+
+	int	fd	= socket( info->ai_family, info->ai_socktype, info->ai_protocol );
+	if( fd >= 0 && 0 != connect( fd, info->ai_addr, info->ai_addrlen ) )
+	{
+		close( fd );
+		fd	= -1;
+	}
+
+	if( fd >= 0 )
+	{
+		int	enable	= 1;
+		setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof( enable ) );
+	}
+
+	freeaddrinfo( info );
+	return	fd;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Net::Close	Closes the socket.
+ */
+void	Net::Close( int fd )
+{
+	if( fd >= 0 )
+		close( fd );
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Net::SetReceiveTimeout	Makes the receive functions fail when no data
+ * arrives for 'milliseconds'. 0 disables the timeout.
+ */
+void	Net::SetReceiveTimeout( int fd, uint32_t milliseconds )
+{
+	timeval	tv;
+	tv.tv_sec	= milliseconds / 1000;
+	tv.tv_usec	= ( milliseconds % 1000 ) * 1000;
+
+	setsockopt( fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof( tv ) );
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Net::SendAll	Sends all of 'data'. Returns false if the connection
+ * is closed or an error occurs.
+ */
+bool	Net::SendAll( int fd, const void* data, size_t size )
+{
+	const uint8_t*	ptr	= static_cast< const uint8_t* >( data );
+	while( size )
+	{
+		ssize_t	sent	= send( fd, ptr, size, MSG_NOSIGNAL );
+		if( sent < 0 && EINTR == errno )
+			continue;
+		if( sent <= 0 )
+			return	false;
+
+		ptr		+= sent;
+		size	-= static_cast< size_t >( sent );
+	}
+
+	return	true;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Net::ReceiveAll	Receives exactly 'size' bytes. Returns false if the
+ * connection is closed, the receive timeout expires or an error occurs.
+ */
+bool	Net::ReceiveAll( int fd, void* data, size_t size )
+{
+	uint8_t*	ptr	= static_cast< uint8_t* >( data );
+	while( size )
+	{
+		ssize_t	received	= recv( fd, ptr, size, 0 );
+		if( received < 0 && EINTR == errno )
+			continue;
+		if( received <= 0 )
+			return	false;
+
+		ptr		+= received;
+		size	-= static_cast< size_t >( received );
+	}
+
+	return	true;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Net::SendMessage	Sends a message of 'type' with 'payload'.
+ */
+bool	Net::SendMessage( int fd, uint32_t type, const void* payload, uint32_t size )
+{
+	return	SendMessage( fd, type, payload, size, nullptr, 0 );
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Net::SendMessage	Sends a message of 'type' whose payload is 'header'
+ * followed by 'payload'. Saves copying large payloads behind a fixed header.
+ */
+bool	Net::SendMessage( int fd, uint32_t type, const void* header, uint32_t headerSize,
+						  const void* payload, uint32_t size )
+{
+	MessageHeader	msg	= { type, headerSize + size };
+
+	return	SendAll( fd, &msg, sizeof( msg ) ) &&
+			SendAll( fd, header, headerSize ) &&
+			SendAll( fd, payload, size );
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Net::ReceiveMessage	Receives one message. Returns false on error or
+ * if the announced size is unreasonably large.
+ */
+bool	Net::ReceiveMessage( int fd, uint32_t& type, std::vector< uint8_t >& payload )
+{
+	MessageHeader	msg;
+	if( ! ReceiveAll( fd, &msg, sizeof( msg ) ) || msg.size > MAX_MESSAGE_SIZE )
+		return	false;
+
+	type	= msg.type;
+	payload.resize( msg.size );
+
+	return	ReceiveAll( fd, payload.data(), msg.size );
+}
+////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,50 @@
+
+#ifndef SOCKET_H
+#define SOCKET_H
+
+////////////////////////////////////////////////////////////////////////////////
+
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Thin wrappers around POSIX sockets used by the multi-process modes.
+ *
+ * Addresses are either "unix:<path>" for a Unix domain socket or
+ * "<host>:<port>" (optionally prefixed with "tcp:") for TCP.
+ *
+ * Messages are framed with a small header (type and payload size). The data
+ * is sent in host byte order, processes are expected to run on machines with
+ * the same endianness.
+ */
+namespace Net
+{
+	struct	MessageHeader
+	{
+		uint32_t	type;
+		uint32_t	size;
+	};
+
+	int		Listen( const char* const address );
+	void	StopListening( int listenFd, const char* const address );
+	int		Accept( int listenFd );
+	int		Connect( const char* const address );
+	void	Close( int fd );
+
+	void	SetReceiveTimeout( int fd, uint32_t milliseconds );
+
+	bool	SendAll( int fd, const void* data, size_t size );
+	bool	ReceiveAll( int fd, void* data, size_t size );
+
+	bool	SendMessage( int fd, uint32_t type, const void* payload, uint32_t size );
+	bool	SendMessage( int fd, uint32_t type, const void* header, uint32_t headerSize,
+						 const void* payload, uint32_t size );
+	bool	ReceiveMessage( int fd, uint32_t& type, std::vector< uint8_t >& payload );
+} // namespace Net
+////////////////////////////////////////////////////////////////////////////////
+
+#endif // SOCKET_H
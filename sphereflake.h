@@ -4,6 +4,10 @@
 
 ////////////////////////////////////////////////////////////////////////////////
 
+#include <algorithm>
+#include <bitset>
+#include <limits>
+
 #include <stdint.h>
 
 #include "simd.h"
@@ -18,19 +22,27 @@
 constexpr float	SIN_HALF_FOV		= 0.4794255386f;
 constexpr float	PIXEL_AT_DISTANCE	= 2.0f * SIN_HALF_FOV * SCREEN_HEIGHT;
 
+// Radius of the bounds of a child's subtree in the parent's frame for the
+// occlusion cull, a little over twice the child radius so the rounding of the
+// test can't cull a subtree that shows.
+constexpr float	OCCLUSION_BOUNDS	= 2.0f * SPHERE_RATIO * 1.001f;
+
 ////////////////////////////////////////////////////////////////////////////////
 
 /**
- * @brief GetMaxDepth	Returns the maximum depth at which the square of the
- * radius will become 0. For starting radius of 1.0f this works out as ~46.
+ * @brief GetMaxDepth	Returns the deepest level of the traversal. The rays are
+ * traced in the local frame of each sphere, so the depth is only limited by
+ * the world size of a level (used to convert the hit distance back to world
+ * units) staying a normal float. For starting radius of 1.0f this works out
+ * as ~79.
  */
-constexpr uint8_t	GetMaxDepth()
+constexpr uint32_t	GetMaxDepth()
 {
-	float	radius		= STARTING_RADIUS;
-	uint8_t	maxDepth	= 1;
-	while( radius * radius > 0.0f )
+	float		scale		= STARTING_RADIUS;
+	uint32_t	maxDepth	= 0;
+	while( scale * SPHERE_RATIO >= std::numeric_limits< float >::min() )
 	{
-		radius	/= 3.0f;
+		scale	*= SPHERE_RATIO;
 		maxDepth++;
 	}
 
@@ -39,29 +51,131 @@ constexpr uint8_t	GetMaxDepth()
 ////////////////////////////////////////////////////////////////////////////////
 
 /**
- * @brief A struct that contantains the radius for each depth.
+ * @brief The ChildTransform struct describes a child sphere in the local frame
+ * of its parent. In the local frame the parent has radius 1 at the origin and
+ * looks the same at every level, so the nine transforms serve the whole flake.
+ *
+ * Center is the child center, axis are the child's local axes. A point p of
+ * the parent frame is at Axes * ( p - center ) / SPHERE_RATIO in the child
+ * frame.
  */
-template< int depth >
-struct rad
+struct ChildTransform
 {
-	constexpr static float	r	= rad< depth - 1 >::r * SPHERE_RATIO;
+	Vec3	center;
+	Vec3	axis[ 3 ];
 };
+////////////////////////////////////////////////////////////////////////////////
 
-template<>
-struct rad< 0 >
+/**
+ * @brief The TraversalFrame struct is one level of the traversal stack: the
+ * ray in the local frame of a sphere, the lanes that still hit its bounds and
+ * the next child to visit. 'onChain' is set for the spheres of the camera
+ * chain (see CameraChain).
+ */
+struct TraversalFrame
 {
-	constexpr static float	r	= STARTING_RADIUS;
+	SIMD::Vec		direction;
+	SIMD::bool_t	active;
+	Vec3			origin;
+	float			scale;
+	uint32_t		nextChild;
+	bool			onChain;
 };
 ////////////////////////////////////////////////////////////////////////////////
 
 /**
- * @brief The Sphere struct A struct containing the center of the sphere and
- * the direction.
+ * @brief The WalkNode struct is a sphere reached by SphereFlake::Walk, the
+ * walk of the hierarchy without rays. 'origin' is the camera in the local
+ * frame of the sphere and a world direction d is ( rows[ 0 ] . d,
+ * rows[ 1 ] . d, rows[ 2 ] . d ) there. 'center' is the world center of the
+ * sphere and 'scale' the world size of one local unit.
  */
-struct Sphere
+struct WalkNode
 {
-	Vec3	center;
-	Vec3	direction;
+	Vec3		rows[ 3 ];
+	Vec3		origin;
+	Vec3		center;
+	float		scale;
+	uint32_t	nextChild;
+	bool		onChain;
+};
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief The TraversalStats struct counts the spheres entered by packets and
+ * the lanes that were active on entry. The lane occupancy of the traversal is
+ * lanes / ( visits * SIMD::SIZE ).
+ */
+struct TraversalStats
+{
+	uint64_t	visits	= 0;
+	uint64_t	lanes	= 0;
+
+	void	Add( const SIMD::bool_t& active )
+	{
+		++visits;
+		lanes	+= std::bitset< 32 >( active.Mask() ).count();
+	}
+
+	TraversalStats	operator-( const TraversalStats& rhs )	const
+	{
+		TraversalStats	result;
+		result.visits	= visits - rhs.visits;
+		result.lanes	= lanes - rhs.lanes;
+
+		return	result;
+	}
+
+	/**
+	 * @brief Occupancy	Returns the average fraction of active lanes.
+	 */
+	double	Occupancy()	const
+	{
+		return	( 0 == visits ) ? 0.0 : double( lanes ) / double( visits * SIMD::SIZE );
+	}
+};
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief The NoSurface struct is the surface record of the traversals that
+ * need only the hit distance and level. It records nothing and compiles away.
+ * A surface record gets Record( children, stack, level, updated, records )
+ * after every sphere test that moved the hit of the 'updated' lanes, see
+ * SurfaceRecord in aov.h.
+ */
+struct NoSurface
+{
+	void	Record( const ChildTransform*, const TraversalFrame*, uint32_t,
+					const SIMD::bool_t&, const HitRecord& ) {}
+};
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief The CameraChain struct is the chain of spheres around the camera, from
+ * the root down to the deepest sphere whose bounds hold the camera, with the
+ * camera in the local frame of each.
+ *
+ * Going down a level the camera moves to Axes * ( p - center ) / SPHERE_RATIO,
+ * so the rounding error of its local position triples with every level that
+ * keeps the camera close, and past ~15 levels in float the nearby spheres
+ * crack. The chain is computed in double once per frame (see FindCameraChain)
+ * and the traversal takes the origins of these spheres from it, rounded to
+ * float only once. Everything else stays float: the spheres off the chain are
+ * entered from an accurate parent and the camera gets farther from them with
+ * every level.
+ *
+ * child[ i ] is the index of the child entered at level i + 1 and origin[ i ]
+ * the camera in the frame of the sphere at level i, root included. 'world' is
+ * the camera in world units, 'scale' the world size of one local unit of the
+ * deepest sphere.
+ */
+struct CameraChain
+{
+	uint32_t	depth	= 0;
+	uint8_t		child[ GetMaxDepth() ];
+	Vec3		origin[ GetMaxDepth() + 1 ];
+	Vec3		world;
+	float		scale	= STARTING_RADIUS;
 };
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -74,6 +188,10 @@ constexpr float	angleToRads( float rad )
 }
 ////////////////////////////////////////////////////////////////////////////////
 
+static_assert( GetMaxDepth() < COLOR_LEVELS, "Every level needs an entry in the color table" );
+
+////////////////////////////////////////////////////////////////////////////////
+
 /**
  * @brief The SphereFlake class is used to implement the ray intersecting with
  * the sphereflake.
@@ -82,6 +200,10 @@ class SphereFlake
 {
 public:
 	SphereFlake()
+		: m_pixelAtDistance( PIXEL_AT_DISTANCE )
+		, m_impostorPixels( 0.0f )
+		, m_impostorRadius( 0.0f )
+		, m_occlusionCull( true )
 	{
 		float	angle1	= angleToRads( 360.0f / float( TYPE1_SPHERES_COUNT ) );
 		float	angle2	= angleToRads( 360.0f / float( TYPE2_SPHERES_COUNT ) );
@@ -90,191 +212,746 @@ public:
 		float	t2Rads	= angleToRads( TYPE2_SPHERES_ROTATION );
 		for( int k = 0; k < TYPE1_SPHERES_COUNT; ++k )
 		{
-			m_rotateSin[				   0 + k ]	= sinf( t1Rads + angle1 * k );
-			m_rotateCos[				   0 + k ]	= cosf( t1Rads + angle1 * k );
-		}
-
-		for( int k = 0; k < TYPE2_SPHERES_COUNT; ++k )
-		{
-			m_rotateSin[ TYPE1_SPHERES_COUNT + k ]	= sinf( t2Rads + angle2 * k );
-			m_rotateCos[ TYPE1_SPHERES_COUNT + k ]	= cosf( t2Rads + angle2 * k );
-		}
-
-		float	t1sin	= sinf( angleToRads( TYPE1_SPHERES_DEGREE ) );
-		float	t1cos	= cosf( angleToRads( TYPE1_SPHERES_DEGREE ) );
-		float	t2sin	= sinf( angleToRads( TYPE2_SPHERES_DEGREE ) );
-		float	t2cos	= cosf( angleToRads( TYPE2_SPHERES_DEGREE ) );
-		for( int k = 0; k < TYPE1_SPHERES_COUNT; ++k )
-		{
-			m_yAxisRotSines[				   0 + k ]		= t1sin;
-			m_yAxisRotCosines[				   0 + k ]		= t1cos;
+			InitChild( 0 + k,
+					   angleToRads( TYPE1_SPHERES_DEGREE ), t1Rads + angle1 * k );
 		}
 
 		for( int k = 0; k < TYPE2_SPHERES_COUNT; ++k )
 		{
-			m_yAxisRotSines[ TYPE1_SPHERES_COUNT   + k ]	= t2sin;
-			m_yAxisRotCosines[ TYPE1_SPHERES_COUNT + k ]	= t2cos;
+			InitChild( TYPE1_SPHERES_COUNT + k,
+					   angleToRads( TYPE2_SPHERES_DEGREE ), t2Rads + angle2 * k );
 		}
 	}
 
+	template< Precision P = Precision::EXACT >
 	void	Intersect( const Ray& ray, HitRecord& records );
 
-private:
-	template< uint8_t DEPTH = 0 >
-	void	IntersectRecurs( const Ray& ray,
-							 const Sphere& current,
-							 const Vec3& parDir,
-							 HitRecord& records );
+	template< Precision P = Precision::EXACT >
+	void	Intersect( const Ray& ray, HitRecord& records, TraversalStats& stats );
+
+	template< Precision P, typename Defer >
+	void	Intersect( const Ray& ray, HitRecord& records, TraversalStats& stats,
+					   uint32_t deferDepth, Defer&& defer );
+
+	template< Precision P, typename Surface >
+	void	Intersect( const Ray& ray, HitRecord& records, TraversalStats& stats,
+					   Surface& surface );
+
+	template< Precision P = Precision::EXACT >
+	void	IntersectSubtree( const TraversalFrame& node, uint32_t depth,
+							  HitRecord& records, TraversalStats& stats );
 
-	template< uint8_t DEPTH, bool testOnly >
+	template< Precision P = Precision::EXACT >
+	void	IntersectInstance( const Vec3& origin, const SIMD::Vec& direction, float scale,
+							   const SIMD::bool_t& active, HitRecord& records, TraversalStats& stats );
+
+	template< typename Visitor >
+	void	Walk( const Vec3& camera, Visitor& visitor )	const;
+
+	static constexpr uint32_t	NodeCount( uint32_t depth );
+
+	CameraChain	FindCameraChain( const uint8_t* zoom, uint32_t zoomDepth, const double camera[ 3 ] )	const;
+	void		SetCameraChain( const CameraChain& chain );
+	void		SetFieldOfView( float tanHalfFov );
+	void		SetImpostorPixels( float pixels );
+	void		SetOcclusionCull( bool enable );
+	float		HitMin()	const;
+
+	// Public for the kernel benchmark (see RunBenchmark).
+	template< Precision P, bool testOnly >
 	SIMD::bool_t	SphereIntersect( const Ray& ray,
-									  const SIMD::Vec& sphereCenter,
-									  HitRecord& hit );
+									 const Vec3& sphereCenter,
+									 float radius,
+									 float scale,
+									 uint32_t depth,
+									 const SIMD::bool_t& active,
+									 HitRecord& hit );
 
 private:
-	float				m_rotateSin[ TOTAL_NUMBER_OF_SPHERES ];
-	float				m_rotateCos[ TOTAL_NUMBER_OF_SPHERES ];
+	void	InitChild( int index, float yAxisAngle, float rotation );
+
+	static bool	IsHiddenByParent( const Vec3& origin, const Vec3& center );
+
+	template< Precision P, typename Defer, typename Surface >
+	void	Trace( const Ray& ray, HitRecord& records, TraversalStats& stats,
+				   uint32_t deferDepth, Defer&& defer, Surface& surface );
+
+	template< Precision P, typename Defer, typename Surface >
+	void	Traverse( TraversalFrame* stack, uint32_t baseDepth, HitRecord& records,
+					  TraversalStats& stats, uint32_t deferDepth, Defer&& defer,
+					  Surface& surface );
 
-	float				m_yAxisRotSines[ TOTAL_NUMBER_OF_SPHERES ];
-	float				m_yAxisRotCosines[ TOTAL_NUMBER_OF_SPHERES ];
+private:
+	ChildTransform		m_children[ TOTAL_NUMBER_OF_SPHERES ];
+	CameraChain			m_chain;
+	// Pixels covered by a sphere of radius 1 at distance 1, for the cull.
+	float				m_pixelAtDistance;
+	// Children with a smaller radius in pixels are drawn as an impostor of
+	// m_impostorRadius in the parent's frame, 0 culls them below a pixel.
+	float				m_impostorPixels;
+	float				m_impostorRadius;
+	// Skip the children hidden behind their parent (see IsHiddenByParent).
+	bool				m_occlusionCull;
 };
 ////////////////////////////////////////////////////////////////////////////////
 
+/**
+ * @brief SphereFlake::InitChild	Computes the transform of child 'index'.
+ * @param yAxisAngle	Angle between the child and the parent's axis.
+ * @param rotation		Rotation of the child around the parent's axis.
+ *
+ * In a local frame the sphere's axis is Y and the axis of its parent lies in
+ * the YZ plane. The child axes are built the same way from the child's own
+ * axis and Y, so the frames chain from level to level.
+ */
+inline
+void	SphereFlake::InitChild( int index, float yAxisAngle, float rotation )
+{
+	const Vec3	up( 0.0f, 1.0f, 0.0f );
+
+	const Vec3	dir( sinf( yAxisAngle ) * cosf( rotation ),
+					 cosf( yAxisAngle ),
+					 - sinf( yAxisAngle ) * sinf( rotation ) );
+
+	const Vec3	perp1	= dir.cross( up ).Normalized();
+	const Vec3	perp2	= dir.cross( perp1 );
+
+	ChildTransform&	child	= m_children[ index ];
+	child.center		= dir * ( 1.0f + SPHERE_RATIO );
+	child.axis[ 0 ]		= perp1;
+	child.axis[ 1 ]		= dir;
+	child.axis[ 2 ]		= perp2 * -1.0f;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief SphereFlake::NodeCount	Returns the number of spheres at 'depth'.
+ */
+constexpr uint32_t	SphereFlake::NodeCount( uint32_t depth )
+{
+	return	( 0 == depth ) ? 1 : TOTAL_NUMBER_OF_SPHERES * NodeCount( depth - 1 );
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief SphereFlake::FindCameraChain	Computes the camera chain in double.
+ * @param zoom		Child indices from the root to the sphere 'camera' is
+ *					given in, 'zoomDepth' of them. With none 'camera' is in
+ *					world units.
+ *
+ * The camera is first carried up to the root, which only shrinks its error,
+ * and the chain then goes on down through the child whose bounds hold the
+ * camera for as long as there is one.
+ */
+inline
+CameraChain	SphereFlake::FindCameraChain( const uint8_t* zoom, uint32_t zoomDepth, const double camera[ 3 ] ) const
+{
+	const auto	toDouble	= []( const Vec3& v ) { return	Vec3d( v.x, v.y, v.z ); };
+	const auto	toFloat		= []( const Vec3d& v ) { return	Vec3( float( v.x ), float( v.y ), float( v.z ) ); };
+
+	Vec3d		local[ GetMaxDepth() + 1 ];
+	CameraChain	chain;
+
+	local[ zoomDepth ]	= Vec3d( camera[ 0 ], camera[ 1 ], camera[ 2 ] );
+	if( 0 == zoomDepth )
+		local[ 0 ]	= local[ 0 ] / double( STARTING_RADIUS );
+
+	// Up: p = center + transpose( Axes ) * q * SPHERE_RATIO.
+	for( uint32_t level = zoomDepth; level > 0; --level )
+	{
+		const ChildTransform&	child	= m_children[ zoom[ level - 1 ] ];
+		const Vec3d&			q		= local[ level ];
+
+		local[ level - 1 ]		= toDouble( child.center )
+								+ ( toDouble( child.axis[ 0 ] ) * q.x
+								  + toDouble( child.axis[ 1 ] ) * q.y
+								  + toDouble( child.axis[ 2 ] ) * q.z ) * double( SPHERE_RATIO );
+		chain.child[ level - 1 ]	= zoom[ level - 1 ];
+	}
+
+	// Down through the nearest child whose bounds (twice its radius) hold the
+	// camera.
+	uint32_t	depth	= zoomDepth;
+	while( depth < GetMaxDepth() - 1 )
+	{
+		uint32_t	nearest	= TOTAL_NUMBER_OF_SPHERES;
+		double		best	= 4.0 * double( SPHERE_RATIO ) * double( SPHERE_RATIO );
+		Vec3d		delta;
+		for( uint32_t k = 0; k < TOTAL_NUMBER_OF_SPHERES; ++k )
+		{
+			const Vec3d		d		= local[ depth ] - toDouble( m_children[ k ].center );
+			const double	distSqr	= d.dot( d );
+			if( distSqr < best )
+			{
+				best	= distSqr;
+				nearest	= k;
+				delta	= d;
+			}
+		}
+
+		if( TOTAL_NUMBER_OF_SPHERES == nearest )
+			break;
+
+		const ChildTransform&	child	= m_children[ nearest ];
+		local[ depth + 1 ]	= Vec3d( toDouble( child.axis[ 0 ] ).dot( delta ),
+									 toDouble( child.axis[ 1 ] ).dot( delta ),
+									 toDouble( child.axis[ 2 ] ).dot( delta ) ) / double( SPHERE_RATIO );
+		chain.child[ depth ]	= static_cast< uint8_t >( nearest );
+		++depth;
+	}
+
+	chain.depth	= depth;
+	chain.world	= toFloat( local[ 0 ] * double( STARTING_RADIUS ) );
+	chain.scale	= STARTING_RADIUS;
+	for( uint32_t level = 0; level <= depth; ++level )
+	{
+		chain.origin[ level ]	= toFloat( local[ level ] );
+		chain.scale				*= ( 0 == level ) ? 1.0f : SPHERE_RATIO;
+	}
+
+	return	chain;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief SphereFlake::SetCameraChain	Sets the chain the following traversals
+ * take their origins from. The rays must start at 'chain.world'. Not to be
+ * called while a traversal runs.
+ */
+inline
+void	SphereFlake::SetCameraChain( const CameraChain& chain )
+{
+	m_chain	= chain;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief SphereFlake::SetFieldOfView	Scales the size of a pixel for the
+ * following traversals to a field of view of 'tanHalfFov' (see
+ * CameraView::TanHalfFov). A narrow view culls the small spheres later. Not to
+ * be called while a traversal runs.
+ */
+inline
+void	SphereFlake::SetFieldOfView( float tanHalfFov )
+{
+	m_pixelAtDistance	= PIXEL_AT_DISTANCE / tanHalfFov;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief SphereFlake::SetImpostorPixels	Draws the subtrees of children with a
+ * radius below 'pixels' as a single sphere (see ImpostorModel) instead of
+ * tracing them, from the following traversals on. 0 skips children below a
+ * pixel instead. Not to be called while a traversal runs.
+ */
+inline
+void	SphereFlake::SetImpostorPixels( float pixels )
+{
+	m_impostorPixels	= pixels;
+	m_impostorRadius	= ( pixels > 0.0f ) ? GetImpostorModel().radius * SPHERE_RATIO : 0.0f;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief SphereFlake::SetOcclusionCull	Enables the cull of the subtrees hidden
+ * behind their parent for the following traversals. It never changes the
+ * image, disabling it is for measuring the cull. Not to be called while a
+ * traversal runs.
+ */
+inline
+void	SphereFlake::SetOcclusionCull( bool enable )
+{
+	m_occlusionCull	= enable;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief SphereFlake::HitMin	Returns the nearest hit distance the traversals
+ * accept, a little behind the camera (see HitRecord) scaled to the spheres
+ * around a deep camera.
+ */
+inline
+float	SphereFlake::HitMin() const
+{
+	return	( 0 == m_chain.depth ) ? HitRecord::DEFAULT_MIN : HitRecord::DEFAULT_MIN * m_chain.scale;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief SphereFlake::IsHiddenByParent	Returns true if no ray from 'origin'
+ * can see the subtree of the child at 'center', both in the local frame of the
+ * parent. Depends only on the origin the rays share, so it holds for the whole
+ * packet.
+ *
+ * The subtree lies in the ball of OCCLUSION_BOUNDS around 'center' and outside
+ * the parent. It is hidden when the ball is
+ *  - inside the cone of the rays that hit the parent, so every ray that could
+ *    hit the subtree hits the parent as well, and
+ *  - behind the plane of the parent's silhouette, x . origin = 1. The points
+ *    of a ray before it enters the parent are in front of that plane, so the
+ *    ray meets the subtree only after it left the parent and the parent's hit
+ *    is the nearer one.
+ */
+inline
+bool	SphereFlake::IsHiddenByParent( const Vec3& origin, const Vec3& center )
+{
+	constexpr float	R	= OCCLUSION_BOUNDS;
+
+	// Behind the plane: R * |origin| <= 1 - center . origin.
+	const float	distSqr	= origin.dot( origin );
+	const float	slack	= 1.0f - center.dot( origin );
+	if( distSqr <= 1.0f || slack <= 0.0f || R * R * distSqr > slack * slack )
+		return	false;
+
+	const float	dist	= sqrtf( distSqr );
+
+	// The angle between the parent's center and the child's seen from the
+	// origin plus the angular radius of the ball must stay under the angular
+	// radius of the parent, compared as cosines.
+	const Vec3	toChild		= center - origin;
+	const float	childSqr	= toChild.dot( toChild );
+	if( childSqr <= R * R )
+		return	false;
+
+	const float	childDist	= sqrtf( childSqr );
+	const float	cosAngle	= -toChild.dot( origin ) / ( childDist * dist );
+	if( cosAngle <= 0.0f )
+		return	false;
+
+	const float	sinAngle	= sqrtf( std::max( 0.0f, 1.0f - cosAngle * cosAngle ) );
+	const float	cosBall		= sqrtf( childSqr - R * R ) / childDist;
+	const float	sinBall		= R / childDist;
+	const float	cosParent	= sqrtf( distSqr - 1.0f ) / dist;
+
+	return	cosAngle * cosBall - sinAngle * sinBall >= cosParent;
+}
+////////////////////////////////////////////////////////////////////////////////
+
 /**
  * @brief SphereFlake::Intersect	This functions checks if a 'ray' is
  * intersecting the sphereflake and stores the result in 'records.'
+ *
+ * P is the precision policy of the square roots.
+ *
+ * @note All the rays of the packet have to share the origin, it is moved to
+ * the child frames once per packet.
  */
+template< Precision P >
 inline
 void	SphereFlake::Intersect( const Ray& ray, HitRecord& records )
 {
-	Sphere	current;
-	Vec3	parDir;
+	TraversalStats	stats;
+	Intersect< P >( ray, records, stats );
+}
+////////////////////////////////////////////////////////////////////////////////
 
-	current.center		= Vec3( 0.0f, 0.0f, 0.0f );
-	current.direction	= Vec3( 0.0f, 1.0f, 0.0f );
-	parDir				= Vec3( 0.0f, 0.0f, 1.0f );
+/**
+ * @brief SphereFlake::Intersect	Same as above, counts the visited spheres in
+ * 'stats'.
+ */
+template< Precision P >
+inline
+void	SphereFlake::Intersect( const Ray& ray, HitRecord& records, TraversalStats& stats )
+{
+	Intersect< P >( ray, records, stats, UINT32_MAX, []( uint32_t, const TraversalFrame& ) {} );
+}
+////////////////////////////////////////////////////////////////////////////////
 
-	IntersectRecurs( ray, current, parDir, records );
+/**
+ * @brief SphereFlake::Intersect	Traces 'ray' from the root, but does not
+ * enter the spheres at 'deferDepth'. For each of them that is hit by any lane
+ * 'defer( node, frame )' is called instead, with the index of the sphere among
+ * the NodeCount( deferDepth ) spheres of that level and the frame the packet
+ * would have entered it with. The caller continues them with IntersectSubtree.
+ */
+template< Precision P, typename Defer >
+inline
+void	SphereFlake::Intersect( const Ray& ray, HitRecord& records, TraversalStats& stats,
+								uint32_t deferDepth, Defer&& defer )
+{
+	NoSurface	surface;
+	Trace< P >( ray, records, stats, deferDepth, defer, surface );
 }
 ////////////////////////////////////////////////////////////////////////////////
 
 /**
- * @brief This is a function that checks for intersection of a sphere from the
- * sphereflake. The function is called recursively and checks each child sphere
- * for intersection.
- *
- * @note This function is using DEPTH, as template parameter which means that
- * the code will generate new function for each depth. This still worksout
- * faster than having single function.
+ * @brief SphereFlake::Intersect	Traces 'ray' from the root and gives every
+ * hit to 'surface' as well, see NoSurface.
  */
-template< uint8_t DEPTH >
+template< Precision P, typename Surface >
 inline
-void	SphereFlake::IntersectRecurs( const Ray& ray, const Sphere& current,
-									  const Vec3& parDir, HitRecord& records )
+void	SphereFlake::Intersect( const Ray& ray, HitRecord& records, TraversalStats& stats,
+								Surface& surface )
 {
-	constexpr float	currentRadius	= rad< DEPTH >::r;
-	constexpr float	childRadius		= rad< DEPTH + 1 >::r;
+	Trace< P >( ray, records, stats, UINT32_MAX, []( uint32_t, const TraversalFrame& ) {}, surface );
+}
+////////////////////////////////////////////////////////////////////////////////
 
-	if( ! SphereIntersect< DEPTH, true >( ray, current.center, records ) )
+/**
+ * @brief SphereFlake::Trace	The root of all the Intersect overloads.
+ */
+template< Precision P, typename Defer, typename Surface >
+inline
+void	SphereFlake::Trace( const Ray& ray, HitRecord& records, TraversalStats& stats,
+							uint32_t deferDepth, Defer&& defer, Surface& surface )
+{
+	TraversalFrame	stack[ GetMaxDepth() ];
+
+	// The frame of the root sphere is the world frame scaled by its radius.
+	TraversalFrame&	root	= stack[ 0 ];
+	root.direction	= ray.direction();
+	root.origin		= ( 0 == m_chain.depth ) ? ray.origin().Extract( 0 ) / STARTING_RADIUS : m_chain.origin[ 0 ];
+	root.scale		= STARTING_RADIUS;
+	root.nextChild	= 0;
+	root.onChain		= true;
+
+	// Hits behind the camera are allowed a little (see HitRecord), scaled to
+	// the spheres around a deep camera.
+	if( 0 != m_chain.depth )
+		records.min	= SIMD::float_t( HitRecord::DEFAULT_MIN * m_chain.scale );
+
+	const Ray	rootRay( root.origin, root.direction );
+	root.active		= SphereIntersect< P, true >( rootRay, Vec3(), 1.0f, root.scale, 0,
+												  SIMD::TRUE_VALUE, records );
+	if( 0 == root.active.Mask() )
 		return;
 
-	SphereIntersect< DEPTH, false >( ray, current.center, records );
+	Traverse< P >( stack, 0, records, stats, deferDepth, defer, surface );
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief SphereFlake::IntersectSubtree	Traces the sphere of 'node' and its
+ * children. 'node' is a frame given to the defer callback of Intersect, with
+ * the ray and the active lanes possibly replaced, and 'depth' is its level.
+ * The origin of the rays must not change.
+ */
+template< Precision P >
+inline
+void	SphereFlake::IntersectSubtree( const TraversalFrame& node, uint32_t depth,
+									   HitRecord& records, TraversalStats& stats )
+{
+	TraversalFrame	stack[ GetMaxDepth() ];
 
-	const Vec3&	curDir	= current.direction;
-	const Vec3&	curCntr	= current.center;
+	stack[ 0 ]				= node;
+	stack[ 0 ].nextChild	= 0;
 
-	constexpr float	radDist	= currentRadius + childRadius;
-	for( int i = 0; i < TOTAL_NUMBER_OF_SPHERES; ++i )
+	if( 0 != m_chain.depth )
+		records.min	= SIMD::float_t( HitRecord::DEFAULT_MIN * m_chain.scale );
+
+	// The path to the node is not known here, so no surface is recorded.
+	NoSurface	surface;
+	Traverse< P >( stack, depth, records, stats, UINT32_MAX, []( uint32_t, const TraversalFrame& ) {}, surface );
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief SphereFlake::IntersectInstance	Traces the 'active' lanes of the rays
+ * from 'origin' along 'direction', given in the frame of the root sphere of a
+ * placed copy of the flake where one unit is 'scale' world units (see Scene).
+ * The hits are kept in world units, so the copies of a scene can share
+ * 'records'. The camera chain is not used.
+ */
+template< Precision P >
+inline
+void	SphereFlake::IntersectInstance( const Vec3& origin, const SIMD::Vec& direction, float scale,
+										const SIMD::bool_t& active, HitRecord& records, TraversalStats& stats )
+{
+	TraversalFrame	stack[ GetMaxDepth() ];
+
+	TraversalFrame&	root	= stack[ 0 ];
+	root.direction	= direction;
+	root.origin		= origin;
+	root.scale		= scale;
+	root.nextChild	= 0;
+	root.onChain	= false;
+	root.active		= SphereIntersect< P, true >( Ray( origin, direction ), Vec3(), 1.0f, scale, 0, active, records );
+	if( 0 == root.active.Mask() )
+		return;
+
+	NoSurface	surface;
+	Traverse< P >( stack, 0, records, stats, UINT32_MAX, []( uint32_t, const TraversalFrame& ) {}, surface );
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief SphereFlake::Traverse	The traversal loop. 'stack[ 0 ]' is a sphere
+ * at level 'baseDepth' whose bounds are hit by the active lanes.
+ *
+ * Every sphere is traced in its own local frame, where it has radius 1 at the
+ * origin. The traversal is depth first with an explicit stack of one frame per
+ * level. Each frame carries the lanes that hit the bounds of its sphere, a
+ * child is entered only with the lanes that also hit the child's bounds and is
+ * skipped when none do, or when its parent hides it from the origin.
+ *
+ * The path to the sphere at 'level' is the child indices of the frames below
+ * it, 'surface' gets the stack after each hit update.
+ */
+template< Precision P, typename Defer, typename Surface >
+inline
+void	SphereFlake::Traverse( TraversalFrame* stack, uint32_t baseDepth, HitRecord& records,
+							   TraversalStats& stats, uint32_t deferDepth, Defer&& defer,
+							   Surface& surface )
+{
+	const uint32_t	maxLevel	= GetMaxDepth() - baseDepth;
+
+	{
+		const TraversalFrame&	base	= stack[ 0 ];
+		const SIMD::bool_t		updated	= SphereIntersect< P, false >( Ray( base.origin, base.direction ),
+																	   Vec3(), 1.0f, base.scale, baseDepth,
+																	   base.active, records );
+		surface.Record( m_children, stack, 0, updated, records );
+		stats.Add( base.active );
+	}
+
+	uint32_t	level	= 0;
+	for(;;)
 	{
-		const Vec3	perp1	= curDir.cross( parDir ).Normalized();
-		const Vec3	perp2	= curDir.cross( perp1  ).Normalized();
+		TraversalFrame&	frame	= stack[ level ];
+		if( TOTAL_NUMBER_OF_SPHERES == frame.nextChild || level + 1 >= maxLevel )
+		{
+			if( 0 == level )
+				return;
 
-		const Vec3	rot		= m_yAxisRotSines[ i ] * m_rotateCos[ i ] * perp1
-							+ m_yAxisRotSines[ i ] * m_rotateSin[ i ] * perp2;
+			--level;
+			continue;
+		}
 
-		const Vec3	newDir	= rot + curDir * m_yAxisRotCosines[ i ];
+		const uint32_t			index	= frame.nextChild++;
+		const ChildTransform&	child	= m_children[ index ];
+		const uint32_t			depth	= baseDepth + level + 1;
 
-		Sphere		child;
-		child.direction		= newDir.Normalized();
-		child.center		= newDir * radDist + curCntr;
+		// Discard spheres that have radius smaller than 1 pixel, or draw their
+		// subtree as one impostor sphere when it is under m_impostorPixels.
+		const Vec3	delta	= frame.origin - child.center;
+		const float	dist	= delta.len();
+		const float	result	= m_pixelAtDistance * SPHERE_RATIO / dist;
+		if( dist < SPHERE_RATIO )
+			continue;
 
-		const Vec3&	ro		= ray.origin().Extract( 0 );
+		const Ray			local( frame.origin, frame.direction );
+		if( result < m_impostorPixels )
+		{
+			const SIMD::bool_t	updated	= SphereIntersect< P, false >( local, child.center, m_impostorRadius,
+																	   frame.scale, IMPOSTOR_LEVEL + depth,
+																	   frame.active, records );
+			if( 0 != updated.Mask() )
+			{
+				// The surface sees the impostor in the frame of the child.
+				TraversalFrame&	next	= stack[ level + 1 ];
+				next.scale		= frame.scale * SPHERE_RATIO;
+				next.origin		= Vec3( child.axis[ 0 ].dot( delta ),
+										child.axis[ 1 ].dot( delta ),
+										child.axis[ 2 ].dot( delta ) ) / SPHERE_RATIO;
+				next.direction	= SIMD::Vec( frame.direction.dot( SIMD::Vec( child.axis[ 0 ] ) ),
+											 frame.direction.dot( SIMD::Vec( child.axis[ 1 ] ) ),
+											 frame.direction.dot( SIMD::Vec( child.axis[ 2 ] ) ) );
+				surface.Record( m_children, stack, level + 1, updated, records );
+			}
 
-		// Discard spheres that have radius smaller than 1 pixel.
-		const float	dist	= ( ro - child.center ).len();
-		const float	result	= PIXEL_AT_DISTANCE * childRadius / dist;
-		if( result < 1.0f || dist < childRadius )
 			continue;
+		}
+
+		if( result < 1.0f )
+			continue;
+
+		const SIMD::bool_t	active	= SphereIntersect< P, true >( local, child.center, SPHERE_RATIO,
+																  frame.scale, depth, frame.active,
+																  records );
+		if( 0 == active.Mask() )
+			continue;
+
+		// After the bounds test, which rejects most children for less. The
+		// impostors above are not culled, they are not bound to the subtree's
+		// spheres and the cull must not change the image.
+		if( m_occlusionCull && IsHiddenByParent( frame.origin, child.center ) )
+			continue;
+
+		TraversalFrame&	next	= stack[ level + 1 ];
+		next.active		= active;
+		next.scale		= frame.scale * SPHERE_RATIO;
+		next.nextChild	= 0;
+		next.onChain	= frame.onChain && depth <= m_chain.depth && index == m_chain.child[ depth - 1 ];
+		next.origin		= next.onChain ? m_chain.origin[ depth ]
+									  : Vec3( child.axis[ 0 ].dot( delta ),
+											  child.axis[ 1 ].dot( delta ),
+											  child.axis[ 2 ].dot( delta ) ) / SPHERE_RATIO;
+		next.direction	= SIMD::Vec( frame.direction.dot( SIMD::Vec( child.axis[ 0 ] ) ),
+									 frame.direction.dot( SIMD::Vec( child.axis[ 1 ] ) ),
+									 frame.direction.dot( SIMD::Vec( child.axis[ 2 ] ) ) );
+
+		if( depth == deferDepth )
+		{
+			// The path of child indices is the index of the sphere in its level.
+			uint32_t	node	= 0;
+			for( uint32_t i = 0; i <= level; ++i )
+				node	= node * TOTAL_NUMBER_OF_SPHERES + stack[ i ].nextChild - 1;
 
-		IntersectRecurs< DEPTH + 1 >( ray, child, current.direction, records );
+			defer( node, next );
+			continue;
+		}
+
+		++level;
+
+		const SIMD::bool_t	updated	= SphereIntersect< P, false >( Ray( next.origin, next.direction ),
+																   Vec3(), 1.0f, next.scale, depth,
+																   next.active, records );
+		surface.Record( m_children, stack, level, updated, records );
+		stats.Add( next.active );
 	}
 }
 ////////////////////////////////////////////////////////////////////////////////
 
 /**
- * @brief This is an empty function to end the recursive generation of the
- * function IntersectRecurs. This saves a little bit compilation time.
+ * @brief SphereFlake::Walk	Walks the hierarchy once from 'camera', without
+ * rays, and gives 'visitor' every sphere the traversal would test for a hit.
  *
- * The last function is at depth calculated by GetMaxDepth().
+ * The children are culled and drawn as impostors the way Traverse does, these
+ * depend only on the camera. Instead of the bounds test of the rays the
+ * visitor is asked whether a ball can be seen at all,
+ * 'visitor.Visible( center, radius )' in world units, and the subtrees of the
+ * bounds it can't see are skipped. Every sphere to draw is given to
+ * 'visitor.Draw( node, center, radius, level )', with its center and radius
+ * in the frame of 'node' and the level the hit records get. That is the
+ * sphere of 'node' itself, or the impostor of one of its children.
  */
-template<>
+template< typename Visitor >
 inline
-void	SphereFlake::IntersectRecurs< GetMaxDepth() >( const Ray&,
-													   const Sphere&,
-													   const Vec3&,
-													   HitRecord& )
+void	SphereFlake::Walk( const Vec3& camera, Visitor& visitor ) const
 {
+	WalkNode	stack[ GetMaxDepth() ];
+
+	WalkNode&	root	= stack[ 0 ];
+	root.rows[ 0 ]	= Vec3( 1.0f, 0.0f, 0.0f );
+	root.rows[ 1 ]	= Vec3( 0.0f, 1.0f, 0.0f );
+	root.rows[ 2 ]	= Vec3( 0.0f, 0.0f, 1.0f );
+	root.origin		= ( 0 == m_chain.depth ) ? camera / STARTING_RADIUS : m_chain.origin[ 0 ];
+	root.center		= Vec3();
+	root.scale		= STARTING_RADIUS;
+	root.nextChild	= 0;
+	root.onChain	= true;
+
+	if( ! visitor.Visible( root.center, 2.0f * root.scale ) )
+		return;
+
+	visitor.Draw( root, Vec3(), 1.0f, 0 );
+
+	uint32_t	level	= 0;
+	for(;;)
+	{
+		WalkNode&	node	= stack[ level ];
+		if( TOTAL_NUMBER_OF_SPHERES == node.nextChild || level + 1 >= GetMaxDepth() )
+		{
+			if( 0 == level )
+				return;
+
+			--level;
+			continue;
+		}
+
+		const uint32_t			index	= node.nextChild++;
+		const ChildTransform&	child	= m_children[ index ];
+		const uint32_t			depth	= level + 1;
+
+		const Vec3	delta	= node.origin - child.center;
+		const float	dist	= delta.len();
+		const float	result	= m_pixelAtDistance * SPHERE_RATIO / dist;
+		if( dist < SPHERE_RATIO )
+			continue;
+
+		const Vec3	center	= node.center + ( node.rows[ 0 ] * child.center.x
+											+ node.rows[ 1 ] * child.center.y
+											+ node.rows[ 2 ] * child.center.z ) * node.scale;
+		if( result < m_impostorPixels )
+		{
+			if( visitor.Visible( center, m_impostorRadius * node.scale ) )
+				visitor.Draw( node, child.center, m_impostorRadius, IMPOSTOR_LEVEL + depth );
+
+			continue;
+		}
+
+		if( result < 1.0f || ! visitor.Visible( center, 2.0f * SPHERE_RATIO * node.scale ) )
+			continue;
+
+		if( m_occlusionCull && IsHiddenByParent( node.origin, child.center ) )
+			continue;
+
+		WalkNode&	next	= stack[ level + 1 ];
+		for( uint32_t i = 0; i < 3; ++i )
+		{
+			next.rows[ i ]	= node.rows[ 0 ] * child.axis[ i ].x
+							+ node.rows[ 1 ] * child.axis[ i ].y
+							+ node.rows[ 2 ] * child.axis[ i ].z;
+		}
+
+		next.onChain	= node.onChain && depth <= m_chain.depth && index == m_chain.child[ depth - 1 ];
+		next.origin		= next.onChain ? m_chain.origin[ depth ]
+									  : Vec3( child.axis[ 0 ].dot( delta ),
+											  child.axis[ 1 ].dot( delta ),
+											  child.axis[ 2 ].dot( delta ) ) / SPHERE_RATIO;
+		next.center		= center;
+		next.scale		= node.scale * SPHERE_RATIO;
+		next.nextChild	= 0;
+
+		++level;
+		visitor.Draw( next, Vec3(), 1.0f, depth );
+	}
 }
 ////////////////////////////////////////////////////////////////////////////////
 
 /**
- * @brief This function checks for intersection with a single sphere.
- * The radius is generated from the depth template parameter.
+ * @brief This function checks for intersection with a single sphere of the
+ * local frame. The hit distance is stored in world units, 'scale' is the world
+ * size of one local unit. Only the 'active' lanes are tested, the function
+ * returns as soon as none of them hits.
  * The testOnly argument is used when checking if the ray hits the sphere or
- * any of it's children.
+ * any of it's children, then the lanes that hit the bounds are returned.
+ * Otherwise the lanes whose hit record was updated are returned.
  *
  * @note The function uses SIMD (if the code is compiled with them).
  */
-template< uint8_t DEPTH, bool testOnly >
+template< Precision P, bool testOnly >
 inline
 SIMD::bool_t	SphereFlake::SphereIntersect( const Ray& ray,
-											  const SIMD::Vec& sphereCenter,
+											  const Vec3& sphereCenter,
+											  float radius,
+											  float scale,
+											  uint32_t depth,
+											  const SIMD::bool_t& active,
 											  HitRecord& hit )
 {
-	constexpr float	ra		= rad< DEPTH >::r;
-	SIMD::float_t	radiusSqr( ra * ra * ( ( testOnly ) ? 4.0f : 1.0f ) );
+	SIMD::float_t	radiusSqr( radius * radius * ( ( testOnly ) ? 4.0f : 1.0f ) );
 
-	SIMD::Vec		deltap		= sphereCenter - ray.origin();
+	SIMD::Vec		deltap		= SIMD::Vec( sphereCenter ) - ray.origin();
 
 	SIMD::float_t	ddp			= ray.direction().dot( deltap );
 
 	SIMD::Vec		remedyTerm	= deltap - ray.direction().MultiplyByFloat( ddp );
 	SIMD::float_t	discrim		= radiusSqr- remedyTerm.dot( remedyTerm );
 
-	SIMD::bool_t	compareRes	= discrim.GreaterOrEqualThan( 0.0f );
+	SIMD::bool_t	compareRes	= discrim.GreaterOrEqualThan( 0.0f ) & active;
 
 	if( testOnly )
 		return	compareRes;
 
-	if( ! compareRes )
+	if( 0 == compareRes.Mask() )
 		return	SIMD::FALSE_VALUE;
 
 	// William H., Saul A. Teukolsky, William T. Vetterling, and Brian P.
 	// Flannery, "Numerical Recipes in C," Cambridge University Press, 1992.
-	SIMD::float_t	sqrtVal		= sqrtf( discrim );
+	SIMD::float_t	sqrtVal		= SIMD::Sqrt< P >( discrim );
 
 	SIMD::bool_t	ddpCmpGE	= ddp.GreaterOrEqualThan( 0.0f );
-	auto			result		= PickBasedOnCondition( ddpCmpGE, ddp + sqrtVal, ddp - sqrtVal );
+	SIMD::float_t	local		= PickBasedOnCondition( ddpCmpGE, ddp + sqrtVal, ddp - sqrtVal );
+	SIMD::float_t	result		= local * SIMD::float_t( scale );
 
-	SIMD::bool_t	cmpRange	= result.IsInRange( hit.min, hit.max );
+	SIMD::bool_t	cmpRange	= result.IsInRange( hit.min, hit.max ) & compareRes;
 
 	hit.max				= PickBasedOnCondition( cmpRange, result, hit.max );
 	hit.result			= PickBasedOnCondition( cmpRange, result, hit.result );
-	hit.sphereCenter	= PickBasedOnCondition( cmpRange, sphereCenter, hit.sphereCenter );
-	hit.radius			= PickBasedOnCondition( cmpRange, radiusSqr, hit.radius );
-	hit.level			= PickBasedOnCondition( cmpRange, DEPTH, hit.level );
+	hit.level			= PickBasedOnCondition( cmpRange, float( depth ), hit.level );
 
-	return	compareRes;
+	return	cmpRange;
 }
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -0,0 +1,323 @@
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iterator>
+#include <thread>
+#include <vector>
+
+#include <stdio.h>
+
+#include "framebuffer.h"
+#include "image.h"
+#include "raygen.h"
+#include "sphereflake.h"
+#include "splatter.h"
+#include "tile.h"
+#include "tracer.h"
+
+#include "splatcheck.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+// The same budget as the precision check. The frames of the splats are
+// composed instead of chained level by level, which rounds differently only
+// where a ray grazes a sphere.
+constexpr uint32_t	MAX_CHANNEL_ERROR		= 2;
+constexpr double	MAX_OUTLIER_FRACTION	= 0.001;
+// The colors leave room for missed spheres, so the hit levels are compared
+// too. A grazing ray can hit another sphere only where the traced level
+// changes, next to a pixel of another level. A pixel that hits another level
+// inside a traced region fails the check, whatever the budget.
+// Frame sizes in screens, and how often every frame is rendered, the fastest
+// run is its time.
+constexpr uint32_t	SCALES[]				= { 1, 2, 4 };
+constexpr uint32_t	REPETITIONS				= 3;
+// The deep zoom view, eight times down the same three children and the camera
+// in the frame of the last sphere, where it has radius 1. Float world space
+// can't tell its spheres apart.
+constexpr uint8_t	DEEP_ZOOM_PATH[]		= { 1, 3, 0, 1, 3, 0, 1, 3, 0, 1, 3, 0, 1, 3, 0, 1, 3, 0, 1, 3, 0, 1, 3, 0 };
+const Vec3			DEEP_ZOOM_CAMERA		= Vec3( 0.0f, 0.0f, 2.2f );
+
+constexpr char		HEADER_MSG[]			= "Splat check of the %s backend, %u threads, camera %g,%g,%g\n";
+constexpr char		SIZE_MSG[]				= "%5ux%-5u rays %8.1f ms %7.1f Mrays/s  splat %8.1f ms %7.1f Mrays/s"
+											  "  %.2fx  walk %6.1f ms %8zu spheres  max error %3u, %6zu pixels over %u"
+											  "  other level %4zu, %zu inside\n";
+constexpr char		DEEP_ZOOM_MSG[]			= "deep zoom  rays %8.1f ms  splat %8.1f ms  max error %3u, %6zu pixels over %u\n";
+constexpr char		PASSED_MSG[]			= "Splat check passed\n";
+constexpr char		FAILED_MSG[]			= "Splat check failed, allowed %.4f%% of pixels over %u and no other level"
+											  " inside the traced regions\n";
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+	using	Clock	= std::chrono::steady_clock;
+
+	/**
+	 * @brief RunTiles	Calls 'render( tile )' for every tile of a 'width' x
+	 * 'height' frame on 'threadCount' threads.
+	 */
+	template< typename Render >
+	void	RunTiles( uint32_t threadCount, uint32_t width, uint32_t height, Render&& render )
+	{
+		const uint32_t			tilesX	= ( width + TILE_SIZE - 1 ) / TILE_SIZE;
+		const uint32_t			tiles	= tilesX * ( ( height + TILE_SIZE - 1 ) / TILE_SIZE );
+		std::atomic< uint32_t >	next	{ 0 };
+
+		const auto	work	= [ & ]()
+		{
+			for( uint32_t i = next++; i < tiles; i = next++ )
+				render( GetTile( i, tilesX, width, height ) );
+		};
+
+		std::vector< std::thread >	threads;
+		for( uint32_t t = 1; t < threadCount; ++t )
+			threads.emplace_back( work );
+
+		work();
+		for( std::thread& thread : threads )
+			thread.join();
+	}
+	////////////////////////////////////////////////////////////////////////////
+
+	/**
+	 * @brief Milliseconds	Returns the milliseconds since 'start'.
+	 */
+	double	Milliseconds( const Clock::time_point& start )
+	{
+		return	std::chrono::duration< double, std::milli >( Clock::now() - start ).count();
+	}
+	////////////////////////////////////////////////////////////////////////////
+
+	/**
+	 * @brief TraceLevels	Writes the hit level of every pixel of 'tile', -1
+	 * for a miss, to 'levels', the way TraceTile traces it.
+	 */
+	template< Precision P >
+	void	TraceLevels( SphereFlake& sphereFlake, const RayGenerator& rays, const Vec3& origin,
+						 const Tile& tile, float* levels, uint32_t stride )
+	{
+		for( uint32_t y = 0; y < tile.height; ++y )
+		{
+			for( uint32_t x = 0; x < tile.width; x += SIMD::SIZE )
+			{
+				HitRecord		records;
+				TraversalStats	stats;
+				const Ray		ray	= rays.Cast( origin, tile.x + x, tile.y + y );
+
+				sphereFlake.Intersect< P >( ray, records, stats );
+
+				for( uint32_t k = 0; k < SIMD::SIZE; ++k )
+					levels[ y * stride + x + k ]	= records.level.Extract( k );
+			}
+		}
+	}
+	////////////////////////////////////////////////////////////////////////////
+
+	/**
+	 * @brief CountOtherLevels	Returns the pixels of a 'width' x 'height' frame
+	 * whose level in 'splatted' is not the one in 'traced', and stores in
+	 * 'inside' those of them whose neighbours all have the same traced level.
+	 */
+	size_t	CountOtherLevels( const float* traced, const float* splatted, uint32_t width, uint32_t height,
+							  size_t& inside )
+	{
+		size_t	other	= 0;
+		inside	= 0;
+		for( uint32_t y = 0; y < height; ++y )
+		{
+			for( uint32_t x = 0; x < width; ++x )
+			{
+				const size_t	i	= size_t( y ) * width + x;
+				if( traced[ i ] == splatted[ i ] )
+					continue;
+
+				++other;
+
+				bool	edge	= false;
+				for( uint32_t ny = ( 0 == y ) ? 0 : y - 1; ny <= std::min( y + 1, height - 1 ); ++ny )
+				{
+					for( uint32_t nx = ( 0 == x ) ? 0 : x - 1; nx <= std::min( x + 1, width - 1 ); ++nx )
+						edge	= edge || traced[ size_t( ny ) * width + nx ] != traced[ i ];
+				}
+
+				inside	+= edge ? 0 : 1;
+			}
+		}
+
+		return	other;
+	}
+	////////////////////////////////////////////////////////////////////////////
+
+	/**
+	 * @brief CheckSize	Renders the frame 'scale' times the screen size both
+	 * ways and prints the line of the size.
+	 * @return	Returns false if the share of pixels over the tolerance is over
+	 * the budget, or a pixel inside a traced region hits another level.
+	 */
+	template< Precision P >
+	bool	CheckSize( const Options& options, uint32_t threadCount, uint32_t scale )
+	{
+		const uint32_t	width	= SCREEN_WIDTH * scale;
+		const uint32_t	height	= SCREEN_HEIGHT * scale;
+		const size_t	pixels	= size_t( width ) * height;
+
+		// The cull and the impostors in pixels of this size.
+		SphereFlake	sphereFlake;
+		sphereFlake.SetImpostorPixels( options.impostorPixels );
+		sphereFlake.SetOcclusionCull( options.occlusionCull );
+		sphereFlake.SetFieldOfView( options.view.TanHalfFov() / float( scale ) );
+
+		RayGenerator	rays;
+		rays.Setup( options.view, width, height, P );
+
+		std::vector< Vec3 >	traced( pixels );
+		std::vector< Vec3 >	splatted( pixels );
+		SphereSplatter		splatter;
+
+		double	traceMs	= 0.0;
+		double	splatMs	= 0.0;
+		double	walkMs	= 0.0;
+		for( uint32_t i = 0; i < REPETITIONS; ++i )
+		{
+			Clock::time_point	start	= Clock::now();
+			RunTiles( threadCount, width, height, [ & ]( const Tile& tile )
+			{
+				TraversalStats	stats;
+				TraceTile< P >( sphereFlake, rays, options.camera, tile,
+								traced.data() + size_t( tile.y ) * width + tile.x, width, stats );
+			} );
+			const double	trace	= Milliseconds( start );
+
+			start	= Clock::now();
+			splatter.Build( sphereFlake, options.view, options.camera, width, height );
+			const double	walk	= Milliseconds( start );
+			RunTiles( threadCount, width, height, [ & ]( const Tile& tile )
+			{
+				splatter.SplatTile< P >( sphereFlake, rays, tile,
+										 splatted.data() + size_t( tile.y ) * width + tile.x, width );
+			} );
+			const double	splat	= Milliseconds( start );
+
+			traceMs	= ( 0 == i || trace < traceMs ) ? trace : traceMs;
+			walkMs	= ( 0 == i || walk < walkMs ) ? walk : walkMs;
+			splatMs	= ( 0 == i || splat < splatMs ) ? splat : splatMs;
+		}
+
+		// The levels are found again after the timed runs.
+		std::vector< float >	tracedLevels( pixels );
+		std::vector< float >	splattedLevels( pixels );
+		RunTiles( threadCount, width, height, [ & ]( const Tile& tile )
+		{
+			const size_t	offset	= size_t( tile.y ) * width + tile.x;
+			TraceLevels< P >( sphereFlake, rays, options.camera, tile, tracedLevels.data() + offset, width );
+			splatter.SplatTile< P >( sphereFlake, rays, tile, splatted.data() + offset, width,
+									 splattedLevels.data() + offset );
+		} );
+
+		std::vector< uint8_t >	a( pixels * 3 );
+		std::vector< uint8_t >	b( pixels * 3 );
+		ConvertToRgb8( traced.data(), width, height, width, a.data() );
+		ConvertToRgb8( splatted.data(), width, height, width, b.data() );
+		const ImageDiff	diff	= CompareRgb8( a.data(), b.data(), pixels, MAX_CHANNEL_ERROR );
+
+		size_t			inside	= 0;
+		const size_t	other	= CountOtherLevels( tracedLevels.data(), splattedLevels.data(), width, height, inside );
+
+		printf( SIZE_MSG, width, height, traceMs, double( pixels ) / ( traceMs * 1000.0 ),
+				splatMs, double( pixels ) / ( splatMs * 1000.0 ), traceMs / splatMs,
+				walkMs, splatter.SplatCount(), diff.maxError, diff.outliers, MAX_CHANNEL_ERROR, other, inside );
+
+		return	double( diff.outliers ) / double( pixels ) <= MAX_OUTLIER_FRACTION && 0 == inside;
+	}
+	////////////////////////////////////////////////////////////////////////////
+
+	/**
+	 * @brief TraceDeepZoom	Renders the deep zoom view with the tracer, with or
+	 * without 'splat', stores the milliseconds in 'ms' and returns the frame
+	 * as RGB8.
+	 */
+	std::vector< uint8_t >	TraceDeepZoom( Options options, bool splat, double& ms )
+	{
+		options.splatSpheres	= splat;
+		options.deepZoom		= true;
+		options.zoomPath.assign( std::begin( DEEP_ZOOM_PATH ), std::end( DEEP_ZOOM_PATH ) );
+		options.tileCacheMb		= 0;
+		options.tileCacheDir.clear();
+
+		Tracer		tracer( options, 0 );
+		FrameBuffer	buffer( options.hugePages );
+		tracer.ClearBuffer( buffer );
+
+		const Clock::time_point	start	= Clock::now();
+		tracer.StartFrame( DEEP_ZOOM_CAMERA, buffer );
+		tracer.WaitFrame();
+		ms	= Milliseconds( start );
+
+		std::vector< uint8_t >	rgb( size_t( SCREEN_WIDTH ) * SCREEN_HEIGHT * 3 );
+		ConvertToRgb8( buffer, false, rgb.data() );
+
+		return	rgb;
+	}
+	////////////////////////////////////////////////////////////////////////////
+
+	/**
+	 * @brief CheckDeepZoom	Renders the deep zoom view through the tracer both
+	 * ways, prints its line and returns the share of pixels over the
+	 * tolerance.
+	 */
+	double	CheckDeepZoom( const Options& options )
+	{
+		double	traceMs	= 0.0;
+		double	splatMs	= 0.0;
+		const std::vector< uint8_t >	traced		= TraceDeepZoom( options, false, traceMs );
+		const std::vector< uint8_t >	splatted	= TraceDeepZoom( options, true, splatMs );
+
+		const size_t	pixels	= size_t( SCREEN_WIDTH ) * SCREEN_HEIGHT;
+		const ImageDiff	diff	= CompareRgb8( traced.data(), splatted.data(), pixels, MAX_CHANNEL_ERROR );
+
+		printf( DEEP_ZOOM_MSG, traceMs, splatMs, diff.maxError, diff.outliers, MAX_CHANNEL_ERROR );
+
+		return	double( diff.outliers ) / double( pixels );
+	}
+	////////////////////////////////////////////////////////////////////////////
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief RunSplatCheck	Compares the splatted and the traced frames at the
+ * camera.
+ * @return	Returns the exit code of the program.
+ */
+int	RunSplatCheck( const Options& options )
+{
+	uint32_t	threadCount	= options.threadCount;
+	if( 0 == threadCount )
+		threadCount	= std::max( 1u, std::thread::hardware_concurrency() );
+
+	printf( HEADER_MSG, SIMD_NAME, threadCount, options.camera.x, options.camera.y, options.camera.z );
+
+	bool	passed	= true;
+	for( const uint32_t scale : SCALES )
+	{
+		const bool	sizePassed	= ( Precision::FAST == options.precision )
+								? CheckSize< Precision::FAST >( options, threadCount, scale )
+								: CheckSize< Precision::EXACT >( options, threadCount, scale );
+
+		passed	= passed && sizePassed;
+	}
+
+	passed	= CheckDeepZoom( options ) <= MAX_OUTLIER_FRACTION && passed;
+
+	if( ! passed )
+	{
+		fprintf( stderr, FAILED_MSG, MAX_OUTLIER_FRACTION * 100.0, MAX_CHANNEL_ERROR );
+		return	1;
+	}
+
+	fprintf( stderr, PASSED_MSG );
+	return	0;
+}
+////////////////////////////////////////////////////////////////////////////////
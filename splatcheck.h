@@ -0,0 +1,31 @@
+
+#ifndef SPLATCHECK_H
+#define SPLATCHECK_H
+
+////////////////////////////////////////////////////////////////////////////////
+
+#include "options.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Compares the splatted primary visibility with the traced one.
+ *
+ * Renders the frame at 'options.camera' and 'options.view' with the ray
+ * packets and with the SphereSplatter at 1, 2 and 4 times the screen size,
+ * with the pixel cull and the impostors in the pixels of that size. The tiles
+ * are split among 'options.threadCount' threads (all CPUs when 0), the same
+ * for both. Prints the best time and the Mrays/s of each, the time and the
+ * sphere count of the splatter's walk, the image difference and the pixels
+ * that hit another level, inside the traced regions and on their edges. A
+ * pixel of another level inside a region is a missed sphere and fails the
+ * size whatever the image budget. A deep zoom
+ * view is then rendered through the Tracer with and without
+ * 'options.splatSpheres', at the screen size. Returns 0 if every frame is
+ * within the image error budget and 1 otherwise.
+ */
+int	RunSplatCheck( const Options& options );
+
+////////////////////////////////////////////////////////////////////////////////
+
+#endif // SPLATCHECK_H
@@ -0,0 +1,155 @@
+
+#include <math.h>
+
+#include "splatter.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Pixels added around the rectangle of a sphere. The rays of the table are
+// rounded (and approximate with Precision::FAST), a ray on the edge of the
+// rectangle must not be left out.
+constexpr float	SPLAT_MARGIN	= 1.0f;
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief SphereSplatter::SphereSplatter	Constructor for the class. The
+ * spheres are found by the first Build.
+ */
+SphereSplatter::SphereSplatter()
+	: m_tanHalfFov( 1.0f )
+	, m_hitMin( HitRecord::DEFAULT_MIN )
+	, m_width( 0 )
+	, m_height( 0 )
+	, m_tilesX( 0 )
+{
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief SphereSplatter::Build	Finds the spheres of a 'width' x 'height'
+ * frame seen from 'origin' through 'view' and bins them into its tiles. The
+ * vectors keep their memory from frame to frame.
+ */
+void	SphereSplatter::Build( const SphereFlake& sphereFlake, const CameraView& view, const Vec3& origin,
+							   uint32_t width, uint32_t height )
+{
+	m_origin		= origin;
+	m_tanHalfFov	= view.TanHalfFov();
+	m_hitMin		= sphereFlake.HitMin();
+	m_width			= width;
+	m_height		= height;
+	m_tilesX		= ( width + TILE_SIZE - 1 ) / TILE_SIZE;
+	view.Axes( m_right, m_up, m_back );
+
+	const uint32_t	tilesY	= ( height + TILE_SIZE - 1 ) / TILE_SIZE;
+	m_bins.resize( size_t( m_tilesX ) * tilesY );
+	for( std::vector< uint32_t >& bin : m_bins )
+		bin.clear();
+
+	m_splats.clear();
+	sphereFlake.Walk( origin, *this );
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief SphereSplatter::Visible	Returns true if a ball at 'center' with
+ * 'radius', in world units, covers a pixel of the frame.
+ */
+bool	SphereSplatter::Visible( const Vec3& center, float radius ) const
+{
+	Splat	splat;
+	return	Project( center, radius, splat );
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief SphereSplatter::Draw	Keeps the sphere at 'center' with 'radius' in
+ * the frame of 'node' and bins it, if it covers a pixel of the frame.
+ */
+void	SphereSplatter::Draw( const WalkNode& node, const Vec3& center, float radius, uint32_t level )
+{
+	const Vec3	world	= node.center + ( node.rows[ 0 ] * center.x
+										+ node.rows[ 1 ] * center.y
+										+ node.rows[ 2 ] * center.z ) * node.scale;
+
+	Splat	splat;
+	if( ! Project( world, radius * node.scale, splat ) )
+		return;
+
+	splat.rows[ 0 ]	= node.rows[ 0 ];
+	splat.rows[ 1 ]	= node.rows[ 1 ];
+	splat.rows[ 2 ]	= node.rows[ 2 ];
+	splat.origin	= node.origin;
+	splat.center	= center;
+	splat.radius	= radius;
+	splat.scale		= node.scale;
+	splat.level		= level;
+
+	const uint32_t	index	= static_cast< uint32_t >( m_splats.size() );
+	m_splats.push_back( splat );
+
+	for( uint32_t ty = splat.y0 / TILE_SIZE; ty <= splat.y1 / TILE_SIZE; ++ty )
+	{
+		for( uint32_t tx = splat.x0 / TILE_SIZE; tx <= splat.x1 / TILE_SIZE; ++tx )
+			m_bins[ ty * m_tilesX + tx ].push_back( index );
+	}
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief SphereSplatter::Project	Computes the pixels a ball at 'center' with
+ * 'radius', in world units, can cover and stores them in the rectangle of
+ * 'splat'.
+ * @return	Returns false if it covers none.
+ *
+ * The edges of the projected ellipse along each camera axis are where the
+ * planes through the camera touch the ball. A ball that reaches the plane of
+ * the camera can cover any pixel. One that is all behind it by more than the
+ * distance the hits may be behind the camera covers none.
+ */
+bool	SphereSplatter::Project( const Vec3& center, float radius, Splat& splat ) const
+{
+	const Vec3	delta	= center - m_origin;
+	const float	x		= m_right.dot( delta );
+	const float	y		= m_up.dot( delta );
+	const float	depth	= -m_back.dot( delta );
+
+	if( depth + radius < m_hitMin )
+		return	false;
+
+	// Camera plane coordinates of the rays through the first and last pixels,
+	// the same as the table of the RayGenerator.
+	const float	uScale	= float( m_width ) / ( 2.0f * m_tanHalfFov );
+	const float	vScale	= float( m_height ) / ( 2.0f * m_tanHalfFov * SCREEN_RATIO );
+	const float	uOffset	= 0.5f * float( m_width );
+	const float	vOffset	= 0.5f * float( m_height ) / SCREEN_RATIO;
+
+	float	left	= 0.0f;
+	float	right	= float( m_width - 1 );
+	float	bottom	= 0.0f;
+	float	top		= float( m_height - 1 );
+
+	if( depth > radius )
+	{
+		const float	k		= depth * depth - radius * radius;
+		const float	sx		= radius * sqrtf( x * x + k );
+		const float	sy		= radius * sqrtf( y * y + k );
+
+		left	= std::max( left, ( x * depth - sx ) / k * uScale + uOffset - SPLAT_MARGIN );
+		right	= std::min( right, ( x * depth + sx ) / k * uScale + uOffset + SPLAT_MARGIN );
+		bottom	= std::max( bottom, ( y * depth - sy ) / k * vScale + vOffset - SPLAT_MARGIN );
+		top		= std::min( top, ( y * depth + sy ) / k * vScale + vOffset + SPLAT_MARGIN );
+	}
+
+	if( !( left <= right && bottom <= top ) )
+		return	false;
+
+	splat.x0	= static_cast< uint32_t >( ceilf( left ) );
+	splat.x1	= static_cast< uint32_t >( floorf( right ) );
+	splat.y0	= static_cast< uint32_t >( ceilf( bottom ) );
+	splat.y1	= static_cast< uint32_t >( floorf( top ) );
+
+	return	splat.x0 <= splat.x1 && splat.y0 <= splat.y1;
+}
+////////////////////////////////////////////////////////////////////////////////
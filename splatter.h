@@ -0,0 +1,178 @@
+
+#ifndef SPLATTER_H
+#define SPLATTER_H
+
+////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <vector>
+
+#include <stdint.h>
+
+#include "cameraview.h"
+#include "config.h"
+#include "hitrecord.h"
+#include "ray.h"
+#include "raygen.h"
+#include "simd.h"
+#include "simd_precision.h"
+#include "sphereflake.h"
+#include "tile.h"
+#include "vec3.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief The SphereSplatter class finds the primary hits of a frame by
+ * splatting the spheres onto the screen, instead of taking every packet down
+ * the hierarchy.
+ *
+ * Build walks the fractal once per frame with the cull and the impostors of
+ * the traversal (see SphereFlake::Walk). Every sphere it would draw is kept
+ * with its local frame and the rectangle its ellipse covers on the screen, and
+ * is binned into the tiles the rectangle overlaps.
+ *
+ * SplatTile goes over the spheres of one tile and intersects each only with
+ * the packets of its rectangle. The nearest hit and level of every packet stay
+ * in a tile sized buffer of hit records, the depth and id buffer of the tile,
+ * which is shaded at the end. The hits are the exact ray-sphere intersections
+ * of the traversal, only the rounding of the local frames differs.
+ *
+ * Build is called while no thread splats, SplatTile by all of them.
+ */
+class SphereSplatter
+{
+public:
+	SphereSplatter();
+
+	void	Build( const SphereFlake& sphereFlake, const CameraView& view, const Vec3& origin,
+				   uint32_t width, uint32_t height );
+
+	template< Precision P >
+	void	SplatTile( SphereFlake& sphereFlake, const RayGenerator& rays, const Tile& tile,
+					   Vec3* out, uint32_t stride, float* levels = nullptr )	const;
+
+	size_t	SplatCount()	const	{ return	m_splats.size(); }
+
+	// The visitor of SphereFlake::Walk.
+	bool	Visible( const Vec3& center, float radius )	const;
+	void	Draw( const WalkNode& node, const Vec3& center, float radius, uint32_t level );
+
+private:
+	/**
+	 * @brief The Splat struct is a sphere to draw: the rotation of the world
+	 * directions into its frame, the camera, center and radius there, the
+	 * world size of a local unit and the level of its hits. x0 to x1 and y0
+	 * to y1 are the pixels it can cover, both included.
+	 */
+	struct Splat
+	{
+		Vec3		rows[ 3 ];
+		Vec3		origin;
+		Vec3		center;
+		float		radius;
+		float		scale;
+		uint32_t	level;
+		uint32_t	x0;
+		uint32_t	y0;
+		uint32_t	x1;
+		uint32_t	y1;
+	};
+
+	bool	Project( const Vec3& center, float radius, Splat& splat )	const;
+
+private:
+	std::vector< Splat >					m_splats;
+	// Indices of the splats overlapping each tile of the frame, by rows.
+	std::vector< std::vector< uint32_t > >	m_bins;
+
+	Vec3		m_origin;
+	Vec3		m_right;
+	Vec3		m_up;
+	Vec3		m_back;
+	float		m_tanHalfFov;
+	float		m_hitMin;
+	uint32_t	m_width;
+	uint32_t	m_height;
+	uint32_t	m_tilesX;
+};
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief SphereSplatter::SplatTile	Writes the pixels of 'tile' of the frame of
+ * the last Build to 'out', with the rays of 'rays', set up for the same frame.
+ * 'stride' is the number of pixels per row and 'out' points to the top left
+ * pixel of the tile. P is the precision policy of the square roots. When
+ * 'levels' is given the hit level of every pixel, -1 for a miss, is written
+ * there the same way as 'out'.
+ */
+template< Precision P >
+inline
+void	SphereSplatter::SplatTile( SphereFlake& sphereFlake, const RayGenerator& rays, const Tile& tile,
+								   Vec3* out, uint32_t stride, float* levels ) const
+{
+	constexpr uint32_t	PACKETS_PER_ROW	= TILE_SIZE / SIMD::SIZE;
+
+	SIMD::Vec	directions[ TILE_SIZE * PACKETS_PER_ROW ];
+	HitRecord	records[ TILE_SIZE * PACKETS_PER_ROW ];
+
+	const uint32_t	packets	= tile.width / SIMD::SIZE;
+	for( uint32_t y = 0; y < tile.height; ++y )
+	{
+		for( uint32_t p = 0; p < packets; ++p )
+		{
+			directions[ y * PACKETS_PER_ROW + p ]	= rays.Cast( m_origin, tile.x + p * SIMD::SIZE, tile.y + y ).direction();
+			records[ y * PACKETS_PER_ROW + p ].min	= SIMD::float_t( m_hitMin );
+		}
+	}
+
+	const uint32_t	lastX	= tile.x + tile.width - 1;
+	const uint32_t	lastY	= tile.y + tile.height - 1;
+
+	for( const uint32_t index : m_bins[ tile.y / TILE_SIZE * m_tilesX + tile.x / TILE_SIZE ] )
+	{
+		const Splat&	splat	= m_splats[ index ];
+		const SIMD::Vec	rows[ 3 ]	= { SIMD::Vec( splat.rows[ 0 ] ), SIMD::Vec( splat.rows[ 1 ] ),
+										SIMD::Vec( splat.rows[ 2 ] ) };
+
+		// The rectangle of the splat in the packets of the tile.
+		const uint32_t	y0	= std::max( splat.y0, tile.y ) - tile.y;
+		const uint32_t	y1	= std::min( splat.y1, lastY ) - tile.y;
+		const uint32_t	p0	= ( std::max( splat.x0, tile.x ) - tile.x ) / SIMD::SIZE;
+		const uint32_t	p1	= ( std::min( splat.x1, lastX ) - tile.x ) / SIMD::SIZE;
+
+		for( uint32_t y = y0; y <= y1; ++y )
+		{
+			for( uint32_t p = p0; p <= p1; ++p )
+			{
+				const SIMD::Vec&	dir	= directions[ y * PACKETS_PER_ROW + p ];
+				const Ray			local( splat.origin, SIMD::Vec( dir.dot( rows[ 0 ] ), dir.dot( rows[ 1 ] ),
+																	dir.dot( rows[ 2 ] ) ) );
+
+				sphereFlake.SphereIntersect< P, false >( local, splat.center, splat.radius, splat.scale,
+														 splat.level, SIMD::TRUE_VALUE,
+														 records[ y * PACKETS_PER_ROW + p ] );
+			}
+		}
+	}
+
+	for( uint32_t y = 0; y < tile.height; ++y )
+	{
+		for( uint32_t p = 0; p < packets; ++p )
+		{
+			const Ray	ray( m_origin, directions[ y * PACKETS_PER_ROW + p ] );
+			SIMD::StorePixels( records[ y * PACKETS_PER_ROW + p ].Shade( ray ), out + y * stride + p * SIMD::SIZE );
+
+			if( nullptr != levels )
+			{
+				for( uint32_t k = 0; k < SIMD::SIZE; ++k )
+					levels[ y * stride + p * SIMD::SIZE + k ]	= records[ y * PACKETS_PER_ROW + p ].level.Extract( k );
+			}
+		}
+	}
+
+	SIMD::StoreFence();
+}
+////////////////////////////////////////////////////////////////////////////////
+
+#endif // SPLATTER_H
@@ -0,0 +1,140 @@
+
+#ifndef TILE_H
+#define TILE_H
+
+////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+
+#include <stdint.h>
+
+#include "aov.h"
+#include "config.h"
+#include "hitrecord.h"
+#include "ray.h"
+#include "raygen.h"
+#include "sphereflake.h"
+#include "vec3.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief The Tile struct is a rectangle of the screen. The width is always a
+ * multiple of the SIMD width. The frame size is the resolution of the traced
+ * frame the tile belongs to, the screen unless the resolution is scaled down.
+ */
+struct Tile
+{
+	uint32_t	x;
+	uint32_t	y;
+	uint32_t	width;
+	uint32_t	height;
+	uint32_t	frameWidth	= SCREEN_WIDTH;
+	uint32_t	frameHeight	= SCREEN_HEIGHT;
+};
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief GetTile	Returns the rectangle of tile number 'index' when the screen
+ * is split in TILE_SIZE tiles, 'tilesX' tiles per row. Tiles are clipped to a
+ * frame of 'frameWidth' x 'frameHeight' pixels, tiles outside of it are empty.
+ */
+inline
+Tile	GetTile( uint32_t index, uint32_t tilesX,
+				 uint32_t frameWidth = SCREEN_WIDTH, uint32_t frameHeight = SCREEN_HEIGHT )
+{
+	Tile	tile;
+	tile.x				= index % tilesX * TILE_SIZE;
+	tile.y				= index / tilesX * TILE_SIZE;
+	tile.width			= ( tile.x >= frameWidth  ) ? 0 : std::min( TILE_SIZE, frameWidth  - tile.x );
+	tile.height			= ( tile.y >= frameHeight ) ? 0 : std::min( TILE_SIZE, frameHeight - tile.y );
+	tile.frameWidth		= frameWidth;
+	tile.frameHeight	= frameHeight;
+
+	return	tile;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief TraceTile	Traces the pixels of 'tile' as seen from 'origin', with
+ * the rays of 'rays', which is set up for the frame of the tile. The
+ * result is written to 'out', where 'stride' is the number of pixels per row
+ * and 'out' points to the top left pixel of the tile. The visited spheres are
+ * counted in 'stats'. P is the precision policy of the square roots.
+ *
+ * When 'out' is aligned the pixels are written with non-temporal stores, they
+ * go to memory without filling the caches with a frame that is read only by
+ * the upload.
+ */
+template< Precision P = Precision::EXACT >
+inline
+void	TraceTile( SphereFlake& sphereFlake, const RayGenerator& rays, const Vec3& origin,
+				   const Tile& tile, Vec3* out, uint32_t stride, TraversalStats& stats )
+{
+	for( uint32_t y = 0; y < tile.height; ++y )
+	{
+		for( uint32_t x = 0; x < tile.width; x += SIMD::SIZE )
+		{
+			HitRecord	records;
+			Ray			ray		= rays.Cast( origin, tile.x + x, tile.y + y );
+			Vec3*		pixels	= out + y * stride + x;
+
+			sphereFlake.Intersect< P >( ray, records, stats );
+
+			SIMD::StorePixels( records.Shade( ray ), pixels );
+		}
+	}
+
+	SIMD::StoreFence();
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief TraceTile	Same as above, and writes the channels of 'aovs' for the
+ * pixels of the tile. The sphere ids and normals are recorded during the
+ * traversal only when one of them is asked for.
+ */
+template< Precision P = Precision::EXACT >
+inline
+void	TraceTile( SphereFlake& sphereFlake, const RayGenerator& rays, const Vec3& origin,
+				   const Tile& tile, Vec3* out, uint32_t stride, TraversalStats& stats,
+				   AovBuffers& aovs )
+{
+	const bool	needsSurface	= aovs.NeedsSurface();
+
+	for( uint32_t y = 0; y < tile.height; ++y )
+	{
+		for( uint32_t x = 0; x < tile.width; x += SIMD::SIZE )
+		{
+			HitRecord		records;
+			SurfaceRecord	surface( aovs.Has( AovChannel::SPHERE_ID ), aovs.Has( AovChannel::NORMAL ) );
+			Ray				ray		= rays.Cast( origin, tile.x + x, tile.y + y );
+			Vec3*			pixels	= out + y * stride + x;
+
+			if( needsSurface )
+				sphereFlake.Intersect< P >( ray, records, stats, surface );
+			else
+				sphereFlake.Intersect< P >( ray, records, stats );
+
+			SIMD::StorePixels( records.Shade( ray ), pixels );
+			aovs.Store( tile.x + x, tile.y + y, records, surface );
+		}
+	}
+
+	SIMD::StoreFence();
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief TraceTile	Same as above, without the statistics.
+ */
+inline
+void	TraceTile( SphereFlake& sphereFlake, const RayGenerator& rays, const Vec3& origin,
+				   const Tile& tile, Vec3* out, uint32_t stride )
+{
+	TraversalStats	stats;
+	TraceTile( sphereFlake, rays, origin, tile, out, stride, stats );
+}
+////////////////////////////////////////////////////////////////////////////////
+
+#endif // TILE_H
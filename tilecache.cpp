@@ -0,0 +1,412 @@
+
+#include <algorithm>
+#include <filesystem>
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "hitrecord.h"
+#include "image.h"
+#include "qoi.h"
+#include "simd.h"
+#include "sphereflake.h"
+
+#include "tilecache.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Changed whenever the traced colors change for the same parameters, so old
+// disk caches are not used.
+constexpr uint32_t	CACHE_VERSION		= 3;
+// Tiles waiting for the disk writer, more are not written.
+constexpr size_t	MAX_PENDING_WRITES	= 4096;
+
+constexpr char		TILE_EXTENSION[]	= ".tile";
+
+constexpr uint64_t	FNV_OFFSET			= 14695981039346656037ull;
+constexpr uint64_t	FNV_PRIME			= 1099511628211ull;
+
+constexpr char		CACHE_DIR_MSG[]		= "Tile cache directory %s: %s\n";
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+	uint64_t	Fnv1a( const void* data, size_t size, uint64_t hash = FNV_OFFSET )
+	{
+		const uint8_t*	bytes	= static_cast< const uint8_t* >( data );
+		for( size_t i = 0; i < size; ++i )
+			hash	= ( hash ^ bytes[ i ] ) * FNV_PRIME;
+
+		return	hash;
+	}
+	////////////////////////////////////////////////////////////////////////////
+
+	/**
+	 * @brief SceneHash	Hashes everything besides the camera that the traced
+	 * colors depend on.
+	 */
+	uint32_t	SceneHash()
+	{
+		const float		values[]	=
+		{
+			float( CACHE_VERSION ), float( SIMD::SIZE ),
+			float( TYPE1_SPHERES_COUNT ), float( TYPE2_SPHERES_COUNT ),
+			float( TYPE1_SPHERES_DEGREE ), float( TYPE2_SPHERES_DEGREE ),
+			float( TYPE1_SPHERES_ROTATION ), float( TYPE2_SPHERES_ROTATION ),
+			STARTING_RADIUS, SPHERE_RATIO, float( SCREEN_WIDTH ), float( SCREEN_HEIGHT ),
+			float( TILE_SIZE ), SIN_HALF_FOV, float( GetMaxDepth() ), float( COLOR_LEVELS ),
+		};
+
+		const uint64_t	hash	= Fnv1a( values, sizeof( values ) );
+		return	static_cast< uint32_t >( hash ^ ( hash >> 32 ) );
+	}
+	////////////////////////////////////////////////////////////////////////////
+
+	int32_t	QuantizeCoordinate( float v )
+	{
+		const double	steps	= double( v ) * TileCache::CAMERA_STEPS;
+		return	static_cast< int32_t >( lround( std::max( double( INT32_MIN ), std::min( double( INT32_MAX ), steps ) ) ) );
+	}
+	////////////////////////////////////////////////////////////////////////////
+}
+////////////////////////////////////////////////////////////////////////////////
+
+uint64_t	TileKey::Hash() const
+{
+	return	Fnv1a( this, sizeof( *this ) );
+}
+////////////////////////////////////////////////////////////////////////////////
+
+bool	TileKey::operator==( const TileKey& other ) const
+{
+	return	0 == memcmp( this, &other, sizeof( *this ) );
+}
+////////////////////////////////////////////////////////////////////////////////
+
+static_assert( 12 * sizeof( uint32_t ) == sizeof( TileKey ), "The tile key must not have padding." );
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief TileCache::TileCache	Creates a cache of at most 'memoryBytes' of
+ * tiles, backed by 'directory' unless it is empty.
+ */
+TileCache::TileCache( size_t memoryBytes, const std::string& directory )
+	: m_capacity( std::max< size_t >( 1, memoryBytes / ( TILE_PIXELS * sizeof( Vec3 ) ) ) )
+	, m_directory( directory )
+	, m_shouldQuit( false )
+{
+	if( m_directory.empty() )
+		return;
+
+	std::error_code	error;
+	std::filesystem::create_directories( m_directory, error );
+	if( error )
+	{
+		fprintf( stderr, CACHE_DIR_MSG, m_directory.c_str(), error.message().c_str() );
+		m_directory.clear();
+		return;
+	}
+
+	ScanDirectory();
+	m_writer	= std::thread( &TileCache::WriteThread, this );
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief TileCache::~TileCache	Writes the tiles that are queued for the disk
+ * and stops the writer.
+ */
+TileCache::~TileCache()
+{
+	{
+		std::lock_guard< std::mutex >	lock( m_mutex );
+		m_shouldQuit	= true;
+	}
+
+	m_writeCv.notify_all();
+	if( m_writer.joinable() )
+		m_writer.join();
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief TileCache::Quantize	Returns the camera snapped to the key grid.
+ */
+Vec3	TileCache::Quantize( const Vec3& camera )
+{
+	return	Vec3( float( QuantizeCoordinate( camera.x ) ) / CAMERA_STEPS,
+				  float( QuantizeCoordinate( camera.y ) ) / CAMERA_STEPS,
+				  float( QuantizeCoordinate( camera.z ) ) / CAMERA_STEPS );
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief TileCache::Quantize	Returns the view snapped to the key grid, the
+ * angles in 1 / CAMERA_STEPS degrees.
+ */
+CameraView	TileCache::Quantize( const CameraView& view )
+{
+	CameraView	quantized;
+	quantized.yaw	= float( QuantizeCoordinate( view.yaw ) ) / CAMERA_STEPS;
+	quantized.pitch	= float( QuantizeCoordinate( view.pitch ) ) / CAMERA_STEPS;
+	quantized.fov	= float( QuantizeCoordinate( view.fov ) ) / CAMERA_STEPS;
+
+	return	quantized;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief TileCache::FrameKey	Returns the key of tile 0 of a frame, the other
+ * tiles only change the tile index.
+ */
+TileKey	TileCache::FrameKey( const Vec3& camera, const CameraView& view,
+							 uint32_t frameWidth, uint32_t frameHeight,
+							 Precision precision, bool streamRays, bool splatSpheres,
+							 float impostorPixels )
+{
+	static const uint32_t	scene	= SceneHash();
+
+	TileKey	key;
+	key.scene		= scene;
+	key.camera[ 0 ]	= QuantizeCoordinate( camera.x );
+	key.camera[ 1 ]	= QuantizeCoordinate( camera.y );
+	key.camera[ 2 ]	= QuantizeCoordinate( camera.z );
+	key.view[ 0 ]	= QuantizeCoordinate( view.yaw );
+	key.view[ 1 ]	= QuantizeCoordinate( view.pitch );
+	key.view[ 2 ]	= QuantizeCoordinate( view.fov );
+	key.frameWidth	= frameWidth;
+	key.frameHeight	= frameHeight;
+	key.tile		= 0;
+	key.flags		= ( Precision::FAST == precision ? 1u : 0u ) | ( streamRays ? 2u : 0u )
+					| ( splatSpheres ? 4u : 0u );
+	key.impostorPixels	= static_cast< uint32_t >( QuantizeCoordinate( impostorPixels ) );
+
+	return	key;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief TileCache::Lookup	Copies the TILE_PIXELS pixels of 'key' to 'tile'.
+ * @return	Returns false if the tile is neither in memory nor on disk.
+ */
+bool	TileCache::Lookup( const TileKey& key, Vec3* tile )
+{
+	const uint64_t	hash	= key.Hash();
+	{
+		std::lock_guard< std::mutex >	lock( m_mutex );
+
+		auto	found	= m_index.find( hash );
+		if( m_index.end() != found && found->second->key == key )
+		{
+			m_entries.splice( m_entries.begin(), m_entries, found->second );
+			memcpy( tile, found->second->pixels.data(), TILE_PIXELS * sizeof( Vec3 ) );
+			++m_stats.memoryHits;
+			return	true;
+		}
+
+		if( 0 == m_onDisk.count( hash ) )
+		{
+			++m_stats.misses;
+			return	false;
+		}
+	}
+
+	const bool	read	= ReadTile( key, tile );
+	if( read )
+		Store( key, tile, true );
+
+	std::lock_guard< std::mutex >	lock( m_mutex );
+	++( read ? m_stats.diskHits : m_stats.misses );
+	return	read;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief TileCache::Insert	Keeps the TILE_PIXELS pixels of 'tile' under
+ * 'key', evicting the least recently used tile when the memory is full.
+ */
+void	TileCache::Insert( const TileKey& key, const Vec3* tile )
+{
+	Store( key, tile, false );
+}
+////////////////////////////////////////////////////////////////////////////////
+
+TileCacheStats	TileCache::Stats() const
+{
+	std::lock_guard< std::mutex >	lock( m_mutex );
+	return	m_stats;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief TileCache::Size	Returns the number of tiles in memory.
+ */
+size_t	TileCache::Size() const
+{
+	std::lock_guard< std::mutex >	lock( m_mutex );
+	return	m_entries.size();
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief TileCache::Store	Puts the tile in memory and, unless it was read
+ * from there, queues it for the disk.
+ */
+void	TileCache::Store( const TileKey& key, const Vec3* tile, bool fromDisk )
+{
+	const uint64_t	hash	= key.Hash();
+
+	std::vector< uint8_t >	rgb;
+	if( ! fromDisk && ! m_directory.empty() )
+	{
+		rgb.resize( TILE_PIXELS * 3 );
+		ConvertToRgb8( tile, TILE_SIZE, TILE_SIZE, TILE_SIZE, rgb.data() );
+	}
+
+	std::lock_guard< std::mutex >	lock( m_mutex );
+
+	auto	found	= m_index.find( hash );
+	if( m_index.end() != found )
+	{
+		found->second->key	= key;
+		memcpy( found->second->pixels.data(), tile, TILE_PIXELS * sizeof( Vec3 ) );
+		m_entries.splice( m_entries.begin(), m_entries, found->second );
+	}
+	else
+	{
+		// Reuse the pixels of the evicted tile.
+		if( m_entries.size() >= m_capacity )
+		{
+			m_index.erase( m_entries.back().key.Hash() );
+			m_entries.splice( m_entries.begin(), m_entries, std::prev( m_entries.end() ) );
+		}
+		else
+		{
+			m_entries.emplace_front();
+			m_entries.front().pixels.resize( TILE_PIXELS );
+		}
+
+		m_entries.front().key	= key;
+		memcpy( m_entries.front().pixels.data(), tile, TILE_PIXELS * sizeof( Vec3 ) );
+		m_index[ hash ]	= m_entries.begin();
+	}
+
+	if( rgb.empty() || m_onDisk.count( hash ) || m_writes.size() >= MAX_PENDING_WRITES )
+		return;
+
+	m_onDisk.insert( hash );
+	m_writes.push_back( { key, std::move( rgb ) } );
+	m_writeCv.notify_one();
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief TileCache::ReadTile	Reads the file of 'key' into 'tile'.
+ * @return	Returns false if the file is missing, is another key or is broken.
+ */
+bool	TileCache::ReadTile( const TileKey& key, Vec3* tile ) const
+{
+	FILE*	file	= fopen( TilePath( key.Hash() ).c_str(), "rb" );
+	if( nullptr == file )
+		return	false;
+
+	std::vector< uint8_t >	data;
+	uint8_t					chunk[ 4096 ];
+	size_t					read;
+	while( 0 != ( read = fread( chunk, 1, sizeof( chunk ), file ) ) )
+		data.insert( data.end(), chunk, chunk + read );
+
+	fclose( file );
+
+	TileKey	stored;
+	if( data.size() < sizeof( stored ) )
+		return	false;
+
+	memcpy( &stored, data.data(), sizeof( stored ) );
+	if( !( stored == key ) )
+		return	false;
+
+	std::vector< uint8_t >	rgb;
+	uint32_t				width;
+	uint32_t				height;
+	if( ! QOI::Decode( data.data() + sizeof( stored ), data.size() - sizeof( stored ), rgb, width, height ) ||
+		TILE_SIZE != width || TILE_SIZE != height )
+		return	false;
+
+	for( uint32_t i = 0; i < TILE_PIXELS; ++i )
+	{
+		tile[ i ]	= Vec3( rgb[ i * 3 + 0 ] / 255.0f,
+							rgb[ i * 3 + 1 ] / 255.0f,
+							rgb[ i * 3 + 2 ] / 255.0f );
+	}
+
+	return	true;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+std::string	TileCache::TilePath( uint64_t hash ) const
+{
+	char	name[ 32 ];
+	snprintf( name, sizeof( name ), "%016" PRIx64 "%s", hash, TILE_EXTENSION );
+
+	return	m_directory + "/" + name;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief TileCache::ScanDirectory	Collects the hashes of the tile files in
+ * the directory. The files are checked when they are read.
+ */
+void	TileCache::ScanDirectory()
+{
+	std::error_code	error;
+	for( const auto& entry : std::filesystem::directory_iterator( m_directory, error ) )
+	{
+		const std::filesystem::path&	path	= entry.path();
+		if( TILE_EXTENSION != path.extension().string() )
+			continue;
+
+		const std::string	stem	= path.stem().string();
+		char*				end		= nullptr;
+		const uint64_t		hash	= strtoull( stem.c_str(), &end, 16 );
+		if( 16 == stem.size() && '\0' == *end )
+			m_onDisk.insert( hash );
+	}
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief TileCache::WriteThread	Encodes and writes the queued tiles.
+ */
+void	TileCache::WriteThread()
+{
+	std::unique_lock< std::mutex >	lock( m_mutex );
+	for(;;)
+	{
+		m_writeCv.wait( lock, [ this ]() { return m_shouldQuit || ! m_writes.empty(); } );
+		if( m_writes.empty() )
+			return;
+
+		Write	write	= std::move( m_writes.front() );
+		m_writes.pop_front();
+
+		lock.unlock();
+
+		const std::vector< uint8_t >	encoded	= QOI::Encode( write.rgb.data(), TILE_SIZE, TILE_SIZE );
+
+		std::vector< uint8_t >	data( sizeof( write.key ) + encoded.size() );
+		memcpy( data.data(), &write.key, sizeof( write.key ) );
+		memcpy( data.data() + sizeof( write.key ), encoded.data(), encoded.size() );
+
+		const bool	written	= WriteFileAtomic( TilePath( write.key.Hash() ).c_str(), data );
+
+		lock.lock();
+		if( ! written )
+			m_onDisk.erase( write.key.Hash() );
+	}
+}
+////////////////////////////////////////////////////////////////////////////////
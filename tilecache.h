@@ -0,0 +1,142 @@
+
+#ifndef TILECACHE_H
+#define TILECACHE_H
+
+////////////////////////////////////////////////////////////////////////////////
+
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cameraview.h"
+#include "config.h"
+#include "simd_precision.h"
+#include "vec3.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief The TileKey struct names the content of a traced tile: the scene
+ * (a hash of the fractal and screen parameters), the quantized camera and
+ * view (yaw, pitch and field of view), the frame size, the tile index and how
+ * it was traced (flags and the impostor threshold). Only 32 bit fields, so
+ * the struct has no padding and is hashed and compared as bytes.
+ */
+struct TileKey
+{
+	uint32_t	scene;
+	int32_t		camera[ 3 ];
+	int32_t		view[ 3 ];
+	uint32_t	frameWidth;
+	uint32_t	frameHeight;
+	uint32_t	tile;
+	uint32_t	flags;
+	uint32_t	impostorPixels;
+
+	uint64_t	Hash()								const;
+	bool		operator==( const TileKey& other )	const;
+};
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief The TileCacheStats struct counts the lookups of a TileCache.
+ */
+struct TileCacheStats
+{
+	uint64_t	memoryHits	= 0;
+	uint64_t	diskHits	= 0;
+	uint64_t	misses		= 0;
+
+	uint64_t	Lookups()	const	{ return	memoryHits + diskHits + misses; }
+};
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief The TileCache class keeps traced tiles so a view that was seen before
+ * is copied instead of traced.
+ *
+ * The camera is snapped to a grid of 1 / CAMERA_STEPS units before tracing
+ * (see Quantize), so a camera that comes back to a position, give or take
+ * float rounding, gets the same key. The tiles are the exact floats of the
+ * frame buffer, TILE_PIXELS each, in an LRU list of at most 'memoryBytes'.
+ *
+ * With a directory the tiles are also written there, one file per key named
+ * by its hash, holding the key and the tile as QOI. The colors are rounded to
+ * 8 bits, which converts back to the same bytes for the screen and the image
+ * files. The files are written by a thread of the cache, a lookup that misses
+ * the memory reads the file if the key is known to be on disk.
+ *
+ * Lookup and Insert are called by the render threads at the same time.
+ */
+class TileCache
+{
+public:
+	static constexpr uint32_t	CAMERA_STEPS	= 4096;
+	static constexpr uint32_t	TILE_PIXELS		= TILE_SIZE * TILE_SIZE;
+
+	TileCache( size_t memoryBytes, const std::string& directory );
+	~TileCache();
+
+	TileCache( const TileCache& )				= delete;
+	TileCache&	operator=( const TileCache& )	= delete;
+
+	static Vec3			Quantize( const Vec3& camera );
+	static CameraView	Quantize( const CameraView& view );
+	static TileKey		FrameKey( const Vec3& camera, const CameraView& view,
+								  uint32_t frameWidth, uint32_t frameHeight,
+								  Precision precision, bool streamRays, bool splatSpheres,
+								  float impostorPixels );
+
+	bool			Lookup( const TileKey& key, Vec3* tile );
+	void			Insert( const TileKey& key, const Vec3* tile );
+
+	TileCacheStats	Stats()		const;
+	size_t			Size()		const;
+
+private:
+	struct Entry
+	{
+		TileKey				key;
+		std::vector< Vec3 >	pixels;
+	};
+
+	struct Write
+	{
+		TileKey					key;
+		std::vector< uint8_t >	rgb;
+	};
+
+	void		Store( const TileKey& key, const Vec3* tile, bool fromDisk );
+	bool		ReadTile( const TileKey& key, Vec3* tile )	const;
+	std::string	TilePath( uint64_t hash )					const;
+	void		ScanDirectory();
+	void		WriteThread();
+
+private:
+	size_t											m_capacity;
+	std::string										m_directory;
+
+	mutable std::mutex								m_mutex;
+	std::list< Entry >								m_entries;
+	std::unordered_map< uint64_t, std::list< Entry >::iterator >	m_index;
+	// Hashes of the tiles on disk and of those waiting to be written.
+	std::unordered_set< uint64_t >					m_onDisk;
+	TileCacheStats									m_stats;
+
+	std::condition_variable							m_writeCv;
+	std::deque< Write >								m_writes;
+	bool											m_shouldQuit;
+	std::thread										m_writer;
+};
+////////////////////////////////////////////////////////////////////////////////
+
+#endif // TILECACHE_H
@@ -0,0 +1,87 @@
+
+#include <math.h>
+#include <string.h>
+
+#include "tilepriority.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+constexpr const char*	TILE_ORDER_NAMES[]	= { "rows", "center", "focus", "error", "age" };
+
+// Weight of the distance to the center for the error and age orders, so tiles
+// that are equal otherwise go center first. Across the screen it adds up to
+// less than a change of one 8 bit step or one frame of age.
+constexpr float			TIE_BREAK			= 1e-6f;
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+	/**
+	 * @brief Distance	Returns the distance of the center of the tile to the
+	 * point x, y.
+	 */
+	float	Distance( const Tile& tile, float x, float y )
+	{
+		const float	dx	= tile.x + tile.width  * 0.5f - x;
+		const float	dy	= tile.y + tile.height * 0.5f - y;
+
+		return	sqrtf( dx * dx + dy * dy );
+	}
+	////////////////////////////////////////////////////////////////////////////
+
+	float	CenterDistance( const Tile& tile )
+	{
+		return	Distance( tile, tile.frameWidth * 0.5f, tile.frameHeight * 0.5f );
+	}
+	////////////////////////////////////////////////////////////////////////////
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief MakeTilePriority	Returns the priority function of 'order', an empty
+ * function for ROWS.
+ */
+TilePriority	MakeTilePriority( TileOrder order )
+{
+	switch( order )
+	{
+		case	TileOrder::ROWS:
+			return	TilePriority();
+
+		case	TileOrder::CENTER:
+			return	[]( const TileInfo& info ) { return	-CenterDistance( info.tile ); };
+
+		case	TileOrder::FOCUS:
+			return	[]( const TileInfo& info ) { return	-Distance( info.tile, info.focusX, info.focusY ); };
+
+		case	TileOrder::ERROR:
+			return	[]( const TileInfo& info ) { return	info.error - TIE_BREAK * CenterDistance( info.tile ); };
+
+		case	TileOrder::AGE:
+			return	[]( const TileInfo& info ) { return	float( info.age ) - TIE_BREAK * CenterDistance( info.tile ); };
+	}
+
+	return	TilePriority();
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief ParseTileOrder	Looks up the TileOrder called 'name'.
+ * @return	Returns false if there is no such order.
+ */
+bool	ParseTileOrder( const char* const name, TileOrder& order )
+{
+	for( uint32_t i = 0; i < sizeof( TILE_ORDER_NAMES ) / sizeof( TILE_ORDER_NAMES[ 0 ] ); ++i )
+	{
+		if( 0 == strcmp( name, TILE_ORDER_NAMES[ i ] ) )
+		{
+			order	= static_cast< TileOrder >( i );
+			return	true;
+		}
+	}
+
+	return	false;
+}
+////////////////////////////////////////////////////////////////////////////////
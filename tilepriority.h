@@ -0,0 +1,61 @@
+
+#ifndef TILEPRIORITY_H
+#define TILEPRIORITY_H
+
+////////////////////////////////////////////////////////////////////////////////
+
+#include <functional>
+
+#include <stdint.h>
+
+#include "tile.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief The TileOrder enum selects the built in tile priority.
+ * ROWS		Row by row from the bottom, the order of the tile indices.
+ * CENTER	Closest to the center of the frame first.
+ * FOCUS	Closest to the focus point (the mouse cursor) first.
+ * ERROR	Largest change in the last frame first.
+ * AGE		Longest not traced first.
+ */
+enum class TileOrder
+{
+	ROWS,
+	CENTER,
+	FOCUS,
+	ERROR,
+	AGE,
+};
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief The TileInfo struct is what a priority function knows about a tile.
+ * tile			The rectangle, clipped to the frame.
+ * focusX		Point of interest in frame pixels, bottom up like the frame.
+ * focusY
+ * error		How much the mean color of the tile changed the last time it was
+ *				traced, summed over the channels.
+ * age			Frames since the tile was last traced.
+ */
+struct TileInfo
+{
+	Tile		tile;
+	float		focusX;
+	float		focusY;
+	float		error;
+	uint32_t	age;
+};
+////////////////////////////////////////////////////////////////////////////////
+
+// Returns the priority of a tile, tiles with a higher priority are traced
+// first. Tiles with equal priority keep the order of their indices.
+using	TilePriority	= std::function< float( const TileInfo& ) >;
+
+TilePriority	MakeTilePriority( TileOrder order );
+bool			ParseTileOrder( const char* const name, TileOrder& order );
+
+////////////////////////////////////////////////////////////////////////////////
+
+#endif // TILEPRIORITY_H
@@ -0,0 +1,718 @@
+
+#include <algorithm>
+#include <limits>
+
+#include "cputopology.h"
+#include "scene.h"
+#include "tile.h"
+
+#include "tracer.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+static_assert( 0 == SCREEN_WIDTH % SIMD::SIZE, "The screen width must be a multiple of the SIMD width." );
+static_assert( 0 == TILE_SIZE % SIMD::SIZE, "The tile size must be a multiple of the SIMD width." );
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Memory of the tile cache when only its directory is set.
+constexpr uint32_t	DEFAULT_TILE_CACHE_MB	= 256;
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Tracer::Tracer	Constructor for the class. Starts the threads.
+ * @param options		Thread and memory settings.
+ * @param reservedCpus	Number of CPUs to leave free when the thread count is
+ *						not set in 'options'.
+ */
+Tracer::Tracer( const Options& options, uint32_t reservedCpus )
+	: m_options( options )
+	, m_tilesX( FrameBuffer::TILES_X )
+	, m_tilesY( FrameBuffer::TILES_Y )
+	, m_tileCount( m_tilesX * m_tilesY )
+	, m_bandCount( 0 )
+	, m_pinnedCount( 0 )
+	, m_job( Job::TRACE )
+	, m_target( nullptr )
+	, m_aovs( nullptr )
+	, m_frameWidth( SCREEN_WIDTH )
+	, m_frameHeight( SCREEN_HEIGHT )
+	, m_frameTiles( 0 )
+	, m_frameCached( false )
+	, m_frameKey()
+	, m_frameSplat( false )
+	, m_priority( MakeTilePriority( options.tileOrder ) )
+	, m_focusX( SCREEN_WIDTH * 0.5f )
+	, m_focusY( SCREEN_HEIGHT * 0.5f )
+	, m_frameNumber( 0 )
+	, m_tileMean( m_tileCount )
+	, m_tileError( m_tileCount, 0.0f )
+	, m_tileFrame( m_tileCount, 0 )
+	, m_tilesDone( 0 )
+	, m_generation( 0 )
+	, m_busyThreads( 0 )
+	, m_frameTime( 0.0 )
+	, m_shouldQuit( false )
+{
+	m_sphereFlake.SetImpostorPixels( options.impostorPixels );
+	m_sphereFlake.SetOcclusionCull( options.occlusionCull );
+
+	if( 0 != options.tileCacheMb || ! options.tileCacheDir.empty() )
+	{
+		const size_t	megabytes	= ( 0 != options.tileCacheMb ) ? options.tileCacheMb : DEFAULT_TILE_CACHE_MB;
+		m_cache.reset( new TileCache( megabytes << 20, options.tileCacheDir ) );
+	}
+
+	InitThreads( reservedCpus );
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Tracer::~Tracer	Destructor for the class. Stops the threads, a frame
+ * in progress is abandoned.
+ */
+Tracer::~Tracer()
+{
+	{
+		std::lock_guard< std::mutex >	lock( m_mutex );
+		m_shouldQuit	= true;
+	}
+
+	m_workCv.notify_all();
+	for( auto& t : m_threads )
+		t.join();
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Tracer::InitThreads	Picks the CPUs for the render threads, splits
+ * the tile rows in one band per NUMA node (proportional to the number of
+ * threads on the node) and starts the threads.
+ */
+void	Tracer::InitThreads( uint32_t reservedCpus )
+{
+	uint32_t	threadCount	= m_options.threadCount;
+	if( 0 == threadCount )
+	{
+		const uint32_t	cpus	= std::thread::hardware_concurrency();
+		threadCount	= ( cpus > reservedCpus ) ? cpus - reservedCpus : 1;
+	}
+
+	CpuTopology				topology;
+	std::vector< CpuInfo >	cpus	= topology.SelectCpus( threadCount, m_options.useSmt );
+
+	// Without pinning the node of a thread is not known, use a single band.
+	std::vector< uint32_t >	nodeBand( topology.NodeCount(), 0 );
+	std::vector< uint32_t >	threadBand( threadCount, 0 );
+	m_bandCount	= 1;
+	if( m_options.pinThreads )
+	{
+		m_bandCount	= 0;
+		for( uint32_t node = 0; node < topology.NodeCount(); ++node )
+		{
+			bool	used	= std::any_of( cpus.begin(), cpus.end(),
+										   [ node ]( const CpuInfo& c ) { return c.node == node; } );
+			if( used )
+				nodeBand[ node ]	= m_bandCount++;
+		}
+
+		for( uint32_t i = 0; i < threadCount; ++i )
+			threadBand[ i ]	= nodeBand[ cpus[ i ].node ];
+	}
+
+	m_bands.reset( new TileBand[ m_bandCount ] );
+	m_stats.reset( new ThreadStats[ threadCount ] );
+	m_perfFrame.resize( threadCount );
+
+	for( uint32_t i = 0; i < threadCount; ++i )
+		++m_bands[ threadBand[ i ] ].threadCount;
+
+	// Every band gets at least one row, the threads of a node with few of
+	// them would first-touch none of the frame otherwise. The last band takes
+	// the rest.
+	uint32_t	row	= 0;
+	for( uint32_t b = 0; b < m_bandCount; ++b )
+	{
+		const uint32_t	later	= m_bandCount - b - 1;
+		const uint32_t	rows	= ( 0 == later )
+								? m_tilesY - row
+								: std::min( std::max( 1u, m_tilesY * m_bands[ b ].threadCount / threadCount ),
+											m_tilesY - row - later );
+
+		m_bands[ b ].firstTile	= row * m_tilesX;
+		m_bands[ b ].tileCount	= rows * m_tilesX;
+		row						+= rows;
+
+		m_bands[ b ].order.resize( m_bands[ b ].tileCount );
+		for( uint32_t i = 0; i < m_bands[ b ].tileCount; ++i )
+			m_bands[ b ].order[ i ]	= m_bands[ b ].firstTile + i;
+	}
+
+	for( uint32_t i = 0; i < threadCount; ++i )
+	{
+		uint32_t	cpu	= m_options.pinThreads ? cpus[ i ].id : UINT32_MAX;
+		m_threads.emplace_back( &Tracer::RenderThread, this, i, cpu, threadBand[ i ] );
+	}
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Tracer::StartFrame	Starts tracing a frame as seen from 'origin' into
+ * 'buffer'. Waits for the previous frame first. 'buffer' must stay alive until
+ * the frame is done. The frame is 'width' x 'height' pixels, the width must be
+ * a multiple of the SIMD width.
+ */
+void	Tracer::StartFrame( const Vec3& origin, FrameBuffer& buffer, uint32_t width, uint32_t height )
+{
+	Start( Job::TRACE, origin, buffer, nullptr, width, height );
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Tracer::StartFrame	Same as above at the native resolution, also
+ * writes the channels of 'aovs'. The AOV frames are traced without ray
+ * streaming, the paths of deferred rays are not known.
+ */
+void	Tracer::StartFrame( const Vec3& origin, FrameBuffer& buffer, AovBuffers& aovs )
+{
+	Start( Job::TRACE, origin, buffer, &aovs, SCREEN_WIDTH, SCREEN_HEIGHT );
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Tracer::ClearBuffer	Fills 'buffer' with the background color and
+ * waits until it is done. Every tile is written by a thread of the node that
+ * owns it, so a buffer cleared before its first frame has its pages placed on
+ * the right NUMA nodes.
+ */
+void	Tracer::ClearBuffer( FrameBuffer& buffer )
+{
+	Start( Job::CLEAR, Vec3(), buffer, nullptr, SCREEN_WIDTH, SCREEN_HEIGHT );
+	WaitFrame();
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Tracer::Start	Publishes a new job to the threads.
+ */
+void	Tracer::Start( Job job, const Vec3& origin, FrameBuffer& buffer, AovBuffers* aovs,
+					   uint32_t width, uint32_t height )
+{
+	WaitFrame();
+
+	// The frame time includes the work done here for the whole frame.
+	const std::chrono::steady_clock::time_point	start	= std::chrono::steady_clock::now();
+
+	m_frameWidth	= width;
+	m_frameHeight	= height;
+	m_frameTiles	= ( ( width + TILE_SIZE - 1 ) / TILE_SIZE ) * ( ( height + TILE_SIZE - 1 ) / TILE_SIZE );
+	m_tilesDone		= 0;
+	// The keys don't know the zoom path or the scene, those frames are always
+	// traced.
+	m_frameCached	= Job::TRACE == job && nullptr == aovs && nullptr != m_cache && ! m_options.deepZoom
+					  && nullptr == m_options.scene;
+
+	// The frame is traced from the camera and view of its key, so a cached
+	// tile is what tracing it would give.
+	Vec3		camera	= origin;
+	CameraView	view	= m_options.view;
+	if( m_frameCached )
+	{
+		m_frameKey	= TileCache::FrameKey( origin, view, width, height, m_options.precision, m_options.streamRays,
+										   m_options.splatSpheres, m_options.impostorPixels );
+		camera		= TileCache::Quantize( origin );
+		view		= TileCache::Quantize( view );
+	}
+
+	// The threads are idle, the directions and the cull can change.
+	if( Job::TRACE == job )
+	{
+		m_rays.Setup( view, width, height, m_options.precision );
+		m_sphereFlake.SetFieldOfView( view.TanHalfFov() );
+	}
+
+	// In deep zoom 'origin' is in the frame of the last sphere of the zoom
+	// path. The threads are idle, so the chain can be swapped. The instances
+	// of a scene have no chain.
+	if( Job::TRACE == job && m_options.deepZoom && nullptr == m_options.scene )
+	{
+		const double		local[ 3 ]	= { origin.x, origin.y, origin.z };
+		const CameraChain	chain		= m_sphereFlake.FindCameraChain( m_options.zoomPath.data(),
+																		 static_cast< uint32_t >( m_options.zoomPath.size() ),
+																		 local );
+		m_sphereFlake.SetCameraChain( chain );
+		camera	= chain.world;
+	}
+
+	// The spheres are found once for the whole frame, before the threads
+	// splat them. The AOV frames need the paths of the traversal, the scenes
+	// are traced. The splatter projects the spheres in float world space,
+	// which can't hold the spheres around a deep zoom camera apart.
+	m_frameSplat	= Job::TRACE == job && nullptr == aovs && m_options.splatSpheres && nullptr == m_options.scene
+					  && ! m_options.deepZoom;
+	if( m_frameSplat )
+		m_splatter.Build( m_sphereFlake, view, camera, width, height );
+
+	if( Job::TRACE == job )
+	{
+		++m_frameNumber;
+		OrderTiles();
+	}
+
+	for( uint32_t b = 0; b < m_bandCount; ++b )
+		m_bands[ b ].next	= 0;
+
+	{
+		std::lock_guard< std::mutex >	lock( m_mutex );
+		m_job			= job;
+		m_origin		= camera;
+		m_target		= &buffer;
+		m_aovs			= aovs;
+		m_busyThreads	= static_cast< uint32_t >( m_threads.size() );
+		m_frameStart	= start;
+		++m_generation;
+	}
+
+	m_workCv.notify_all();
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Tracer::IsFrameDone	Returns true when no frame is in progress.
+ */
+bool	Tracer::IsFrameDone() const
+{
+	std::lock_guard< std::mutex >	lock( m_mutex );
+	return	0 == m_busyThreads;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Tracer::FrameTime	Returns the seconds the last finished frame took,
+ * from StartFrame until the last tile was written.
+ */
+double	Tracer::FrameTime() const
+{
+	std::lock_guard< std::mutex >	lock( m_mutex );
+	return	m_frameTime;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Tracer::Elapsed	Returns the seconds since the frame in progress (or
+ * the last one) was started.
+ */
+double	Tracer::Elapsed() const
+{
+	std::lock_guard< std::mutex >	lock( m_mutex );
+	return	std::chrono::duration< double >( std::chrono::steady_clock::now() - m_frameStart ).count();
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Tracer::CancelFrame	Stops handing out the tiles of the frame in
+ * progress and waits for the tiles that are being traced. The other tiles keep
+ * the previous frame.
+ */
+void	Tracer::CancelFrame()
+{
+	for( uint32_t b = 0; b < m_bandCount; ++b )
+		m_bands[ b ].next.store( m_bands[ b ].tileCount, std::memory_order_relaxed );
+
+	WaitFrame();
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Tracer::SetTilePriority	Sets the order of the tiles of the next
+ * frames. An empty function traces the tiles row by row.
+ */
+void	Tracer::SetTilePriority( TilePriority priority )
+{
+	WaitFrame();
+	m_priority	= std::move( priority );
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Tracer::SetPrecision	Sets the square root policy of the next frames.
+ */
+void	Tracer::SetPrecision( Precision precision )
+{
+	WaitFrame();
+	m_options.precision	= precision;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Tracer::SetView	Sets the direction and field of view of the next
+ * frames.
+ */
+void	Tracer::SetView( const CameraView& view )
+{
+	WaitFrame();
+	m_options.view	= view;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Tracer::SetFocus	Sets the point of interest of the next frames, in
+ * frame pixels bottom up (see TileInfo).
+ */
+void	Tracer::SetFocus( float x, float y )
+{
+	WaitFrame();
+	m_focusX	= x;
+	m_focusY	= y;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Tracer::WaitFrame	Blocks until the frame in progress is done.
+ */
+void	Tracer::WaitFrame()
+{
+	std::unique_lock< std::mutex >	lock( m_mutex );
+	m_doneCv.wait( lock, [ this ]() { return 0 == m_busyThreads; } );
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Tracer::RayCount	Returns the number of primary rays traced so far.
+ */
+uint64_t	Tracer::RayCount() const
+{
+	uint64_t	rays	= 0;
+	for( size_t i = 0; i < m_threads.size(); ++i )
+		rays	+= m_stats[ i ].rays.load( std::memory_order_relaxed );
+
+	return	rays;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Tracer::Traversal	Returns the sphere visits and active lanes counted
+ * so far.
+ */
+TraversalStats	Tracer::Traversal() const
+{
+	TraversalStats	total;
+	for( size_t i = 0; i < m_threads.size(); ++i )
+	{
+		total.visits	+= m_stats[ i ].visits.load( std::memory_order_relaxed );
+		total.lanes		+= m_stats[ i ].lanes.load( std::memory_order_relaxed );
+	}
+
+	return	total;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Tracer::Stream	Returns the lane occupancy at the stream depth
+ * counted so far. Empty when not tracing in stream mode.
+ */
+StreamStats	Tracer::Stream() const
+{
+	StreamStats	total;
+	for( size_t i = 0; i < m_threads.size(); ++i )
+	{
+		total.deferred.visits	+= m_stats[ i ].deferredVisits.load( std::memory_order_relaxed );
+		total.deferred.lanes	+= m_stats[ i ].deferredLanes.load( std::memory_order_relaxed );
+		total.compacted.visits	+= m_stats[ i ].compactedVisits.load( std::memory_order_relaxed );
+		total.compacted.lanes	+= m_stats[ i ].compactedLanes.load( std::memory_order_relaxed );
+	}
+
+	return	total;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Tracer::CacheStats	Returns the lookups of the tile cache so far.
+ * Empty without a cache.
+ */
+TileCacheStats	Tracer::CacheStats() const
+{
+	return	m_cache ? m_cache->Stats() : TileCacheStats();
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Tracer::PerfFrame	Returns the hardware events of each thread over
+ * the last traced frame. Empty masks without 'options.perfCounters' or when
+ * the counters are not available (see PerfError).
+ */
+std::vector< PerfCounts >	Tracer::PerfFrame() const
+{
+	std::lock_guard< std::mutex >	lock( m_mutex );
+	return	m_perfFrame;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Tracer::PerfError	Returns why the counters of a thread could not be
+ * opened, empty if they all were. Known once the first job is done.
+ */
+std::string	Tracer::PerfError() const
+{
+	std::lock_guard< std::mutex >	lock( m_mutex );
+	return	m_perfError;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Tracer::RenderThread	The body of a render thread. Pins itself to
+ * 'cpu' (unless it is UINT32_MAX), opens its counters and then waits for
+ * jobs. Tiles of the own band are done first, when tracing the thread then
+ * helps the other bands.
+ */
+void	Tracer::RenderThread( uint32_t threadIndex, uint32_t cpu, uint32_t band )
+{
+	ThreadStats&	stats	= m_stats[ threadIndex ];
+	uint64_t		seen	= 0;
+
+	if( UINT32_MAX != cpu && CpuTopology::PinCurrentThread( cpu ) )
+		++m_pinnedCount;
+
+	// Created after pinning, so the buffers are on the thread's node.
+	std::unique_ptr< RayStream >	stream;
+	if( m_options.streamRays )
+		stream.reset( new RayStream() );
+
+	// The events count on the thread that opened them, wherever it runs.
+	PerfCounters	counters;
+	if( m_options.perfCounters && ! counters.Open() )
+	{
+		std::lock_guard< std::mutex >	lock( m_mutex );
+		if( m_perfError.empty() )
+			m_perfError	= counters.Error();
+	}
+
+	for(;;)
+	{
+		Job	job;
+		{
+			std::unique_lock< std::mutex >	lock( m_mutex );
+			m_workCv.wait( lock, [ & ]() { return m_shouldQuit || m_generation != seen; } );
+			if( m_shouldQuit )
+				return;
+
+			seen	= m_generation;
+			job		= m_job;
+		}
+
+		const PerfCounts	before	= counters.Read();
+
+		bool	finished	= RunBand( band, stats, stream.get() );
+		for( uint32_t i = 1; finished && Job::TRACE == job && i < m_bandCount; ++i )
+			finished	= RunBand( ( band + i ) % m_bandCount, stats, stream.get() );
+
+		const PerfCounts	frame	= counters.Read() - before;
+
+		std::lock_guard< std::mutex >	lock( m_mutex );
+		if( Job::TRACE == job )
+			m_perfFrame[ threadIndex ]	= frame;
+
+		if( 0 == --m_busyThreads )
+		{
+			// A cancelled frame counts as the time all its tiles would take.
+			// A clear counts no tiles and keeps the time of the last frame.
+			if( Job::TRACE == job )
+			{
+				const uint32_t	done	= std::max( 1u, m_tilesDone.load( std::memory_order_relaxed ) );
+				m_frameTime	= std::chrono::duration< double >( std::chrono::steady_clock::now() - m_frameStart ).count();
+				m_frameTime	*= double( std::max( done, m_frameTiles ) ) / done;
+			}
+			m_doneCv.notify_all();
+		}
+	}
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Tracer::RunBand	Takes tiles of 'band' until there are none left.
+ * @return	Returns false if the tracer is shutting down.
+ */
+bool	Tracer::RunBand( uint32_t band, ThreadStats& stats, RayStream* stream )
+{
+	TileBand&	tiles	= m_bands[ band ];
+
+	for(;;)
+	{
+		uint32_t	i	= tiles.next.fetch_add( 1, std::memory_order_relaxed );
+		if( i >= tiles.tileCount )
+			return	true;
+
+		if( m_shouldQuit.load( std::memory_order_relaxed ) )
+			return	false;
+
+		if( Job::TRACE == m_job )
+			RenderTile( tiles.order[ i ], stats, stream );
+		else
+			ClearTile( tiles.firstTile + i );
+	}
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Tracer::RenderTile	Traces all the pixels of a single tile, through
+ * the instances of the scene if there is one, else with the AOVs of the frame
+ * if it has any, else splatted if the frame is, else in stream mode if
+ * 'stream' is set, and with the precision of the options. A tile of the cache
+ * is copied. The AOVs are not written with a scene.
+ */
+void	Tracer::RenderTile( uint32_t index, ThreadStats& stats, RayStream* stream )
+{
+	const Tile		tile	= GetTile( index, m_tilesX, m_frameWidth, m_frameHeight );
+	Vec3* const		out		= m_target->Tile( index );
+	if( 0 == tile.width || 0 == tile.height )
+		return;
+
+	TileKey	key	= m_frameKey;
+	key.tile	= index;
+	if( m_frameCached && m_cache->Lookup( key, out ) )
+	{
+		FinishTile( index, tile );
+		return;
+	}
+
+	TraversalStats	traversal;
+	if( nullptr != m_options.scene )
+	{
+		if( Precision::FAST == m_options.precision )
+			TraceTile< Precision::FAST >( *m_options.scene, m_sphereFlake, m_rays, m_origin, tile, out, TILE_SIZE, traversal );
+		else
+			TraceTile< Precision::EXACT >( *m_options.scene, m_sphereFlake, m_rays, m_origin, tile, out, TILE_SIZE, traversal );
+	}
+	else if( nullptr != m_aovs )
+	{
+		if( Precision::FAST == m_options.precision )
+			TraceTile< Precision::FAST >( m_sphereFlake, m_rays, m_origin, tile, out, TILE_SIZE, traversal, *m_aovs );
+		else
+			TraceTile< Precision::EXACT >( m_sphereFlake, m_rays, m_origin, tile, out, TILE_SIZE, traversal, *m_aovs );
+	}
+	else if( m_frameSplat )
+	{
+		if( Precision::FAST == m_options.precision )
+			m_splatter.SplatTile< Precision::FAST >( m_sphereFlake, m_rays, tile, out, TILE_SIZE );
+		else
+			m_splatter.SplatTile< Precision::EXACT >( m_sphereFlake, m_rays, tile, out, TILE_SIZE );
+	}
+	else if( nullptr != stream )
+	{
+		StreamStats	streamStats;
+		if( Precision::FAST == m_options.precision )
+			stream->TraceTile< Precision::FAST >( m_sphereFlake, m_rays, m_origin, tile, out, TILE_SIZE,
+												  traversal, streamStats );
+		else
+			stream->TraceTile< Precision::EXACT >( m_sphereFlake, m_rays, m_origin, tile, out, TILE_SIZE,
+												   traversal, streamStats );
+
+		stats.deferredVisits.fetch_add( streamStats.deferred.visits, std::memory_order_relaxed );
+		stats.deferredLanes.fetch_add( streamStats.deferred.lanes, std::memory_order_relaxed );
+		stats.compactedVisits.fetch_add( streamStats.compacted.visits, std::memory_order_relaxed );
+		stats.compactedLanes.fetch_add( streamStats.compacted.lanes, std::memory_order_relaxed );
+	}
+	else if( Precision::FAST == m_options.precision )
+	{
+		TraceTile< Precision::FAST >( m_sphereFlake, m_rays, m_origin, tile, out, TILE_SIZE, traversal );
+	}
+	else
+	{
+		TraceTile< Precision::EXACT >( m_sphereFlake, m_rays, m_origin, tile, out, TILE_SIZE, traversal );
+	}
+
+	if( m_frameCached )
+		m_cache->Insert( key, out );
+
+	FinishTile( index, tile );
+
+	stats.rays.fetch_add( tile.width * tile.height, std::memory_order_relaxed );
+	stats.visits.fetch_add( traversal.visits, std::memory_order_relaxed );
+	stats.lanes.fetch_add( traversal.lanes, std::memory_order_relaxed );
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Tracer::OrderTiles	Sorts the tiles of every band by the priority
+ * for the next frame. Tiles outside of the frame go last. Called while the
+ * threads are idle.
+ */
+void	Tracer::OrderTiles()
+{
+	std::vector< float >	priority( m_tileCount );
+
+	for( uint32_t b = 0; b < m_bandCount; ++b )
+	{
+		TileBand&	band	= m_bands[ b ];
+		for( uint32_t i = 0; i < band.tileCount; ++i )
+			band.order[ i ]	= band.firstTile + i;
+
+		if( ! m_priority )
+			continue;
+
+		for( uint32_t index : band.order )
+		{
+			TileInfo	info;
+			info.tile	= GetTile( index, m_tilesX, m_frameWidth, m_frameHeight );
+			info.focusX	= m_focusX;
+			info.focusY	= m_focusY;
+			info.error	= m_tileError[ index ];
+			info.age	= m_frameNumber - m_tileFrame[ index ];
+
+			const bool	empty	= 0 == info.tile.width || 0 == info.tile.height;
+			priority[ index ]	= empty ? -std::numeric_limits< float >::infinity() : m_priority( info );
+		}
+
+		std::stable_sort( band.order.begin(), band.order.end(),
+						  [ & ]( uint32_t a, uint32_t b ) { return priority[ a ] > priority[ b ]; } );
+	}
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Tracer::FinishTile	Records that the tile was written this frame.
+ */
+void	Tracer::FinishTile( uint32_t index, const Tile& tile )
+{
+	if( TileOrder::ERROR == m_options.tileOrder )
+		UpdateTileError( index, tile );
+
+	m_tileFrame[ index ]	= m_frameNumber;
+	m_tilesDone.fetch_add( 1, std::memory_order_relaxed );
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Tracer::UpdateTileError	Records how much the mean color of a tile
+ * changed since it was traced last.
+ */
+void	Tracer::UpdateTileError( uint32_t index, const Tile& tile )
+{
+	const Vec3* const	pixels	= m_target->Tile( index );
+
+	Vec3	sum;
+	for( uint32_t y = 0; y < tile.height; ++y )
+	{
+		for( uint32_t x = 0; x < tile.width; ++x )
+			sum	+= pixels[ y * TILE_SIZE + x ];
+	}
+
+	const Vec3	mean	= sum / float( tile.width * tile.height );
+	const Vec3	delta	= mean - m_tileMean[ index ];
+
+	m_tileError[ index ]	= fabsf( delta.x ) + fabsf( delta.y ) + fabsf( delta.z );
+	m_tileMean[ index ]		= mean;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Tracer::ClearTile	Fills a single tile with the background color,
+ * including the padding of the edge tiles.
+ */
+void	Tracer::ClearTile( uint32_t index )
+{
+	Vec3* const	tile	= m_target->Tile( index );
+	std::fill( tile, tile + FrameBuffer::TILE_PIXELS, BACKGROUND_COLOR );
+}
+////////////////////////////////////////////////////////////////////////////////
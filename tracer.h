@@ -0,0 +1,206 @@
+
+#ifndef TRACER_H
+#define TRACER_H
+
+////////////////////////////////////////////////////////////////////////////////
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stdint.h>
+
+#include "aov.h"
+#include "framebuffer.h"
+#include "options.h"
+#include "perfcounters.h"
+#include "raygen.h"
+#include "raystream.h"
+#include "sphereflake.h"
+#include "splatter.h"
+#include "tilecache.h"
+#include "tilepriority.h"
+#include "vec3.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief The Tracer class owns the render threads and traces whole frames
+ * into a FrameBuffer. It does not use SDL or OpenGL, so it is shared by the
+ * window and the offline modes.
+ *
+ * The threads are pinned one per physical core first (see CpuTopology) and
+ * the tile rows are split in one band per NUMA node. A thread traces the tiles
+ * of its own band and helps the other bands only when its own is done.
+ *
+ * A frame is started with StartFrame and runs in the background, IsFrameDone
+ * and WaitFrame tell when all tiles are written. A frame can be traced at a
+ * lower resolution, it then fills the top left corner of the tiles. The
+ * rays of a frame look the way of the view of SetView (see RayGenerator).
+ *
+ * With 'options.scene' the rays go through the instances of the Scene instead
+ * of the single flake at the origin, all the other tracing options but the
+ * precision and the culls are then left out.
+ *
+ * With 'options.streamRays' the tiles are traced with a RayStream per thread.
+ * With 'options.splatSpheres' the spheres of a frame are found once by a
+ * SphereSplatter and the threads splat them into their tiles instead. A frame
+ * can also write AOV channels next to the colors (see AovBuffers), those are
+ * always traced.
+ *
+ * The tiles of a band are handed out in the order of a TilePriority, so when
+ * a frame is cut short with CancelFrame the tiles that matter most are done.
+ *
+ * With 'options.tileCacheMb' or 'options.tileCacheDir' the tiles are kept in
+ * a TileCache and the camera of a frame is snapped to its grid. A tile that
+ * is found there is copied instead of traced. Frames with AOVs bypass it.
+ *
+ * With 'options.perfCounters' every thread opens its PerfCounters when it
+ * starts and reads them when it takes a job and when it is done with it. The
+ * difference of each thread over the last traced frame is kept for PerfFrame.
+ */
+class Tracer
+{
+public:
+	Tracer( const Options& options, uint32_t reservedCpus );
+	~Tracer();
+
+	void		StartFrame( const Vec3& origin, FrameBuffer& buffer,
+							uint32_t width = SCREEN_WIDTH, uint32_t height = SCREEN_HEIGHT );
+	void		StartFrame( const Vec3& origin, FrameBuffer& buffer, AovBuffers& aovs );
+	void		ClearBuffer( FrameBuffer& buffer );
+	bool		IsFrameDone()		const;
+	void		WaitFrame();
+	void		CancelFrame();
+
+	void		SetTilePriority( TilePriority priority );
+	void		SetPrecision( Precision precision );
+	void		SetView( const CameraView& view );
+	void		SetFocus( float x, float y );
+
+	double			FrameTime()			const;
+	double			Elapsed()			const;
+	uint64_t		RayCount()			const;
+	TraversalStats	Traversal()			const;
+	StreamStats		Stream()			const;
+	TileCacheStats	CacheStats()		const;
+	std::vector< PerfCounts >	PerfFrame()	const;
+	std::string		PerfError()			const;
+	uint32_t	ThreadCount()		const	{ return	static_cast< uint32_t >( m_threads.size() ); }
+	uint32_t	PinnedCount()		const	{ return	m_pinnedCount; }
+	uint32_t	NodeCount()			const	{ return	m_bandCount; }
+
+private:
+	enum class Job
+	{
+		TRACE,
+		CLEAR,
+	};
+
+	/**
+	 * @brief The TileBand struct is a range of tile rows owned by the threads
+	 * of one NUMA node. Next is the shared cursor of the current frame.
+	 */
+	struct TileBand
+	{
+		uint32_t				firstTile	= 0;
+		uint32_t				tileCount	= 0;
+		uint32_t				threadCount	= 0;
+		std::atomic< uint32_t >	next		{ 0 };
+		// Tile indices in the order they are handed out.
+		std::vector< uint32_t >	order;
+	};
+
+	/**
+	 * @brief The ThreadStats struct holds the counters of one render thread.
+	 * Aligned to a cache line so the threads do not share lines.
+	 */
+	struct alignas( 64 ) ThreadStats
+	{
+		std::atomic< uint64_t >	rays			{ 0 };
+		std::atomic< uint64_t >	visits			{ 0 };
+		std::atomic< uint64_t >	lanes			{ 0 };
+		std::atomic< uint64_t >	deferredVisits	{ 0 };
+		std::atomic< uint64_t >	deferredLanes	{ 0 };
+		std::atomic< uint64_t >	compactedVisits	{ 0 };
+		std::atomic< uint64_t >	compactedLanes	{ 0 };
+	};
+
+	void	InitThreads( uint32_t reservedCpus );
+	void	Start( Job job, const Vec3& origin, FrameBuffer& buffer, AovBuffers* aovs,
+				   uint32_t width, uint32_t height );
+	void	RenderThread( uint32_t threadIndex, uint32_t cpu, uint32_t band );
+	bool	RunBand( uint32_t band, ThreadStats& stats, RayStream* stream );
+	void	RenderTile( uint32_t index, ThreadStats& stats, RayStream* stream );
+	void	FinishTile( uint32_t index, const Tile& tile );
+	void	ClearTile( uint32_t index );
+	void	OrderTiles();
+	void	UpdateTileError( uint32_t index, const Tile& tile );
+
+private:
+	Options					m_options;
+	SphereFlake				m_sphereFlake;
+	RayGenerator			m_rays;
+	SphereSplatter			m_splatter;
+
+	uint32_t				m_tilesX;
+	uint32_t				m_tilesY;
+	uint32_t				m_tileCount;
+
+	std::unique_ptr< TileBand[] >		m_bands;
+	std::unique_ptr< ThreadStats[] >	m_stats;
+	std::unique_ptr< TileCache >		m_cache;
+	uint32_t							m_bandCount;
+	std::atomic< uint32_t >				m_pinnedCount;
+
+	// State of the current frame. Written by StartFrame while the threads are
+	// idle, read by the threads after they have seen the new generation.
+	Job						m_job;
+	Vec3					m_origin;
+	FrameBuffer*			m_target;
+	AovBuffers*				m_aovs;
+	uint32_t				m_frameWidth;
+	uint32_t				m_frameHeight;
+	uint32_t				m_frameTiles;
+	// Key of tile 0 of the frame when it uses the cache.
+	bool					m_frameCached;
+	TileKey					m_frameKey;
+	// The frame is splatted (see SphereSplatter) instead of traced.
+	bool					m_frameSplat;
+
+	// Tile order and what it is based on. The history of a tile is written
+	// only by the thread that traces it.
+	TilePriority			m_priority;
+	float					m_focusX;
+	float					m_focusY;
+	uint32_t				m_frameNumber;
+	std::vector< Vec3 >		m_tileMean;
+	std::vector< float >	m_tileError;
+	std::vector< uint32_t >	m_tileFrame;
+	std::atomic< uint32_t >	m_tilesDone;
+
+	// Hardware events of each thread over the last traced frame, and why the
+	// counters could not be opened.
+	std::vector< PerfCounts >	m_perfFrame;
+	std::string					m_perfError;
+
+	mutable std::mutex		m_mutex;
+	std::condition_variable	m_workCv;
+	std::condition_variable	m_doneCv;
+	uint64_t				m_generation;
+	uint32_t				m_busyThreads;
+
+	std::chrono::steady_clock::time_point	m_frameStart;
+	double									m_frameTime;
+	std::atomic< bool >		m_shouldQuit;
+
+	std::vector< std::thread >	m_threads;
+};
+////////////////////////////////////////////////////////////////////////////////
+
+#endif // TRACER_H
@@ -60,7 +60,7 @@ public:
 		return	Vec( x - k, y - k, z - k );
 	}
 
-	constexpr Vec	operator*( float k )			const
+	constexpr Vec	operator*( T k )				const
 	{
 		return	Vec( x * k, y * k, z * k );
 	}
@@ -75,25 +75,26 @@ public:
 		return	Vec( x * rhs.x, y * rhs.y, z * rhs.z );
 	}
 
-	constexpr Vec	operator/( float k )			const
+	constexpr Vec	operator/( T k )				const
 	{
 		return	Vec( x / k, y / k, z / k );
 	}
 
-	constexpr float	len()							const
+	constexpr T		len()							const
 	{
-		return	sqrtf( x * x + y * y + z * z );
+		// The overload of T, a Vec3d keeps its precision.
+		return	sqrt( x * x + y * y + z * z );
 	}
 
-	constexpr float	dot( const Vec& rhs )			const
+	constexpr T		dot( const Vec& rhs )			const
 	{
 		return	x * rhs.x + y * rhs.y + z * rhs.z;
 	}
 
 	constexpr Vec	Normalized()					const
 	{
-		float	length	= len();
-		if( length == 0.0f )
+		T	length	= len();
+		if( length == T( 0 ) )
 		{
 			return	Vec( *this );
 		}
@@ -166,6 +167,8 @@ Vec< T >	operator*( float t, const Vec< T >& v )
 ////////////////////////////////////////////////////////////////////////////////
 
 using	Vec3	= Vec< float >;
+// Used where float runs out of precision, see CameraChain.
+using	Vec3d	= Vec< double >;
 
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -1,4 +1,6 @@
 
+#include <algorithm>
+
 #include <SDL2/SDL.h>
 #include <GL/glew.h>
 
@@ -12,16 +14,29 @@
 ////////////////////////////////////////////////////////////////////////////////
 
 static constexpr float	VELOCITY	= 0.1f;
+// Degrees the arrow keys turn the camera.
+static constexpr float	TURN_STEP	= 2.0f;
+
+constexpr char			VSYNC_FAILED_MSG[]	= "No vsync (%s), pacing frames at %u fps";
+constexpr char			FRAME_TIMING_MSG[]	= "Frame %.2f ms avg, %.2f ms max (render %.2f, swap %.2f, wait %.2f)";
 
 ////////////////////////////////////////////////////////////////////////////////
 
 /**
  * @brief Window::Window	Constructor for the Window class.
  * @param appName	The name the APP that is going to be displayed.
+ * @param options	Settings passed to the screen renderer.
  */
-Window::Window( const char* const appName )
+Window::Window( const char* const appName, const Options& options )
 	: m_shouldQuit( false )
+	, m_vsync( false )
 	, m_cameraPos( 0., 0., 5.f )
+	, m_view( options.view )
+	, m_cursorX( SCREEN_WIDTH / 2 )
+	, m_cursorY( SCREEN_HEIGHT / 2 )
+	, m_statsMax( 0.0 )
+	, m_statsFrames( 0 )
+	, m_statsTime( Clock::now() )
 {
 	auto	result	= SDL_Init( SDL_INIT_VIDEO );
 	if( result )
@@ -48,9 +63,16 @@ Window::Window( const char* const appName )
 	if( GLEW_OK != glewError )
 		return;
 
+	if( options.vsync )
+	{
+		m_vsync	= 0 == SDL_GL_SetSwapInterval( 1 );
+		if( ! m_vsync )
+			SDL_Log( VSYNC_FAILED_MSG, SDL_GetError(), FPS );
+	}
+
 	glEnable( GL_DEBUG_OUTPUT );
 	glDebugMessageCallback( GL::MessageCallback, nullptr );
-	m_screenRenderer	= new ScreenRenderer;
+	m_screenRenderer	= new ScreenRenderer( options, m_cameraPos, m_view );
 }
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -66,93 +88,212 @@ Window::~Window()
 ////////////////////////////////////////////////////////////////////////////////
 
 /**
- * @brief Window::run	The main loop for the program.
+ * @brief Window::run	The main loop for the program. With vsync the swap
+ * paces the loop, otherwise the input is waited for until the next deadline.
  */
 void	Window::run()
 {
-	constexpr uint32_t	delay	= 1000 / FPS;
+	const Clock::duration	period		= std::chrono::microseconds( 1000000 / FPS );
+	Clock::time_point		deadline	= Clock::now() + period;
 
 	do
 	{
-		m_screenRenderer->Update( m_cameraPos );
+		const Clock::time_point	start	= Clock::now();
+
+		m_screenRenderer->Update( m_cameraPos, m_view, m_cursorX, m_cursorY );
 
 		m_screenRenderer->ClearScreen();
 		m_screenRenderer->RenderFrame();
 
+		const Clock::time_point	rendered	= Clock::now();
 		SDL_GL_SwapWindow( m_window );
+		const Clock::time_point	swapped		= Clock::now();
+
+		if( m_vsync )
+		{
+			HandleEvents( swapped );
+		}
+		else
+		{
+			HandleEvents( deadline );
+
+			// Skip the deadlines of a slow frame instead of rushing to catch up.
+			deadline	+= period;
+			if( deadline < Clock::now() )
+				deadline	= Clock::now() + period;
+		}
+
+		const Clock::time_point	end	= Clock::now();
+
+		using	Ms	= std::chrono::duration< double, std::milli >;
+		m_lastFrame.render	= Ms( rendered - start ).count();
+		m_lastFrame.swap	= Ms( swapped - rendered ).count();
+		m_lastFrame.wait	= Ms( end - swapped ).count();
+		m_lastFrame.total	= Ms( end - start ).count();
 
-		HandleEvents();
-		SDL_Delay( delay );
+		LogFrameTiming();
 	} while( ! m_shouldQuit );
 }
 ////////////////////////////////////////////////////////////////////////////////
 
 /**
- * @brief Window::HandleEvents	This function will handle OS events.
+ * @brief Window::LogFrameTiming	Logs the average and worst frame time about
+ * once per second.
+ */
+void	Window::LogFrameTiming()
+{
+	m_statsSum.render	+= m_lastFrame.render;
+	m_statsSum.swap		+= m_lastFrame.swap;
+	m_statsSum.wait		+= m_lastFrame.wait;
+	m_statsSum.total	+= m_lastFrame.total;
+	m_statsMax			= std::max( m_statsMax, m_lastFrame.total );
+	++m_statsFrames;
+
+	const Clock::time_point	now	= Clock::now();
+	if( std::chrono::duration< double >( now - m_statsTime ).count() < 1.0 )
+		return;
+
+	const double	frames	= m_statsFrames;
+	SDL_Log( FRAME_TIMING_MSG, m_statsSum.total / frames, m_statsMax, m_statsSum.render / frames,
+			 m_statsSum.swap / frames, m_statsSum.wait / frames );
+
+	m_statsSum		= FrameTiming();
+	m_statsMax		= 0.0;
+	m_statsFrames	= 0;
+	m_statsTime		= now;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Window::HandleEvents	This function will handle OS events. Blocks
+ * for events until 'deadline', then handles the ones that are left.
  */
-void	Window::HandleEvents()
+void	Window::HandleEvents( Clock::time_point deadline )
 {
 	SDL_Event	event;
+	for(;;)
+	{
+		const Clock::time_point	now	= Clock::now();
+		if( now >= deadline )
+			break;
+
+		// Round up, waking before the deadline would only wait again.
+		const auto	timeout	= std::chrono::duration_cast< std::chrono::milliseconds >(
+								  deadline - now + std::chrono::microseconds( 999 ) ).count();
+		if( ! SDL_WaitEventTimeout( &event, static_cast< int >( timeout ) ) )
+			continue;
+
+		HandleEvent( event );
+		if( m_shouldQuit )
+			return;
+	}
+
 	while( SDL_PollEvent( &event ) )
+		HandleEvent( event );
+}
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Window::HandleEvent	Handles a single OS event.
+ */
+void	Window::HandleEvent( const SDL_Event& event )
+{
+	switch( event.type )
 	{
-		switch( event.type )
+		case	SDL_KEYDOWN:
 		{
-			case	SDL_KEYDOWN:
+			// A and D strafe, W and S move along the view, Q and E stay
+			// vertical.
+			Vec3	right;
+			Vec3	up;
+			Vec3	back;
+			m_view.Axes( right, up, back );
+
+			switch( event.key.keysym.scancode )
 			{
+				case	SDL_SCANCODE_ESCAPE:
+					m_shouldQuit	= true;
+					break;
 
-				switch( event.key.keysym.scancode )
-				{
-					case	SDL_SCANCODE_ESCAPE:
-						m_shouldQuit	= true;
-						break;
+				case	SDL_SCANCODE_A:
+					m_cameraPos	= m_cameraPos - right * VELOCITY;
+					break;
 
-					case	SDL_SCANCODE_A:
-						m_cameraPos.x	-= VELOCITY;
-						break;
+				case	SDL_SCANCODE_Q:
+					m_cameraPos.y	+= VELOCITY;
+					break;
 
-					case	SDL_SCANCODE_Q:
-						m_cameraPos.y	+= VELOCITY;
-						break;
+				case	SDL_SCANCODE_E:
+					m_cameraPos.y	-= VELOCITY;
+					break;
 
-					case	SDL_SCANCODE_E:
-						m_cameraPos.y	-= VELOCITY;
-						break;
+				case	SDL_SCANCODE_D:
+					m_cameraPos	= m_cameraPos + right * VELOCITY;
+					break;
 
-					case	SDL_SCANCODE_D:
-						m_cameraPos.x	+= VELOCITY;
-						break;
+				case	SDL_SCANCODE_W:
+					m_cameraPos	= m_cameraPos - back * VELOCITY;
+					break;
 
-					case	SDL_SCANCODE_W:
-						m_cameraPos.z	-= VELOCITY;
-						break;
+				case	SDL_SCANCODE_S:
+					m_cameraPos	= m_cameraPos + back * VELOCITY;
+					break;
 
-					case	SDL_SCANCODE_S:
-						m_cameraPos.z	+= VELOCITY;
-						break;
+				case	SDL_SCANCODE_LEFT:
+					m_view.yaw		+= TURN_STEP;
+					break;
 
-					case	SDL_SCANCODE_R:
-						if( event.key.keysym.mod & KMOD_CTRL )
-						{
-							m_cameraPos.x	= 0.f;
-							m_cameraPos.y	= 0.f;
-							m_cameraPos.z	= 5.f;
-						}
+				case	SDL_SCANCODE_RIGHT:
+					m_view.yaw		-= TURN_STEP;
+					break;
 
-						break;
+				case	SDL_SCANCODE_UP:
+					m_view.pitch	= std::min( m_view.pitch + TURN_STEP, MAX_PITCH );
+					break;
 
-					default:
-						break;
+				case	SDL_SCANCODE_DOWN:
+					m_view.pitch	= std::max( m_view.pitch - TURN_STEP, -MAX_PITCH );
+					break;
 
-				}
+				case	SDL_SCANCODE_F9:
+					m_screenRenderer->ToggleRecording();
+					break;
 
-				break;
-			}
+				case	SDL_SCANCODE_F12:
+					m_screenRenderer->TakeScreenshot();
+					break;
+
+				case	SDL_SCANCODE_R:
+					if( event.key.keysym.mod & KMOD_CTRL )
+					{
+						m_cameraPos.x	= 0.f;
+						m_cameraPos.y	= 0.f;
+						m_cameraPos.z	= 5.f;
+						m_view.yaw		= 0.f;
+						m_view.pitch	= 0.f;
+					}
+
+					break;
+
+				default:
+					break;
 
-			case	SDL_QUIT:
-			{
-				m_shouldQuit	= true;
-				break;
 			}
+
+			break;
+		}
+
+		case	SDL_MOUSEMOTION:
+		{
+			m_cursorX	= event.motion.x;
+			m_cursorY	= event.motion.y;
+			break;
+		}
+
+		case	SDL_QUIT:
+		{
+			m_shouldQuit	= true;
+			break;
 		}
 	}
 }
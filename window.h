@@ -4,36 +4,78 @@
 
 ////////////////////////////////////////////////////////////////////////////////
 
+#include <chrono>
+
 #include <stdint.h>
 
 #include "simd_base.h"
+#include "options.h"
 
 ////////////////////////////////////////////////////////////////////////////////
 
 typedef void*	SDL_GLContext;
+union			SDL_Event;
 struct			SDL_Window;
 class			ScreenRenderer;
 class			GLProgram;
 
 ////////////////////////////////////////////////////////////////////////////////
 
+/**
+ * @brief The FrameTiming struct holds where the time of one displayed frame
+ * went, in milliseconds.
+ * render	Starting the trace, clearing and uploading the buffer.
+ * swap		SDL_GL_SwapWindow, includes the wait for vsync.
+ * wait		Waiting for input until the frame deadline.
+ * total	The whole frame.
+ */
+struct FrameTiming
+{
+	double	render	= 0.0;
+	double	swap	= 0.0;
+	double	wait	= 0.0;
+	double	total	= 0.0;
+};
+////////////////////////////////////////////////////////////////////////////////
+
 /**
  * @brief The Window class is used to initialize SDL2 and to open a window.
+ *
+ * Frames are paced by vsync when the driver supports a swap interval,
+ * otherwise by a deadline every 1 / FPS seconds. Between the swap and the
+ * deadline the loop sleeps in SDL_WaitEventTimeout, so input is handled as
+ * soon as it arrives and no CPU is spent waiting.
  */
 class Window
 {
 public:
-	Window( const char* const appName );
+	Window( const char* const appName, const Options& options );
 	~Window();
 
 	void	run();
 
+	const FrameTiming&	LastFrame()	const	{ return	m_lastFrame; }
+
 private:
-	void	HandleEvents();
+	using	Clock	= std::chrono::steady_clock;
+
+	void	HandleEvents( Clock::time_point deadline );
+	void	HandleEvent( const SDL_Event& event );
+	void	LogFrameTiming();
 
 private:
 	bool			m_shouldQuit;
+	bool			m_vsync;
 	Vec3			m_cameraPos;
+	CameraView		m_view;
+	int				m_cursorX;
+	int				m_cursorY;
+
+	FrameTiming			m_lastFrame;
+	FrameTiming			m_statsSum;
+	double				m_statsMax;
+	uint32_t			m_statsFrames;
+	Clock::time_point	m_statsTime;
 
 	SDL_Window*		m_window;
 	SDL_GLContext	m_context;